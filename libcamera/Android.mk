@@ -20,10 +20,12 @@ LOCAL_CFLAGS+= -DNUM_PREVIEW_BUFFERS=4 -D_ANDROID_
 LOCAL_C_INCLUDES+= \
     $(TARGET_OUT_HEADERS)/mm-camera \
     $(TARGET_OUT_HEADERS)/mm-still/jpeg \
+    $(LOCAL_PATH)/../libcopybit
 
 LOCAL_SHARED_LIBRARIES:= libutils libui libcamera_client liblog libcutils
 
 LOCAL_SHARED_LIBRARIES+= libbinder
+LOCAL_STATIC_LIBRARIES:= libmdpblit
 ifneq ($(DLOPEN_LIBMMCAMERA),1)
 LOCAL_SHARED_LIBRARIES+= liboemcamera
 else
@@ -48,6 +48,8 @@
 
 #include "linux/msm_mdp.h"
 #include <linux/fb.h>
+#include "blitter.h"
+#include "yuv.h"
 
 #define LIKELY(exp)   __builtin_expect(!!(exp), 1)
 #define UNLIKELY(exp) __builtin_expect(!!(exp), 0)
@@ -194,6 +196,8 @@ static thumbnail_size_type thumbnail_sizes[] = {
 #define THUMBNAIL_HEIGHT_STR "384"
 #define THUMBNAIL_SMALL_HEIGHT 144
 
+#define DEFAULT_ZSL_DEPTH 3
+
 static int attr_lookup(const str_map arr[], int len, const char *name)
 {
     if (name) {
@@ -282,6 +286,18 @@ static String8 create_sizes_str(const camera_size_type *sizes, int len) {
     return str;
 }
 
+// In ms.
+static String8 create_times_str(const nsecs_t *times, int len) {
+    String8 str;
+    char buffer[32];
+
+    for (int i = 0; i < len; i++) {
+        sprintf(buffer, i ? ",%lld" : "%lld", ns2ms(times[i]));
+        str.append(buffer);
+    }
+    return str;
+}
+
 static String8 create_values_str(const str_map *values, int len) {
     String8 str;
 
@@ -325,6 +341,7 @@ static void receive_jpeg_callback(jpeg_event_t status);
 static void receive_shutter_callback(common_crop_t *crop);
 static void receive_camframetimeout_callback(void);
 static int fb_fd = -1;
+static Blitter* fb_blitter;
 static int32_t mMaxZoom = 0;
 static bool native_get_maxzoom(int camfd, void *pZm);
 
@@ -352,6 +369,18 @@ void *opencamerafd(void *data) {
  * 4. With crop information present, MDP zoom will be called, and the final
  * data will be placed in a buffer from DstSet, and this buffer will be given
  * to surface flinger to display.
+ *
+ * While recording, each frame is also copied to one of kRecordRingSize
+ * buffers after the DstSet, and that one is given to the video encoder. The
+ * frame thread doesn't wait for the encoder to release it, so the VFE gets
+ * its buffer back at once. A frame that finds all of the ring with the
+ * encoder is dropped.
+ *
+ * With "zsl" on, the preview heap ends with "zsl-depth" more buffers, which
+ * each frame shown is copied to in turn. takePicture() encodes the one
+ * nearest to the shutter from there, and preview doesn't stop. A burst,
+ * sendCommand(CAMERA_CMD_BURST_CAPTURE), takes the newest frame there over
+ * and over instead.
  */
 #define NUM_MORE_BUFS 2
 
@@ -365,7 +394,18 @@ QualcommCameraHardware::QualcommCameraHardware()
       mInSnapshotMode(false),
       mJpegThreadRunning(false),
       mSnapshotFormat(0),
-      mReleasedRecordingFrame(false),
+      mRecordNext(0),
+      mRecordFrames(0),
+      mRecordDrops(0),
+      mZslDepth(0),
+      mZslNext(0),
+      mZslPinned(-1),
+      mZslCapture(false),
+      mBurstCount(0),
+      mJpegIndex(0),
+      mJpegDoneTime(0),
+      mBurstFrames(0),
+      mBurstTotalTime(0),
       mPreviewFrameSize(0),
       mRawSize(0),
       mCameraControlFd(-1),
@@ -399,7 +439,10 @@ QualcommCameraHardware::QualcommCameraHardware()
     char value[PROPERTY_VALUE_MAX];
     property_get("persist.debug.sf.showfps", value, "0");
     mDebugFps = atoi(value);
-    kPreviewBufferCountActual = kPreviewBufferCount + NUM_MORE_BUFS;
+    kPreviewBufferCountActual = kPreviewBufferCount + NUM_MORE_BUFS +
+                                kRecordRingSize;
+    memset(mRecordBusy, 0, sizeof(mRecordBusy));
+    memset(mZslTime, 0, sizeof(mZslTime));
 
   jpegPadding = 8;
     LOGV("constructor EX");
@@ -514,6 +557,12 @@ void QualcommCameraHardware::initDefaultParameters()
     mParameters.set(CameraParameters::KEY_SUPPORTED_PICTURE_FORMATS,
                     picture_format_values);
 
+    mParameters.set("zsl", "off");
+    mParameters.set("zsl-values", "off,on");
+    mParameters.set("zsl-depth", DEFAULT_ZSL_DEPTH);
+    mParameters.set("burst-count", 1);
+    mParameters.set("max-burst-count", kBurstMaxCount);
+
 
     if (setParameters(mParameters) != NO_ERROR) {
         LOGE("Failed to set default parameters?!");
@@ -632,6 +681,7 @@ bool QualcommCameraHardware::startCamera()
             LOGE("startCamera: fb0 open failed: %s!", strerror(errno));
             return FALSE;
         }
+        fb_blitter = Blitter::create(fb_fd);
 
     /* This will block until the control thread is launched. After that, sensor
      * information becomes available.
@@ -1078,12 +1128,14 @@ bool QualcommCameraHardware::initPreview()
     int cnt = 0;
     mPreviewFrameSize = previewWidth * previewHeight * 3/2;
     dstOffset = 0;
+    resetRecordRing();
+    resetZslRing();
     mPreviewHeap = new PmemPool("/dev/pmem_adsp",
                                 MemoryHeapBase::READ_ONLY,
                                 mCameraControlFd,
                                 MSM_PMEM_PREVIEW, //MSM_PMEM_OUTPUT2,
                                 mPreviewFrameSize,
-                                kPreviewBufferCountActual,
+                                kPreviewBufferCountActual + mZslDepth,
                                 mPreviewFrameSize,
                                 "preview");
 
@@ -1157,22 +1209,17 @@ void QualcommCameraHardware::deinitPreview(void)
 
 
 
-bool QualcommCameraHardware::initRaw(bool initJpegHeap)
+// The thumbnail for a width x height picture, in mDimension.
+void QualcommCameraHardware::setThumbnailSize(int width, int height)
 {
-    int rawWidth, rawHeight;
-
-    mParameters.getPictureSize(&rawWidth, &rawHeight);
-    LOGE("initRaw E: picture size=%dx%d", rawWidth, rawHeight);
-
-    int thumbnailBufferSize;
     //Thumbnail height should be smaller than Picture height
-    if (rawHeight > (int)thumbnail_sizes[DEFAULT_THUMBNAIL_SETTING].height){
+    if (height > (int)thumbnail_sizes[DEFAULT_THUMBNAIL_SETTING].height){
         mDimension.ui_thumbnail_width = thumbnail_sizes[DEFAULT_THUMBNAIL_SETTING].width;
         mDimension.ui_thumbnail_height = thumbnail_sizes[DEFAULT_THUMBNAIL_SETTING].height;
 
-        uint32_t pictureAspectRatio = (uint32_t)((rawWidth * Q12) / rawHeight);
+        uint32_t pictureAspectRatio = (uint32_t)((width * Q12) / height);
         uint32_t i;
-    LOGE("initRaw E: aspect ratio=%d", pictureAspectRatio);
+    LOGE("setThumbnailSize: aspect ratio=%d", pictureAspectRatio);
 
         for(i = 0; i < THUMBNAIL_SIZE_COUNT; i++ )
         {
@@ -1186,11 +1233,21 @@ bool QualcommCameraHardware::initRaw(bool initJpegHeap)
     }
     else{
         mDimension.ui_thumbnail_height = THUMBNAIL_SMALL_HEIGHT;
-        mDimension.ui_thumbnail_width = (THUMBNAIL_SMALL_HEIGHT * rawWidth)/ rawHeight;
+        mDimension.ui_thumbnail_width = (THUMBNAIL_SMALL_HEIGHT * width)/ height;
     }
 
     LOGE("Thumbnail Size Width %d Height %d", mDimension.ui_thumbnail_width, mDimension.ui_thumbnail_height);
+}
+
+bool QualcommCameraHardware::initRaw(bool initJpegHeap)
+{
+    int rawWidth, rawHeight;
 
+    mParameters.getPictureSize(&rawWidth, &rawHeight);
+    LOGE("initRaw E: picture size=%dx%d", rawWidth, rawHeight);
+
+    int thumbnailBufferSize;
+    setThumbnailSize(rawWidth, rawHeight);
     thumbnailBufferSize = mDimension.ui_thumbnail_width * mDimension.ui_thumbnail_height * 3 / 2;
 
     // mDimension will be filled with thumbnail_width, thumbnail_height,
@@ -1207,15 +1264,72 @@ bool QualcommCameraHardware::initRaw(bool initJpegHeap)
         return false;
     }
 
+    // Snapshot
+    mRawSize = rawWidth * rawHeight * 3 / 2;
+    mJpegMaxSize = rawWidth * rawHeight * 3 / 2;
+
+    return initRawHeaps(initJpegHeap ? kJpegBufferCount : 0,
+                        thumbnailBufferSize);
+}
+
+/* The snapshot heaps of a ZSL picture: it is a preview frame, so they're
+ * the preview size, and the driver isn't told since it takes no picture. A
+ * burst of them has a JPEG buffer for each, and a spare pair of snapshot
+ * and thumbnail heaps to copy the next one to.
+ */
+bool QualcommCameraHardware::initZslRaw(int pictures)
+{
+    LOGV("initZslRaw E: frame size=%dx%d", previewWidth, previewHeight);
+
+    setThumbnailSize(previewWidth, previewHeight);
+    // even, for yuv420sp_scale
+    mDimension.ui_thumbnail_width &= ~1;
+    int thumbnailBufferSize =
+        mDimension.ui_thumbnail_width * mDimension.ui_thumbnail_height * 3 / 2;
+
+    mRawSize = mPreviewFrameSize;
+    mJpegMaxSize = mPreviewFrameSize;
+
+    if (!initRawHeaps(pictures, thumbnailBufferSize))
+        return false;
+    if (pictures == 1)
+        return true;
+
+    mSpareRawHeap =
+        new PmemPool("/dev/pmem",
+                     MemoryHeapBase::READ_ONLY,
+                     mCameraControlFd,
+                     MSM_PMEM_MAINIMG,
+                     mJpegMaxSize,
+                     kRawBufferCount,
+                     mRawSize,
+                     "snapshot camera");
+    mSpareThumbnailHeap =
+        new PmemPool("/dev/pmem_adsp",
+                     MemoryHeapBase::READ_ONLY,
+                     mCameraControlFd,
+                     MSM_PMEM_THUMBNAIL,
+                     thumbnailBufferSize,
+                     1,
+                     thumbnailBufferSize,
+                     "thumbnail");
+    if (!mSpareRawHeap->initialized() ||
+        !mSpareThumbnailHeap->initialized()) {
+        LOGE("initZslRaw X failed: error initializing the spare heaps.");
+        deinitRaw();
+        return false;
+    }
+    return true;
+}
+
+bool QualcommCameraHardware::initRawHeaps(int jpegBufferCount,
+                                          int thumbnailBufferSize)
+{
     if (mJpegHeap != NULL) {
         LOGV("initRaw: clearing old mJpegHeap.");
         mJpegHeap.clear();
     }
 
-    // Snapshot
-    mRawSize = rawWidth * rawHeight * 3 / 2;
-    mJpegMaxSize = rawWidth * rawHeight * 3 / 2;
-
     LOGV("initRaw: initializing mRawHeap. mRawSize:%d , mJpegMaxSize:%d",mRawSize,mJpegMaxSize);
     mRawHeap =
         new PmemPool("/dev/pmem",
@@ -1238,10 +1352,10 @@ bool QualcommCameraHardware::initRaw(bool initJpegHeap)
 
     // Jpeg
 
-    if (initJpegHeap) {
+    if (jpegBufferCount) {
         LOGV("initRaw: initializing mJpegHeap.");
         mJpegHeap =  new AshmemPool(mJpegMaxSize,
-                           kJpegBufferCount,
+                           jpegBufferCount,
                            0, // we do not know how big the picture will be
                            "jpeg");
 
@@ -1285,6 +1399,8 @@ void QualcommCameraHardware::deinitRaw()
     mJpegHeap.clear();
     mRawHeap.clear();
     mDisplayHeap.clear();
+    mSpareThumbnailHeap.clear();
+    mSpareRawHeap.clear();
 
     LOGV("deinitRaw X");
 }
@@ -1306,12 +1422,6 @@ void QualcommCameraHardware::release()
     int cnt, rc;
     struct msm_ctrl_cmd ctrlCmd;
     if (mCameraRunning) {
-        if(mDataCallbackTimestamp && (mMsgEnabled & CAMERA_MSG_VIDEO_FRAME)) {
-            mRecordFrameLock.lock();
-            mReleasedRecordingFrame = true;
-            mRecordWait.signal();
-            mRecordFrameLock.unlock();
-        }
         stopPreviewInternal();
     }
 
@@ -1338,6 +1448,8 @@ void QualcommCameraHardware::release()
     close(mCameraControlFd);
     mCameraControlFd = -1;
     if(fb_fd >= 0) {
+        delete fb_blitter;
+        fb_blitter = NULL;
         close(fb_fd);
         fb_fd = -1;
     }
@@ -1694,7 +1806,13 @@ status_t QualcommCameraHardware::cancelAutoFocus()
 void QualcommCameraHardware::runSnapshotThread(void *data)
 {
     LOGV("runSnapshotThread E");
-    if(mSnapshotFormat == PICTURE_FORMAT_JPEG){
+    if (mZslCapture) {
+        if (mBurstCount)
+            runBurst();
+        else
+            receiveZslPicture();
+        mZslCapture = false;
+    } else if(mSnapshotFormat == PICTURE_FORMAT_JPEG){
         if (native_start_snapshot(mCameraControlFd))
             receiveRawPicture();
         else
@@ -1717,6 +1835,8 @@ void QualcommCameraHardware::runSnapshotThread(void *data)
     //clear the resources
     LINK_jpeg_encoder_join();
     deinitRaw();
+    mBurstCount = 0;
+    mJpegIndex = 0;
 
     mSnapshotThreadWaitLock.lock();
     mSnapshotThreadRunning = false;
@@ -1751,6 +1871,17 @@ status_t QualcommCameraHardware::takePicture()
         LOGV("takePicture: old snapshot thread completed.");
     }
 
+    if (mZslDepth && mCameraRunning) {
+        int slot = pinZslBuffer(systemTime());
+        if (slot >= 0) {
+            bool ok = takeZslPicture(slot);
+            mSnapshotThreadWaitLock.unlock();
+            LOGV("takePicture: X (zsl)");
+            return ok ? NO_ERROR : UNKNOWN_ERROR;
+        }
+        LOGW("takePicture: no frame in the ZSL ring yet, stopping preview.");
+    }
+
         mSnapshotFormat = PICTURE_FORMAT_JPEG;
 
     if(mSnapshotFormat == PICTURE_FORMAT_JPEG){
@@ -1790,6 +1921,143 @@ status_t QualcommCameraHardware::takePicture()
     return mSnapshotThreadRunning ? NO_ERROR : UNKNOWN_ERROR;
 }
 
+/* Encodes ZSL buffer slot, which pinZslBuffer() has pinned, while preview
+ * goes on. Called with mSnapshotThreadWaitLock held.
+ */
+bool QualcommCameraHardware::takeZslPicture(int slot)
+{
+    bool ok = initZslRaw(1) &&
+              copyZslFrame(slot, mRawHeap, mThumbnailHeap);
+    unpinZslBuffer();
+    if (!ok) {
+        LOGE("takeZslPicture: could not copy the frame.  Not taking picture.");
+        deinitRaw();
+        return false;
+    }
+    return startZslCapture();
+}
+
+status_t QualcommCameraHardware::takeBurst(int count)
+{
+    LOGV("takeBurst(%d)", count);
+    Mutex::Autolock l(&mLock);
+
+    if (!count)
+        count = mParameters.getInt("burst-count");
+    if (count < 1 || count > kBurstMaxCount) {
+        LOGE("takeBurst: invalid count %d", count);
+        return BAD_VALUE;
+    }
+    if (!mZslDepth || !mCameraRunning) {
+        LOGE("takeBurst: preview must be running with zsl on.");
+        return INVALID_OPERATION;
+    }
+
+    mSnapshotThreadWaitLock.lock();
+    while (mSnapshotThreadRunning) {
+        LOGV("takeBurst: waiting for old snapshot thread to complete.");
+        mSnapshotThreadWait.wait(mSnapshotThreadWaitLock);
+        LOGV("takeBurst: old snapshot thread completed.");
+    }
+
+    if (!initZslRaw(count)) {
+        LOGE("initZslRaw failed.  Not taking burst.");
+        mSnapshotThreadWaitLock.unlock();
+        return UNKNOWN_ERROR;
+    }
+    mBurstCount = count;
+    bool ok = startZslCapture();
+    if (!ok)
+        mBurstCount = 0;
+    mSnapshotThreadWaitLock.unlock();
+
+    LOGV("takeBurst: X");
+    return ok ? NO_ERROR : UNKNOWN_ERROR;
+}
+
+/* Starts the snapshot thread on ZSL pictures, which are the preview size
+ * and already zoomed. Called with mSnapshotThreadWaitLock held.
+ */
+bool QualcommCameraHardware::startZslCapture()
+{
+    // zoomed already, and the encoder shouldn't scale it
+    memset(&mCrop, 0, sizeof(mCrop));
+    mDimension.orig_picture_dx = previewWidth;
+    mDimension.orig_picture_dy = previewHeight;
+    mDimension.thumbnail_width = mDimension.ui_thumbnail_width;
+    mDimension.thumbnail_height = mDimension.ui_thumbnail_height;
+
+    mZslCapture = true;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    mSnapshotThreadRunning = !pthread_create(&mSnapshotThread,
+                                             &attr,
+                                             snapshot_thread,
+                                             NULL);
+    if (!mSnapshotThreadRunning) {
+        mZslCapture = false;
+        deinitRaw();
+    }
+    return mSnapshotThreadRunning;
+}
+
+/* Copies ZSL buffer slot to raw and scales it down to thumbnail, in one
+ * blit list, or on the CPU if the MDP won't.
+ */
+bool QualcommCameraHardware::copyZslFrame(int slot, const sp<PmemPool>& raw,
+                                          const sp<PmemPool>& thumbnail)
+{
+    union {
+        char d[sizeof(struct mdp_blit_req_list) + sizeof(struct mdp_blit_req) * 2];
+        struct mdp_blit_req_list list;
+    } copy;
+    // a burst copies while preview may stop
+    sp<PmemPool> preview = mPreviewHeap;
+    if (preview == NULL)
+        return false;
+    int srcOffset = (kPreviewBufferCountActual + slot) *
+                    preview->mAlignedBufferSize;
+    uint32_t thumbnailWidth = mDimension.ui_thumbnail_width;
+    uint32_t thumbnailHeight = mDimension.ui_thumbnail_height;
+
+    memset(&copy, 0, sizeof(copy));
+    copy.list.count = 2;
+    for (int i = 0; i < 2; i++) {
+        struct mdp_blit_req *e = &copy.list.req[i];
+        e->src.width = previewWidth;
+        e->src.height = previewHeight;
+        e->src.format = MDP_Y_CBCR_H2V2;
+        e->src.offset = srcOffset;
+        e->src.memory_id = preview->mHeap->getHeapID();
+        e->src_rect.w = previewWidth;
+        e->src_rect.h = previewHeight;
+        e->dst.format = MDP_Y_CBCR_H2V2;
+        e->transp_mask = 0xffffffff;
+        e->alpha = 0xff;
+    }
+    copy.list.req[0].dst.width = copy.list.req[0].dst_rect.w = previewWidth;
+    copy.list.req[0].dst.height = copy.list.req[0].dst_rect.h = previewHeight;
+    copy.list.req[0].dst.memory_id = raw->mHeap->getHeapID();
+    copy.list.req[1].dst.width = copy.list.req[1].dst_rect.w = thumbnailWidth;
+    copy.list.req[1].dst.height = copy.list.req[1].dst_rect.h = thumbnailHeight;
+    copy.list.req[1].dst.memory_id = thumbnail->mHeap->getHeapID();
+    if (fb_blitter->blit(&copy.list) >= 0)
+        return true;
+
+    uint8_t *src = (uint8_t *)preview->mHeap->base() + srcOffset;
+    memcpy(raw->mHeap->base(), src, mPreviewFrameSize);
+    int result = yuv420sp_scale((uint8_t *)thumbnail->mHeap->base(),
+                                thumbnailWidth, thumbnailHeight,
+                                src, previewWidth, previewHeight,
+                                &copy.list.req[1].src_rect);
+    if (result < 0) {
+        LOGE("copyZslFrame: thumbnail failed: %s", strerror(-result));
+        return false;
+    }
+    return true;
+}
+
 status_t QualcommCameraHardware::cancelPicture()
 {
     status_t rc;
@@ -1811,6 +2079,8 @@ status_t QualcommCameraHardware::setParameters(const CameraParameters& params)
     if ((rc = setPictureSize(params)))  final_rc = rc;
     if ((rc = setJpegQuality(params)))  final_rc = rc;
     if ((rc = setPictureFormat(params))) final_rc = rc;
+    if ((rc = setZsl(params)))  final_rc = rc;
+    if ((rc = setBurst(params)))  final_rc = rc;
 
     LOGV("setParameters: X");
     return NO_ERROR;
@@ -1819,13 +2089,26 @@ status_t QualcommCameraHardware::setParameters(const CameraParameters& params)
 CameraParameters QualcommCameraHardware::getParameters() const
 {
     LOGV("getParameters: EX");
-    return mParameters;
+    CameraParameters params = mParameters;
+
+    // how the last burst went, in ms from its start
+    Mutex::Autolock bLock(&mBurstLock);
+    if (mBurstFrames) {
+        params.set("burst-capture-times",
+                   create_times_str(mBurstCaptureTime, mBurstFrames).string());
+        params.set("burst-jpeg-times",
+                   create_times_str(mBurstJpegTime, mBurstFrames).string());
+        params.set("burst-total-time", (int)ns2ms(mBurstTotalTime));
+    }
+    return params;
 }
 
 status_t QualcommCameraHardware::sendCommand(int32_t command, int32_t arg1,
                                              int32_t arg2)
 {
     LOGV("sendCommand: EX");
+    if (command == CAMERA_CMD_BURST_CAPTURE)
+        return takeBurst(arg1);
     return BAD_VALUE;
 }
 
@@ -1978,10 +2261,16 @@ bool QualcommCameraHardware::native_zoom_image(int fd, int srcOffset, int dstOff
     e->dst_rect.w = previewWidth;
     e->dst_rect.h = previewHeight;
 
-    result = ioctl(fb_fd, MSMFB_BLIT, &zoomImage.list);
+    result = fb_blitter->blit(&zoomImage.list);
     if (result < 0) {
-        LOGE("MSM_FBIOBLT failed! line=%d\n", __LINE__);
-        return FALSE;
+        // the MDP doesn't scale beyond 4x, zoom on the CPU
+        uint8_t *base = (uint8_t *)mPreviewHeap->mHeap->base();
+        result = yuv420sp_scale(base + dstOffSet, previewWidth, previewHeight,
+                base + srcOffset, previewWidth, previewHeight, &e->src_rect);
+        if (result < 0) {
+            LOGE("native_zoom_image: zoom failed: %s", strerror(-result));
+            return FALSE;
+        }
     }
     return TRUE;
 }
@@ -2048,7 +2337,20 @@ void QualcommCameraHardware::receivePreviewFrame(struct msm_frame *frame)
     common_crop_t *crop = (common_crop_t *) (frame->cropinfo);
 
     mInPreviewCallback = true;
-	if (crop->in2_w != 0 || crop->in2_h != 0) {
+    bool recording = rcb != NULL && (msgEnabled & CAMERA_MSG_VIDEO_FRAME);
+    int slot = recording ? claimRecordBuffer() : -1;
+    if (slot >= 0) {
+        // zoomed or not, the frame is copied to the ring, which preview
+        // callbacks get too
+        offset = kPreviewBufferCount + NUM_MORE_BUFS + slot;
+        ssize_t slotOffset_addr = offset * mPreviewHeap->mAlignedBufferSize;
+        if (!native_zoom_image(mPreviewHeap->mHeap->getHeapID(),
+                offset_addr, slotOffset_addr, crop)) {
+            LOGE(" Error while copying a recording frame with the MDP ");
+            memcpy((uint8_t *)mPreviewHeap->mHeap->base() + slotOffset_addr,
+                   (void *)frame->buffer, mPreviewFrameSize);
+        }
+    } else if (crop->in2_w != 0 || crop->in2_h != 0) {
 	    dstOffset = (dstOffset + 1) % NUM_MORE_BUFS;
 	    offset = kPreviewBufferCount + dstOffset;
 	    ssize_t dstOffset_addr = offset * mPreviewHeap->mAlignedBufferSize;
@@ -2062,18 +2364,15 @@ void QualcommCameraHardware::receivePreviewFrame(struct msm_frame *frame)
         pcb(CAMERA_MSG_PREVIEW_FRAME, mPreviewHeap->mBuffers[offset],
             pdata);
 
-        if(rcb != NULL && (msgEnabled & CAMERA_MSG_VIDEO_FRAME)) {
-            rcb(systemTime(), CAMERA_MSG_VIDEO_FRAME, mPreviewHeap->mBuffers[offset], rdata);
-            Mutex::Autolock rLock(&mRecordFrameLock);
-            if (mReleasedRecordingFrame != true) {
-                LOGV("block waiting for frame release");
-                mRecordWait.wait(mRecordFrameLock);
-                LOGV("frame released, continuing");
-            }
-            mReleasedRecordingFrame = false;
-        }
+    // the encoder gives the buffer back with releaseRecordingFrame()
+    if (slot >= 0)
+        rcb(systemTime(), CAMERA_MSG_VIDEO_FRAME, mPreviewHeap->mBuffers[offset], rdata);
     mInPreviewCallback = false;
 
+    // what was shown, zoomed or not, for takePicture() in ZSL mode
+    if (mZslDepth)
+        storeZslFrame(offset);
+
     LOGV("receivePreviewFrame X");
 }
 
@@ -2134,7 +2433,7 @@ status_t QualcommCameraHardware::startRecording()
     LOGV("startRecording E");
     int ret;
     Mutex::Autolock l(&mLock);
-    mReleasedRecordingFrame = false;
+    resetRecordRing();
     if( (ret=startPreviewInternal())== NO_ERROR){
 
     }
@@ -2147,8 +2446,8 @@ void QualcommCameraHardware::stopRecording()
     Mutex::Autolock l(&mLock);
     {
         mRecordFrameLock.lock();
-        mReleasedRecordingFrame = true;
-        mRecordWait.signal();
+        LOGI("stopRecording: %u frames recorded, %u dropped",
+             mRecordFrames, mRecordDrops);
         mRecordFrameLock.unlock();
 
         if(mDataCallback && (mMsgEnabled & CAMERA_MSG_PREVIEW_FRAME)) {
@@ -2163,16 +2462,159 @@ void QualcommCameraHardware::stopRecording()
 }
 
 void QualcommCameraHardware::releaseRecordingFrame(
-       const sp<IMemory>& mem __attribute__((unused)))
+       const sp<IMemory>& mem)
 {
     LOGV("releaseRecordingFrame E");
+    ssize_t offset;
+    size_t size;
+    sp<IMemoryHeap> heap = mem->getMemory(&offset, &size);
     Mutex::Autolock rLock(&mRecordFrameLock);
-    mReleasedRecordingFrame = true;
-    mRecordWait.signal();
+    // frames of a previous preview heap were forgotten with it
+    if (mPreviewHeap != NULL && heap != NULL &&
+        heap->base() == mPreviewHeap->mHeap->base()) {
+        int slot = offset / mPreviewHeap->mAlignedBufferSize -
+                   (kPreviewBufferCount + NUM_MORE_BUFS);
+        if (slot >= 0 && slot < kRecordRingSize)
+            mRecordBusy[slot] = false;
+        else
+            LOGE("releaseRecordingFrame: not a recording buffer (offset %d)",
+                 (int)offset);
+    }
 
     LOGV("releaseRecordingFrame X");
 }
 
+/* The next buffer of the record ring the encoder doesn't have, or -1 to
+ * drop the frame.
+ */
+int QualcommCameraHardware::claimRecordBuffer()
+{
+    Mutex::Autolock rLock(&mRecordFrameLock);
+    for (int i = 0; i < kRecordRingSize; i++) {
+        int slot = (mRecordNext + i) % kRecordRingSize;
+        if (!mRecordBusy[slot]) {
+            mRecordBusy[slot] = true;
+            mRecordNext = (slot + 1) % kRecordRingSize;
+            mRecordFrames++;
+            return slot;
+        }
+    }
+    if (mRecordDrops++ % 30 == 0)
+        LOGW("encoder holds all %d recording buffers, %u frames dropped",
+             kRecordRingSize, mRecordDrops);
+    return -1;
+}
+
+void QualcommCameraHardware::resetRecordRing()
+{
+    Mutex::Autolock rLock(&mRecordFrameLock);
+    memset(mRecordBusy, 0, sizeof(mRecordBusy));
+    mRecordNext = 0;
+    mRecordFrames = 0;
+    mRecordDrops = 0;
+}
+
+/* Latches "zsl" and "zsl-depth" for the preview heap initPreview() is
+ * about to make, and empties the ring.
+ */
+void QualcommCameraHardware::resetZslRing()
+{
+    Mutex::Autolock zLock(&mZslLock);
+    const char *zsl = mParameters.get("zsl");
+    mZslDepth = 0;
+    if (zsl != NULL && !strcmp(zsl, "on"))
+        mZslDepth = mParameters.getInt("zsl-depth");
+    mZslNext = 0;
+    mZslPinned = -1;
+    memset(mZslTime, 0, sizeof(mZslTime));
+}
+
+/* Copies preview buffer index to the oldest buffer of the ZSL ring but the
+ * pinned one.
+ */
+void QualcommCameraHardware::storeZslFrame(int index)
+{
+    int slot;
+    {
+        Mutex::Autolock zLock(&mZslLock);
+        slot = mZslNext;
+        if (slot == mZslPinned)
+            slot = (slot + 1) % mZslDepth;
+        if (slot == mZslPinned)
+            return;
+        mZslNext = (slot + 1) % mZslDepth;
+        // not a frame to take until it's copied
+        mZslTime[slot] = 0;
+    }
+
+    common_crop_t none;
+    memset(&none, 0, sizeof(none));
+    ssize_t srcOffset_addr = index * mPreviewHeap->mAlignedBufferSize;
+    ssize_t slotOffset_addr = (kPreviewBufferCountActual + slot) *
+                              mPreviewHeap->mAlignedBufferSize;
+    if (!native_zoom_image(mPreviewHeap->mHeap->getHeapID(),
+            srcOffset_addr, slotOffset_addr, &none)) {
+        LOGE(" Error while copying a ZSL frame with the MDP ");
+        uint8_t *base = (uint8_t *)mPreviewHeap->mHeap->base();
+        memcpy(base + slotOffset_addr, base + srcOffset_addr,
+               mPreviewFrameSize);
+    }
+
+    Mutex::Autolock zLock(&mZslLock);
+    mZslTime[slot] = systemTime();
+    mZslFrameWait.signal();
+}
+
+/* Pins the newest buffer of the ZSL ring filled after *after, waiting a
+ * second at most for one, and returns it with its time in *after; -1 if
+ * none came.
+ */
+int QualcommCameraHardware::waitZslFrame(nsecs_t *after)
+{
+    Mutex::Autolock zLock(&mZslLock);
+    for (;;) {
+        int best = -1;
+        for (int i = 0; i < mZslDepth; i++) {
+            if (mZslTime[i] > *after &&
+                (best < 0 || mZslTime[i] > mZslTime[best]))
+                best = i;
+        }
+        if (best >= 0) {
+            mZslPinned = best;
+            *after = mZslTime[best];
+            return best;
+        }
+        if (mZslFrameWait.waitRelative(mZslLock, s2ns(1)) != NO_ERROR)
+            return -1;
+    }
+}
+
+/* Pins the buffer of the ZSL ring taken nearest to when, so it isn't
+ * refilled, and returns it; -1 if there's no frame yet.
+ */
+int QualcommCameraHardware::pinZslBuffer(nsecs_t when)
+{
+    Mutex::Autolock zLock(&mZslLock);
+    int best = -1;
+    for (int i = 0; i < mZslDepth; i++) {
+        if (!mZslTime[i])
+            continue;
+        if (best < 0 || llabs(mZslTime[i] - when) < llabs(mZslTime[best] - when))
+            best = i;
+    }
+    mZslPinned = best;
+    if (best >= 0)
+        LOGV("pinZslBuffer: frame %d, %lld us from the shutter", best,
+             llabs(mZslTime[best] - when) / 1000);
+    return best;
+}
+
+void QualcommCameraHardware::unpinZslBuffer()
+{
+    Mutex::Autolock zLock(&mZslLock);
+    mZslPinned = -1;
+}
+
 bool QualcommCameraHardware::recordingEnabled()
 {
     return mCameraRunning && mDataCallbackTimestamp && (mMsgEnabled & CAMERA_MSG_VIDEO_FRAME);
@@ -2226,36 +2668,17 @@ static void receive_shutter_callback(common_crop_t *crop)
     LOGV("receive_shutter_callback: X");
 }
 
-// Crop the picture in place.
+// Crop the picture in place, around its center.
 static void crop_yuv420(uint32_t width, uint32_t height,
                  uint32_t cropped_width, uint32_t cropped_height,
                  uint8_t *image)
 {
-    uint32_t i, x, y;
-    uint8_t* chroma_src, *chroma_dst;
-
-    // Calculate the start position of the cropped area.
-    x = (width - cropped_width) / 2;
-    y = (height - cropped_height) / 2;
-    x &= ~1;
-    y &= ~1;
-
-    // Copy luma component.
-    for(i = 0; i < cropped_height; i++)
-        memcpy(image + i * cropped_width,
-               image + width * (y + i) + x,
-               cropped_width);
-
-    chroma_src = image + width * height;
-    chroma_dst = image + cropped_width * cropped_height;
-
-    // Copy chroma components.
-    cropped_height /= 2;
-    y /= 2;
-    for(i = 0; i < cropped_height; i++)
-        memcpy(chroma_dst + i * cropped_width,
-               chroma_src + width * (y + i) + x,
-               cropped_width);
+    struct mdp_rect r;
+    r.x = ((width - cropped_width) / 2) & ~1;
+    r.y = ((height - cropped_height) / 2) & ~1;
+    r.w = cropped_width;
+    r.h = cropped_height;
+    yuv420sp_crop(image, image, width, height, &r);
 }
 
 void QualcommCameraHardware::receiveRawPicture()
@@ -2284,10 +2707,13 @@ void QualcommCameraHardware::receiveRawPicture()
             // By the time native_get_picture returns, picture is taken. Call
             // shutter callback if cam config thread has not done that.
             notifyShutter(&mCrop);
-                    crop_yuv420(mCrop.out2_w, mCrop.out2_h, (mCrop.in2_w + jpegPadding), (mCrop.in2_h + jpegPadding),
-                            (uint8_t *)mRawHeap->mHeap->base());
-                    crop_yuv420(mCrop.out1_w, mCrop.out1_h, (mCrop.in1_w + jpegPadding), (mCrop.in1_h + jpegPadding),
-                            (uint8_t *)mThumbnailHeap->mHeap->base());
+
+            // The encoder reads whole frames from the start of each heap,
+            // it takes no stride, so the crop has to move the pixels.
+            crop_yuv420(mCrop.out2_w, mCrop.out2_h, (mCrop.in2_w + jpegPadding), (mCrop.in2_h + jpegPadding),
+                    (uint8_t *)mRawHeap->mHeap->base());
+            crop_yuv420(mCrop.out1_w, mCrop.out1_h, (mCrop.in1_w + jpegPadding), (mCrop.in1_h + jpegPadding),
+                    (uint8_t *)mThumbnailHeap->mHeap->base());
 
             // We do not need jpeg encoder to upscale the image. Set the new
             // dimension for encoder.
@@ -2309,20 +2735,9 @@ void QualcommCameraHardware::receiveRawPicture()
     else LOGV("Raw-picture callback was canceled--skipping.");
 
     if (mDataCallback && (mMsgEnabled & CAMERA_MSG_COMPRESSED_IMAGE)) {
-        mJpegSize = 0;
-        mJpegThreadWaitLock.lock();
-        if (LINK_jpeg_encoder_init()) {
-            mJpegThreadRunning = true;
-            mJpegThreadWaitLock.unlock();
-            if(native_jpeg_encode()) {
-                LOGV("receiveRawPicture: X (success)");
-                return;
-            }
-            LOGE("jpeg encoding failed");
-        }
-        else {
-            LOGE("receiveRawPicture X: jpeg_encoder_init failed.");
-            mJpegThreadWaitLock.unlock();
+        if (encodePicture()) {
+            LOGV("receiveRawPicture: X (success)");
+            return;
         }
     }
     else LOGV("JPEG callback is NULL, not encoding image.");
@@ -2330,12 +2745,128 @@ void QualcommCameraHardware::receiveRawPicture()
     LOGV("receiveRawPicture: X");
 }
 
+/* Preview is still running, so there is no shutter or raw picture
+ * callback: CameraService would take the preview buffers off the surface
+ * for them.
+ */
+void QualcommCameraHardware::receiveZslPicture()
+{
+    LOGV("receiveZslPicture: E");
+
+    Mutex::Autolock cbLock(&mCallbackLock);
+    if (mDataCallback && (mMsgEnabled & CAMERA_MSG_COMPRESSED_IMAGE)) {
+        if (encodePicture()) {
+            LOGV("receiveZslPicture: X (success)");
+            return;
+        }
+    }
+    else LOGV("JPEG callback is NULL, not encoding image.");
+    LOGV("receiveZslPicture: X");
+}
+
+/* Takes mBurstCount ZSL pictures, each a newer frame than the last. Frame
+ * K+1 is copied to the spare heaps while K is encoded, and the pairs swap
+ * when K is done. Each picture has its own mJpegHeap buffer, since
+ * CameraService may still be reading the one before.
+ */
+void QualcommCameraHardware::runBurst()
+{
+    nsecs_t start = systemTime();
+    nsecs_t captured[kBurstMaxCount];
+    nsecs_t encoded[kBurstMaxCount];
+    nsecs_t last = 0;
+    int frames = 0, done = 0;
+
+    for (int k = 0; k < mBurstCount; k++) {
+        int slot = waitZslFrame(&last);
+        if (slot < 0) {
+            LOGE("runBurst: no frame for picture %d", k);
+            break;
+        }
+        bool ok = copyZslFrame(slot, k ? mSpareRawHeap : mRawHeap,
+                               k ? mSpareThumbnailHeap : mThumbnailHeap);
+        unpinZslBuffer();
+        if (!ok) {
+            LOGE("runBurst: could not copy picture %d", k);
+            break;
+        }
+        captured[k] = systemTime() - start;
+
+        if (k) {
+            encoded[k - 1] = waitJpegDone() - start;
+            done = k;
+            LINK_jpeg_encoder_join();
+            sp<PmemPool> heap = mRawHeap;
+            mRawHeap = mSpareRawHeap;
+            mSpareRawHeap = heap;
+            heap = mThumbnailHeap;
+            mThumbnailHeap = mSpareThumbnailHeap;
+            mSpareThumbnailHeap = heap;
+        }
+
+        mJpegIndex = k;
+        if (!encodePicture())
+            break;
+        frames = k + 1;
+    }
+    if (done < frames)
+        encoded[frames - 1] = waitJpegDone() - start;
+
+    Mutex::Autolock bLock(&mBurstLock);
+    mBurstFrames = frames;
+    memcpy(mBurstCaptureTime, captured, frames * sizeof(nsecs_t));
+    memcpy(mBurstJpegTime, encoded, frames * sizeof(nsecs_t));
+    mBurstTotalTime = systemTime() - start;
+    for (int k = 0; k < frames; k++)
+        LOGV("runBurst: picture %d copied at %lld ms, delivered at %lld ms",
+             k, ns2ms(captured[k]), ns2ms(encoded[k]));
+    LOGI("runBurst: %d of %d pictures in %lld ms", frames, mBurstCount,
+         ns2ms(mBurstTotalTime));
+}
+
+// When the picture being encoded was delivered.
+nsecs_t QualcommCameraHardware::waitJpegDone()
+{
+    mJpegThreadWaitLock.lock();
+    while (mJpegThreadRunning)
+        mJpegThreadWait.wait(mJpegThreadWaitLock);
+    nsecs_t when = mJpegDoneTime;
+    mJpegThreadWaitLock.unlock();
+    return when;
+}
+
+// Starts encoding mRawHeap and mThumbnailHeap; the encoder's thread
+// delivers the picture.
+bool QualcommCameraHardware::encodePicture()
+{
+    mJpegSize = 0;
+    mJpegThreadWaitLock.lock();
+    if (LINK_jpeg_encoder_init()) {
+        mJpegThreadRunning = true;
+        mJpegThreadWaitLock.unlock();
+        if(native_jpeg_encode())
+            return true;
+        LOGE("jpeg encoding failed");
+        // no picture will come to say it's done
+        mJpegThreadWaitLock.lock();
+        mJpegThreadRunning = false;
+        mJpegThreadWait.signal();
+        mJpegThreadWaitLock.unlock();
+    }
+    else {
+        LOGE("encodePicture: jpeg_encoder_init failed.");
+        mJpegThreadWaitLock.unlock();
+    }
+    return false;
+}
+
 void QualcommCameraHardware::receiveJpegPictureFragment(
     uint8_t *buff_ptr, uint32_t buff_size)
 {
-    uint32_t remaining = mJpegHeap->mHeap->virtualSize();
+    uint32_t offset = mJpegIndex * mJpegHeap->mAlignedBufferSize;
+    uint32_t remaining = mJpegHeap->mHeap->virtualSize() - offset;
     remaining -= mJpegSize;
-    uint8_t *base = (uint8_t *)mJpegHeap->mHeap->base();
+    uint8_t *base = (uint8_t *)mJpegHeap->mHeap->base() + offset;
 
     LOGV("receiveJpegPictureFragment size %d", buff_size);
     if (buff_size > remaining) {
@@ -2355,15 +2886,18 @@ void QualcommCameraHardware::receiveJpegPicture(void)
          mJpegSize, mJpegHeap->mBufferSize);
     Mutex::Autolock cbLock(&mCallbackLock);
 
-    int index = 0, rc;
+    int index = mJpegIndex, rc;
 
-    if (mDataCallback && (mMsgEnabled & CAMERA_MSG_COMPRESSED_IMAGE)) {
+    // CameraService turns the message off after the first picture of a
+    // burst, and doesn't turn it on for sendCommand()
+    if (mDataCallback &&
+        ((mMsgEnabled & CAMERA_MSG_COMPRESSED_IMAGE) || mBurstCount)) {
         // The reason we do not allocate into mJpegHeap->mBuffers[offset] is
         // that the JPEG image's size will probably change from one snapshot
         // to the next, so we cannot reuse the MemoryBase object.
         sp<MemoryBase> buffer = new
             MemoryBase(mJpegHeap->mHeap,
-                       index * mJpegHeap->mBufferSize +
+                       index * mJpegHeap->mAlignedBufferSize +
                        0,
                        mJpegSize);
         mDataCallback(CAMERA_MSG_COMPRESSED_IMAGE, buffer, mCallbackCookie);
@@ -2373,6 +2907,7 @@ void QualcommCameraHardware::receiveJpegPicture(void)
 
     mJpegThreadWaitLock.lock();
     mJpegThreadRunning = false;
+    mJpegDoneTime = systemTime();
     mJpegThreadWait.signal();
     mJpegThreadWaitLock.unlock();
 
@@ -2547,6 +3082,44 @@ status_t QualcommCameraHardware::setPictureFormat(const CameraParameters& params
     return NO_ERROR;
 }
 
+status_t QualcommCameraHardware::setZsl(const CameraParameters& params)
+{
+    // both take effect at the next startPreview()
+    const char *str = params.get("zsl");
+    if (str != NULL) {
+        if (strcmp(str, "on") && strcmp(str, "off")) {
+            LOGE("Invalid zsl value: %s", str);
+            return BAD_VALUE;
+        }
+        mParameters.set("zsl", str);
+    }
+
+    const char *depth = params.get("zsl-depth");
+    if (depth != NULL) {
+        int value = atoi(depth);
+        if (value < 1 || value > kZslMaxDepth) {
+            LOGE("Invalid zsl-depth value: %s", depth);
+            return BAD_VALUE;
+        }
+        mParameters.set("zsl-depth", value);
+    }
+    return NO_ERROR;
+}
+
+status_t QualcommCameraHardware::setBurst(const CameraParameters& params)
+{
+    const char *str = params.get("burst-count");
+    if (str != NULL) {
+        int value = atoi(str);
+        if (value < 1 || value > kBurstMaxCount) {
+            LOGE("Invalid burst-count value: %s", str);
+            return BAD_VALUE;
+        }
+        mParameters.set("burst-count", value);
+    }
+    return NO_ERROR;
+}
+
 QualcommCameraHardware::MemPool::MemPool(int buffer_size, int num_buffers,
                                          int frame_size,
                                          const char *name) :
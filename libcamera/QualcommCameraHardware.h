@@ -358,6 +358,11 @@ typedef struct {
 #define EXIFTAGID_EXIF_DATE_TIME 0x3B9004
 /* End of values originally in proprietary headers */
 
+/* sendCommand() with this takes arg1 pictures back to back from the ZSL
+ * ring, or "burst-count" of them if arg1 is 0.
+ */
+#define CAMERA_CMD_BURST_CAPTURE 0x1000
+
 namespace android {
 
 class QualcommCameraHardware : public CameraHardwareInterface {
@@ -418,6 +423,16 @@ private:
     bool native_jpeg_encode (void);
     bool native_set_parm(cam_ctrl_type type, uint16_t length, void *value);
     bool native_zoom_image(int fd, int srcOffset, int dstOffset, common_crop_t *crop);
+    int claimRecordBuffer();
+    void resetRecordRing();
+    void resetZslRing();
+    void storeZslFrame(int index);
+    int pinZslBuffer(nsecs_t when);
+    void unpinZslBuffer();
+    int waitZslFrame(nsecs_t *after);
+    bool takeZslPicture(int slot);
+    status_t takeBurst(int count);
+    bool startZslCapture();
 
     static wp<QualcommCameraHardware> singleton;
 
@@ -426,6 +441,15 @@ private:
        changes.
     */
     static const int kPreviewBufferCount = NUM_PREVIEW_BUFFERS;
+    /* The buffers frames are copied to for the video encoder while
+       recording, see receivePreviewFrame().
+    */
+    static const int kRecordRingSize = 4;
+    /* The most "zsl-depth" can be: the buffers kept for takePicture() in
+       ZSL mode, after the record ring.
+    */
+    static const int kZslMaxDepth = 6;
+    static const int kBurstMaxCount = 8;
     static const int kRawBufferCount = 1;
     static const int kJpegBufferCount = 1;
 
@@ -490,6 +514,9 @@ private:
     sp<PmemPool> mThumbnailHeap;
     sp<PmemPool> mRawHeap;
     sp<PmemPool> mDisplayHeap;
+    // where a burst copies the next picture while one is encoded
+    sp<PmemPool> mSpareRawHeap;
+    sp<PmemPool> mSpareThumbnailHeap;
     sp<AshmemPool> mJpegHeap;
     sp<PmemPool> mRawSnapShotPmemHeap;
     sp<PmemPool> mPostViewHeap;
@@ -499,7 +526,12 @@ private:
     bool initPreview();
     bool initRecord();
     void deinitPreview();
+    void setThumbnailSize(int width, int height);
     bool initRaw(bool initJpegHeap);
+    bool initZslRaw(int pictures);
+    bool initRawHeaps(int jpegBufferCount, int thumbnailBufferSize);
+    bool copyZslFrame(int slot, const sp<PmemPool>& raw,
+                      const sp<PmemPool>& thumbnail);
     bool initRawSnapshot();
     void deinitRaw();
     void deinitRawSnapshot();
@@ -568,6 +600,8 @@ private:
     status_t setSharpness(const CameraParameters& params);
     status_t setContrast(const CameraParameters& params);
     status_t setSaturation(const CameraParameters& params);
+    status_t setZsl(const CameraParameters& params);
+    status_t setBurst(const CameraParameters& params);
     void setGpsParameters();
     void storePreviewFrameForPostview();
     bool isValidDimension(int w, int h);
@@ -575,16 +609,52 @@ private:
     Mutex mLock;
     Mutex mCamframeTimeoutLock;
     bool camframe_timeout_flag;
-    bool mReleasedRecordingFrame;
 
     void receiveRawPicture(void);
+    void receiveZslPicture(void);
+    void runBurst(void);
+    bool encodePicture(void);
+    nsecs_t waitJpegDone(void);
     void receiveRawSnapshot(void);
 
     Mutex mCallbackLock;
     Mutex mOverlayLock;
 	Mutex mRecordLock;
 	Mutex mRecordFrameLock;
-	Condition mRecordWait;
+    /* The record ring, under mRecordFrameLock: which buffers the encoder
+       still has, where to look for a free one first, and the frames given
+       to the encoder and dropped because it had them all.
+    */
+    bool mRecordBusy[kRecordRingSize];
+    int mRecordNext;
+    uint32_t mRecordFrames;
+    uint32_t mRecordDrops;
+    /* The ZSL ring, under mZslLock: its depth, 0 unless preview started
+       with "zsl" on, where the next frame goes, the buffer takePicture()
+       is copying, and when each was filled, 0 for not yet.
+    */
+    Mutex mZslLock;
+    int mZslDepth;
+    int mZslNext;
+    int mZslPinned;
+    nsecs_t mZslTime[kZslMaxDepth];
+    Condition mZslFrameWait;
+    // the snapshot thread encodes a ZSL frame, or mBurstCount of them
+    bool mZslCapture;
+    int mBurstCount;
+    // the mJpegHeap buffer being encoded to, and when the last picture was
+    // delivered, under mJpegThreadWaitLock
+    int mJpegIndex;
+    nsecs_t mJpegDoneTime;
+    /* The last burst, under mBurstLock for getParameters(): the pictures
+       taken, and from its start when each was copied, when each was
+       delivered and when it was all done.
+    */
+    mutable Mutex mBurstLock;
+    int mBurstFrames;
+    nsecs_t mBurstCaptureTime[kBurstMaxCount];
+    nsecs_t mBurstJpegTime[kBurstMaxCount];
+    nsecs_t mBurstTotalTime;
     Condition mStateWait;
 
     /* mJpegSize keeps track of the size of the accumulated JPEG.  We clear it
@@ -20,7 +20,8 @@ LOCAL_PATH:= $(call my-dir)
 include $(CLEAR_VARS)
 LOCAL_PRELINK_MODULE := false
 LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
-LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_SHARED_LIBRARIES := liblog libcutils
+LOCAL_STATIC_LIBRARIES := libmdpblit
 LOCAL_SRC_FILES := copybit.cpp
 LOCAL_MODULE := copybit.delta
 LOCAL_C_INCLUDES += hardware/msm7k/libgralloc
@@ -28,3 +29,23 @@ LOCAL_CFLAGS += -DCOPYBIT_MSM7K=1
 LOCAL_MODULE_TAGS := optional
 include $(BUILD_SHARED_LIBRARY)
 
+
+# the MSMFB_BLIT ioctl, the software MDP, the CPU blitter and the YUV kernels,
+# also used by gralloc and the camera
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := blitter.cpp blitqueue.cpp cpublit.cpp region.cpp tiler.cpp \
+    yuv.cpp
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+LOCAL_CFLAGS += -mfpu=neon
+endif
+LOCAL_MODULE := libmdpblit
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := blitter.cpp blitqueue.cpp cpublit.cpp region.cpp tiler.cpp \
+    yuv.cpp
+LOCAL_MODULE := libmdpblit_host
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_STATIC_LIBRARY)
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "copybit"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <cutils/log.h>
+
+#include "blitqueue.h"
+
+
+static int64_t now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+// grows *array, of header bytes then items of size, to at least count items
+static int grow(void** array, uint32_t* capacity, uint32_t count,
+        size_t header, size_t size)
+{
+    if (count <= *capacity)
+        return 0;
+    uint32_t n = *capacity ? *capacity * 2 : 16;
+    while (n < count)
+        n *= 2;
+    void* p = realloc(*array, header + n * size);
+    if (!p)
+        return -ENOMEM;
+    *array = p;
+    *capacity = n;
+    return 0;
+}
+
+static uint32_t nextToken(uint32_t token)
+{
+    token = (token + 1) & 0x7fffffff;
+    return token ? token : 1;
+}
+
+// whether token is no later than reached, within half the range of tokens
+static bool upTo(uint32_t token, uint32_t reached)
+{
+    return ((reached - token) & 0x7fffffff) < 0x40000000;
+}
+
+/*****************************************************************************/
+
+BlitQueue::BlitQueue()
+    : mRunning(false), mQuit(false),
+      mSegments(0), mSegmentCount(0), mSegmentCapacity(0),
+      mPending(0), mPendingCount(0), mPendingCapacity(0),
+      mBatch(0), mBatchCapacity(0),
+      mLastToken(0), mDoneToken(0), mErrorFirst(0), mErrorLast(0), mError(0),
+      mSubmits(0), mBatches(0), mDepthSum(0), mMaxDepth(0),
+      mWaits(0), mWaitTime(0), mMaxWait(0)
+{
+    pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mQueued, NULL);
+    pthread_cond_init(&mDone, NULL);
+    if (pthread_create(&mThread, NULL, thread, this) == 0) {
+        mRunning = true;
+    } else {
+        LOGW("couldn't start the blit thread, blitting synchronously");
+    }
+}
+
+BlitQueue::~BlitQueue()
+{
+    if (mRunning) {
+        pthread_mutex_lock(&mLock);
+        mQuit = true;
+        pthread_cond_signal(&mQueued);
+        pthread_mutex_unlock(&mLock);
+        pthread_join(mThread, NULL);
+    }
+    free(mSegments);
+    free(mPending);
+    free(mBatch);
+    pthread_cond_destroy(&mDone);
+    pthread_cond_destroy(&mQueued);
+    pthread_mutex_destroy(&mLock);
+}
+
+void* BlitQueue::thread(void* data)
+{
+    static_cast<BlitQueue*>(data)->loop();
+    return NULL;
+}
+
+void BlitQueue::loop()
+{
+    pthread_mutex_lock(&mLock);
+    for (;;) {
+        while (!mSegmentCount && !mQuit) {
+            pthread_cond_wait(&mQueued, &mLock);
+        }
+        // what is queued is still done when quitting
+        if (!mSegmentCount)
+            break;
+
+        // submit() merged the lists for the same blitter, the first
+        // segment is the whole batch
+        segment_t seg = mSegments[0];
+        int err = grow((void**)&mBatch, &mBatchCapacity, seg.count,
+                sizeof(mdp_blit_req_list), sizeof(mdp_blit_req));
+        if (err == 0) {
+            mBatch->count = seg.count;
+            memcpy(mBatch->req, mPending, seg.count * sizeof(mdp_blit_req));
+        }
+        mPendingCount -= seg.count;
+        memmove(mPending, mPending + seg.count,
+                mPendingCount * sizeof(mdp_blit_req));
+        mSegmentCount--;
+        memmove(mSegments, mSegments + 1, mSegmentCount * sizeof(segment_t));
+        pthread_cond_broadcast(&mDone);
+        uint32_t first = nextToken(mDoneToken);
+
+        pthread_mutex_unlock(&mLock);
+        if (err == 0 && seg.count) {
+            err = seg.blitter->blit(mBatch);
+        }
+        pthread_mutex_lock(&mLock);
+
+        LOGE_IF(err<0, "queued blits %u to %u failed (%s)",
+                first, seg.token, strerror(-err));
+        if (err < 0) {
+            mErrorFirst = first;
+            mErrorLast = seg.token;
+            mError = err;
+        }
+        mBatches++;
+        mDoneToken = seg.token;
+        pthread_cond_broadcast(&mDone);
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+int BlitQueue::submit(Blitter* blitter, mdp_blit_req_list const* list)
+{
+    if (!mRunning) {
+        int err = blitter->blit(list);
+        pthread_mutex_lock(&mLock);
+        uint32_t token = nextToken(mLastToken);
+        mLastToken = mDoneToken = token;
+        if (err < 0) {
+            mErrorFirst = mErrorLast = token;
+            mError = err;
+        }
+        mSubmits++;
+        mBatches++;
+        pthread_mutex_unlock(&mLock);
+        return err < 0 ? err : int(token);
+    }
+
+    pthread_mutex_lock(&mLock);
+    while (mPendingCount && mPendingCount + list->count > kMaxPending) {
+        pthread_cond_wait(&mDone, &mLock);
+    }
+    if (grow((void**)&mPending, &mPendingCapacity,
+                mPendingCount + list->count, 0, sizeof(mdp_blit_req)) ||
+        grow((void**)&mSegments, &mSegmentCapacity,
+                mSegmentCount + 1, 0, sizeof(segment_t))) {
+        pthread_mutex_unlock(&mLock);
+        return -ENOMEM;
+    }
+
+    mSubmits++;
+    mDepthSum += mPendingCount;
+    if (mPendingCount > mMaxDepth)
+        mMaxDepth = mPendingCount;
+
+    memcpy(mPending + mPendingCount, list->req,
+            list->count * sizeof(mdp_blit_req));
+    mPendingCount += list->count;
+    uint32_t token = nextToken(mLastToken);
+    mLastToken = token;
+    segment_t* last = mSegmentCount ? &mSegments[mSegmentCount - 1] : 0;
+    if (last && last->blitter == blitter) {
+        last->count += list->count;
+        last->token = token;
+    } else {
+        segment_t seg = { blitter, list->count, int(token) };
+        mSegments[mSegmentCount++] = seg;
+    }
+    pthread_cond_signal(&mQueued);
+    pthread_mutex_unlock(&mLock);
+    return int(token);
+}
+
+bool BlitQueue::done(int token) const
+{
+    return upTo(token, mDoneToken);
+}
+
+int BlitQueue::status(int token) const
+{
+    if (mError && upTo(mErrorFirst, token) && upTo(token, mErrorLast))
+        return mError;
+    return 0;
+}
+
+int BlitQueue::wait(int token)
+{
+    if (token == 0)
+        return 0;
+    pthread_mutex_lock(&mLock);
+    if (token < 0 || !upTo(token, mLastToken)) {
+        // not one of ours, it would never be done
+        pthread_mutex_unlock(&mLock);
+        return -EINVAL;
+    }
+    if (!done(token)) {
+        int64_t start = now();
+        while (!done(token)) {
+            pthread_cond_wait(&mDone, &mLock);
+        }
+        int64_t waited = now() - start;
+        mWaits++;
+        mWaitTime += waited;
+        if (waited > mMaxWait)
+            mMaxWait = waited;
+    }
+    int err = status(token);
+    pthread_mutex_unlock(&mLock);
+    return err;
+}
+
+int BlitQueue::poll(int token)
+{
+    if (token == 0)
+        return 0;
+    pthread_mutex_lock(&mLock);
+    int err;
+    if (token < 0 || !upTo(token, mLastToken)) {
+        err = -EINVAL;
+    } else {
+        err = done(token) ? status(token) : -EAGAIN;
+    }
+    pthread_mutex_unlock(&mLock);
+    return err;
+}
+
+int BlitQueue::last()
+{
+    pthread_mutex_lock(&mLock);
+    int token = mLastToken;
+    pthread_mutex_unlock(&mLock);
+    return token;
+}
+
+void BlitQueue::dump(char* buff, int buff_len)
+{
+    pthread_mutex_lock(&mLock);
+    snprintf(buff, buff_len,
+            "    blit queue: %u lists in %u batches (%.2f per batch), "
+            "%.1f requests queued on average, %u most\n"
+            "    %u waits for %lld us, %lld us most\n",
+            mSubmits, mBatches, mBatches ? float(mSubmits) / mBatches : 0.0f,
+            mSubmits ? float(mDepthSum) / mSubmits : 0.0f, mMaxDepth,
+            mWaits, (long long)(mWaitTime / 1000),
+            (long long)(mMaxWait / 1000));
+    pthread_mutex_unlock(&mLock);
+}
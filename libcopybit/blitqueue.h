@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COPYBIT_MSM7K_BLITQUEUE_H
+#define COPYBIT_MSM7K_BLITQUEUE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "blitter.h"
+
+
+/*
+ * Runs blits on a thread of its own, so that the caller can go on while
+ * they're done.
+ *
+ * Each list submitted gets a token, one more than the previous one, and
+ * tokens complete in order. The thread takes everything queued for the
+ * same Blitter at once and runs it as a single list, so blits submitted
+ * back to back cost one MSMFB_BLIT. The requests are copied, but the
+ * buffers they refer to must stay until their token is done.
+ *
+ * submit() waits while more than kMaxPending requests are queued. Without
+ * the thread, if it couldn't be started, lists are blitted right away.
+ */
+class BlitQueue {
+
+ public:
+
+    enum { kMaxPending = 256 };
+
+    BlitQueue();
+    // waits for what is queued
+    ~BlitQueue();
+
+    // the token of list, which is blitted by blitter, or -errno
+    int submit(Blitter* blitter, mdp_blit_req_list const* list);
+    // Waits until token is done, at once for 0. Returns 0, or the -errno
+    // of the blit it was part of if that failed and it's the last failure.
+    int wait(int token);
+    // like wait() if token is done, -EAGAIN if it isn't yet
+    int poll(int token);
+    // the token of the last list submitted, 0 before any
+    int last();
+
+    void dump(char* buff, int buff_len);
+
+ private:
+
+    struct segment_t {
+        Blitter*    blitter;
+        uint32_t    count;
+        int         token;
+    };
+
+    static void* thread(void* data);
+    void loop();
+    bool done(int token) const;
+    int status(int token) const;
+
+    pthread_mutex_t     mLock;
+    pthread_cond_t      mQueued;    // something queued, or quitting
+    pthread_cond_t      mDone;      // some tokens done, room in the queue
+    pthread_t           mThread;
+    bool                mRunning;
+    bool                mQuit;
+
+    // the lists queued, their requests back to back in mPending
+    segment_t*          mSegments;
+    uint32_t            mSegmentCount;
+    uint32_t            mSegmentCapacity;
+    mdp_blit_req*       mPending;
+    uint32_t            mPendingCount;
+    uint32_t            mPendingCapacity;
+    // what the thread is blitting, out of the lock
+    mdp_blit_req_list*  mBatch;
+    uint32_t            mBatchCapacity;
+
+    // tokens count on 31 bits and wrap, skipping 0
+    uint32_t            mLastToken;
+    uint32_t            mDoneToken;
+    // the tokens of the last batch that failed, and how
+    uint32_t            mErrorFirst;
+    uint32_t            mErrorLast;
+    int                 mError;
+
+    // submissions and the batches they were blitted in
+    uint32_t            mSubmits;
+    uint32_t            mBatches;
+    // requests queued when submitting, summed and the most
+    uint64_t            mDepthSum;
+    uint32_t            mMaxDepth;
+    // calls to wait() that had to block, and for how long in ns
+    uint32_t            mWaits;
+    int64_t             mWaitTime;
+    int64_t             mMaxWait;
+};
+
+#endif  // COPYBIT_MSM7K_BLITQUEUE_H
@@ -0,0 +1,563 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "copybit"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include <linux/android_pmem.h>
+
+#include "blitter.h"
+
+
+static int64_t now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+Blitter::Blitter()
+    : mLists(0), mRequests(0), mPixels(0), mTime(0)
+{
+}
+
+int Blitter::blit(mdp_blit_req_list const* list)
+{
+    int64_t start = now();
+    int err = doBlit(list);
+    mTime += now() - start;
+    mLists++;
+    mRequests += list->count;
+    for (uint32_t i=0 ; i<list->count ; i++) {
+        mPixels += uint64_t(list->req[i].dst_rect.w) * list->req[i].dst_rect.h;
+    }
+    return err;
+}
+
+void Blitter::dump(char* buff, int buff_len) const
+{
+    double seconds = mTime / 1e9;
+    snprintf(buff, buff_len,
+            "    %s blitter: %u lists, %u requests (%.2f per list), "
+            "%llu pixels in %lld us (%.1f Mpixel/s)\n",
+            name(), mLists, mRequests,
+            mLists ? float(mRequests) / mLists : 0.0f,
+            (unsigned long long)mPixels,
+            (long long)(mTime / 1000),
+            seconds > 0 ? mPixels / seconds / 1e6 : 0.0);
+}
+
+Blitter* Blitter::create(int fd)
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.mdp.blitter", value, "mdp");
+    if (!strcmp(value, "soft")) {
+        LOGI("using the software MDP for blits");
+        return new SoftwareBlitter();
+    }
+    return new MdpBlitter(fd);
+}
+
+/*****************************************************************************/
+
+MdpBlitter::MdpBlitter(int fd)
+    : mFD(fd)
+{
+}
+
+int MdpBlitter::doBlit(mdp_blit_req_list const* list)
+{
+    if (ioctl(mFD, MSMFB_BLIT, list) < 0)
+        return -errno;
+    return 0;
+}
+
+/*****************************************************************************/
+
+// A pixel on its way through the blit, 8 bits per channel, either R, G, B
+// or Y, Cb, Cr depending on the destination.
+struct texel_t {
+    int c[3];
+    int a;
+};
+
+struct image_t {
+    uint8_t* base;
+    uint32_t format;
+    uint32_t w;
+    uint32_t h;
+};
+
+static inline int clamp(int v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+static inline int expand5(int v) { return (v << 3) | (v >> 2); }
+static inline int expand6(int v) { return (v << 2) | (v >> 4); }
+
+static bool isYuv(uint32_t format)
+{
+    switch (format) {
+        case MDP_Y_CBCR_H2V2:
+        case MDP_Y_CRCB_H2V2:
+        case MDP_Y_CBCR_H2V1:
+        case MDP_Y_CRCB_H2V1:
+        case MDP_YCRYCB_H2V1:
+            return true;
+    }
+    return false;
+}
+
+static bool hasAlpha(uint32_t format)
+{
+    switch (format) {
+        case MDP_ARGB_8888:
+        case MDP_RGBA_8888:
+        case MDP_BGRA_8888:
+            return true;
+    }
+    return false;
+}
+
+// bytes per pixel of the RGB formats
+static int getBpp(uint32_t format)
+{
+    switch (format) {
+        case MDP_RGB_565:
+        case MDP_BGR_565:
+            return 2;
+        case MDP_RGB_888:
+            return 3;
+        case MDP_XRGB_8888:
+        case MDP_ARGB_8888:
+        case MDP_RGBA_8888:
+        case MDP_BGRA_8888:
+        case MDP_RGBX_8888:
+            return 4;
+    }
+    return 0;
+}
+
+// the chroma rows are shared by two lines in the H2V2 formats
+static inline int chromaShift(uint32_t format)
+{
+    return (format == MDP_Y_CBCR_H2V2 || format == MDP_Y_CRCB_H2V2) ? 1 : 0;
+}
+
+// the chroma that goes first in memory is Cr
+static inline bool crFirst(uint32_t format)
+{
+    return format == MDP_Y_CBCR_H2V2 || format == MDP_Y_CBCR_H2V1;
+}
+
+size_t SoftwareBlitter::getImageSize(uint32_t format, uint32_t w, uint32_t h)
+{
+    size_t ew = (w + 1) & ~1;
+    switch (format) {
+        case MDP_Y_CBCR_H2V2:
+        case MDP_Y_CRCB_H2V2:
+            return size_t(w) * h + ew * ((h + 1) / 2);
+        case MDP_Y_CBCR_H2V1:
+        case MDP_Y_CRCB_H2V1:
+            return size_t(w) * h + ew * h;
+        case MDP_YCRYCB_H2V1:
+            return ew * 2 * h;
+    }
+    return size_t(getBpp(format)) * w * h;
+}
+
+static void rgbToYuv(texel_t* t)
+{
+    int r = t->c[0], g = t->c[1], b = t->c[2];
+    t->c[0] = ((  66*r + 129*g +  25*b + 128) >> 8) +  16;
+    t->c[1] = (( -38*r -  74*g + 112*b + 128) >> 8) + 128;
+    t->c[2] = (( 112*r -  94*g -  18*b + 128) >> 8) + 128;
+}
+
+static void yuvToRgb(texel_t* t)
+{
+    int y = 298 * (t->c[0] - 16);
+    int u = t->c[1] - 128;
+    int v = t->c[2] - 128;
+    t->c[0] = clamp((y           + 409*v + 128) >> 8);
+    t->c[1] = clamp((y - 100*u   - 208*v + 128) >> 8);
+    t->c[2] = clamp((y + 516*u           + 128) >> 8);
+}
+
+static texel_t fetch(image_t const& img, uint32_t x, uint32_t y, bool yuv)
+{
+    texel_t t;
+    t.a = 255;
+    if (isYuv(img.format)) {
+        uint8_t const* c;
+        size_t ew = (img.w + 1) & ~1;
+        if (img.format == MDP_YCRYCB_H2V1) {
+            uint8_t const* p = img.base + y * ew * 2 + (x & ~1) * 2;
+            t.c[0] = p[(x & 1) * 2];
+            t.c[1] = p[3];
+            t.c[2] = p[1];
+        } else {
+            t.c[0] = img.base[y * img.w + x];
+            c = img.base + img.w * img.h +
+                    (y >> chromaShift(img.format)) * ew + (x & ~1);
+            t.c[1] = crFirst(img.format) ? c[1] : c[0];
+            t.c[2] = crFirst(img.format) ? c[0] : c[1];
+        }
+        if (!yuv) yuvToRgb(&t);
+        return t;
+    }
+
+    uint8_t const* p = img.base + (size_t(y) * img.w + x) * getBpp(img.format);
+    switch (img.format) {
+        case MDP_RGB_565:
+        case MDP_BGR_565: {
+            int v = p[0] | (p[1] << 8);
+            int hi = expand5(v >> 11), lo = expand5(v & 0x1f);
+            t.c[0] = img.format == MDP_RGB_565 ? hi : lo;
+            t.c[1] = expand6((v >> 5) & 0x3f);
+            t.c[2] = img.format == MDP_RGB_565 ? lo : hi;
+            break;
+        }
+        case MDP_RGB_888:
+        case MDP_RGBX_8888:
+        case MDP_RGBA_8888:
+            t.c[0] = p[0]; t.c[1] = p[1]; t.c[2] = p[2];
+            if (img.format == MDP_RGBA_8888) t.a = p[3];
+            break;
+        case MDP_XRGB_8888:
+        case MDP_ARGB_8888:
+        case MDP_BGRA_8888:
+            t.c[0] = p[2]; t.c[1] = p[1]; t.c[2] = p[0];
+            if (img.format != MDP_XRGB_8888) t.a = p[3];
+            break;
+    }
+    if (yuv) rgbToYuv(&t);
+    return t;
+}
+
+const uint8_t SoftwareBlitter::sDither[4][4] = {
+    {  0,  8,  2, 10 },
+    { 12,  4, 14,  6 },
+    {  3, 11,  1,  9 },
+    { 15,  7, 13,  5 },
+};
+
+static void storeRgb(image_t const& img, uint32_t x, uint32_t y,
+        texel_t const& t, bool dither)
+{
+    uint8_t* p = img.base + (size_t(y) * img.w + x) * getBpp(img.format);
+    switch (img.format) {
+        case MDP_RGB_565:
+        case MDP_BGR_565: {
+            int r = t.c[0], g = t.c[1], b = t.c[2];
+            if (dither) {
+                int d = SoftwareBlitter::sDither[y & 3][x & 3];
+                r = clamp(r + (d >> 1));
+                g = clamp(g + (d >> 2));
+                b = clamp(b + (d >> 1));
+            }
+            if (img.format == MDP_BGR_565) {
+                int tmp = r; r = b; b = tmp;
+            }
+            int v = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+            p[0] = v;
+            p[1] = v >> 8;
+            break;
+        }
+        case MDP_RGB_888:
+        case MDP_RGBX_8888:
+        case MDP_RGBA_8888:
+            p[0] = t.c[0]; p[1] = t.c[1]; p[2] = t.c[2];
+            if (img.format != MDP_RGB_888) p[3] = t.a;
+            break;
+        case MDP_XRGB_8888:
+        case MDP_ARGB_8888:
+        case MDP_BGRA_8888:
+            p[0] = t.c[2]; p[1] = t.c[1]; p[2] = t.c[0]; p[3] = t.a;
+            break;
+    }
+}
+
+static void storeLuma(image_t const& img, uint32_t x, uint32_t y, int luma)
+{
+    if (img.format == MDP_YCRYCB_H2V1) {
+        size_t ew = (img.w + 1) & ~1;
+        img.base[y * ew * 2 + x * 2] = luma;
+    } else {
+        img.base[y * img.w + x] = luma;
+    }
+}
+
+// cx is in chroma samples, y in lines
+static void storeChroma(image_t const& img, uint32_t cx, uint32_t y,
+        int cb, int cr)
+{
+    size_t ew = (img.w + 1) & ~1;
+    if (img.format == MDP_YCRYCB_H2V1) {
+        uint8_t* p = img.base + y * ew * 2 + cx * 4;
+        p[1] = cr;
+        p[3] = cb;
+    } else {
+        uint8_t* p = img.base + img.w * img.h +
+                (y >> chromaShift(img.format)) * ew + cx * 2;
+        p[0] = crFirst(img.format) ? cr : cb;
+        p[1] = crFirst(img.format) ? cb : cr;
+    }
+}
+
+static uint32_t keyOf(image_t const& img, uint32_t x, uint32_t y)
+{
+    if (img.format == MDP_RGB_565 || img.format == MDP_BGR_565) {
+        uint8_t const* p = img.base + (size_t(y) * img.w + x) * 2;
+        return p[0] | (p[1] << 8);
+    }
+    texel_t t = fetch(img, x, y, false);
+    return (t.c[0] << 16) | (t.c[1] << 8) | t.c[2];
+}
+
+// Bilinear sample at fx, fy, 16.16 and relative to the source rectangle
+// of sw x sh pixels at sx, sy.
+static texel_t sample(image_t const& img, uint32_t sx, uint32_t sy,
+        uint32_t sw, uint32_t sh, int32_t fx, int32_t fy, bool yuv)
+{
+    uint32_t x0 = fx >> 16, y0 = fy >> 16;
+    int wx = (fx & 0xffff) >> 8, wy = (fy & 0xffff) >> 8;
+    texel_t t = fetch(img, sx + x0, sy + y0, yuv);
+    if (!wx && !wy)
+        return t;
+
+    uint32_t x1 = x0 + 1 < sw ? x0 + 1 : x0;
+    uint32_t y1 = y0 + 1 < sh ? y0 + 1 : y0;
+    texel_t tr = fetch(img, sx + x1, sy + y0, yuv);
+    texel_t bl = fetch(img, sx + x0, sy + y1, yuv);
+    texel_t br = fetch(img, sx + x1, sy + y1, yuv);
+    int* out[4] = { &t.c[0], &t.c[1], &t.c[2], &t.a };
+    int const* in[4][3] = {
+        { &tr.c[0], &bl.c[0], &br.c[0] },
+        { &tr.c[1], &bl.c[1], &br.c[1] },
+        { &tr.c[2], &bl.c[2], &br.c[2] },
+        { &tr.a,    &bl.a,    &br.a    },
+    };
+    for (int i=0 ; i<4 ; i++) {
+        int top = *out[i] * (256 - wx) + *in[i][0] * wx;
+        int bottom = *in[i][1] * (256 - wx) + *in[i][2] * wx;
+        *out[i] = (top * (256 - wy) + bottom * wy + (1 << 15)) >> 16;
+    }
+    return t;
+}
+
+// 16.16 position in a source span of s pixels of the center of pixel i of
+// a destination span of d pixels, clamped to the span
+static inline int32_t mapCenter(uint32_t i, uint32_t s, uint32_t d)
+{
+    int64_t f = ((int64_t(2 * i + 1) * s) << 16) / (2 * d) - 0x8000;
+    if (f < 0) f = 0;
+    if (f > int64_t(s - 1) << 16) f = int64_t(s - 1) << 16;
+    return int32_t(f);
+}
+
+static texel_t blend(texel_t const& s, texel_t const& d, int plane,
+        bool premult)
+{
+    texel_t t;
+    int a = (s.a * plane + 127) / 255;
+    for (int i=0 ; i<3 ; i++) {
+        if (premult) {
+            t.c[i] = clamp((s.c[i] * plane + d.c[i] * (255 - a) + 127) / 255);
+        } else {
+            t.c[i] = (s.c[i] * a + d.c[i] * (255 - a) + 127) / 255;
+        }
+    }
+    t.a = a + (d.a * (255 - a) + 127) / 255;
+    return t;
+}
+
+static bool fits(mdp_img const& img, mdp_rect const& r)
+{
+    return r.w && r.h && r.x <= img.width && r.w <= img.width - r.x &&
+            r.y <= img.height && r.h <= img.height - r.y;
+}
+
+SoftwareBlitter::SoftwareBlitter()
+{
+}
+
+int SoftwareBlitter::doBlit(mdp_blit_req_list const* list)
+{
+    for (uint32_t i=0 ; i<list->count ; i++) {
+        int err = blitOne(&list->req[i]);
+        if (err < 0) {
+            return err;
+        }
+    }
+    return 0;
+}
+
+int SoftwareBlitter::blitOne(mdp_blit_req const* req)
+{
+    if (req->flags & MDP_NO_BLIT)
+        return 0;
+
+    size_t srcSize = getImageSize(req->src.format,
+            req->src.width, req->src.height);
+    size_t dstSize = getImageSize(req->dst.format,
+            req->dst.width, req->dst.height);
+    if (!srcSize || !dstSize)
+        return -EINVAL;
+    if (req->src.width > kMaxDimension || req->src.height > kMaxDimension ||
+        req->dst.width > kMaxDimension || req->dst.height > kMaxDimension)
+        return -EINVAL;
+    if (!fits(req->src, req->src_rect) || !fits(req->dst, req->dst_rect))
+        return -EINVAL;
+
+    // the destination spans along the source's x and y axes
+    const bool rot90 = req->flags & MDP_ROT_90;
+    const uint32_t sw = req->src_rect.w, sh = req->src_rect.h;
+    const uint32_t dw = req->dst_rect.w, dh = req->dst_rect.h;
+    const uint32_t aw = rot90 ? dh : dw;
+    const uint32_t ah = rot90 ? dw : dh;
+    if (sw > aw * kMaxScale || aw > sw * kMaxScale ||
+        sh > ah * kMaxScale || ah > sh * kMaxScale)
+        return -EINVAL;
+
+    image_t src = { 0, req->src.format, req->src.width, req->src.height };
+    image_t dst = { 0, req->dst.format, req->dst.width, req->dst.height };
+    src.base = map(req->src, srcSize);
+    dst.base = map(req->dst, dstSize);
+    if (!src.base || !dst.base) {
+        if (src.base) unmap(req->src, src.base, srcSize);
+        if (dst.base) unmap(req->dst, dst.base, dstSize);
+        return -ENOMEM;
+    }
+
+    const bool yuv = isYuv(dst.format);
+    const int plane = req->alpha > 0xff ? 0xff : req->alpha;
+    const bool opaque = plane == 0xff && !hasAlpha(src.format);
+    const bool premult = (req->flags & MDP_BLEND_FG_PREMULT) && !yuv;
+    const bool dither = req->flags & MDP_DITHER;
+    const bool keyed = req->transp_mask != MDP_TRANSP_NOP;
+
+    // chroma sums of the line(s) in progress, per destination chroma sample
+    const uint32_t cx0 = req->dst_rect.x >> 1;
+    const uint32_t cn = ((req->dst_rect.x + dw - 1) >> 1) - cx0 + 1;
+    int* chroma = 0;
+    if (yuv) {
+        chroma = (int*)calloc(cn * 3, sizeof(int));
+        if (!chroma) {
+            unmap(req->src, src.base, srcSize);
+            unmap(req->dst, dst.base, dstSize);
+            return -ENOMEM;
+        }
+    }
+
+    for (uint32_t v=0 ; v<dh ; v++) {
+        const uint32_t y = req->dst_rect.y + v;
+        for (uint32_t u=0 ; u<dw ; u++) {
+            const uint32_t x = req->dst_rect.x + u;
+            int32_t fx = rot90 ? mapCenter(v, sw, aw) : mapCenter(u, sw, aw);
+            int32_t fy = rot90 ? mapCenter(dw - 1 - u, sh, ah) :
+                    mapCenter(v, sh, ah);
+            if (req->flags & MDP_FLIP_LR) fx = ((sw - 1) << 16) - fx;
+            if (req->flags & MDP_FLIP_UD) fy = ((sh - 1) << 16) - fy;
+
+            if (keyed) {
+                uint32_t nx = (fx + 0x8000) >> 16, ny = (fy + 0x8000) >> 16;
+                if (nx >= sw) nx = sw - 1;
+                if (ny >= sh) ny = sh - 1;
+                if (keyOf(src, req->src_rect.x + nx, req->src_rect.y + ny) ==
+                        req->transp_mask)
+                    continue;
+            }
+
+            texel_t t = sample(src, req->src_rect.x, req->src_rect.y,
+                    sw, sh, fx, fy, yuv);
+            if (!opaque) {
+                t = blend(t, fetch(dst, x, y, yuv), plane, premult);
+            }
+            if (yuv) {
+                int* c = chroma + ((x >> 1) - cx0) * 3;
+                storeLuma(dst, x, y, t.c[0]);
+                c[0] += t.c[1];
+                c[1] += t.c[2];
+                c[2]++;
+            } else {
+                storeRgb(dst, x, y, t, dither);
+            }
+        }
+
+        // write the chroma once all the lines sharing it are done
+        const uint32_t lines = 1 << chromaShift(dst.format);
+        if (yuv && (v == dh - 1 || ((y + 1) & (lines - 1)) == 0)) {
+            for (uint32_t i=0 ; i<cn ; i++) {
+                int* c = chroma + i * 3;
+                if (c[2]) {
+                    storeChroma(dst, cx0 + i, y,
+                            (c[0] + c[2] / 2) / c[2], (c[1] + c[2] / 2) / c[2]);
+                }
+                c[0] = c[1] = c[2] = 0;
+            }
+        }
+    }
+
+    free(chroma);
+    flush(req->dst, dst.base, dstSize);
+    unmap(req->src, src.base, srcSize);
+    unmap(req->dst, dst.base, dstSize);
+    return 0;
+}
+
+uint8_t* SoftwareBlitter::map(mdp_img const& img, size_t size)
+{
+    size_t page = getpagesize();
+    size_t delta = img.offset & (page - 1);
+    void* base = mmap(0, size + delta, PROT_READ|PROT_WRITE, MAP_SHARED,
+            img.memory_id, img.offset - delta);
+    if (base == MAP_FAILED) {
+        LOGE("can't map memory_id %d at %u (%s)", img.memory_id, img.offset,
+                strerror(errno));
+        return 0;
+    }
+    return (uint8_t*)base + delta;
+}
+
+void SoftwareBlitter::unmap(mdp_img const& img, uint8_t* base, size_t size)
+{
+    size_t delta = img.offset & (getpagesize() - 1);
+    munmap(base - delta, size + delta);
+}
+
+void SoftwareBlitter::flush(mdp_img const& img, uint8_t* base, size_t size)
+{
+    // fails harmlessly for the framebuffer, which isn't cached
+    struct pmem_addr pmem_addr;
+    pmem_addr.vaddr = (unsigned long)base;
+    pmem_addr.offset = img.offset;
+    pmem_addr.length = size;
+    ioctl(img.memory_id, PMEM_CLEAN_CACHES, &pmem_addr);
+}
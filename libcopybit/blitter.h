@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COPYBIT_MSM7K_BLITTER_H
+#define COPYBIT_MSM7K_BLITTER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "msm_mdp.h"
+
+
+/*
+ * Executes lists of mdp_blit_req. copybit, the framebuffer and the camera
+ * go through a Blitter rather than issuing MSMFB_BLIT themselves, so the
+ * software MDP below can stand in for the hardware, off-device or when
+ * debug.mdp.blitter is set to "soft".
+ *
+ * Every blit is counted and timed, dump() gives the throughput.
+ */
+class Blitter {
+
+ public:
+
+    virtual ~Blitter() {}
+
+    // returns 0 or -errno, the requests after a failed one aren't done
+    int blit(mdp_blit_req_list const* list);
+
+    uint32_t lists() const      { return mLists; }
+    uint32_t requests() const   { return mRequests; }
+    uint64_t pixels() const     { return mPixels; }
+    // ns spent in blit()
+    int64_t time() const        { return mTime; }
+
+    void dump(char* buff, int buff_len) const;
+
+    // The MDP, using fd for MSMFB_BLIT, or the software MDP if so set.
+    // The caller keeps ownership of fd.
+    static Blitter* create(int fd);
+
+ protected:
+
+    Blitter();
+
+    virtual const char* name() const = 0;
+    virtual int doBlit(mdp_blit_req_list const* list) = 0;
+
+ private:
+
+    uint32_t    mLists;
+    uint32_t    mRequests;
+    uint64_t    mPixels;
+    int64_t     mTime;
+};
+
+/*****************************************************************************/
+
+// Forwards to the MSMFB_BLIT ioctl.
+class MdpBlitter : public Blitter {
+
+ public:
+
+    MdpBlitter(int fd);
+
+ protected:
+
+    virtual const char* name() const { return "mdp"; }
+    virtual int doBlit(mdp_blit_req_list const* list);
+
+ private:
+
+    int mFD;
+};
+
+/*****************************************************************************/
+
+/*
+ * A reference implementation of the MDP 3.1 PPP blits, slow but exact
+ * enough to check the hardware and the code building requests against:
+ *
+ *  - all the MDP_IMGTYPE formats and MDP_BGR_565. The RGB formats are
+ *    named after their bytes in memory, except XRGB/ARGB_8888 which are
+ *    0xAARRGGBB words. In the pseudo planar formats the chroma named first
+ *    is in the MSB, i.e. Y_CBCR is NV21. YUV is BT.601, video range.
+ *  - scaling by up to kMaxScale either way, bilinear, with pixel centers
+ *    mapped onto each other.
+ *  - MDP_FLIP_LR/UD of the source, then MDP_ROT_90 clockwise.
+ *  - plane alpha, per-pixel alpha of the ARGB, RGBA and BGRA sources,
+ *    MDP_BLEND_FG_PREMULT.
+ *  - transp_mask, compared against the nearest source pixel as 0xRRGGBB,
+ *    or as the raw value for the 565 formats.
+ *  - MDP_DITHER with a 4x4 ordered dither, when writing 565.
+ *
+ * Images are found by their memory_id and offset, see map().
+ */
+class SoftwareBlitter : public Blitter {
+
+ public:
+
+    enum {
+        kMaxScale       = 4,
+        kMaxDimension   = 4096,
+    };
+
+    SoftwareBlitter();
+
+    // bytes used by an image of that format and size, 0 if unknown
+    static size_t getImageSize(uint32_t format, uint32_t w, uint32_t h);
+
+    // the ordered dither thresholds, 0 to 15, by y & 3 and x & 3
+    static const uint8_t sDither[4][4];
+
+ protected:
+
+    virtual const char* name() const { return "software"; }
+    virtual int doBlit(mdp_blit_req_list const* list);
+
+    // Maps size bytes of img, starting at img.offset of img.memory_id.
+    // By default the fd is mmap()ed, which works for pmem and the
+    // framebuffer alike. NULL if that fails.
+    virtual uint8_t* map(mdp_img const& img, size_t size);
+    virtual void unmap(mdp_img const& img, uint8_t* base, size_t size);
+    // Makes what the CPU wrote to a mapped image visible to the hardware,
+    // by cleaning the caches if it's pmem.
+    virtual void flush(mdp_img const& img, uint8_t* base, size_t size);
+
+    int blitOne(mdp_blit_req const* req);
+};
+
+#endif  // COPYBIT_MSM7K_BLITTER_H
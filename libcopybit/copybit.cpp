@@ -18,11 +18,13 @@
 #define LOG_TAG "copybit"
 
 #include <cutils/log.h>
+#include <cutils/properties.h>
 
 #include "msm_mdp.h"
 #include <linux/fb.h>
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
@@ -35,6 +37,12 @@
 #include <hardware/copybit.h>
 
 #include "gralloc_priv.h"
+#include "blitter.h"
+#include "blitqueue.h"
+#include "copybit_priv.h"
+#include "cpublit.h"
+#include "region.h"
+#include "tiler.h"
 
 #define DEBUG_MDP_ERRORS 1
 
@@ -56,8 +64,27 @@
 struct copybit_context_t {
     struct copybit_device_t device;
     int     mFD;
+    Blitter* mBlitter;
+    Blitter* mCpuBlitter;
+    // the blits in flight in COPYBIT_ASYNC mode, NULL otherwise
+    BlitQueue* mQueue;
     uint8_t mAlpha;
     uint8_t mFlags;
+    // the clip rects and the requests of a stretch, grown as needed
+    struct mdp_rect* mRects;
+    uint32_t mRectCapacity;
+    struct mdp_blit_req_list* mList;
+    uint32_t mListCapacity;
+    // pmem for the intermediate image of two pass blits, or -1
+    int mTmpFd;
+    void* mTmpBase;
+    size_t mTmpSize;
+    // stretches, the clip rects they came with and the requests issued,
+    // logged every mStatsInterval stretches if debug.copybit.stats is set
+    uint32_t mStretches;
+    uint32_t mClips;
+    uint32_t mRequests;
+    uint32_t mStatsInterval;
 };
 
 /**
@@ -195,6 +222,78 @@ static void set_rects(struct copybit_context_t *dev,
     }
 }
 
+/** grow *array, of header bytes then items of size, to at least count items */
+static int reserve(void** array, uint32_t* capacity, uint32_t count,
+        size_t header, size_t size)
+{
+    if (count <= *capacity)
+        return 0;
+    uint32_t n = *capacity ? *capacity * 2 : 16;
+    while (n < count)
+        n *= 2;
+    void* p = realloc(*array, header + n * size);
+    if (!p)
+        return -ENOMEM;
+    *array = p;
+    *capacity = n;
+    return 0;
+}
+
+/** make the intermediate image of two pass blits at least size bytes */
+static int reserve_tmp(struct copybit_context_t *dev, size_t size)
+{
+    if (size <= dev->mTmpSize)
+        return 0;
+    if (dev->mQueue) {
+        // queued blits may go through the old one
+        dev->mQueue->wait(dev->mQueue->last());
+    }
+    if (dev->mTmpFd >= 0) {
+        munmap(dev->mTmpBase, dev->mTmpSize);
+        close(dev->mTmpFd);
+        dev->mTmpFd = -1;
+        dev->mTmpSize = 0;
+    }
+    size_t page = getpagesize();
+    size = (size + page - 1) & ~(page - 1);
+    // pmem_adsp allocates what each open() maps
+    int fd = open("/dev/pmem_adsp", O_RDWR, 0);
+    if (fd < 0) {
+        LOGE("can't open pmem for two pass blits (%s)", strerror(errno));
+        return -errno;
+    }
+    void* base = mmap(0, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        LOGE("can't allocate %u bytes of pmem for two pass blits (%s)",
+                (unsigned)size, strerror(errno));
+        close(fd);
+        return -ENOMEM;
+    }
+    dev->mTmpFd = fd;
+    dev->mTmpBase = base;
+    dev->mTmpSize = size;
+    return 0;
+}
+
+/** whether format has its chroma in a plane of its own */
+static bool is_planar(int format) {
+    return format == COPYBIT_FORMAT_YCrCb_420_SP ||
+           format == COPYBIT_FORMAT_YCbCr_422_SP;
+}
+
+/** log the batching of the stretches so far */
+static void dump_stats(struct copybit_context_t *dev)
+{
+    LOGI("%u stretches: %u clip rects, %u requests (%.2f per stretch)",
+            dev->mStretches, dev->mClips, dev->mRequests,
+            dev->mStretches ? float(dev->mRequests) / dev->mStretches : 0.0f);
+    if (dev->mQueue) {
+        char buff[256];
+        dev->mQueue->dump(buff, sizeof(buff));
+        LOGI("%s", buff);
+    }
+}
+
 /** setup mdp request */
 static void set_infos(struct copybit_context_t *dev, struct mdp_blit_req *req) {
     req->alpha = dev->mAlpha;
@@ -203,11 +302,11 @@ static void set_infos(struct copybit_context_t *dev, struct mdp_blit_req *req) {
 }
 
 /** copy the bits */
-static int msm_copybit(struct copybit_context_t *dev, void const *list) 
+static int msm_copybit(struct copybit_context_t *dev, Blitter* blitter,
+        void const *list) 
 {
-    int err = ioctl(dev->mFD, MSMFB_BLIT,
-                    (struct mdp_blit_req_list const*)list);
-    LOGE_IF(err<0, "copyBits failed (%s)", strerror(errno));
+    int err = blitter->blit((struct mdp_blit_req_list const*)list);
+    LOGE_IF(err<0, "copyBits failed (%s)", strerror(-err));
     if (err == 0) {
         return 0;
     } else {
@@ -237,7 +336,7 @@ static int msm_copybit(struct copybit_context_t *dev, void const *list)
             );
         }
 #endif
-        return -errno;
+        return err;
     }
 }
 
@@ -301,6 +400,22 @@ static int set_parameter_copybit(
             ctx->mFlags &= ~0x7;
             ctx->mFlags |= value & 0x7;
             break;
+        case COPYBIT_ASYNC:
+            if (value == COPYBIT_ENABLE) {
+                if (!ctx->mQueue)
+                    ctx->mQueue = new BlitQueue();
+            } else if (value == COPYBIT_DISABLE) {
+                // waits for what is queued
+                delete ctx->mQueue;
+                ctx->mQueue = 0;
+            }
+            break;
+        case COPYBIT_WAIT:
+            status = ctx->mQueue ? ctx->mQueue->wait(value) : 0;
+            break;
+        case COPYBIT_POLL:
+            status = ctx->mQueue ? ctx->mQueue->poll(value) : 0;
+            break;
         default:
             status = -EINVAL;
             break;
@@ -319,10 +434,11 @@ static int get(struct copybit_device_t *dev, int name)
     if (ctx) {
         switch(name) {
         case COPYBIT_MINIFICATION_LIMIT:
-            value = MAX_SCALE_FACTOR;
+            // up to the square of MAX_SCALE_FACTOR, in two passes
+            value = MAX_SCALE_FACTOR * MAX_SCALE_FACTOR;
             break;
         case COPYBIT_MAGNIFICATION_LIMIT:
-            value = MAX_SCALE_FACTOR;
+            value = MAX_SCALE_FACTOR * MAX_SCALE_FACTOR;
             break;
         case COPYBIT_SCALING_FRAC_BITS:
             value = 32;
@@ -330,6 +446,9 @@ static int get(struct copybit_device_t *dev, int name)
         case COPYBIT_ROTATION_STEP_DEG:
             value = 90;
             break;
+        case COPYBIT_LAST_TOKEN:
+            value = ctx->mQueue ? ctx->mQueue->last() : 0;
+            break;
         default:
             value = -EINVAL;
         }
@@ -351,16 +470,15 @@ static int stretch_copybit(
     struct copybit_context_t* ctx = (struct copybit_context_t*)dev;
     int status = 0;
     if (ctx) {
-        struct {
-            uint32_t count;
-            struct mdp_blit_req req[12];
-        } list;
-
+        // what the MDP can't do is left to the CPU
+        Blitter* blitter = ctx->mBlitter;
         if (ctx->mAlpha < 255) {
             switch (src->format) {
-                // we don't support plane alpha with RGBA formats
+                // the MDP doesn't support plane alpha with RGBA formats
                 case COPYBIT_FORMAT_RGBA_8888:
                 case COPYBIT_FORMAT_BGRA_8888:
+                    blitter = ctx->mCpuBlitter;
+                    break;
                 case COPYBIT_FORMAT_RGBA_5551:
                 case COPYBIT_FORMAT_RGBA_4444:
                     return -EINVAL;
@@ -373,38 +491,153 @@ static int stretch_copybit(
             return -EINVAL;
         }
 
-        if (src->w > MAX_DIMENSION || src->h > MAX_DIMENSION)
-            return -EINVAL;
+        // Images taller than the MDP takes are done by bands of rows, but
+        // the width is the stride and can't be cut, and the chroma plane
+        // is found from the height. Scaling by more than the MDP does is
+        // done in two passes, up to its square.
+        const bool tall = src->h > MAX_DIMENSION || dst->h > MAX_DIMENSION;
+        if (src->w > MAX_DIMENSION || dst->w > MAX_DIMENSION ||
+            (tall && (is_planar(src->format) || is_planar(dst->format)))) {
+            blitter = ctx->mCpuBlitter;
+        }
+        const bool rot90 = ctx->mFlags & COPYBIT_TRANSFORM_ROT_90;
+        struct mdp_blit_req whole;
+        whole.flags = rot90 ? MDP_ROT_90 : 0;
+        whole.src_rect.w = src_rect->r - src_rect->l;
+        whole.src_rect.h = src_rect->b - src_rect->t;
+        whole.dst_rect.w = dst_rect->r - dst_rect->l;
+        whole.dst_rect.h = dst_rect->b - dst_rect->t;
+        if (!fits_scale(&whole, MAX_SCALE_FACTOR * MAX_SCALE_FACTOR)) {
+            blitter = ctx->mCpuBlitter;
+        }
 
-        if (dst->w > MAX_DIMENSION || dst->h > MAX_DIMENSION)
-            return -EINVAL;
+        // With the MDP, the clip rects are cut into tiles short enough
+        // for a band of both images to fit it. Each tile is mapped by
+        // set_rects() like a clip rect, from the whole rectangles.
+        uint32_t tw = dst->w, th = dst->h;
+        if (tall && blitter == ctx->mBlitter && whole.src_rect.h) {
+            // the destination's extent along the source's rows
+            uint32_t along = rot90 ? whole.dst_rect.w : whole.dst_rect.h;
+            uint32_t n = uint64_t(MAX_DIMENSION) * along / whole.src_rect.h;
+            n = max(1, min(n, MAX_DIMENSION));
+            if (rot90) {
+                tw = n;
+                th = MAX_DIMENSION;
+            } else {
+                th = n;
+            }
+        }
 
-        const uint32_t maxCount = sizeof(list.req)/sizeof(list.req[0]);
+        // the visible part of each clip rect, merged with its neighbours
+        // so a region made of strips costs a request rather than one each
         const struct copybit_rect_t bounds = { 0, 0, dst->w, dst->h };
         struct copybit_rect_t clip;
-        list.count = 0;
-        status = 0;
-        while ((status == 0) && region->next(region, &clip)) {
+        uint32_t count = 0;
+        while (region->next(region, &clip)) {
+            ctx->mClips++;
             intersect(&clip, &bounds, &clip);
-            mdp_blit_req* req = &list.req[list.count];
-            set_infos(ctx, req);
-            set_image(&req->dst, dst);
-            set_image(&req->src, src);
-            set_rects(ctx, req, dst_rect, src_rect, &clip);
-
-            if (req->src_rect.w<=0 || req->src_rect.h<=0)
-                continue;
-
-            if (req->dst_rect.w<=0 || req->dst_rect.h<=0)
+            intersect(&clip, dst_rect, &clip);
+            if (clip.r <= clip.l || clip.b <= clip.t)
                 continue;
-
-            if (++list.count == maxCount) {
-                status = msm_copybit(ctx, &list);
-                list.count = 0;
+            status = reserve((void**)&ctx->mRects, &ctx->mRectCapacity,
+                    count + 1, 0, sizeof(struct mdp_rect));
+            if (status < 0)
+                return status;
+            struct mdp_rect* r = &ctx->mRects[count++];
+            r->x = clip.l;
+            r->y = clip.t;
+            r->w = clip.r - clip.l;
+            r->h = clip.b - clip.t;
+        }
+        count = coalesce_rects(ctx->mRects, count);
+
+        // All in one MSMFB_BLIT. The two pass tiles share one intermediate
+        // image, which growing would close under the requests naming it, so
+        // the tiles are walked once to size it and once to build the list.
+        struct mdp_blit_req_list* list = 0;
+        size_t tmpSize = 0;
+        for (int build=0 ; build<2 ; build++) {
+            if (build) {
+                if (tmpSize) {
+                    status = reserve_tmp(ctx, tmpSize);
+                    if (status < 0)
+                        return status;
+                }
+                status = reserve((void**)&ctx->mList, &ctx->mListCapacity,
+                        count, sizeof(struct mdp_blit_req_list),
+                        sizeof(struct mdp_blit_req));
+                if (status < 0)
+                    return status;
+                list = ctx->mList;
+                list->count = 0;
+            }
+            for (uint32_t i=0 ; i<count ; i++) {
+                struct mdp_rect const r = ctx->mRects[i];
+                for (uint32_t y=r.y ; y<r.y + r.h ; y+=th) {
+                for (uint32_t x=r.x ; x<r.x + r.w ; x+=tw) {
+                    clip.l = x;
+                    clip.t = y;
+                    clip.r = min(x + tw, r.x + r.w);
+                    clip.b = min(y + th, r.y + r.h);
+                    mdp_blit_req req[2];
+                    set_infos(ctx, req);
+                    set_image(&req->dst, dst);
+                    set_image(&req->src, src);
+                    set_rects(ctx, req, dst_rect, src_rect, &clip);
+
+                    if (req->src_rect.w<=0 || req->src_rect.h<=0)
+                        continue;
+
+                    uint32_t n = 1;
+                    if (blitter == ctx->mBlitter) {
+                        if (tall) {
+                            rebase_rows(req);
+                        }
+                        if (!fits_scale(req, MAX_SCALE_FACTOR)) {
+                            struct mdp_blit_req passes[2];
+                            struct mdp_img tmp;
+                            size_t size = split_passes(req, MAX_SCALE_FACTOR,
+                                    &tmp, passes);
+                            if (size > tmpSize)
+                                tmpSize = size;
+                            passes[0].dst.memory_id = ctx->mTmpFd;
+                            passes[0].dst.offset = 0;
+                            passes[1].src.memory_id = ctx->mTmpFd;
+                            passes[1].src.offset = 0;
+                            req[0] = passes[0];
+                            req[1] = passes[1];
+                            n = 2;
+                        }
+                    }
+                    if (!build)
+                        continue;
+
+                    status = reserve((void**)&ctx->mList, &ctx->mListCapacity,
+                            list->count + n, sizeof(struct mdp_blit_req_list),
+                            sizeof(struct mdp_blit_req));
+                    if (status < 0)
+                        return status;
+                    list = ctx->mList;
+                    memcpy(&list->req[list->count], req, n * sizeof(req[0]));
+                    list->count += n;
+                }
+                }
             }
         }
-        if ((status == 0) && list.count) {
-            status = msm_copybit(ctx, &list);
+        if (list->count) {
+            if (ctx->mQueue) {
+                int token = ctx->mQueue->submit(blitter, list);
+                status = token < 0 ? token : 0;
+            } else {
+                status = msm_copybit(ctx, blitter, list);
+            }
+        }
+
+        ctx->mStretches++;
+        ctx->mRequests += list->count;
+        if (ctx->mStatsInterval &&
+                (ctx->mStretches % ctx->mStatsInterval) == 0) {
+            dump_stats(ctx);
         }
     } else {
         status = -EINVAL;
@@ -431,6 +664,19 @@ static int close_copybit(struct hw_device_t *dev)
 {
     struct copybit_context_t* ctx = (struct copybit_context_t*)dev;
     if (ctx) {
+        if (ctx->mStatsInterval) {
+            dump_stats(ctx);
+        }
+        // waits for what is queued
+        delete ctx->mQueue;
+        free(ctx->mRects);
+        free(ctx->mList);
+        if (ctx->mTmpFd >= 0) {
+            munmap(ctx->mTmpBase, ctx->mTmpSize);
+            close(ctx->mTmpFd);
+        }
+        delete ctx->mBlitter;
+        delete ctx->mCpuBlitter;
         close(ctx->mFD);
         free(ctx);
     }
@@ -456,6 +702,7 @@ static int open_copybit(const struct hw_module_t* module, const char* name,
     ctx->device.stretch = stretch_copybit;
     ctx->mAlpha = MDP_ALPHA_NOP;
     ctx->mFlags = 0;
+    ctx->mTmpFd = -1;
     ctx->mFD = open("/dev/graphics/fb0", O_RDWR, 0);
     
     if (ctx->mFD < 0) {
@@ -480,6 +727,11 @@ static int open_copybit(const struct hw_module_t* module, const char* name,
     }
 
     if (status == 0) {
+        ctx->mBlitter = Blitter::create(ctx->mFD);
+        ctx->mCpuBlitter = new CpuBlitter();
+        char value[PROPERTY_VALUE_MAX];
+        property_get("debug.copybit.stats", value, "0");
+        ctx->mStatsInterval = atoi(value);
         *device = &ctx->device.common;
     } else {
         close_copybit(&ctx->device.common);
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COPYBIT_MSM7K_COPYBIT_PRIV_H
+#define COPYBIT_MSM7K_COPYBIT_PRIV_H
+
+/*
+ * Names of set_parameter() and get() understood by this copybit only, for
+ * the callers that know about them. Other copybits return -EINVAL.
+ */
+enum {
+    /* COPYBIT_ENABLE to have blit() and stretch() return once the blit is
+     * queued, done on a thread of its own and batched with the next ones.
+     * COPYBIT_DISABLE, the default, waits for what is queued. A blit to the
+     * framebuffer must be done before it is posted. */
+    COPYBIT_ASYNC = 0x100,
+    /* waits until the blits up to the token given are done, returns 0 or
+     * the -errno they failed with */
+    COPYBIT_WAIT = 0x101,
+    /* as COPYBIT_WAIT, but -EAGAIN rather than waiting */
+    COPYBIT_POLL = 0x102,
+};
+
+enum {
+    /* the token of the last blit queued, 0 if none was */
+    COPYBIT_LAST_TOKEN = 0x100,
+};
+
+#endif  // COPYBIT_MSM7K_COPYBIT_PRIV_H
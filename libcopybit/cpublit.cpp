@@ -0,0 +1,460 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "cpublit.h"
+
+
+/*
+ * Lines are held as RGBA, i.e. 0xAABBGGRR words on this little endian CPU.
+ * The operations work on R and B, and on G and A, as two pairs of 16 bit
+ * lanes at once.
+ */
+
+static inline uint32_t mul255(uint32_t a, uint32_t b)
+{
+    uint32_t t = a * b + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+// a + (b - a) * w / 256, rounded, w from 0 to 256
+static inline uint32_t lerp(uint32_t a, uint32_t b, uint32_t w)
+{
+    uint32_t rb = ((a & 0x00ff00ff) * (256 - w) + (b & 0x00ff00ff) * w +
+            0x00800080) >> 8;
+    uint32_t ga = ((a >> 8) & 0x00ff00ff) * (256 - w) +
+            ((b >> 8) & 0x00ff00ff) * w + 0x00800080;
+    return (rb & 0x00ff00ff) | (ga & 0xff00ff00);
+}
+
+// c * w / 256 for all channels, rounded, w from 0 to 256
+static inline uint32_t scale(uint32_t c, uint32_t w)
+{
+    uint32_t rb = ((c & 0x00ff00ff) * w + 0x00800080) >> 8;
+    uint32_t ga = ((c >> 8) & 0x00ff00ff) * w + 0x00800080;
+    return (rb & 0x00ff00ff) | (ga & 0xff00ff00);
+}
+
+// a + b for all channels, saturated
+static inline uint32_t addSat(uint32_t a, uint32_t b)
+{
+    uint32_t rb = (a & 0x00ff00ff) + (b & 0x00ff00ff);
+    uint32_t ga = ((a >> 8) & 0x00ff00ff) + ((b >> 8) & 0x00ff00ff);
+    // a carry into bit 8 of a lane saturates it
+    rb |= 0x01000100 - ((rb >> 8) & 0x00010001);
+    ga |= 0x01000100 - ((ga >> 8) & 0x00010001);
+    return (rb & 0x00ff00ff) | ((ga & 0x00ff00ff) << 8);
+}
+
+static inline uint32_t swapRB(uint32_t c)
+{
+    return (c & 0xff00ff00) | ((c >> 16) & 0xff) | ((c & 0xff) << 16);
+}
+
+static inline uint32_t from565(uint16_t v)
+{
+    uint32_t r = v >> 11, g = (v >> 5) & 0x3f, b = v & 0x1f;
+    r = (r << 3) | (r >> 2);
+    g = (g << 2) | (g >> 4);
+    b = (b << 3) | (b >> 2);
+    return 0xff000000 | (b << 16) | (g << 8) | r;
+}
+
+static inline uint16_t to565(uint32_t c)
+{
+    return ((c & 0xf8) << 8) | ((c >> 5) & 0x7e0) | ((c >> 19) & 0x1f);
+}
+
+static inline int bppOf(uint32_t format)
+{
+    return format == MDP_RGB_565 ? 2 : 4;
+}
+
+static bool isFastFormat(uint32_t format)
+{
+    switch (format) {
+        case MDP_RGBA_8888:
+        case MDP_BGRA_8888:
+        case MDP_RGBX_8888:
+        case MDP_RGB_565:
+            return true;
+    }
+    return false;
+}
+
+// Converts n pixels, step bytes apart, to RGBA.
+static void loadLine(uint8_t const* p, size_t step, uint32_t format,
+        uint32_t n, uint32_t* out)
+{
+    switch (format) {
+        case MDP_RGBA_8888:
+            if (step == 4) {
+                memcpy(out, p, n * 4);
+                break;
+            }
+            for (uint32_t i=0 ; i<n ; i++, p += step)
+                out[i] = *(uint32_t const*)p;
+            break;
+        case MDP_RGBX_8888:
+            for (uint32_t i=0 ; i<n ; i++, p += step)
+                out[i] = *(uint32_t const*)p | 0xff000000;
+            break;
+        case MDP_BGRA_8888:
+            for (uint32_t i=0 ; i<n ; i++, p += step)
+                out[i] = swapRB(*(uint32_t const*)p);
+            break;
+        case MDP_RGB_565:
+            for (uint32_t i=0 ; i<n ; i++, p += step)
+                out[i] = from565(*(uint16_t const*)p);
+            break;
+    }
+}
+
+// Stores n RGBA pixels at p, the destination line starting at x, y.
+static void storeLine(uint8_t* p, uint32_t format, uint32_t n,
+        uint32_t const* in, bool dither, uint32_t x, uint32_t y)
+{
+    uint32_t i = 0;
+    switch (format) {
+        case MDP_RGBA_8888:
+        case MDP_RGBX_8888:
+            memcpy(p, in, n * 4);
+            break;
+        case MDP_BGRA_8888:
+            for ( ; i<n ; i++)
+                ((uint32_t*)p)[i] = swapRB(in[i]);
+            break;
+        case MDP_RGB_565:
+            if (dither) {
+                uint8_t const* d = SoftwareBlitter::sDither[y & 3];
+                for ( ; i<n ; i++) {
+                    uint32_t c = in[i];
+                    int t = d[(x + i) & 3];
+                    uint32_t r = (c & 0xff) + (t >> 1);
+                    uint32_t g = ((c >> 8) & 0xff) + (t >> 2);
+                    uint32_t b = ((c >> 16) & 0xff) + (t >> 1);
+                    if (r > 255) r = 255;
+                    if (g > 255) g = 255;
+                    if (b > 255) b = 255;
+                    ((uint16_t*)p)[i] = ((r >> 3) << 11) | ((g >> 2) << 5) |
+                            (b >> 3);
+                }
+                break;
+            }
+#if defined(__ARM_NEON__)
+            for ( ; i+8<=n ; i+=8) {
+                uint8x8x4_t c = vld4_u8((uint8_t const*)(in + i));
+                uint16x8_t r = vmovl_u8(vshr_n_u8(c.val[0], 3));
+                uint16x8_t g = vmovl_u8(vshr_n_u8(c.val[1], 2));
+                uint16x8_t b = vmovl_u8(vshr_n_u8(c.val[2], 3));
+                uint16x8_t v = vorrq_u16(vshlq_n_u16(r, 11),
+                        vorrq_u16(vshlq_n_u16(g, 5), b));
+                vst1q_u16((uint16_t*)p + i, v);
+            }
+#endif
+            for ( ; i<n ; i++)
+                ((uint16_t*)p)[i] = to565(in[i]);
+            break;
+    }
+}
+
+// Blends n RGBA pixels of row onto dst, leaving the result in row.
+static void blendLine(uint32_t* row, uint32_t const* dst, uint32_t n,
+        uint32_t plane, bool premult)
+{
+    uint32_t i = 0;
+    if (premult) {
+        uint32_t pw = plane + (plane >> 7);
+        for ( ; i<n ; i++) {
+            uint32_t s = row[i], d = dst[i];
+            uint32_t a = mul255(s >> 24, plane);
+            uint32_t c = addSat(scale(s, pw), scale(d, 256 - (a + (a >> 7))));
+            row[i] = (c & 0x00ffffff) | ((a + mul255(d >> 24, 255 - a)) << 24);
+        }
+        return;
+    }
+
+#if defined(__ARM_NEON__)
+    uint16x8_t vplane = vdupq_n_u16(plane);
+    uint16x8_t v128 = vdupq_n_u16(128);
+    uint16x8_t v255 = vdupq_n_u16(255);
+    uint16x8_t v256 = vdupq_n_u16(256);
+    for ( ; i+8<=n ; i+=8) {
+        uint8x8x4_t s = vld4_u8((uint8_t const*)(row + i));
+        uint8x8x4_t d = vld4_u8((uint8_t const*)(dst + i));
+        uint8x8x4_t o;
+        uint16x8_t t = vmlaq_u16(v128, vmovl_u8(s.val[3]), vplane);
+        uint16x8_t a = vshrq_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8);
+        uint16x8_t w = vaddq_u16(a, vshrq_n_u16(a, 7));
+        uint16x8_t iw = vsubq_u16(v256, w);
+        for (int c=0 ; c<3 ; c++) {
+            uint16x8_t x = vmlaq_u16(vmulq_u16(vmovl_u8(d.val[c]), iw),
+                    vmovl_u8(s.val[c]), w);
+            o.val[c] = vmovn_u16(vshrq_n_u16(vaddq_u16(x, v128), 8));
+        }
+        t = vmlaq_u16(v128, vmovl_u8(d.val[3]), vsubq_u16(v255, a));
+        t = vshrq_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8);
+        o.val[3] = vmovn_u16(vaddq_u16(a, t));
+        vst4_u8((uint8_t*)(row + i), o);
+    }
+#endif
+    for ( ; i<n ; i++) {
+        uint32_t s = row[i], d = dst[i];
+        uint32_t a = mul255(s >> 24, plane);
+        if (a == 0) {
+            row[i] = d;
+        } else if (a != 255) {
+            uint32_t c = lerp(d, s, a + (a >> 7));
+            row[i] = (c & 0x00ffffff) | ((a + mul255(d >> 24, 255 - a)) << 24);
+        }
+    }
+}
+
+/*
+ * Walks the 16.16 source positions of the centers of d destination pixels
+ * over s source pixels, clamped to the span and mirrored if flip is set.
+ * The same mapping as the software MDP's, without a division per pixel.
+ */
+struct span_t {
+    int32_t     f;
+    uint32_t    r;
+    int32_t     q;
+    uint32_t    rs;
+    uint32_t    den;
+    int32_t     max;
+    bool        flip;
+
+    void init(uint32_t s, uint32_t d, bool mirror) {
+        int64_t first = int64_t(s) << 16;
+        int64_t step = int64_t(s) << 17;
+        den = 2 * d;
+        f = int32_t(first / den);
+        r = uint32_t(first % den);
+        q = int32_t(step / den);
+        rs = uint32_t(step % den);
+        max = int32_t(s - 1) << 16;
+        flip = mirror;
+    }
+    int32_t get() const {
+        int32_t v = f - 0x8000;
+        if (v < 0) v = 0;
+        if (v > max) v = max;
+        return flip ? max - v : v;
+    }
+    void next() {
+        f += q;
+        r += rs;
+        if (r >= den) {
+            r -= den;
+            f++;
+        }
+    }
+};
+
+/*****************************************************************************/
+
+CpuBlitter::CpuBlitter(bool filter)
+    : mFilter(filter), mRow(0), mDst(0), mLength(0)
+{
+    mLines[0] = mLines[1] = 0;
+    mLineIndex[0] = mLineIndex[1] = -1;
+}
+
+CpuBlitter::~CpuBlitter()
+{
+    free(mLines[0]);
+    free(mLines[1]);
+    free(mRow);
+    free(mDst);
+}
+
+bool CpuBlitter::isFast(mdp_blit_req const* req)
+{
+    return isFastFormat(req->src.format) && isFastFormat(req->dst.format) &&
+            req->transp_mask == MDP_TRANSP_NOP;
+}
+
+bool CpuBlitter::reserve(uint32_t length)
+{
+    if (length <= mLength)
+        return true;
+    uint32_t** buffers[4] = { &mLines[0], &mLines[1], &mRow, &mDst };
+    for (int i=0 ; i<4 ; i++) {
+        uint32_t* p = (uint32_t*)realloc(*buffers[i], length * 4);
+        if (!p)
+            return false;
+        *buffers[i] = p;
+    }
+    mLength = length;
+    return true;
+}
+
+int CpuBlitter::doBlit(mdp_blit_req_list const* list)
+{
+    for (uint32_t i=0 ; i<list->count ; i++) {
+        mdp_blit_req const* req = &list->req[i];
+        int err = isFast(req) ? blitFast(req) : blitOne(req);
+        if (err < 0) {
+            return err;
+        }
+    }
+    return 0;
+}
+
+static bool fits(mdp_img const& img, mdp_rect const& r)
+{
+    return r.w && r.h && r.x <= img.width && r.w <= img.width - r.x &&
+            r.y <= img.height && r.h <= img.height - r.y;
+}
+
+int CpuBlitter::blitFast(mdp_blit_req const* req)
+{
+    if (req->flags & MDP_NO_BLIT)
+        return 0;
+    if (!fits(req->src, req->src_rect) || !fits(req->dst, req->dst_rect))
+        return -EINVAL;
+
+    // lines run along the source's x, or its y when rotating, and the
+    // destination's x
+    const bool rot90 = req->flags & MDP_ROT_90;
+    const uint32_t sw = req->src_rect.w, sh = req->src_rect.h;
+    const uint32_t dw = req->dst_rect.w, dh = req->dst_rect.h;
+    const uint32_t along = rot90 ? sh : sw;
+    const uint32_t across = rot90 ? sw : sh;
+    const bool flipAlong = req->flags & (rot90 ? MDP_FLIP_UD : MDP_FLIP_LR);
+    const bool flipAcross = req->flags & (rot90 ? MDP_FLIP_LR : MDP_FLIP_UD);
+    if (!reserve(along > dw ? along : dw))
+        return -ENOMEM;
+
+    size_t srcSize = getImageSize(req->src.format,
+            req->src.width, req->src.height);
+    size_t dstSize = getImageSize(req->dst.format,
+            req->dst.width, req->dst.height);
+    uint8_t* src = map(req->src, srcSize);
+    uint8_t* dst = map(req->dst, dstSize);
+    if (!src || !dst) {
+        if (src) unmap(req->src, src, srcSize);
+        if (dst) unmap(req->dst, dst, dstSize);
+        return -ENOMEM;
+    }
+
+    const int sbpp = bppOf(req->src.format);
+    const int dbpp = bppOf(req->dst.format);
+    const size_t sstride = size_t(req->src.width) * sbpp;
+    const size_t dstride = size_t(req->dst.width) * dbpp;
+    const size_t lineStep = rot90 ? sstride : sbpp;
+    const size_t lineSkip = rot90 ? sbpp : sstride;
+    uint8_t const* origin = src + req->src_rect.y * sstride +
+            req->src_rect.x * sbpp;
+
+    const uint32_t plane = req->alpha > 0xff ? 0xff : req->alpha;
+    const bool opaque = plane == 0xff && req->src.format != MDP_RGBA_8888 &&
+            req->src.format != MDP_BGRA_8888;
+    const bool premult = req->flags & MDP_BLEND_FG_PREMULT;
+    const bool dither = (req->flags & MDP_DITHER) &&
+            req->dst.format == MDP_RGB_565;
+    // with rotation the first destination pixel samples the end of a line
+    const bool reverse = rot90;
+    const bool straight = along == dw && !(flipAlong ^ reverse);
+
+    mLineIndex[0] = mLineIndex[1] = -1;
+    span_t v;
+    v.init(across, dh, flipAcross);
+    for (uint32_t y=0 ; y<dh ; y++, v.next()) {
+        int32_t fv = v.get();
+        int32_t k0 = fv >> 16;
+        int32_t k1 = k0 + 1 < int32_t(across) ? k0 + 1 : k0;
+        uint32_t wv = (fv & 0xffff) >> 8;
+        if (!mFilter) {
+            k0 = k1 = (fv + 0x8000) >> 16;
+            if (k0 >= int32_t(across)) k0 = k1 = across - 1;
+            wv = 0;
+        }
+
+        // the lines this row samples, converted once for all rows using them
+        const int32_t need[2] = { k0, k1 };
+        const int count = wv ? 2 : 1;
+        uint32_t* lines[2];
+        for (int j=0 ; j<count ; j++) {
+            int slot = mLineIndex[0] == need[j] ? 0 :
+                    (mLineIndex[1] == need[j] ? 1 : -1);
+            if (slot < 0) {
+                // keep the other line of this row, or else the newer one
+                if (count == 2) {
+                    slot = mLineIndex[0] == need[1 - j] ? 1 : 0;
+                } else {
+                    slot = mLineIndex[0] < mLineIndex[1] ? 0 : 1;
+                }
+                loadLine(origin + need[j] * lineSkip, lineStep,
+                        req->src.format, along, mLines[slot]);
+                mLineIndex[slot] = need[j];
+            }
+            lines[j] = mLines[slot];
+        }
+
+        uint32_t* row = mRow;
+        if (straight && !wv) {
+            row = lines[0];
+        } else {
+            span_t u;
+            u.init(along, dw, flipAlong);
+            for (uint32_t x=0 ; x<dw ; x++, u.next()) {
+                int32_t fu = u.get();
+                uint32_t c;
+                if (mFilter) {
+                    int32_t i0 = fu >> 16;
+                    int32_t i1 = i0 + 1 < int32_t(along) ? i0 + 1 : i0;
+                    uint32_t wu = (fu & 0xffff) >> 8;
+                    c = lines[0][i0];
+                    if (wu) c = lerp(c, lines[0][i1], wu);
+                    if (wv) {
+                        uint32_t b = lines[1][i0];
+                        if (wu) b = lerp(b, lines[1][i1], wu);
+                        c = lerp(c, b, wv);
+                    }
+                } else {
+                    int32_t i = (fu + 0x8000) >> 16;
+                    c = lines[0][i < int32_t(along) ? i : along - 1];
+                }
+                row[reverse ? dw - 1 - x : x] = c;
+            }
+        }
+
+        uint32_t dy = req->dst_rect.y + y;
+        uint8_t* out = dst + dy * dstride + req->dst_rect.x * dbpp;
+        if (!opaque) {
+            if (row != mRow) {
+                memcpy(mRow, row, dw * 4);
+                row = mRow;
+            }
+            loadLine(out, dbpp, req->dst.format, dw, mDst);
+            blendLine(row, mDst, dw, plane, premult);
+        }
+        storeLine(out, req->dst.format, dw, row, dither, req->dst_rect.x, dy);
+    }
+
+    flush(req->dst, dst, dstSize);
+    unmap(req->src, src, srcSize);
+    unmap(req->dst, dst, dstSize);
+    return 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COPYBIT_MSM7K_CPUBLIT_H
+#define COPYBIT_MSM7K_CPUBLIT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "blitter.h"
+
+
+/*
+ * The CPU blitter stretch_copybit() falls back to for what the MDP won't
+ * do: plane alpha over a source with an alpha channel, and images larger
+ * than MAX_DIMENSION.
+ *
+ * Requests between RGBA_8888, BGRA_8888, RGBX_8888 and RGB_565 take the
+ * fast path, which has no size or scale limits. It works a line at a time:
+ * the (at most two) source lines a destination line samples from are
+ * converted to RGBA once and kept while they're still used, then scaled,
+ * blended and stored. Pixels are processed two channels per operation in
+ * 32-bit registers, or 8 pixels at a time with NEON where the CPU has it.
+ *
+ * Anything else goes to the software MDP, which the fast path matches to
+ * within two levels per channel.
+ */
+class CpuBlitter : public SoftwareBlitter {
+
+ public:
+
+    // without filtering, scaling picks the nearest pixel
+    CpuBlitter(bool filter = true);
+    virtual ~CpuBlitter();
+
+    // whether req takes the fast path
+    static bool isFast(mdp_blit_req const* req);
+
+ protected:
+
+    virtual const char* name() const { return "cpu"; }
+    virtual int doBlit(mdp_blit_req_list const* list);
+
+ private:
+
+    int blitFast(mdp_blit_req const* req);
+    bool reserve(uint32_t length);
+
+    bool        mFilter;
+    // the two cached source lines, the destination line and the line
+    // being blended onto, all RGBA
+    uint32_t*   mLines[2];
+    int32_t     mLineIndex[2];
+    uint32_t*   mRow;
+    uint32_t*   mDst;
+    uint32_t    mLength;
+};
+
+#endif  // COPYBIT_MSM7K_CPUBLIT_H
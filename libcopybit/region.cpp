@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include "region.h"
+
+/*****************************************************************************/
+
+static int compare(uint32_t a, uint32_t b)
+{
+    return (a < b) ? -1 : (a > b);
+}
+
+// by band, then left to right
+static int compare_rows(const void* lhs, const void* rhs)
+{
+    mdp_rect const* a = (mdp_rect const*)lhs;
+    mdp_rect const* b = (mdp_rect const*)rhs;
+    int c = compare(a->y, b->y);
+    if (!c) c = compare(a->h, b->h);
+    if (!c) c = compare(a->x, b->x);
+    return c;
+}
+
+// by column, then top to bottom
+static int compare_columns(const void* lhs, const void* rhs)
+{
+    mdp_rect const* a = (mdp_rect const*)lhs;
+    mdp_rect const* b = (mdp_rect const*)rhs;
+    int c = compare(a->x, b->x);
+    if (!c) c = compare(a->w, b->w);
+    if (!c) c = compare(a->y, b->y);
+    return c;
+}
+
+// one pass merging side by side (rows) or stacked rectangles
+static int merge(mdp_rect* rects, int count, bool rows)
+{
+    qsort(rects, count, sizeof(*rects), rows ? compare_rows : compare_columns);
+    int n = 0;
+    for (int i=0 ; i<count ; i++) {
+        mdp_rect const& r = rects[i];
+        mdp_rect* last = n ? &rects[n-1] : 0;
+        if (last && rows && last->y == r.y && last->h == r.h &&
+                last->x + last->w == r.x) {
+            last->w += r.w;
+        } else if (last && !rows && last->x == r.x && last->w == r.w &&
+                last->y + last->h == r.y) {
+            last->h += r.h;
+        } else {
+            rects[n++] = r;
+        }
+    }
+    return n;
+}
+
+int coalesce_rects(struct mdp_rect* rects, int count)
+{
+    int n = 0;
+    for (int i=0 ; i<count ; i++) {
+        if (rects[i].w && rects[i].h)
+            rects[n++] = rects[i];
+    }
+    if (n < 2)
+        return n;
+
+    // merging rows can line up columns and the other way around
+    int last;
+    do {
+        last = n;
+        n = merge(rects, n, true);
+        n = merge(rects, n, false);
+    } while (n > 1 && n < last);
+    return n;
+}
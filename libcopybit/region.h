@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COPYBIT_MSM7K_REGION_H
+#define COPYBIT_MSM7K_REGION_H
+
+#include <stdint.h>
+
+#include "msm_mdp.h"
+
+/*
+ * Merges the rectangles that are adjacent strips of a larger one, side by
+ * side with the same top and height or stacked with the same left and
+ * width, until none can be merged. Empty rectangles are dropped.
+ *
+ * The rectangles mustn't overlap, as those of a clip region don't, so the
+ * result covers exactly the same pixels. Their order isn't kept.
+ *
+ * Returns the new count.
+ */
+int coalesce_rects(struct mdp_rect* rects, int count);
+
+#endif  // COPYBIT_MSM7K_REGION_H
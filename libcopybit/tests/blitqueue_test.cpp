@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "blitqueue.h"
+
+/******************************************************************************/
+
+// records the lists it's given, held back until opened
+class GatedBlitter : public Blitter {
+ public:
+    enum { kMaxLists = 64 };
+
+    GatedBlitter(int err = 0)
+        : mErr(err), mOpen(false), mEntered(false), mCount(0) {
+        pthread_mutex_init(&mLock, NULL);
+        pthread_cond_init(&mCond, NULL);
+    }
+    ~GatedBlitter() {
+        pthread_cond_destroy(&mCond);
+        pthread_mutex_destroy(&mLock);
+    }
+
+    // until a list reached the gate
+    void waitEntered() {
+        pthread_mutex_lock(&mLock);
+        while (!mEntered) {
+            pthread_cond_wait(&mCond, &mLock);
+        }
+        pthread_mutex_unlock(&mLock);
+    }
+
+    void open() {
+        pthread_mutex_lock(&mLock);
+        mOpen = true;
+        pthread_cond_broadcast(&mCond);
+        pthread_mutex_unlock(&mLock);
+    }
+
+    // the number of requests of each list, and their alpha in order
+    uint32_t mSizes[kMaxLists];
+    uint32_t mAlphas[kMaxLists * 4];
+    uint32_t mAlphaCount;
+    int mErr;
+
+ protected:
+    virtual const char* name() const { return "gated"; }
+    virtual int doBlit(mdp_blit_req_list const* list) {
+        pthread_mutex_lock(&mLock);
+        mEntered = true;
+        pthread_cond_broadcast(&mCond);
+        while (!mOpen) {
+            pthread_cond_wait(&mCond, &mLock);
+        }
+        if (mCount < kMaxLists) {
+            if (!mCount) mAlphaCount = 0;
+            mSizes[mCount++] = list->count;
+            for (uint32_t i=0 ; i<list->count ; i++)
+                mAlphas[mAlphaCount++] = list->req[i].alpha;
+        }
+        pthread_mutex_unlock(&mLock);
+        return mErr;
+    }
+
+ private:
+    pthread_mutex_t mLock;
+    pthread_cond_t mCond;
+    bool mOpen;
+    bool mEntered;
+
+ public:
+    uint32_t mCount;
+};
+
+struct list_t {
+    uint32_t count;
+    mdp_blit_req req[4];
+};
+
+static mdp_blit_req_list const* makeList(list_t* list, uint32_t count,
+        uint32_t alpha)
+{
+    memset(list, 0, sizeof(*list));
+    list->count = count;
+    for (uint32_t i=0 ; i<count ; i++)
+        list->req[i].alpha = alpha + i;
+    return (mdp_blit_req_list const*)list;
+}
+
+TEST(test_blitqueue, testBatchesAcrossSubmissions) {
+    GatedBlitter blitter;
+    BlitQueue queue;
+    list_t list;
+
+    // the first list is taken at once and held, the rest pile up behind
+    int first = queue.submit(&blitter, makeList(&list, 1, 0));
+    ASSERT_LT(0, first);
+    blitter.waitEntered();
+    int token = first;
+    for (int i=1 ; i<5 ; i++) {
+        int t = queue.submit(&blitter, makeList(&list, 2, i * 10));
+        ASSERT_LT(token, t);
+        token = t;
+    }
+    ASSERT_EQ(token, queue.last());
+    ASSERT_EQ(-EAGAIN, queue.poll(token));
+
+    blitter.open();
+    ASSERT_EQ(0, queue.wait(token));
+    ASSERT_EQ(0, queue.poll(first));
+
+    // the four lists queued while blitting became one, in order
+    ASSERT_EQ(2U, blitter.mCount);
+    ASSERT_EQ(1U, blitter.mSizes[0]);
+    ASSERT_EQ(8U, blitter.mSizes[1]);
+    static const uint32_t alphas[] = { 0, 10, 11, 20, 21, 30, 31, 40, 41 };
+    ASSERT_EQ(9U, blitter.mAlphaCount);
+    for (int i=0 ; i<9 ; i++)
+        ASSERT_EQ(alphas[i], blitter.mAlphas[i]) << i;
+}
+
+TEST(test_blitqueue, testBlittersNotMixed) {
+    GatedBlitter a, b;
+    BlitQueue queue;
+    list_t list;
+    a.open();
+    // held in b, so the following ones queue up
+    queue.submit(&b, makeList(&list, 1, 0));
+    b.waitEntered();
+    queue.submit(&a, makeList(&list, 1, 1));
+    queue.submit(&a, makeList(&list, 1, 2));
+    queue.submit(&b, makeList(&list, 1, 3));
+    int token = queue.submit(&a, makeList(&list, 1, 4));
+    b.open();
+    ASSERT_EQ(0, queue.wait(token));
+    ASSERT_EQ(2U, a.mCount);
+    ASSERT_EQ(2U, a.mSizes[0]);
+    ASSERT_EQ(1U, a.mSizes[1]);
+    ASSERT_EQ(2U, b.mCount);
+}
+
+TEST(test_blitqueue, testErrors) {
+    GatedBlitter failing(-EINVAL), fine;
+    failing.open();
+    fine.open();
+    BlitQueue queue;
+    list_t list;
+    int bad = queue.submit(&failing, makeList(&list, 1, 0));
+    int good = queue.submit(&fine, makeList(&list, 1, 0));
+    ASSERT_EQ(0, queue.wait(good));
+    ASSERT_EQ(-EINVAL, queue.wait(bad));
+    ASSERT_EQ(-EINVAL, queue.poll(bad));
+
+    // nothing to wait for, and tokens that weren't given
+    ASSERT_EQ(0, queue.wait(0));
+    ASSERT_EQ(-EINVAL, queue.wait(good + 1));
+    ASSERT_EQ(-EINVAL, queue.poll(-1));
+}
+
+TEST(test_blitqueue, testDrainsWhenDestroyed) {
+    GatedBlitter blitter;
+    blitter.open();
+    list_t list;
+    {
+        BlitQueue queue;
+        for (int i=0 ; i<10 ; i++)
+            queue.submit(&blitter, makeList(&list, 1, i));
+    }
+    uint32_t requests = 0;
+    for (uint32_t i=0 ; i<blitter.mCount ; i++)
+        requests += blitter.mSizes[i];
+    ASSERT_EQ(10U, requests);
+}
+
+TEST(test_blitqueue, testStats) {
+    GatedBlitter blitter;
+    BlitQueue queue;
+    list_t list;
+    queue.submit(&blitter, makeList(&list, 1, 0));
+    blitter.waitEntered();
+    queue.submit(&blitter, makeList(&list, 3, 0));
+    int token = queue.submit(&blitter, makeList(&list, 1, 0));
+    blitter.open();
+    queue.wait(token);
+
+    char buff[512];
+    queue.dump(buff, sizeof(buff));
+    ASSERT_TRUE(strstr(buff, "3 lists in 2 batches")) << buff;
+    // the 3 requests of the second list were queued for the third
+    ASSERT_TRUE(strstr(buff, "3 most")) << buff;
+}
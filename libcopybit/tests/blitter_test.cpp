@@ -0,0 +1,364 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "blitter.h"
+
+/******************************************************************************/
+
+// images live in plain memory, memory_id indexes mImages
+class TestBlitter : public SoftwareBlitter {
+ public:
+    enum { kImages = 4 };
+    uint8_t* mImages[kImages];
+    TestBlitter() { memset(mImages, 0, sizeof(mImages)); }
+ protected:
+    virtual uint8_t* map(mdp_img const& img, size_t size) {
+        if (img.memory_id < 0 || img.memory_id >= kImages)
+            return 0;
+        return mImages[img.memory_id] + img.offset;
+    }
+    virtual void unmap(mdp_img const& img, uint8_t* base, size_t size) {
+    }
+    virtual void flush(mdp_img const& img, uint8_t* base, size_t size) {
+    }
+};
+
+struct list_t {
+    uint32_t count;
+    mdp_blit_req req[2];
+};
+
+static void setImage(mdp_img* img, int id, uint32_t format,
+        uint32_t w, uint32_t h)
+{
+    img->width = w;
+    img->height = h;
+    img->format = format;
+    img->offset = 0;
+    img->memory_id = id;
+}
+
+static void setRect(mdp_rect* r, uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+{
+    r->x = x;
+    r->y = y;
+    r->w = w;
+    r->h = h;
+}
+
+// one request from image 0 to image 1, whole images
+static void setRequest(list_t* list, uint32_t srcFormat, uint32_t sw,
+        uint32_t sh, uint32_t dstFormat, uint32_t dw, uint32_t dh)
+{
+    memset(list, 0, sizeof(*list));
+    list->count = 1;
+    mdp_blit_req* req = &list->req[0];
+    setImage(&req->src, 0, srcFormat, sw, sh);
+    setImage(&req->dst, 1, dstFormat, dw, dh);
+    setRect(&req->src_rect, 0, 0, sw, sh);
+    setRect(&req->dst_rect, 0, 0, dw, dh);
+    req->alpha = MDP_ALPHA_NOP;
+    req->transp_mask = MDP_TRANSP_NOP;
+}
+
+static mdp_blit_req_list const* asList(list_t const* list)
+{
+    return (mdp_blit_req_list const*)list;
+}
+
+TEST(test_blitter, testCopiesRect) {
+    uint16_t src[4 * 4], dst[4 * 4];
+    for (int i=0 ; i<16 ; i++) {
+        src[i] = 0x1000 + i;
+        dst[i] = 0;
+    }
+    TestBlitter blitter;
+    blitter.mImages[0] = (uint8_t*)src;
+    blitter.mImages[1] = (uint8_t*)dst;
+
+    list_t list;
+    setRequest(&list, MDP_RGB_565, 4, 4, MDP_RGB_565, 4, 4);
+    setRect(&list.req[0].src_rect, 1, 1, 2, 2);
+    setRect(&list.req[0].dst_rect, 0, 2, 2, 2);
+    ASSERT_EQ(0, blitter.blit(asList(&list)));
+
+    for (int y=0 ; y<4 ; y++) {
+        for (int x=0 ; x<4 ; x++) {
+            uint16_t expected = 0;
+            if (x < 2 && y >= 2)
+                expected = src[(y - 1) * 4 + x + 1];
+            ASSERT_EQ(expected, dst[y * 4 + x]) << x << "," << y;
+        }
+    }
+    ASSERT_EQ(1U, blitter.lists());
+    ASSERT_EQ(1U, blitter.requests());
+    ASSERT_EQ(4ULL, blitter.pixels());
+}
+
+TEST(test_blitter, testConvertsFormats) {
+    // red, green, blue, half transparent white
+    uint8_t src[4 * 4] = {
+        0xff, 0, 0, 0xff,   0, 0xff, 0, 0xff,
+        0, 0, 0xff, 0xff,   0xff, 0xff, 0xff, 0x80,
+    };
+    uint8_t bgra[4 * 4];
+    uint16_t rgb565[4];
+    TestBlitter blitter;
+    list_t list;
+
+    blitter.mImages[0] = src;
+    blitter.mImages[1] = bgra;
+    setRequest(&list, MDP_RGBX_8888, 4, 1, MDP_BGRA_8888, 4, 1);
+    ASSERT_EQ(0, blitter.blit(asList(&list)));
+    ASSERT_EQ(0, bgra[0]);
+    ASSERT_EQ(0xff, bgra[2]);
+    ASSERT_EQ(0xff, bgra[8]);
+    // RGBX has no alpha
+    ASSERT_EQ(0xff, bgra[15]);
+
+    blitter.mImages[0] = bgra;
+    blitter.mImages[1] = (uint8_t*)rgb565;
+    setRequest(&list, MDP_BGRA_8888, 4, 1, MDP_RGB_565, 4, 1);
+    ASSERT_EQ(0, blitter.blit(asList(&list)));
+    ASSERT_EQ(0xf800, rgb565[0]);
+    ASSERT_EQ(0x07e0, rgb565[1]);
+    ASSERT_EQ(0x001f, rgb565[2]);
+    ASSERT_EQ(0xffff, rgb565[3]);
+}
+
+TEST(test_blitter, testRotatesAndFlips) {
+    // 3x2, the pixels hold their own coordinates
+    uint8_t src[3 * 2 * 3];
+    for (int y=0 ; y<2 ; y++) {
+        for (int x=0 ; x<3 ; x++) {
+            uint8_t* p = src + (y * 3 + x) * 3;
+            p[0] = x; p[1] = y; p[2] = 0;
+        }
+    }
+    uint8_t dst[2 * 3 * 3];
+    TestBlitter blitter;
+    blitter.mImages[0] = src;
+    blitter.mImages[1] = dst;
+
+    // clockwise, the first source line ends up in the right column
+    list_t list;
+    setRequest(&list, MDP_RGB_888, 3, 2, MDP_RGB_888, 2, 3);
+    list.req[0].flags = MDP_ROT_90;
+    ASSERT_EQ(0, blitter.blit(asList(&list)));
+    for (int y=0 ; y<3 ; y++) {
+        for (int x=0 ; x<2 ; x++) {
+            uint8_t* p = dst + (y * 2 + x) * 3;
+            ASSERT_EQ(y, p[0]) << x << "," << y;
+            ASSERT_EQ(1 - x, p[1]) << x << "," << y;
+        }
+    }
+
+    // 270 is both flips and 90
+    list.req[0].flags = MDP_ROT_270;
+    ASSERT_EQ(0, blitter.blit(asList(&list)));
+    for (int y=0 ; y<3 ; y++) {
+        for (int x=0 ; x<2 ; x++) {
+            uint8_t* p = dst + (y * 2 + x) * 3;
+            ASSERT_EQ(2 - y, p[0]) << x << "," << y;
+            ASSERT_EQ(x, p[1]) << x << "," << y;
+        }
+    }
+
+    uint8_t flipped[3 * 2 * 3];
+    blitter.mImages[1] = flipped;
+    setRequest(&list, MDP_RGB_888, 3, 2, MDP_RGB_888, 3, 2);
+    list.req[0].flags = MDP_FLIP_LR;
+    ASSERT_EQ(0, blitter.blit(asList(&list)));
+    for (int y=0 ; y<2 ; y++) {
+        for (int x=0 ; x<3 ; x++) {
+            uint8_t* p = flipped + (y * 3 + x) * 3;
+            ASSERT_EQ(2 - x, p[0]);
+            ASSERT_EQ(y, p[1]);
+        }
+    }
+}
+
+TEST(test_blitter, testScales) {
+    // 2x1 black and white, up 4 times is a ramp, pixel centers on centers
+    uint8_t src[2 * 4] = { 0, 0, 0, 0xff,   0xff, 0xff, 0xff, 0xff };
+    uint8_t dst[8 * 4 * 4];
+    TestBlitter blitter;
+    blitter.mImages[0] = src;
+    blitter.mImages[1] = dst;
+
+    list_t list;
+    setRequest(&list, MDP_RGBA_8888, 2, 1, MDP_RGBA_8888, 8, 4);
+    ASSERT_EQ(0, blitter.blit(asList(&list)));
+    int expected[8] = { 0, 0, 16, 48, 80, 112, 128, 128 };
+    for (int x=0 ; x<8 ; x++) {
+        ASSERT_NEAR(expected[x] * 0xff / 128, dst[(3 * 8 + x) * 4], 1) << x;
+        ASSERT_EQ(0xff, dst[x * 4 + 3]);
+    }
+
+    // and down again, 4:1 samples between the middle two of each group
+    uint8_t back[2 * 4];
+    blitter.mImages[0] = dst;
+    blitter.mImages[1] = back;
+    setRequest(&list, MDP_RGBA_8888, 8, 4, MDP_RGBA_8888, 2, 1);
+    ASSERT_EQ(0, blitter.blit(asList(&list)));
+    ASSERT_NEAR(16, back[0], 1);
+    ASSERT_NEAR(239, back[4], 1);
+
+    // beyond the MDP limits
+    setRequest(&list, MDP_RGBA_8888, 8, 4, MDP_RGBA_8888, 1, 1);
+    ASSERT_EQ(-EINVAL, blitter.blit(asList(&list)));
+}
+
+TEST(test_blitter, testBlends) {
+    uint8_t src[2 * 4] = { 0xff, 0, 0, 0xff,   0xff, 0, 0, 0 };
+    uint8_t dst[2 * 4] = { 0, 0, 0xff, 0xff,   0, 0, 0xff, 0xff };
+    TestBlitter blitter;
+    blitter.mImages[0] = src;
+    blitter.mImages[1] = dst;
+
+    list_t list;
+    setRequest(&list, MDP_RGBA_8888, 2, 1, MDP_RGBA_8888, 2, 1);
+    list.req[0].alpha = 0x80;
+    ASSERT_EQ(0, blitter.blit(asList(&list)));
+    ASSERT_NEAR(0x80, dst[0], 1);
+    ASSERT_NEAR(0x7f, dst[2], 1);
+    ASSERT_EQ(0xff, dst[3]);
+    // a transparent pixel leaves the destination alone
+    ASSERT_EQ(0, dst[4]);
+    ASSERT_EQ(0xff, dst[6]);
+
+    // premultiplied, the color is added as is
+    uint8_t glow[4] = { 0x40, 0x40, 0x40, 0 };
+    uint8_t grey[4] = { 0x80, 0x80, 0x80, 0xff };
+    blitter.mImages[0] = glow;
+    blitter.mImages[1] = grey;
+    setRequest(&list, MDP_RGBA_8888, 1, 1, MDP_RGBA_8888, 1, 1);
+    list.req[0].flags = MDP_BLEND_FG_PREMULT;
+    ASSERT_EQ(0, blitter.blit(asList(&list)));
+    ASSERT_EQ(0xc0, grey[0]);
+}
+
+TEST(test_blitter, testTransparentColor) {
+    uint16_t src[4] = { 0xf81f, 0x1234, 0xf81f, 0x4321 };
+    uint16_t dst[4] = { 0, 0, 0, 0 };
+    TestBlitter blitter;
+    blitter.mImages[0] = (uint8_t*)src;
+    blitter.mImages[1] = (uint8_t*)dst;
+
+    list_t list;
+    setRequest(&list, MDP_RGB_565, 4, 1, MDP_RGB_565, 4, 1);
+    list.req[0].transp_mask = 0xf81f;
+    ASSERT_EQ(0, blitter.blit(asList(&list)));
+    ASSERT_EQ(0, dst[0]);
+    ASSERT_EQ(0x1234, dst[1]);
+    ASSERT_EQ(0, dst[2]);
+    ASSERT_EQ(0x4321, dst[3]);
+}
+
+TEST(test_blitter, testDithers) {
+    // a level between two 565 values comes out as a mix of both
+    uint8_t src[4 * 4 * 3];
+    memset(src, 0x84, sizeof(src));
+    uint16_t dst[4 * 4];
+    TestBlitter blitter;
+    blitter.mImages[0] = src;
+    blitter.mImages[1] = (uint8_t*)dst;
+
+    list_t list;
+    setRequest(&list, MDP_RGB_888, 4, 4, MDP_RGB_565, 4, 4);
+    ASSERT_EQ(0, blitter.blit(asList(&list)));
+    for (int i=0 ; i<16 ; i++) {
+        ASSERT_EQ(0x10, dst[i] >> 11);
+    }
+
+    list.req[0].flags = MDP_DITHER;
+    ASSERT_EQ(0, blitter.blit(asList(&list)));
+    int up = 0;
+    for (int i=0 ; i<16 ; i++) {
+        int r = dst[i] >> 11;
+        ASSERT_TRUE(r == 0x10 || r == 0x11);
+        up += r - 0x10;
+    }
+    // 0x84 is half way from 0x80 to 0x88
+    ASSERT_EQ(8, up);
+}
+
+TEST(test_blitter, testYuv) {
+    // 4x2 NV21, copied with a 2 pixel shift, then to RGB
+    const size_t size = SoftwareBlitter::getImageSize(MDP_Y_CBCR_H2V2, 4, 2);
+    ASSERT_EQ(12U, size);
+    uint8_t src[12] = {
+        16, 50, 100, 235,
+        16, 50, 100, 235,
+        128, 128,   200, 60,
+    };
+    uint8_t dst[12];
+    memset(dst, 0, sizeof(dst));
+    TestBlitter blitter;
+    blitter.mImages[0] = src;
+    blitter.mImages[1] = dst;
+
+    list_t list;
+    setRequest(&list, MDP_Y_CBCR_H2V2, 4, 2, MDP_Y_CBCR_H2V2, 4, 2);
+    setRect(&list.req[0].src_rect, 2, 0, 2, 2);
+    setRect(&list.req[0].dst_rect, 0, 0, 2, 2);
+    ASSERT_EQ(0, blitter.blit(asList(&list)));
+    ASSERT_EQ(100, dst[0]);
+    ASSERT_EQ(235, dst[5]);
+    ASSERT_EQ(200, dst[8]);
+    ASSERT_EQ(60, dst[9]);
+
+    uint8_t rgb[4 * 2 * 3];
+    blitter.mImages[1] = rgb;
+    setRequest(&list, MDP_Y_CBCR_H2V2, 4, 2, MDP_RGB_888, 4, 2);
+    ASSERT_EQ(0, blitter.blit(asList(&list)));
+    // without chroma, black and grey stay neutral
+    ASSERT_EQ(0, rgb[0]);
+    ASSERT_EQ(0, rgb[2]);
+    ASSERT_EQ(40, rgb[3]);
+    ASSERT_EQ(40, rgb[5]);
+}
+
+TEST(test_blitter, testRejectsBadRequests) {
+    uint8_t mem[64];
+    TestBlitter blitter;
+    blitter.mImages[0] = mem;
+    blitter.mImages[1] = mem;
+
+    list_t list;
+    setRequest(&list, MDP_RGB_565, 4, 4, MDP_RGB_565, 4, 4);
+    setRect(&list.req[0].src_rect, 3, 0, 2, 1);
+    ASSERT_EQ(-EINVAL, blitter.blit(asList(&list)));
+
+    setRequest(&list, MDP_IMGTYPE_LIMIT, 4, 4, MDP_RGB_565, 4, 4);
+    ASSERT_EQ(-EINVAL, blitter.blit(asList(&list)));
+
+    setRequest(&list, MDP_RGB_565, 4, 4, MDP_RGB_565, 4, 4);
+    list.req[0].dst.memory_id = TestBlitter::kImages;
+    ASSERT_EQ(-ENOMEM, blitter.blit(asList(&list)));
+
+    // nothing to do
+    setRequest(&list, MDP_RGB_565, 4, 4, MDP_RGB_565, 4, 4);
+    list.req[0].flags = MDP_NO_BLIT;
+    list.req[0].dst.memory_id = TestBlitter::kImages;
+    ASSERT_EQ(0, blitter.blit(asList(&list)));
+}
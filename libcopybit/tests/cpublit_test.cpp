@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "cpublit.h"
+
+/******************************************************************************/
+
+// images live in plain memory, memory_id indexes mImages
+#define MEMORY_IMAGES                                                       \
+    enum { kImages = 2 };                                                   \
+    uint8_t* mImages[kImages];                                              \
+    virtual uint8_t* map(mdp_img const& img, size_t size) {                 \
+        if (img.memory_id < 0 || img.memory_id >= kImages)                  \
+            return 0;                                                       \
+        return mImages[img.memory_id] + img.offset;                         \
+    }                                                                       \
+    virtual void unmap(mdp_img const& img, uint8_t* base, size_t size) {}   \
+    virtual void flush(mdp_img const& img, uint8_t* base, size_t size) {}
+
+class TestSoftware : public SoftwareBlitter {
+ public:
+    MEMORY_IMAGES
+};
+
+class TestCpu : public CpuBlitter {
+ public:
+    TestCpu(bool filter = true) : CpuBlitter(filter) {}
+    MEMORY_IMAGES
+};
+
+struct list_t {
+    uint32_t count;
+    mdp_blit_req req[1];
+};
+
+static mdp_blit_req_list const* asList(list_t const* list)
+{
+    return (mdp_blit_req_list const*)list;
+}
+
+static void setRequest(list_t* list, uint32_t srcFormat, uint32_t sw,
+        uint32_t sh, uint32_t dstFormat, uint32_t dw, uint32_t dh)
+{
+    memset(list, 0, sizeof(*list));
+    list->count = 1;
+    mdp_blit_req* req = &list->req[0];
+    req->src.width = sw;
+    req->src.height = sh;
+    req->src.format = srcFormat;
+    req->src.memory_id = 0;
+    req->dst.width = dw;
+    req->dst.height = dh;
+    req->dst.format = dstFormat;
+    req->dst.memory_id = 1;
+    req->src_rect.w = sw;
+    req->src_rect.h = sh;
+    req->dst_rect.w = dw;
+    req->dst_rect.h = dh;
+    req->alpha = MDP_ALPHA_NOP;
+    req->transp_mask = MDP_TRANSP_NOP;
+}
+
+static uint32_t pick(unsigned int* seed, uint32_t lo, uint32_t hi)
+{
+    return lo + rand_r(seed) % (hi - lo + 1);
+}
+
+// the largest difference of a channel between two pixels
+static int channelDiff(uint32_t format, uint8_t const* a, uint8_t const* b)
+{
+    int diff = 0;
+    if (format == MDP_RGB_565) {
+        int va = a[0] | (a[1] << 8), vb = b[0] | (b[1] << 8);
+        int shifts[3] = { 11, 5, 0 };
+        int masks[3] = { 0x1f, 0x3f, 0x1f };
+        for (int i=0 ; i<3 ; i++) {
+            int d = abs(((va >> shifts[i]) & masks[i]) -
+                    ((vb >> shifts[i]) & masks[i]));
+            if (d > diff) diff = d;
+        }
+    } else {
+        for (int i=0 ; i<4 ; i++) {
+            int d = abs(a[i] - b[i]);
+            if (d > diff) diff = d;
+        }
+    }
+    return diff;
+}
+
+TEST(test_cpublit, testMatchesSoftwareMdp) {
+    static const uint32_t formats[] = {
+        MDP_RGBA_8888, MDP_BGRA_8888, MDP_RGBX_8888, MDP_RGB_565
+    };
+    unsigned int seed = 1;
+    TestSoftware reference;
+    TestCpu cpu;
+
+    for (int n=0 ; n<1000 ; n++) {
+        list_t list;
+        uint32_t sf = formats[pick(&seed, 0, 3)];
+        uint32_t df = formats[pick(&seed, 0, 3)];
+        uint32_t sw = pick(&seed, 1, 24), sh = pick(&seed, 1, 24);
+        uint32_t dw = pick(&seed, 1, 24), dh = pick(&seed, 1, 24);
+        setRequest(&list, sf, sw, sh, df, dw, dh);
+        mdp_blit_req* req = &list.req[0];
+        req->flags = pick(&seed, 0, 7);
+        if (pick(&seed, 0, 3) == 0) req->flags |= MDP_DITHER;
+        if (pick(&seed, 0, 3) == 0) req->flags |= MDP_BLEND_FG_PREMULT;
+        if (pick(&seed, 0, 1)) req->alpha = pick(&seed, 0, 255);
+
+        // a rectangle of each, within the scaling limits
+        const bool rot90 = req->flags & MDP_ROT_90;
+        req->dst_rect.x = pick(&seed, 0, dw - 1);
+        req->dst_rect.y = pick(&seed, 0, dh - 1);
+        req->dst_rect.w = pick(&seed, 1, dw - req->dst_rect.x);
+        req->dst_rect.h = pick(&seed, 1, dh - req->dst_rect.y);
+        uint32_t aw = rot90 ? req->dst_rect.h : req->dst_rect.w;
+        uint32_t ah = rot90 ? req->dst_rect.w : req->dst_rect.h;
+        uint32_t rw = pick(&seed, (aw + 3) / 4, aw * 4);
+        uint32_t rh = pick(&seed, (ah + 3) / 4, ah * 4);
+        if (rw > sw || rh > sh)
+            continue;
+        req->src_rect.x = pick(&seed, 0, sw - rw);
+        req->src_rect.y = pick(&seed, 0, sh - rh);
+        req->src_rect.w = rw;
+        req->src_rect.h = rh;
+        ASSERT_TRUE(CpuBlitter::isFast(req));
+
+        size_t srcSize = SoftwareBlitter::getImageSize(sf, sw, sh);
+        size_t dstSize = SoftwareBlitter::getImageSize(df, dw, dh);
+        uint8_t* src = new uint8_t[srcSize];
+        uint8_t* expected = new uint8_t[dstSize];
+        uint8_t* actual = new uint8_t[dstSize];
+        for (size_t i=0 ; i<srcSize ; i++) src[i] = rand_r(&seed);
+        for (size_t i=0 ; i<dstSize ; i++) expected[i] = rand_r(&seed);
+        if ((req->flags & MDP_BLEND_FG_PREMULT) &&
+                (sf == MDP_RGBA_8888 || sf == MDP_BGRA_8888)) {
+            // colors no larger than alpha
+            for (size_t i=0 ; i<srcSize ; i+=4) {
+                for (int c=0 ; c<3 ; c++)
+                    src[i + c] = src[i + c] * src[i + 3] / 255;
+            }
+        }
+        memcpy(actual, expected, dstSize);
+
+        reference.mImages[0] = src;
+        reference.mImages[1] = expected;
+        cpu.mImages[0] = src;
+        cpu.mImages[1] = actual;
+        ASSERT_EQ(0, reference.blit(asList(&list)));
+        ASSERT_EQ(0, cpu.blit(asList(&list)));
+
+        // filtering and blending round twice, the software MDP once
+        const int bpp = df == MDP_RGB_565 ? 2 : 4;
+        for (size_t i=0 ; i<dstSize ; i+=bpp) {
+            ASSERT_GE(2, channelDiff(df, expected + i, actual + i))
+                    << "case " << n << " pixel " << i / bpp << " flags "
+                    << req->flags << " formats " << sf << "->" << df;
+        }
+        delete [] src;
+        delete [] expected;
+        delete [] actual;
+    }
+}
+
+TEST(test_cpublit, testWideImages) {
+    // wider than the MDP takes
+    const uint32_t w = SoftwareBlitter::kMaxDimension + 904;
+    uint32_t* src = new uint32_t[w * 2];
+    uint16_t* dst = new uint16_t[w * 2];
+    for (uint32_t i=0 ; i<w * 2 ; i++) src[i] = 0xff0000ff;
+
+    list_t list;
+    setRequest(&list, MDP_RGBA_8888, w, 2, MDP_RGB_565, w, 2);
+    TestSoftware reference;
+    reference.mImages[0] = (uint8_t*)src;
+    reference.mImages[1] = (uint8_t*)dst;
+    ASSERT_EQ(-EINVAL, reference.blit(asList(&list)));
+
+    TestCpu cpu;
+    cpu.mImages[0] = (uint8_t*)src;
+    cpu.mImages[1] = (uint8_t*)dst;
+    ASSERT_EQ(0, cpu.blit(asList(&list)));
+    ASSERT_EQ(0xf800, dst[0]);
+    ASSERT_EQ(0xf800, dst[w * 2 - 1]);
+    delete [] src;
+    delete [] dst;
+}
+
+TEST(test_cpublit, testNearest) {
+    uint32_t src[2] = { 0xff000011, 0xff000022 };
+    uint32_t dst[8 * 2];
+    list_t list;
+    setRequest(&list, MDP_RGBA_8888, 2, 1, MDP_RGBA_8888, 8, 2);
+    TestCpu cpu(false);
+    cpu.mImages[0] = (uint8_t*)src;
+    cpu.mImages[1] = (uint8_t*)dst;
+    ASSERT_EQ(0, cpu.blit(asList(&list)));
+    for (int i=0 ; i<16 ; i++) {
+        ASSERT_EQ((i & 7) < 4 ? src[0] : src[1], dst[i]) << i;
+    }
+}
+
+TEST(test_cpublit, testOtherFormatsFallBack) {
+    // NV21 isn't done by the fast path, the result is the software MDP's
+    uint8_t src[12] = {
+        16, 50, 100, 235,   16, 50, 100, 235,   128, 128, 200, 60,
+    };
+    uint8_t expected[4 * 2 * 3], actual[4 * 2 * 3];
+    list_t list;
+    setRequest(&list, MDP_Y_CBCR_H2V2, 4, 2, MDP_RGB_888, 4, 2);
+    ASSERT_FALSE(CpuBlitter::isFast(&list.req[0]));
+
+    TestSoftware reference;
+    reference.mImages[0] = src;
+    reference.mImages[1] = expected;
+    ASSERT_EQ(0, reference.blit(asList(&list)));
+    TestCpu cpu;
+    cpu.mImages[0] = src;
+    cpu.mImages[1] = actual;
+    ASSERT_EQ(0, cpu.blit(asList(&list)));
+    ASSERT_EQ(0, memcmp(expected, actual, sizeof(expected)));
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "region.h"
+
+/******************************************************************************/
+
+enum { kSize = 64 };
+
+// how many rectangles cover each pixel
+static void cover(uint8_t* map, mdp_rect const* rects, int count)
+{
+    memset(map, 0, kSize * kSize);
+    for (int i=0 ; i<count ; i++) {
+        for (uint32_t y=rects[i].y ; y<rects[i].y + rects[i].h ; y++) {
+            for (uint32_t x=rects[i].x ; x<rects[i].x + rects[i].w ; x++)
+                map[y * kSize + x]++;
+        }
+    }
+}
+
+// splits r into up to max pieces by cutting it across, at random
+static int split(unsigned int* seed, mdp_rect r, mdp_rect* out, int max)
+{
+    if (max < 2 || (r.w < 2 && r.h < 2) || rand_r(seed) % 4 == 0) {
+        out[0] = r;
+        return 1;
+    }
+    mdp_rect a = r, b = r;
+    if (r.w >= 2 && (r.h < 2 || rand_r(seed) & 1)) {
+        a.w = 1 + rand_r(seed) % (r.w - 1);
+        b.x += a.w;
+        b.w -= a.w;
+    } else {
+        a.h = 1 + rand_r(seed) % (r.h - 1);
+        b.y += a.h;
+        b.h -= a.h;
+    }
+    int n = split(seed, a, out, max / 2);
+    return n + split(seed, b, out + n, max - n);
+}
+
+TEST(test_region, testStrips) {
+    // a band per line, as a region made of scanlines comes
+    mdp_rect rects[8];
+    for (int i=0 ; i<8 ; i++) {
+        mdp_rect r = { 4, uint32_t(10 + i), 20, 1 };
+        rects[i] = r;
+    }
+    ASSERT_EQ(1, coalesce_rects(rects, 8));
+    ASSERT_EQ(4U, rects[0].x);
+    ASSERT_EQ(10U, rects[0].y);
+    ASSERT_EQ(20U, rects[0].w);
+    ASSERT_EQ(8U, rects[0].h);
+}
+
+TEST(test_region, testSideBySide) {
+    // given out of order, and needing both directions
+    mdp_rect rects[4] = {
+        { 10, 0, 10, 5 }, { 0, 5, 20, 5 }, { 0, 0, 10, 5 }, { 3, 3, 0, 0 },
+    };
+    ASSERT_EQ(1, coalesce_rects(rects, 4));
+    ASSERT_EQ(0U, rects[0].x);
+    ASSERT_EQ(0U, rects[0].y);
+    ASSERT_EQ(20U, rects[0].w);
+    ASSERT_EQ(10U, rects[0].h);
+}
+
+TEST(test_region, testKeepsShape) {
+    // an L and a separate rectangle, which can't become fewer than three
+    mdp_rect rects[4] = {
+        { 0, 0, 4, 4 }, { 0, 4, 4, 4 }, { 4, 4, 4, 4 }, { 20, 0, 4, 4 },
+    };
+    int n = coalesce_rects(rects, 4);
+    ASSERT_EQ(3, n);
+    uint8_t map[kSize * kSize];
+    cover(map, rects, n);
+    ASSERT_EQ(1, map[0]);
+    ASSERT_EQ(1, map[7 * kSize + 7]);
+    ASSERT_EQ(0, map[0 * kSize + 7]);
+    ASSERT_EQ(1, map[0 * kSize + 20]);
+}
+
+TEST(test_region, testGrid) {
+    mdp_rect rects[6 * 5];
+    for (int i=0 ; i<6 * 5 ; i++) {
+        mdp_rect r = { uint32_t(i % 6) * 7, uint32_t(i / 6) * 3, 7, 3 };
+        rects[i] = r;
+    }
+    ASSERT_EQ(1, coalesce_rects(rects, 6 * 5));
+    ASSERT_EQ(42U, rects[0].w);
+    ASSERT_EQ(15U, rects[0].h);
+}
+
+TEST(test_region, testRandomSplits) {
+    unsigned int seed = 1;
+    for (int n=0 ; n<500 ; n++) {
+        mdp_rect whole;
+        whole.x = rand_r(&seed) % 8;
+        whole.y = rand_r(&seed) % 8;
+        whole.w = 1 + rand_r(&seed) % 56;
+        whole.h = 1 + rand_r(&seed) % 56;
+        mdp_rect rects[64];
+        int count = split(&seed, whole, rects, 64);
+
+        // drop one piece now and then, for a region with a hole
+        bool hole = count > 1 && rand_r(&seed) % 2;
+        if (hole) {
+            int i = rand_r(&seed) % count;
+            rects[i] = rects[--count];
+        }
+
+        uint8_t expected[kSize * kSize], actual[kSize * kSize];
+        cover(expected, rects, count);
+        int merged = coalesce_rects(rects, count);
+        cover(actual, rects, merged);
+        ASSERT_LE(merged, count);
+        ASSERT_EQ(0, memcmp(expected, actual, sizeof(expected))) << "case " << n;
+        if (count == 2 && !hole) {
+            ASSERT_EQ(1, merged) << "case " << n;
+        }
+    }
+}
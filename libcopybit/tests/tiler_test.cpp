@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "cpublit.h"
+#include "tiler.h"
+
+/******************************************************************************/
+
+// the source, the destination and the intermediate image, by memory_id
+#define MEMORY_IMAGES                                                       \
+    enum { kImages = 3 };                                                   \
+    uint8_t* mImages[kImages];                                              \
+    virtual uint8_t* map(mdp_img const& img, size_t size) {                 \
+        if (img.memory_id < 0 || img.memory_id >= kImages)                  \
+            return 0;                                                       \
+        return mImages[img.memory_id] + img.offset;                         \
+    }                                                                       \
+    virtual void unmap(mdp_img const& img, uint8_t* base, size_t size) {}   \
+    virtual void flush(mdp_img const& img, uint8_t* base, size_t size) {}
+
+class TestSoftware : public SoftwareBlitter {
+ public:
+    MEMORY_IMAGES
+};
+
+class TestCpu : public CpuBlitter {
+ public:
+    MEMORY_IMAGES
+};
+
+struct list_t {
+    uint32_t count;
+    mdp_blit_req req[2];
+};
+
+static mdp_blit_req_list const* asList(list_t const* list)
+{
+    return (mdp_blit_req_list const*)list;
+}
+
+static void setRequest(mdp_blit_req* req, uint32_t format, uint32_t sw,
+        uint32_t sh, uint32_t dw, uint32_t dh)
+{
+    memset(req, 0, sizeof(*req));
+    req->src.width = sw;
+    req->src.height = sh;
+    req->src.format = format;
+    req->src.memory_id = 0;
+    req->dst.width = dw;
+    req->dst.height = dh;
+    req->dst.format = format;
+    req->dst.memory_id = 1;
+    req->src_rect.w = sw;
+    req->src_rect.h = sh;
+    req->dst_rect.w = dw;
+    req->dst_rect.h = dh;
+    req->alpha = MDP_ALPHA_NOP;
+    req->transp_mask = MDP_TRANSP_NOP;
+}
+
+TEST(test_tiler, testRebaseRows) {
+    // a band of a source and a destination taller than the MDP takes
+    const uint32_t h = SoftwareBlitter::kMaxDimension + 100;
+    uint32_t* src = new uint32_t[4 * h];
+    uint32_t* dst = new uint32_t[4 * h];
+    for (uint32_t i=0 ; i<4 * h ; i++) {
+        src[i] = i & 0xffffff;
+        dst[i] = 0;
+    }
+
+    list_t list;
+    list.count = 1;
+    mdp_blit_req* req = &list.req[0];
+    setRequest(req, MDP_RGBX_8888, 4, h, 4, h);
+    req->src_rect.y = h - 60;
+    req->src_rect.h = 50;
+    req->dst_rect.y = h - 50;
+    req->dst_rect.h = 50;
+
+    TestSoftware mdp;
+    mdp.mImages[0] = (uint8_t*)src;
+    mdp.mImages[1] = (uint8_t*)dst;
+    ASSERT_EQ(-EINVAL, mdp.blit(asList(&list)));
+
+    ASSERT_TRUE(rebase_rows(req));
+    ASSERT_EQ(0U, req->src_rect.y);
+    ASSERT_EQ(50U, req->src.height);
+    ASSERT_EQ((h - 60) * 4 * 4, req->src.offset);
+    ASSERT_EQ(0, mdp.blit(asList(&list)));
+    for (uint32_t y=0 ; y<h ; y++) {
+        for (uint32_t x=0 ; x<4 ; x++) {
+            // RGBX is written opaque
+            uint32_t expected = (y >= h - 50) ?
+                    src[(y - 10) * 4 + x] | 0xff000000 : 0;
+            ASSERT_EQ(expected, dst[y * 4 + x]) << x << "," << y;
+        }
+    }
+    delete [] src;
+    delete [] dst;
+}
+
+TEST(test_tiler, testPlanarNotRebased) {
+    mdp_blit_req req;
+    setRequest(&req, MDP_RGB_565, 4, 4, 4, 4);
+    req.src.format = MDP_Y_CRCB_H2V2;
+    req.src_rect.y = 2;
+    req.src_rect.h = 2;
+    ASSERT_FALSE(rebase_rows(&req));
+}
+
+TEST(test_tiler, testFitsScale) {
+    mdp_blit_req req;
+    setRequest(&req, MDP_RGB_565, 64, 8, 16, 8);
+    ASSERT_TRUE(fits_scale(&req, 4));
+    req.src_rect.w = 65;
+    ASSERT_FALSE(fits_scale(&req, 4));
+    // rotated, the source's width becomes the destination's height
+    req.flags = MDP_ROT_90;
+    req.src_rect.w = 64;
+    req.dst_rect.w = 8;
+    req.dst_rect.h = 16;
+    ASSERT_TRUE(fits_scale(&req, 4));
+}
+
+TEST(test_tiler, testTwoPasses) {
+    // a gradient, which scaling in one pass or two keeps alike
+    const uint32_t sw = 96, sh = 96;
+    uint8_t* src = new uint8_t[sw * sh * 4];
+    for (uint32_t y=0 ; y<sh ; y++) {
+        for (uint32_t x=0 ; x<sw ; x++) {
+            uint8_t* p = src + (y * sw + x) * 4;
+            p[0] = x * 2;
+            p[1] = y * 2;
+            p[2] = (x + y);
+            p[3] = 255;
+        }
+    }
+    static const struct {
+        uint32_t dw, dh, flags;
+    } cases[] = {
+        { 12, 10, 0 },                          // down 8x and 9.6x
+        { 80, 80, MDP_ROT_90 | MDP_FLIP_LR },   // up 6.7x, down 1.2x
+        { 10, 9, MDP_ROT_270 | MDP_DITHER },
+    };
+    for (size_t c=0 ; c<sizeof(cases)/sizeof(cases[0]) ; c++) {
+        uint32_t dw = cases[c].dw, dh = cases[c].dh;
+        uint32_t sw2 = (cases[c].flags & MDP_ROT_90) ? 12 : sw;
+        list_t list;
+        list.count = 1;
+        mdp_blit_req* req = &list.req[0];
+        setRequest(req, MDP_RGBA_8888, sw, sh, dw, dh);
+        req->src_rect.w = sw2;
+        req->flags = cases[c].flags;
+        req->alpha = 0xc0;
+
+        uint8_t* expected = new uint8_t[dw * dh * 4];
+        uint8_t* actual = new uint8_t[dw * dh * 4];
+        memset(expected, 0x40, dw * dh * 4);
+        memset(actual, 0x40, dw * dh * 4);
+
+        // in one go on the CPU, which doesn't limit scaling
+        TestCpu cpu;
+        cpu.mImages[0] = src;
+        cpu.mImages[1] = expected;
+        ASSERT_EQ(0, cpu.blit(asList(&list)));
+
+        TestSoftware mdp;
+        mdp.mImages[0] = src;
+        mdp.mImages[1] = actual;
+        ASSERT_FALSE(fits_scale(req, SoftwareBlitter::kMaxScale));
+        ASSERT_EQ(-EINVAL, mdp.blit(asList(&list)));
+
+        list_t passes;
+        passes.count = 2;
+        mdp_img tmp;
+        tmp.memory_id = 2;
+        tmp.offset = 0;
+        size_t size = split_passes(req, SoftwareBlitter::kMaxScale, &tmp,
+                passes.req);
+        ASSERT_TRUE(fits_scale(&passes.req[0], SoftwareBlitter::kMaxScale));
+        ASSERT_TRUE(fits_scale(&passes.req[1], SoftwareBlitter::kMaxScale));
+        ASSERT_EQ((uint32_t)MDP_RGBA_8888, tmp.format);
+        uint8_t* between = new uint8_t[size];
+        mdp.mImages[2] = between;
+        ASSERT_EQ(0, mdp.blit(asList(&passes)));
+
+        for (uint32_t i=0 ; i<dw * dh * 4 ; i++) {
+            ASSERT_NEAR(expected[i], actual[i], 3)
+                    << "case " << c << " byte " << i;
+        }
+        delete [] between;
+        delete [] expected;
+        delete [] actual;
+    }
+    delete [] src;
+}
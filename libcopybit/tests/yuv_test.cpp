@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "yuv.h"
+
+/******************************************************************************/
+
+// the kernels against plain per-sample versions
+
+static uint32_t pick(unsigned int* seed, uint32_t lo, uint32_t hi)
+{
+    return lo + rand_r(seed) % (hi - lo + 1);
+}
+
+static uint32_t pickEven(unsigned int* seed, uint32_t lo, uint32_t hi)
+{
+    return pick(seed, lo / 2, hi / 2) * 2;
+}
+
+static uint8_t* newFrame(unsigned int* seed, uint32_t w, uint32_t h)
+{
+    size_t size = yuv420sp_size(w, h);
+    uint8_t* frame = new uint8_t[size];
+    for (size_t i=0 ; i<size ; i++) frame[i] = rand_r(seed);
+    return frame;
+}
+
+static int clamp(int v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+static void referenceRgb(uint8_t const* src, uint32_t w, uint32_t h,
+        uint32_t x, uint32_t y, bool nv12, int* r, int* g, int* b)
+{
+    uint8_t const* c = src + w * h + (y / 2) * w + (x & ~1);
+    int luma = 298 * (src[y * w + x] - 16);
+    int u = c[nv12 ? 0 : 1] - 128;
+    int v = c[nv12 ? 1 : 0] - 128;
+    *r = clamp((luma + 409 * v + 128) >> 8);
+    *g = clamp((luma - 100 * u - 208 * v + 128) >> 8);
+    *b = clamp((luma + 516 * u + 128) >> 8);
+}
+
+// bilinear, in floating point, of a plane of samples bpp bytes apart
+static double referenceSample(uint8_t const* plane, uint32_t stride,
+        uint32_t bpp, uint32_t sw, uint32_t sh, uint32_t dw, uint32_t dh,
+        uint32_t x, uint32_t y)
+{
+    double fx = (x + 0.5) * sw / dw - 0.5;
+    double fy = (y + 0.5) * sh / dh - 0.5;
+    fx = fx < 0 ? 0 : (fx > sw - 1 ? sw - 1 : fx);
+    fy = fy < 0 ? 0 : (fy > sh - 1 ? sh - 1 : fy);
+    uint32_t x0 = uint32_t(fx), y0 = uint32_t(fy);
+    uint32_t x1 = x0 + 1 < sw ? x0 + 1 : x0;
+    uint32_t y1 = y0 + 1 < sh ? y0 + 1 : y0;
+    double wx = fx - x0, wy = fy - y0;
+    double top = plane[y0 * stride + x0 * bpp] * (1 - wx) +
+            plane[y0 * stride + x1 * bpp] * wx;
+    double bottom = plane[y1 * stride + x0 * bpp] * (1 - wx) +
+            plane[y1 * stride + x1 * bpp] * wx;
+    return top * (1 - wy) + bottom * wy;
+}
+
+TEST(test_yuv, testCropInPlace) {
+    unsigned int seed = 1;
+    for (int n=0 ; n<200 ; n++) {
+        uint32_t w = pickEven(&seed, 2, 96), h = pickEven(&seed, 2, 96);
+        mdp_rect r;
+        r.w = pickEven(&seed, 2, w);
+        r.h = pickEven(&seed, 2, h);
+        r.x = pickEven(&seed, 0, w - r.w);
+        r.y = pickEven(&seed, 0, h - r.h);
+        uint8_t* frame = newFrame(&seed, w, h);
+
+        uint8_t* expected = new uint8_t[yuv420sp_size(r.w, r.h)];
+        for (uint32_t y=0 ; y<r.h ; y++) {
+            for (uint32_t x=0 ; x<r.w ; x++) {
+                expected[y * r.w + x] = frame[(r.y + y) * w + r.x + x];
+                if (!(y & 1)) {
+                    expected[r.w * r.h + (y / 2) * r.w + x] =
+                            frame[w * h + ((r.y + y) / 2) * w + r.x + x];
+                }
+            }
+        }
+        yuv420sp_crop(frame, frame, w, h, &r);
+        ASSERT_EQ(0, memcmp(expected, frame, yuv420sp_size(r.w, r.h)))
+                << "case " << n;
+        delete [] expected;
+        delete [] frame;
+    }
+}
+
+TEST(test_yuv, testScaleIdentity) {
+    unsigned int seed = 2;
+    const uint32_t w = 38, h = 22;
+    uint8_t* src = newFrame(&seed, w, h);
+    uint8_t* dst = new uint8_t[yuv420sp_size(w, h)];
+    mdp_rect r = { 0, 0, w, h };
+    ASSERT_EQ(0, yuv420sp_scale(dst, w, h, src, w, h, &r));
+    ASSERT_EQ(0, memcmp(src, dst, yuv420sp_size(w, h)));
+
+    r.x = w;
+    ASSERT_EQ(-EINVAL, yuv420sp_scale(dst, w, h, src, w, h, &r));
+    delete [] src;
+    delete [] dst;
+}
+
+TEST(test_yuv, testScaleMatchesReference) {
+    unsigned int seed = 3;
+    for (int n=0 ; n<200 ; n++) {
+        uint32_t sw = pickEven(&seed, 2, 80), sh = pickEven(&seed, 2, 80);
+        uint32_t dw = pickEven(&seed, 2, 80), dh = pickEven(&seed, 2, 80);
+        mdp_rect r;
+        r.w = pickEven(&seed, 2, sw);
+        r.h = pickEven(&seed, 2, sh);
+        r.x = pickEven(&seed, 0, sw - r.w);
+        r.y = pickEven(&seed, 0, sh - r.h);
+        uint8_t* src = newFrame(&seed, sw, sh);
+        uint8_t* dst = new uint8_t[yuv420sp_size(dw, dh)];
+        ASSERT_EQ(0, yuv420sp_scale(dst, dw, dh, src, sw, sh, &r));
+
+        // the weights are to 1/256, and the result is rounded twice
+        uint8_t const* luma = src + r.y * sw + r.x;
+        for (uint32_t y=0 ; y<dh ; y++) {
+            for (uint32_t x=0 ; x<dw ; x++) {
+                double e = referenceSample(luma, sw, 1, r.w, r.h, dw, dh,
+                        x, y);
+                ASSERT_GE(2, fabs(e - dst[y * dw + x]))
+                        << "case " << n << " luma " << x << "," << y;
+            }
+        }
+        uint8_t const* chroma = src + sw * sh + (r.y / 2) * sw + r.x;
+        for (uint32_t y=0 ; y<dh / 2 ; y++) {
+            for (uint32_t x=0 ; x<dw ; x++) {
+                double e = referenceSample(chroma + (x & 1), sw, 2,
+                        r.w / 2, r.h / 2, dw / 2, dh / 2, x / 2, y);
+                ASSERT_GE(2, fabs(e - dst[dw * dh + y * dw + x]))
+                        << "case " << n << " chroma " << x << "," << y;
+            }
+        }
+        delete [] src;
+        delete [] dst;
+    }
+}
+
+TEST(test_yuv, testConvert) {
+    unsigned int seed = 4;
+    for (int n=0 ; n<100 ; n++) {
+        uint32_t w = pickEven(&seed, 2, 70), h = pickEven(&seed, 2, 20);
+        uint32_t stride = w + pick(&seed, 0, 5);
+        bool nv12 = pick(&seed, 0, 1);
+        uint8_t* src = newFrame(&seed, w, h);
+        uint16_t* rgb565 = new uint16_t[stride * h];
+        uint32_t* rgba = new uint32_t[stride * h];
+        yuv420sp_to_rgb565(rgb565, stride, src, w, h, nv12);
+        yuv420sp_to_rgba(rgba, stride, src, w, h, nv12);
+        for (uint32_t y=0 ; y<h ; y++) {
+            for (uint32_t x=0 ; x<w ; x++) {
+                int r, g, b;
+                referenceRgb(src, w, h, x, y, nv12, &r, &g, &b);
+                ASSERT_EQ(uint32_t(0xff000000 | (b << 16) | (g << 8) | r),
+                        rgba[y * stride + x])
+                        << "case " << n << " pixel " << x << "," << y;
+                ASSERT_EQ(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3),
+                        rgb565[y * stride + x])
+                        << "case " << n << " pixel " << x << "," << y;
+            }
+        }
+        delete [] src;
+        delete [] rgb565;
+        delete [] rgba;
+    }
+}
+
+TEST(test_yuv, testRotate) {
+    unsigned int seed = 5;
+    for (int n=0 ; n<100 ; n++) {
+        uint32_t w = pickEven(&seed, 2, 70), h = pickEven(&seed, 2, 70);
+        uint8_t* src = newFrame(&seed, w, h);
+        uint8_t* dst = new uint8_t[yuv420sp_size(w, h)];
+        yuv420sp_rotate90(dst, src, w, h);
+        for (uint32_t y=0 ; y<h ; y++) {
+            for (uint32_t x=0 ; x<w ; x++) {
+                ASSERT_EQ(src[y * w + x], dst[x * h + h - 1 - y])
+                        << "case " << n << " luma " << x << "," << y;
+            }
+        }
+        uint8_t const* sc = src + w * h;
+        uint8_t const* dc = dst + w * h;
+        for (uint32_t y=0 ; y<h / 2 ; y++) {
+            for (uint32_t x=0 ; x<w / 2 ; x++) {
+                for (int c=0 ; c<2 ; c++) {
+                    ASSERT_EQ(sc[y * w + x * 2 + c],
+                            dc[x * h + (h / 2 - 1 - y) * 2 + c])
+                            << "case " << n << " chroma " << x << "," << y;
+                }
+            }
+        }
+
+        // four times round is where it started
+        uint8_t* back = new uint8_t[yuv420sp_size(w, h)];
+        yuv420sp_rotate90(back, dst, h, w);
+        yuv420sp_rotate90(dst, back, w, h);
+        yuv420sp_rotate90(back, dst, h, w);
+        ASSERT_EQ(0, memcmp(src, back, yuv420sp_size(w, h)));
+        delete [] src;
+        delete [] dst;
+        delete [] back;
+    }
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tiler.h"
+#include "blitter.h"
+
+/*****************************************************************************/
+
+static bool isPlanar(uint32_t format)
+{
+    switch (format) {
+        case MDP_Y_CBCR_H2V2:
+        case MDP_Y_CRCB_H2V2:
+        case MDP_Y_CBCR_H2V1:
+        case MDP_Y_CRCB_H2V1:
+            return true;
+    }
+    return false;
+}
+
+static void rebase(mdp_img* img, mdp_rect* rect)
+{
+    // the bytes of rect->y whole rows
+    img->offset += SoftwareBlitter::getImageSize(img->format,
+            img->width, rect->y);
+    img->height = rect->h;
+    rect->y = 0;
+}
+
+bool rebase_rows(struct mdp_blit_req* req)
+{
+    if (isPlanar(req->src.format) || isPlanar(req->dst.format))
+        return false;
+    rebase(&req->src, &req->src_rect);
+    rebase(&req->dst, &req->dst_rect);
+    return true;
+}
+
+bool fits_scale(struct mdp_blit_req const* req, uint32_t maxScale)
+{
+    // the destination spans along the source's x and y axes
+    const bool rot90 = req->flags & MDP_ROT_90;
+    const uint32_t sw = req->src_rect.w, sh = req->src_rect.h;
+    const uint32_t aw = rot90 ? req->dst_rect.h : req->dst_rect.w;
+    const uint32_t ah = rot90 ? req->dst_rect.w : req->dst_rect.h;
+    return !(sw > aw * maxScale || aw > sw * maxScale ||
+             sh > ah * maxScale || ah > sh * maxScale);
+}
+
+// the size of the intermediate image on one axis, s source pixels
+// becoming a
+static uint32_t between(uint32_t s, uint32_t a, uint32_t maxScale)
+{
+    if (s > a * maxScale)
+        return (s + maxScale - 1) / maxScale;
+    if (a > s * maxScale)
+        return s * maxScale;
+    return s;
+}
+
+size_t split_passes(struct mdp_blit_req const* req, uint32_t maxScale,
+        struct mdp_img* tmp, struct mdp_blit_req* passes)
+{
+    const bool rot90 = req->flags & MDP_ROT_90;
+    const uint32_t aw = rot90 ? req->dst_rect.h : req->dst_rect.w;
+    const uint32_t ah = rot90 ? req->dst_rect.w : req->dst_rect.h;
+
+    // in the source's orientation, keeping alpha if the source has it
+    tmp->width = between(req->src_rect.w, aw, maxScale);
+    tmp->height = between(req->src_rect.h, ah, maxScale);
+    switch (req->src.format) {
+        case MDP_RGB_565:
+        case MDP_ARGB_8888:
+        case MDP_RGBA_8888:
+        case MDP_BGRA_8888:
+            tmp->format = req->src.format;
+            break;
+        default:
+            tmp->format = MDP_RGBX_8888;
+            break;
+    }
+
+    // only scaling, then everything else: the flips and the rotation of
+    // the whole source rectangle, blending, dithering
+    mdp_blit_req* first = &passes[0];
+    *first = *req;
+    first->dst = *tmp;
+    first->dst_rect.x = 0;
+    first->dst_rect.y = 0;
+    first->dst_rect.w = tmp->width;
+    first->dst_rect.h = tmp->height;
+    first->alpha = MDP_ALPHA_NOP;
+    first->transp_mask = MDP_TRANSP_NOP;
+    first->flags = 0;
+
+    mdp_blit_req* second = &passes[1];
+    *second = *req;
+    second->src = *tmp;
+    second->src_rect = first->dst_rect;
+
+    return SoftwareBlitter::getImageSize(tmp->format,
+            tmp->width, tmp->height);
+}
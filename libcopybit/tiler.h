@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COPYBIT_MSM7K_TILER_H
+#define COPYBIT_MSM7K_TILER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "msm_mdp.h"
+
+/*
+ * Helpers for stretch_copybit() to turn a blit the MDP refuses, for the
+ * size of its images or for how much it scales, into requests it takes.
+ * The requests come from set_rects() as for any other blit and are only
+ * re-expressed, so they sample the same source pixels.
+ */
+
+// Moves the origin of the images of req to the first row of their
+// rectangles, and their heights to those of the rectangles, so tall images
+// can be done a band at a time. Only for formats with a single plane,
+// false for the others.
+bool rebase_rows(struct mdp_blit_req* req);
+
+// whether req scales by no more than maxScale either way, on both axes
+bool fits_scale(struct mdp_blit_req const* req, uint32_t maxScale);
+
+// Splits req, which scales by up to maxScale squared, into passes[0]
+// scaling its source rectangle into tmp and passes[1] doing the rest of
+// req from there, each within maxScale. tmp.memory_id and offset are the
+// caller's, its size and format are set. Returns the bytes tmp needs.
+size_t split_passes(struct mdp_blit_req const* req, uint32_t maxScale,
+        struct mdp_img* tmp, struct mdp_blit_req* passes);
+
+#endif  // COPYBIT_MSM7K_TILER_H
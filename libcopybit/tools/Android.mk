@@ -0,0 +1,55 @@
+# Copyright (C) 2010 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+# the CPU blitter against the software MDP, on the host and on the device
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := blit_bench.cpp
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+LOCAL_STATIC_LIBRARIES := libmdpblit_host libcutils liblog
+LOCAL_LDLIBS := -lrt
+LOCAL_MODULE := blit_bench
+LOCAL_MODULE_TAGS := eng
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := blit_bench.cpp
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+LOCAL_STATIC_LIBRARIES := libmdpblit
+LOCAL_SHARED_LIBRARIES := libcutils liblog
+LOCAL_MODULE := blit_bench
+LOCAL_MODULE_TAGS := eng
+include $(BUILD_EXECUTABLE)
+
+# the YUV kernels against the software MDP, on the host and on the device
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := yuv_bench.cpp
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+LOCAL_STATIC_LIBRARIES := libmdpblit_host libcutils liblog
+LOCAL_LDLIBS := -lrt
+LOCAL_MODULE := yuv_bench
+LOCAL_MODULE_TAGS := eng
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := yuv_bench.cpp
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+LOCAL_STATIC_LIBRARIES := libmdpblit
+LOCAL_SHARED_LIBRARIES := libcutils liblog
+LOCAL_MODULE := yuv_bench
+LOCAL_MODULE_TAGS := eng
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Times the CPU blitter against the software MDP on the blits copybit
+ * hands to the CPU, and a few it doesn't:
+ *
+ *     blit_bench [-w <width>] [-h <height>] [-n <iterations>]
+ *
+ * The images are in plain memory, the screen sized by default.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cpublit.h"
+
+/*****************************************************************************/
+
+#define MEMORY_IMAGES                                                       \
+    uint8_t* mImages[2];                                                    \
+    virtual uint8_t* map(mdp_img const& img, size_t size) {                 \
+        return mImages[img.memory_id] + img.offset;                         \
+    }                                                                       \
+    virtual void unmap(mdp_img const& img, uint8_t* base, size_t size) {}   \
+    virtual void flush(mdp_img const& img, uint8_t* base, size_t size) {}
+
+class BenchSoftware : public SoftwareBlitter {
+ public:
+    MEMORY_IMAGES
+};
+
+class BenchCpu : public CpuBlitter {
+ public:
+    BenchCpu(bool filter) : CpuBlitter(filter) {}
+    MEMORY_IMAGES
+};
+
+struct case_t {
+    const char* name;
+    uint32_t    srcFormat;
+    uint32_t    dstFormat;
+    int         scale;      // source size over destination size, in %
+    uint32_t    flags;
+    uint32_t    alpha;
+    int         wide;       // wider than the MDP takes, like a wallpaper
+};
+
+static const case_t sCases[] = {
+    { "copy 565",                 MDP_RGB_565,   MDP_RGB_565,   100, 0,          0xff, 0 },
+    { "RGBA to 565, dithered",    MDP_RGBA_8888, MDP_RGB_565,   100, MDP_DITHER, 0xff, 0 },
+    { "BGRA to RGBA",             MDP_BGRA_8888, MDP_RGBA_8888, 100, 0,          0xff, 0 },
+    { "RGBA plane alpha to 565",  MDP_RGBA_8888, MDP_RGB_565,   100, 0,          0x80, 0 },
+    { "RGBA plane alpha to RGBA", MDP_RGBA_8888, MDP_RGBA_8888, 100, 0,          0x80, 0 },
+    { "RGBA premultiplied",       MDP_RGBA_8888, MDP_RGBA_8888, 100,
+                                  MDP_BLEND_FG_PREMULT,                  0x80, 0 },
+    { "565 up 2x",                MDP_RGB_565,   MDP_RGB_565,   50,  0,          0xff, 0 },
+    { "RGBA down 2x to 565",      MDP_RGBA_8888, MDP_RGB_565,   200, 0,          0xff, 0 },
+    { "565 rotated 90",           MDP_RGB_565,   MDP_RGB_565,   100, MDP_ROT_90, 0xff, 0 },
+    { "565 rotated 180",          MDP_RGB_565,   MDP_RGB_565,   100, MDP_ROT_180,0xff, 0 },
+    { "RGBA rotated 270 to 565",  MDP_RGBA_8888, MDP_RGB_565,   100, MDP_ROT_270,0xff, 0 },
+    { "wide RGBA to 565",         MDP_RGBA_8888, MDP_RGB_565,   100, 0,          0xff, 1 },
+};
+
+static int64_t now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+// Mpixel/s of n blits, 0 if the blitter refused it
+static double run(Blitter* blitter, mdp_blit_req_list const* list, int n)
+{
+    mdp_blit_req const* req = &list->req[0];
+    int64_t start = now();
+    for (int i=0 ; i<n ; i++) {
+        if (blitter->blit(list) < 0)
+            return 0;
+    }
+    double seconds = (now() - start) / 1e9;
+    return double(req->dst_rect.w) * req->dst_rect.h * n / seconds / 1e6;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr, "usage: %s [-w <width>] [-h <height>] [-n <iterations>]\n",
+            name);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t w = 320, h = 480;
+    int n = 20;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "w:h:n:")) != -1) {
+        switch (opt) {
+            case 'w': w = atoi(optarg); break;
+            case 'h': h = atoi(optarg); break;
+            case 'n': n = atoi(optarg); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc || !w || !h || n < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // large enough for any of the cases
+    const uint32_t wide = SoftwareBlitter::kMaxDimension + w;
+    size_t size = size_t(w) * h * 4 * 4;
+    if (size < size_t(wide) * h * 4)
+        size = size_t(wide) * h * 4;
+    uint8_t* src = (uint8_t*)malloc(size);
+    uint8_t* dst = (uint8_t*)malloc(size);
+    if (!src || !dst) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    unsigned int seed = 1;
+    for (size_t i=0 ; i<size ; i++) {
+        src[i] = rand_r(&seed);
+        dst[i] = rand_r(&seed);
+    }
+
+    BenchSoftware reference;
+    BenchCpu filtered(true);
+    BenchCpu nearest(false);
+    Blitter* blitters[3] = { &reference, &filtered, &nearest };
+    reference.mImages[0] = filtered.mImages[0] = nearest.mImages[0] = src;
+    reference.mImages[1] = filtered.mImages[1] = nearest.mImages[1] = dst;
+
+    printf("%ux%u, Mpixel/s        software MDP   cpu bilinear  cpu nearest\n",
+            w, h);
+    for (size_t c=0 ; c<sizeof(sCases)/sizeof(sCases[0]) ; c++) {
+        case_t const& k = sCases[c];
+        struct {
+            uint32_t count;
+            mdp_blit_req req[1];
+        } list;
+        memset(&list, 0, sizeof(list));
+        list.count = 1;
+        mdp_blit_req* req = &list.req[0];
+
+        uint32_t dw = (k.flags & MDP_ROT_90) ? h : w;
+        uint32_t dh = (k.flags & MDP_ROT_90) ? w : h;
+        req->src.width = k.wide ? wide : w * k.scale / 100;
+        req->src.height = h * k.scale / 100;
+        req->src.format = k.srcFormat;
+        req->src.memory_id = 0;
+        req->src_rect.w = req->src.width;
+        req->src_rect.h = req->src.height;
+        req->dst.width = k.wide ? wide : dw;
+        req->dst.height = dh;
+        req->dst.format = k.dstFormat;
+        req->dst.memory_id = 1;
+        req->dst_rect.w = req->dst.width;
+        req->dst_rect.h = dh;
+        req->alpha = k.alpha;
+        req->transp_mask = MDP_TRANSP_NOP;
+        req->flags = k.flags;
+
+        printf("%-26s", k.name);
+        for (int b=0 ; b<3 ; b++) {
+            double rate = run(blitters[b], (mdp_blit_req_list const*)&list, n);
+            if (rate > 0) {
+                printf("  %12.1f", rate);
+            } else {
+                printf("  %12s", "refused");
+            }
+        }
+        printf("\n");
+    }
+
+    free(src);
+    free(dst);
+    return 0;
+}
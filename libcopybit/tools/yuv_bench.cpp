@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Times the YUV kernels the camera uses against the software MDP doing
+ * the same:
+ *
+ *     yuv_bench [-w <width>] [-h <height>] [-n <iterations>]
+ *
+ * The frames are NV21 in plain memory, VGA by default.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "blitter.h"
+#include "yuv.h"
+
+/*****************************************************************************/
+
+class BenchSoftware : public SoftwareBlitter {
+ public:
+    uint8_t* mImages[2];
+    virtual uint8_t* map(mdp_img const& img, size_t size) {
+        return mImages[img.memory_id] + img.offset;
+    }
+    virtual void unmap(mdp_img const& img, uint8_t* base, size_t size) {}
+    virtual void flush(mdp_img const& img, uint8_t* base, size_t size) {}
+};
+
+enum {
+    CROP,
+    ZOOM,
+    TO_RGB565,
+    TO_RGBA,
+    ROTATE_90
+};
+
+struct case_t {
+    const char* name;
+    int         kernel;
+    uint32_t    dstFormat;
+};
+
+static const case_t sCases[] = {
+    { "crop to a half",       CROP,      MDP_Y_CRCB_H2V2 },
+    { "zoom a half 2x",       ZOOM,      MDP_Y_CRCB_H2V2 },
+    { "NV21 to 565",          TO_RGB565, MDP_RGB_565 },
+    { "NV21 to RGBA",         TO_RGBA,   MDP_RGBA_8888 },
+    { "NV21 rotated 90",      ROTATE_90, MDP_Y_CRCB_H2V2 },
+};
+
+static int64_t now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static void runKernel(case_t const& k, uint8_t* dst, uint8_t* src,
+        uint32_t w, uint32_t h)
+{
+    mdp_rect half = { w / 4 & ~1, h / 4 & ~1, w / 2 & ~1, h / 2 & ~1 };
+    switch (k.kernel) {
+        case CROP:
+            // not in place, or the next run would crop the crop
+            yuv420sp_crop(dst, src, w, h, &half);
+            break;
+        case ZOOM:
+            yuv420sp_scale(dst, w, h, src, w, h, &half);
+            break;
+        case TO_RGB565:
+            yuv420sp_to_rgb565((uint16_t*)dst, w, src, w, h, false);
+            break;
+        case TO_RGBA:
+            yuv420sp_to_rgba((uint32_t*)dst, w, src, w, h, false);
+            break;
+        case ROTATE_90:
+            yuv420sp_rotate90(dst, src, w, h);
+            break;
+    }
+}
+
+// the same as a blit
+static void setRequest(case_t const& k, mdp_blit_req* req,
+        uint32_t w, uint32_t h)
+{
+    memset(req, 0, sizeof(*req));
+    req->src.width = w;
+    req->src.height = h;
+    req->src.format = MDP_Y_CRCB_H2V2;
+    req->src.memory_id = 0;
+    req->dst.width = w;
+    req->dst.height = h;
+    req->dst.format = k.dstFormat;
+    req->dst.memory_id = 1;
+    req->src_rect.w = w;
+    req->src_rect.h = h;
+    req->dst_rect.w = w;
+    req->dst_rect.h = h;
+    req->alpha = MDP_ALPHA_NOP;
+    req->transp_mask = MDP_TRANSP_NOP;
+    switch (k.kernel) {
+        case CROP:
+            req->src_rect.x = w / 4 & ~1;
+            req->src_rect.y = h / 4 & ~1;
+            req->src_rect.w = req->dst_rect.w = req->dst.width = w / 2 & ~1;
+            req->src_rect.h = req->dst_rect.h = req->dst.height = h / 2 & ~1;
+            break;
+        case ZOOM:
+            req->src_rect.x = w / 4 & ~1;
+            req->src_rect.y = h / 4 & ~1;
+            req->src_rect.w = w / 2 & ~1;
+            req->src_rect.h = h / 2 & ~1;
+            break;
+        case ROTATE_90:
+            req->dst.width = req->dst_rect.w = h;
+            req->dst.height = req->dst_rect.h = w;
+            req->flags = MDP_ROT_90;
+            break;
+    }
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr, "usage: %s [-w <width>] [-h <height>] [-n <iterations>]\n",
+            name);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t w = 640, h = 480;
+    int n = 20;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "w:h:n:")) != -1) {
+        switch (opt) {
+            case 'w': w = atoi(optarg); break;
+            case 'h': h = atoi(optarg); break;
+            case 'n': n = atoi(optarg); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc || w < 4 || h < 4 || (w | h) & 1 || n < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // large enough for RGBA
+    size_t size = size_t(w) * h * 4;
+    uint8_t* src = (uint8_t*)malloc(size);
+    uint8_t* dst = (uint8_t*)malloc(size);
+    if (!src || !dst) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    unsigned int seed = 1;
+    for (size_t i=0 ; i<size ; i++)
+        src[i] = rand_r(&seed);
+
+    BenchSoftware reference;
+    reference.mImages[0] = src;
+    reference.mImages[1] = dst;
+
+    printf("%ux%u, Mpixel/s   software MDP       kernel\n", w, h);
+    for (size_t c=0 ; c<sizeof(sCases)/sizeof(sCases[0]) ; c++) {
+        case_t const& k = sCases[c];
+        struct {
+            uint32_t count;
+            mdp_blit_req req[1];
+        } list;
+        list.count = 1;
+        setRequest(k, &list.req[0], w, h);
+        const double pixels = double(list.req[0].dst_rect.w) *
+                list.req[0].dst_rect.h * n;
+
+        printf("%-21s", k.name);
+        int64_t start = now();
+        int err = 0;
+        for (int i=0 ; i<n && !err ; i++)
+            err = reference.blit((mdp_blit_req_list const*)&list);
+        if (err < 0) {
+            printf("  %12s", "refused");
+        } else {
+            printf("  %12.1f", pixels / ((now() - start) / 1e3));
+        }
+
+        start = now();
+        for (int i=0 ; i<n ; i++)
+            runKernel(k, dst, src, w, h);
+        printf("  %12.1f\n", pixels / ((now() - start) / 1e3));
+    }
+
+    free(src);
+    free(dst);
+    return 0;
+}
@@ -0,0 +1,490 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "yuv.h"
+
+/*****************************************************************************/
+
+size_t yuv420sp_size(uint32_t w, uint32_t h)
+{
+    return size_t(w) * h * 3 / 2;
+}
+
+void yuv420sp_crop(uint8_t* dst, uint8_t const* src, uint32_t w, uint32_t h,
+        struct mdp_rect const* r)
+{
+    // Lines only move towards the start of the frame, so they can be
+    // copied in order in place. libc's memmove is as fast as copies get.
+    uint8_t const* luma = src + r->y * w + r->x;
+    for (uint32_t i=0 ; i<r->h ; i++)
+        memmove(dst + i * r->w, luma + i * w, r->w);
+
+    uint8_t const* chroma = src + w * h + (r->y / 2) * w + r->x;
+    dst += r->w * r->h;
+    for (uint32_t i=0 ; i<r->h / 2 ; i++)
+        memmove(dst + i * r->w, chroma + i * w, r->w);
+}
+
+/*****************************************************************************/
+
+/*
+ * A destination sample of a scale: the first of the two source samples it
+ * is between, and the weight of the second, from 0 to 256. The positions
+ * are the software MDP's, pixel centers mapped to pixel centers.
+ */
+struct tap_t {
+    uint32_t    index;
+    uint32_t    weight;
+};
+
+static tap_t tapOf(uint32_t s, uint32_t d, uint32_t i)
+{
+    const int32_t max = int32_t(s - 1) << 16;
+    int32_t p = int32_t(((2 * int64_t(i) + 1) * s << 16) / (2 * d)) - 0x8000;
+    if (p < 0) p = 0;
+    if (p > max) p = max;
+    tap_t t;
+    t.index = p >> 16;
+    t.weight = ((p & 0xffff) + 0x80) >> 8;
+    return t;
+}
+
+// Scales a line of samples, bytes or chroma pairs, through taps.
+static void scaleLine(uint8_t* out, uint8_t const* in, tap_t const* taps,
+        uint32_t n, bool pairs)
+{
+    if (!pairs) {
+        for (uint32_t i=0 ; i<n ; i++) {
+            tap_t t = taps[i];
+            uint32_t a = in[t.index], b = in[t.index + (t.weight != 0)];
+            out[i] = (a * (256 - t.weight) + b * t.weight + 128) >> 8;
+        }
+        return;
+    }
+    // both of a pair at once, in the 16 bit lanes of a word
+    for (uint32_t i=0 ; i<n ; i++) {
+        tap_t t = taps[i];
+        uint8_t const* p = in + t.index * 2;
+        uint8_t const* q = p + (t.weight != 0) * 2;
+        uint32_t a = p[0] | (p[1] << 16), b = q[0] | (q[1] << 16);
+        uint32_t c = (a * (256 - t.weight) + b * t.weight + 0x00800080) >> 8;
+        out[i * 2] = c;
+        out[i * 2 + 1] = c >> 16;
+    }
+}
+
+// out = a + (b - a) * w / 256, rounded, for n bytes of word aligned lines,
+// w from 1 to 255
+static void blendLines(uint8_t* out, uint8_t const* a, uint8_t const* b,
+        uint32_t n, uint32_t w)
+{
+    uint32_t i = 0;
+#if defined(__ARM_NEON__)
+    uint8x8_t wa = vdup_n_u8(256 - w);
+    uint8x8_t wb = vdup_n_u8(w);
+    for ( ; i+16<=n ; i+=16) {
+        uint8x16_t va = vld1q_u8(a + i);
+        uint8x16_t vb = vld1q_u8(b + i);
+        uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(va), wa),
+                vget_low_u8(vb), wb);
+        uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(va), wa),
+                vget_high_u8(vb), wb);
+        vst1q_u8(out + i, vcombine_u8(vrshrn_n_u16(lo, 8),
+                vrshrn_n_u16(hi, 8)));
+    }
+#endif
+    for ( ; i+4<=n ; i+=4) {
+        uint32_t x = *(uint32_t const*)(a + i);
+        uint32_t y = *(uint32_t const*)(b + i);
+        uint32_t even = ((x & 0x00ff00ff) * (256 - w) +
+                (y & 0x00ff00ff) * w + 0x00800080) >> 8;
+        uint32_t odd = ((x >> 8) & 0x00ff00ff) * (256 - w) +
+                ((y >> 8) & 0x00ff00ff) * w + 0x00800080;
+        *(uint32_t*)(out + i) = (even & 0x00ff00ff) | (odd & 0xff00ff00);
+    }
+    for ( ; i<n ; i++)
+        out[i] = (a[i] * (256 - w) + b[i] * w + 128) >> 8;
+}
+
+/*
+ * Scales a plane of sh lines, stride bytes apart, into one of dw x dh
+ * samples, with taps across. The (at most two) source lines a destination
+ * line is between are scaled across once, into lines[0] and [1], and kept
+ * while they're still used. lines[2] takes the blend, as dst may not be
+ * aligned.
+ */
+static void scalePlane(uint8_t* dst, uint32_t dw, uint32_t dh,
+        uint8_t const* src, uint32_t sh, uint32_t stride, bool pairs,
+        tap_t const* taps, uint8_t* lines[3])
+{
+    const uint32_t n = pairs ? dw * 2 : dw;
+    int32_t cached[2] = { -1, -1 };
+    for (uint32_t v=0 ; v<dh ; v++, dst += n) {
+        tap_t t = tapOf(sh, dh, v);
+        int32_t first = t.index;
+        if (cached[1] == first) {
+            uint8_t* line = lines[0];
+            lines[0] = lines[1];
+            lines[1] = line;
+            cached[0] = cached[1];
+            cached[1] = -1;
+        }
+        if (cached[0] != first) {
+            scaleLine(lines[0], src + first * stride, taps, dw, pairs);
+            cached[0] = first;
+        }
+        if (t.weight && cached[1] != first + 1) {
+            scaleLine(lines[1], src + (first + 1) * stride, taps, dw, pairs);
+            cached[1] = first + 1;
+        }
+
+        if (t.weight == 0) {
+            memcpy(dst, lines[0], n);
+        } else if (t.weight == 256) {
+            memcpy(dst, lines[1], n);
+        } else {
+            blendLines(lines[2], lines[0], lines[1], n, t.weight);
+            memcpy(dst, lines[2], n);
+        }
+    }
+}
+
+int yuv420sp_scale(uint8_t* dst, uint32_t dw, uint32_t dh,
+        uint8_t const* src, uint32_t sw, uint32_t sh,
+        struct mdp_rect const* r)
+{
+    const uint32_t x = r->x & ~1, y = r->y & ~1;
+    if (dw < 2 || dh < 2 || r->w < 2 || r->h < 2 ||
+            x + r->w > sw || y + r->h > sh)
+        return -EINVAL;
+
+    // the taps across luma and chroma, then three word aligned lines
+    const uint32_t line = (dw + 3) & ~3;
+    const size_t tapSize = sizeof(tap_t) * (dw + dw / 2);
+    uint8_t* mem = (uint8_t*)malloc(tapSize + line * 3);
+    if (!mem)
+        return -ENOMEM;
+    tap_t* taps = (tap_t*)mem;
+    for (uint32_t i=0 ; i<dw ; i++)
+        taps[i] = tapOf(r->w, dw, i);
+    for (uint32_t i=0 ; i<dw / 2 ; i++)
+        taps[dw + i] = tapOf(r->w / 2, dw / 2, i);
+    uint8_t* lines[3] = {
+        mem + tapSize, mem + tapSize + line, mem + tapSize + line * 2
+    };
+
+    scalePlane(dst, dw, dh, src + y * sw + x, r->h, sw, false, taps, lines);
+    scalePlane(dst + dw * dh, dw / 2, dh / 2,
+            src + sw * sh + (y / 2) * sw + x, r->h / 2, sw, true,
+            taps + dw, lines);
+    free(mem);
+    return 0;
+}
+
+/*****************************************************************************/
+
+/*
+ * The software MDP's conversion:
+ *
+ *     R = (298 (Y - 16)                  + 409 (Cr - 128) + 128) >> 8
+ *     G = (298 (Y - 16) - 100 (Cb - 128) - 208 (Cr - 128) + 128) >> 8
+ *     B = (298 (Y - 16) + 516 (Cb - 128)                  + 128) >> 8
+ *
+ * clamped. The chroma terms are worked out once for the four pixels of
+ * their block.
+ */
+
+static inline uint32_t clamp(int32_t v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+static inline void store(uint16_t* p, uint32_t r, uint32_t g, uint32_t b)
+{
+    *p = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+}
+
+static inline void store(uint32_t* p, uint32_t r, uint32_t g, uint32_t b)
+{
+    *p = 0xff000000 | (b << 16) | (g << 8) | r;
+}
+
+template <typename T>
+static inline void pixel(T* p, uint32_t luma, int32_t kr, int32_t kg,
+        int32_t kb)
+{
+    int32_t y = 298 * (int32_t(luma) - 16) + 128;
+    store(p, clamp((y + kr) >> 8), clamp((y + kg) >> 8), clamp((y + kb) >> 8));
+}
+
+#if defined(__ARM_NEON__)
+
+// the chroma terms of 8 pixels, in two halves
+struct terms_t {
+    int32x4_t   r[2];
+    int32x4_t   g[2];
+    int32x4_t   b[2];
+};
+
+static inline void neonTerms(terms_t* k, uint8x8_t cb, uint8x8_t cr)
+{
+    int16x8_t u = vreinterpretq_s16_u16(vsubl_u8(cb, vdup_n_u8(128)));
+    int16x8_t v = vreinterpretq_s16_u16(vsubl_u8(cr, vdup_n_u8(128)));
+    for (int i=0 ; i<2 ; i++) {
+        int16x4_t hu = i ? vget_high_s16(u) : vget_low_s16(u);
+        int16x4_t hv = i ? vget_high_s16(v) : vget_low_s16(v);
+        k->r[i] = vmull_n_s16(hv, 409);
+        k->g[i] = vmlal_n_s16(vmull_n_s16(hu, -100), hv, -208);
+        k->b[i] = vmull_n_s16(hu, 516);
+    }
+}
+
+static inline void neonStore(uint16_t* p, uint8x8_t r, uint8x8_t g,
+        uint8x8_t b)
+{
+    uint16x8_t v = vorrq_u16(vshlq_n_u16(vmovl_u8(vshr_n_u8(r, 3)), 11),
+            vorrq_u16(vshlq_n_u16(vmovl_u8(vshr_n_u8(g, 2)), 5),
+            vmovl_u8(vshr_n_u8(b, 3))));
+    vst1q_u16(p, v);
+}
+
+static inline void neonStore(uint32_t* p, uint8x8_t r, uint8x8_t g,
+        uint8x8_t b)
+{
+    uint8x8x4_t v;
+    v.val[0] = r;
+    v.val[1] = g;
+    v.val[2] = b;
+    v.val[3] = vdup_n_u8(255);
+    vst4_u8((uint8_t*)p, v);
+}
+
+// 8 pixels; the rounding narrowing shifts add the 128 and clamp
+template <typename T>
+static inline void neonPixels(T* p, uint8x8_t luma, terms_t const& k)
+{
+    int16x8_t y = vreinterpretq_s16_u16(vsubl_u8(luma, vdup_n_u8(16)));
+    uint16x4_t r[2], g[2], b[2];
+    for (int i=0 ; i<2 ; i++) {
+        int32x4_t t = vmull_n_s16(i ? vget_high_s16(y) : vget_low_s16(y), 298);
+        r[i] = vqrshrun_n_s32(vaddq_s32(t, k.r[i]), 8);
+        g[i] = vqrshrun_n_s32(vaddq_s32(t, k.g[i]), 8);
+        b[i] = vqrshrun_n_s32(vaddq_s32(t, k.b[i]), 8);
+    }
+    neonStore(p, vqmovn_u16(vcombine_u16(r[0], r[1])),
+            vqmovn_u16(vcombine_u16(g[0], g[1])),
+            vqmovn_u16(vcombine_u16(b[0], b[1])));
+}
+
+#endif
+
+template <typename T>
+static void convert(T* dst, uint32_t stride, uint8_t const* src,
+        uint32_t w, uint32_t h, bool nv12)
+{
+    // where Cb is in a pair
+    const uint32_t cbAt = nv12 ? 0 : 1;
+    for (uint32_t j=0 ; j<h ; j+=2) {
+        uint8_t const* y0 = src + j * w;
+        uint8_t const* y1 = y0 + w;
+        uint8_t const* c = src + w * h + (j / 2) * w;
+        T* d0 = dst + j * stride;
+        T* d1 = d0 + stride;
+        uint32_t x = 0;
+#if defined(__ARM_NEON__)
+        // 16 pixels of both lines from 8 chroma pairs, each used twice
+        for ( ; x+16<=w ; x+=16) {
+            uint8x8x2_t pairs = vld2_u8(c + x);
+            uint8x8_t u = nv12 ? pairs.val[0] : pairs.val[1];
+            uint8x8_t v = nv12 ? pairs.val[1] : pairs.val[0];
+            uint8x8x2_t us = vzip_u8(u, u);
+            uint8x8x2_t vs = vzip_u8(v, v);
+            uint8x16_t l0 = vld1q_u8(y0 + x);
+            uint8x16_t l1 = vld1q_u8(y1 + x);
+            for (int i=0 ; i<2 ; i++) {
+                terms_t k;
+                neonTerms(&k, us.val[i], vs.val[i]);
+                neonPixels(d0 + x + i * 8,
+                        i ? vget_high_u8(l0) : vget_low_u8(l0), k);
+                neonPixels(d1 + x + i * 8,
+                        i ? vget_high_u8(l1) : vget_low_u8(l1), k);
+            }
+        }
+#endif
+        for ( ; x<w ; x+=2) {
+            int32_t u = c[x + cbAt] - 128;
+            int32_t v = c[x + (cbAt ^ 1)] - 128;
+            int32_t kr = 409 * v;
+            int32_t kg = -100 * u - 208 * v;
+            int32_t kb = 516 * u;
+            pixel(d0 + x, y0[x], kr, kg, kb);
+            pixel(d0 + x + 1, y0[x + 1], kr, kg, kb);
+            pixel(d1 + x, y1[x], kr, kg, kb);
+            pixel(d1 + x + 1, y1[x + 1], kr, kg, kb);
+        }
+    }
+}
+
+void yuv420sp_to_rgb565(uint16_t* dst, uint32_t stride, uint8_t const* src,
+        uint32_t w, uint32_t h, bool nv12)
+{
+    convert(dst, stride, src, w, h, nv12);
+}
+
+void yuv420sp_to_rgba(uint32_t* dst, uint32_t stride, uint8_t const* src,
+        uint32_t w, uint32_t h, bool nv12)
+{
+    convert(dst, stride, src, w, h, nv12);
+}
+
+/*****************************************************************************/
+
+/*
+ * Rotation goes a square block at a time: its lines are loaded bottom up
+ * and transposed, which makes them the destination's lines. Blocks are 8
+ * bytes a side with NEON, and a word a side otherwise.
+ */
+
+#if defined(__ARM_NEON__)
+
+static const uint32_t kBlockBytes = 8;
+
+static void rotateBlock(uint8_t* d, uint32_t dstStride, uint8_t const* s,
+        uint32_t stride, uint32_t bpp)
+{
+    if (bpp == 1) {
+        uint8x8_t r[8];
+        for (int i=0 ; i<8 ; i++)
+            r[i] = vld1_u8(s + (7 - i) * stride);
+        uint8x8x2_t t01 = vtrn_u8(r[0], r[1]);
+        uint8x8x2_t t23 = vtrn_u8(r[2], r[3]);
+        uint8x8x2_t t45 = vtrn_u8(r[4], r[5]);
+        uint8x8x2_t t67 = vtrn_u8(r[6], r[7]);
+        uint16x4x2_t s02 = vtrn_u16(vreinterpret_u16_u8(t01.val[0]),
+                vreinterpret_u16_u8(t23.val[0]));
+        uint16x4x2_t s13 = vtrn_u16(vreinterpret_u16_u8(t01.val[1]),
+                vreinterpret_u16_u8(t23.val[1]));
+        uint16x4x2_t s46 = vtrn_u16(vreinterpret_u16_u8(t45.val[0]),
+                vreinterpret_u16_u8(t67.val[0]));
+        uint16x4x2_t s57 = vtrn_u16(vreinterpret_u16_u8(t45.val[1]),
+                vreinterpret_u16_u8(t67.val[1]));
+        uint32x2x2_t c04 = vtrn_u32(vreinterpret_u32_u16(s02.val[0]),
+                vreinterpret_u32_u16(s46.val[0]));
+        uint32x2x2_t c26 = vtrn_u32(vreinterpret_u32_u16(s02.val[1]),
+                vreinterpret_u32_u16(s46.val[1]));
+        uint32x2x2_t c15 = vtrn_u32(vreinterpret_u32_u16(s13.val[0]),
+                vreinterpret_u32_u16(s57.val[0]));
+        uint32x2x2_t c37 = vtrn_u32(vreinterpret_u32_u16(s13.val[1]),
+                vreinterpret_u32_u16(s57.val[1]));
+        vst1_u8(d, vreinterpret_u8_u32(c04.val[0]));
+        vst1_u8(d + dstStride, vreinterpret_u8_u32(c15.val[0]));
+        vst1_u8(d + dstStride * 2, vreinterpret_u8_u32(c26.val[0]));
+        vst1_u8(d + dstStride * 3, vreinterpret_u8_u32(c37.val[0]));
+        vst1_u8(d + dstStride * 4, vreinterpret_u8_u32(c04.val[1]));
+        vst1_u8(d + dstStride * 5, vreinterpret_u8_u32(c15.val[1]));
+        vst1_u8(d + dstStride * 6, vreinterpret_u8_u32(c26.val[1]));
+        vst1_u8(d + dstStride * 7, vreinterpret_u8_u32(c37.val[1]));
+        return;
+    }
+    uint16x4_t r[4];
+    for (int i=0 ; i<4 ; i++)
+        r[i] = vld1_u16((uint16_t const*)(s + (3 - i) * stride));
+    uint16x4x2_t t01 = vtrn_u16(r[0], r[1]);
+    uint16x4x2_t t23 = vtrn_u16(r[2], r[3]);
+    uint32x2x2_t c02 = vtrn_u32(vreinterpret_u32_u16(t01.val[0]),
+            vreinterpret_u32_u16(t23.val[0]));
+    uint32x2x2_t c13 = vtrn_u32(vreinterpret_u32_u16(t01.val[1]),
+            vreinterpret_u32_u16(t23.val[1]));
+    vst1_u16((uint16_t*)d, vreinterpret_u16_u32(c02.val[0]));
+    vst1_u16((uint16_t*)(d + dstStride), vreinterpret_u16_u32(c13.val[0]));
+    vst1_u16((uint16_t*)(d + dstStride * 2), vreinterpret_u16_u32(c02.val[1]));
+    vst1_u16((uint16_t*)(d + dstStride * 3), vreinterpret_u16_u32(c13.val[1]));
+}
+
+#else
+
+static const uint32_t kBlockBytes = 4;
+
+static void rotateBlock(uint8_t* d, uint32_t dstStride, uint8_t const* s,
+        uint32_t stride, uint32_t bpp)
+{
+    if (bpp == 1) {
+        uint32_t a = *(uint32_t const*)s;
+        uint32_t b = *(uint32_t const*)(s + stride);
+        uint32_t c = *(uint32_t const*)(s + stride * 2);
+        uint32_t e = *(uint32_t const*)(s + stride * 3);
+        for (int j=0 ; j<4 ; j++, d += dstStride) {
+            const int k = j * 8;
+            *(uint32_t*)d = ((e >> k) & 0xff) | (((c >> k) & 0xff) << 8) |
+                    (((b >> k) & 0xff) << 16) | ((a >> k) << 24);
+        }
+        return;
+    }
+    uint32_t a = *(uint32_t const*)s;
+    uint32_t b = *(uint32_t const*)(s + stride);
+    *(uint32_t*)d = (b & 0xffff) | (a << 16);
+    *(uint32_t*)(d + dstStride) = (b >> 16) | (a & 0xffff0000);
+}
+
+#endif
+
+// Rotates a plane of w x h samples of bpp bytes.
+static void rotatePlane(uint8_t* dst, uint8_t const* src, uint32_t w,
+        uint32_t h, uint32_t bpp)
+{
+    const uint32_t stride = w * bpp, dstStride = h * bpp;
+    uint32_t n = kBlockBytes / bpp;
+#if !defined(__ARM_NEON__)
+    // a word at a time only when all of them are aligned
+    if ((uintptr_t(src) | uintptr_t(dst) | stride | dstStride) & 3)
+        n = 1;
+#endif
+    uint32_t bw = 0, bh = 0;
+    if (n > 1) {
+        bw = w - w % n;
+        bh = h - h % n;
+        for (uint32_t y=0 ; y<bh ; y+=n) {
+            for (uint32_t x=0 ; x<bw ; x+=n) {
+                rotateBlock(dst + x * dstStride + (h - n - y) * bpp,
+                        dstStride, src + y * stride + x * bpp, stride, bpp);
+            }
+        }
+    }
+    // what the blocks don't cover, a sample at a time
+    for (uint32_t y=0 ; y<h ; y++) {
+        for (uint32_t x=(y < bh ? bw : 0) ; x<w ; x++) {
+            uint8_t const* s = src + y * stride + x * bpp;
+            uint8_t* d = dst + x * dstStride + (h - 1 - y) * bpp;
+            d[0] = s[0];
+            if (bpp == 2) d[1] = s[1];
+        }
+    }
+}
+
+void yuv420sp_rotate90(uint8_t* dst, uint8_t const* src,
+        uint32_t w, uint32_t h)
+{
+    rotatePlane(dst, src, w, h, 1);
+    rotatePlane(dst + w * h, src + w * h, w / 2, h / 2, 2);
+}
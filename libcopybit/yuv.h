@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COPYBIT_MSM7K_YUV_H
+#define COPYBIT_MSM7K_YUV_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "msm_mdp.h"
+
+/*
+ * CPU kernels for the camera's semi-planar YUV 4:2:0 frames, for what the
+ * MDP can't or shouldn't do: NV21 (Cr first, the preview and snapshot
+ * format, which the MDP calls MDP_Y_CBCR_H2V2, see blitter.h) and NV12 (Cb
+ * first, MDP_Y_CRCB_H2V2). A w x h frame is w x h bytes of luma followed by
+ * w x h/2 bytes of interleaved chroma, one pair for each 2x2 block. Sizes
+ * and positions are even.
+ *
+ * Each kernel has a portable path, working on four bytes at a time in
+ * 32-bit registers where it can, and a NEON one where the CPU has it. Both
+ * give the same results.
+ */
+
+// bytes of a w x h frame
+size_t yuv420sp_size(uint32_t w, uint32_t h);
+
+// Copies the rectangle r of the w x h frame src to dst, as an r.w x r.h
+// frame. dst may be src, to crop in place.
+void yuv420sp_crop(uint8_t* dst, uint8_t const* src, uint32_t w, uint32_t h,
+        struct mdp_rect const* r);
+
+// Scales the rectangle r of the sw x sh frame src into the dw x dh frame
+// dst, with bilinear filtering and the software MDP's sampling positions.
+// The left and top of r are rounded down to even. Not in place. Returns 0,
+// or -ENOMEM.
+int yuv420sp_scale(uint8_t* dst, uint32_t dw, uint32_t dh,
+        uint8_t const* src, uint32_t sw, uint32_t sh,
+        struct mdp_rect const* r);
+
+// Converts the w x h frame src to RGB_565 or RGBA_8888 lines stride pixels
+// apart, with the software MDP's coefficients. Each chroma pair is used for
+// its whole 2x2 block. nv12 if Cb comes first.
+void yuv420sp_to_rgb565(uint16_t* dst, uint32_t stride, uint8_t const* src,
+        uint32_t w, uint32_t h, bool nv12);
+void yuv420sp_to_rgba(uint32_t* dst, uint32_t stride, uint8_t const* src,
+        uint32_t w, uint32_t h, bool nv12);
+
+// Rotates the w x h frame src by 90 degrees clockwise into dst, an h x w
+// frame. Not in place.
+void yuv420sp_rotate90(uint8_t* dst, uint8_t const* src,
+        uint32_t w, uint32_t h);
+
+#endif  // COPYBIT_MSM7K_YUV_H
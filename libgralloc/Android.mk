@@ -21,15 +21,22 @@ include $(CLEAR_VARS)
 LOCAL_PRELINK_MODULE := false
 LOCAL_MODULE_TAGS := optional
 LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
-LOCAL_SHARED_LIBRARIES := liblog libcutils libGLESv1_CM
+LOCAL_SHARED_LIBRARIES := liblog libcutils libEGL libGLESv1_CM
+LOCAL_STATIC_LIBRARIES := libmdpblit
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../libcopybit
 
 LOCAL_SRC_FILES := 	\
 	allocator.cpp 	\
+	dirty.cpp		\
 	framebuffer.cpp \
+	framestats.cpp	\
 	gpu.cpp			\
 	gralloc.cpp		\
 	mapper.cpp		\
-	pmemalloc.cpp
+	pacer.cpp		\
+	pmemalloc.cpp	\
+	recycler.cpp	\
+	trace.cpp
 	
 LOCAL_MODULE := gralloc.delta
 LOCAL_CFLAGS:= -DLOG_TAG=\"$(TARGET_BOARD_PLATFORM).gralloc\"
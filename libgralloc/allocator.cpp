@@ -14,6 +14,9 @@
  * limitations under the License.
  */
 
+#include <stdio.h>
+#include <string.h>
+
 #include <cutils/log.h>
 
 #include "allocator.h"
@@ -23,21 +26,24 @@
 const int SimpleBestFitAllocator::kMemoryAlign = 32;
 
 SimpleBestFitAllocator::SimpleBestFitAllocator()
-    : mHeapSize(0)
+    : mCleanTree(mPool), mDirtyTree(mPool), mUsedTree(mPool),
+      mHeapSize(0), mFreeSize(0), mLargestFree(0), mPeakFragmentation(0),
+      mFreeChunks(0), mUsedChunks(0), mFragmentedFailures(0)
 {
+    memset(mFreeHist, 0, sizeof(mFreeHist));
 }
 
 SimpleBestFitAllocator::SimpleBestFitAllocator(size_t size)
-    : mHeapSize(0)
+    : mCleanTree(mPool), mDirtyTree(mPool), mUsedTree(mPool),
+      mHeapSize(0), mFreeSize(0), mLargestFree(0), mPeakFragmentation(0),
+      mFreeChunks(0), mUsedChunks(0), mFragmentedFailures(0)
 {
+    memset(mFreeHist, 0, sizeof(mFreeHist));
     setSize(size);
 }
 
 SimpleBestFitAllocator::~SimpleBestFitAllocator()
 {
-    while(!mList.isEmpty()) {
-        delete mList.remove(mList.head());
-    }
 }
 
 ssize_t SimpleBestFitAllocator::setSize(size_t size)
@@ -45,9 +51,12 @@ ssize_t SimpleBestFitAllocator::setSize(size_t size)
     Locker::Autolock _l(mLock);
     if (mHeapSize != 0) return -EINVAL;
     size_t pagesize = getpagesize();
+    // enough chunks for a typical set of buffers up front
+    if (!mPool.reserve(64)) return -ENOMEM;
     mHeapSize = ((size + pagesize-1) & ~(pagesize-1));
-    chunk_t* node = new chunk_t(0, mHeapSize / kMemoryAlign);
-    mList.insertHead(node);
+    const uint32_t node = newChunk(0, mHeapSize / kMemoryAlign, 0);
+    insertFree(node);
+    sample();
     return size;
 }
     
@@ -60,8 +69,29 @@ size_t SimpleBestFitAllocator::size() const
 ssize_t SimpleBestFitAllocator::allocate(size_t size, uint32_t flags)
 {
     Locker::Autolock _l(mLock);
+    return allocLocked(size, flags);
+}
+
+ssize_t SimpleBestFitAllocator::tryAllocate(size_t size, uint32_t flags)
+{
+    if (!mLock.tryLock()) {
+        return -EBUSY;
+    }
+    ssize_t offset = allocLocked(size, flags);
+    mLock.unlock();
+    return offset;
+}
+
+ssize_t SimpleBestFitAllocator::allocLocked(size_t size, uint32_t flags)
+{
     if (mHeapSize == 0) return -EINVAL;
     ssize_t offset = alloc(size, flags);
+    // a zeroed allocation may just be waiting for the scrubber
+    if (offset == -ENOMEM && !(flags & ALLOCATE_ZEROED) &&
+            size <= mFreeSize * kMemoryAlign) {
+        mFragmentedFailures++;
+    }
+    sample();
     return offset;
 }
 
@@ -69,97 +99,834 @@ ssize_t SimpleBestFitAllocator::deallocate(size_t offset)
 {
     Locker::Autolock _l(mLock);
     if (mHeapSize == 0) return -EINVAL;
-    chunk_t const * const freed = dealloc(offset);
+    const uint32_t freed = dealloc(offset, false);
+    if (freed) {
+        sample();
+        return 0;
+    }
+    return -ENOENT;
+}
+
+bool SimpleBestFitAllocator::supportsScrubbing() const
+{
+    return true;
+}
+
+ssize_t SimpleBestFitAllocator::claimDirty(size_t maxSize, size_t* pSize)
+{
+    Locker::Autolock _l(mLock);
+    if (mHeapSize == 0) return -EINVAL;
+
+    // scrub the largest dirty chunk first, that's the one that would cost
+    // the most to zero on the allocation path
+    const uint32_t chunk = mDirtyTree.last();
+    if (chunk == 0) {
+        return -ENOENT;
+    }
+    maxSize = maxSize / kMemoryAlign;
+    if (maxSize == 0) {
+        return -EINVAL;
+    }
+    if (!mPool.reserve(mPool.used() + 1)) {
+        return -ENOMEM;
+    }
+
+    removeFree(chunk);
+    if (c(chunk).size > maxSize) {
+        const uint32_t split = newChunk(c(chunk).start + maxSize,
+                c(chunk).size - maxSize, 0);
+        c(chunk).size = maxSize;
+        insertAfter(chunk, split);
+        insertFree(split);
+    }
+    c(chunk).free = 0;
+    mUsedTree.insert(chunk);
+    mUsedChunks++;
+    sample();
+    *pSize = c(chunk).size * kMemoryAlign;
+    return c(chunk).start * kMemoryAlign;
+}
+
+ssize_t SimpleBestFitAllocator::releaseClean(size_t offset)
+{
+    Locker::Autolock _l(mLock);
+    if (mHeapSize == 0) return -EINVAL;
+    const uint32_t freed = dealloc(offset, true);
     if (freed) {
+        sample();
         return 0;
     }
     return -ENOENT;
 }
 
+ssize_t SimpleBestFitAllocator::allocateSpanning(size_t size,
+        range_t* dirty, int maxDirty, int* pDirty)
+{
+    Locker::Autolock _l(mLock);
+    if (mHeapSize == 0 || size == 0) return -EINVAL;
+    ssize_t offset = allocSpanning(size, dirty, maxDirty, pDirty);
+    sample();
+    return offset;
+}
+
+void SimpleBestFitAllocator::getStats(stats_t* stats) const
+{
+    Locker::Autolock _l(mLock);
+    stats->heapSize = mHeapSize;
+    stats->freeBytes = mFreeSize * kMemoryAlign;
+    stats->largestFree = mLargestFree * kMemoryAlign;
+    stats->fragmentation = mFreeSize ?
+            1000 - uint32_t((uint64_t(mLargestFree) * 1000) / mFreeSize) : 0;
+    stats->peakFragmentation = mPeakFragmentation;
+    stats->freeChunks = mFreeChunks;
+    stats->usedChunks = mUsedChunks;
+    stats->fragmentedFailures = mFragmentedFailures;
+    memcpy(stats->freeHist, mFreeHist, sizeof(mFreeHist));
+    stats->chunkCapacity = mPool.capacity();
+    stats->lockContention = mLock.contention();
+    stats->busySkips = mLock.busySkips();
+}
+
+void SimpleBestFitAllocator::dump(char* buff, int buff_len) const
+{
+    stats_t stats;
+    getStats(&stats);
+
+    const size_t pagesize = getpagesize();
+    int len = snprintf(buff, buff_len,
+            "    heap=%u KiB, free=%u KiB in %u chunks, largest free=%u KiB, "
+            "%u used chunks (room for %u)\n"
+            "    fragmentation=%u.%u%% (peak %u.%u%%), "
+            "%u allocations failed on fragmentation, lock contended %u times\n",
+            stats.heapSize >> 10, stats.freeBytes >> 10, stats.freeChunks,
+            stats.largestFree >> 10, stats.usedChunks, stats.chunkCapacity,
+            stats.fragmentation / 10, stats.fragmentation % 10,
+            stats.peakFragmentation / 10, stats.peakFragmentation % 10,
+            stats.fragmentedFailures, stats.lockContention);
+    for (int i=0 ; i<kHistBuckets && len>0 && len<buff_len ; i++) {
+        if (stats.freeHist[i] == 0)
+            continue;
+        len += snprintf(buff + len, buff_len - len,
+                "    free chunks >= %6u KiB: %u\n",
+                i ? (pagesize << i) >> 10 : 0, stats.freeHist[i]);
+    }
+}
+
+int SimpleBestFitAllocator::histBucket(size_t size)
+{
+    size_t pages = (size * kMemoryAlign) / getpagesize();
+    int bucket = 0;
+    while (pages > 1 && bucket < kHistBuckets-1) {
+        pages >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+uint32_t SimpleBestFitAllocator::newChunk(size_t start, size_t size,
+        int clean)
+{
+    const uint32_t chunk = mPool.alloc();
+    LOG_FATAL_IF(!chunk, "out of chunks");
+    c(chunk).start = start;
+    c(chunk).size = size;
+    c(chunk).free = 1;
+    c(chunk).clean = clean;
+    return chunk;
+}
+
+void SimpleBestFitAllocator::deleteChunk(uint32_t chunk)
+{
+    const uint32_t p = c(chunk).prev;
+    const uint32_t n = c(chunk).next;
+    if (p) c(p).next = n;
+    if (n) c(n).prev = p;
+    mPool.release(chunk);
+}
+
+void SimpleBestFitAllocator::insertAfter(uint32_t chunk, uint32_t newChunk)
+{
+    const uint32_t n = c(chunk).next;
+    c(newChunk).prev = chunk;
+    c(newChunk).next = n;
+    if (n) c(n).prev = newChunk;
+    c(chunk).next = newChunk;
+}
+
+void SimpleBestFitAllocator::insertBefore(uint32_t chunk, uint32_t newChunk)
+{
+    const uint32_t p = c(chunk).prev;
+    c(newChunk).prev = p;
+    c(newChunk).next = chunk;
+    if (p) c(p).next = newChunk;
+    c(chunk).prev = newChunk;
+}
+
+void SimpleBestFitAllocator::insertFree(uint32_t chunk)
+{
+    freeTree(chunk).insert(chunk);
+    mFreeHist[histBucket(c(chunk).size)]++;
+    mFreeChunks++;
+    mFreeSize += c(chunk).size;
+}
+
+void SimpleBestFitAllocator::removeFree(uint32_t chunk)
+{
+    freeTree(chunk).remove(chunk);
+    mFreeHist[histBucket(c(chunk).size)]--;
+    mFreeChunks--;
+    mFreeSize -= c(chunk).size;
+}
+
+void SimpleBestFitAllocator::sample()
+{
+    // what the next allocation can get at most, clean and dirty chunks
+    // are never handed out together
+    const uint32_t clean = mCleanTree.last();
+    const uint32_t dirty = mDirtyTree.last();
+    mLargestFree = 0;
+    if (clean) mLargestFree = c(clean).size;
+    if (dirty && c(dirty).size > mLargestFree) mLargestFree = c(dirty).size;
+    if (mFreeSize) {
+        uint32_t fragmentation =
+                1000 - uint32_t((uint64_t(mLargestFree) * 1000) / mFreeSize);
+        if (fragmentation > mPeakFragmentation) {
+            mPeakFragmentation = fragmentation;
+        }
+    }
+}
+
+uint32_t SimpleBestFitAllocator::bestFit(free_tree_t& tree, size_t size)
+{
+    // walk up from the smallest free chunk that is large enough, the first
+    // one that still fits once page-aligned is the best fit. Any chunk at
+    // least (size + a page) long always fits, so this visits at most the
+    // chunks whose size is within a page of the request.
+    size_t pagesize = getpagesize();
+    chunk_t key;
+    memset(&key, 0, sizeof(key));
+    key.size = size;
+    uint32_t cur = tree.lowerBound(key);
+    while (cur) {
+        int extra = ( -c(cur).start & ((pagesize/kMemoryAlign)-1) ) ;
+        if (c(cur).size >= (size+extra)) {
+            return cur;
+        }
+        cur = tree.next(cur);
+    }
+    return 0;
+}
+
 ssize_t SimpleBestFitAllocator::alloc(size_t size, uint32_t flags)
 {
     if (size == 0) {
         return 0;
     }
     size = (size + kMemoryAlign-1) / kMemoryAlign;
-    chunk_t* free_chunk = 0;
-    chunk_t* cur = mList.head();
 
-    size_t pagesize = getpagesize();
-    while (cur) {
-        int extra = ( -cur->start & ((pagesize/kMemoryAlign)-1) ) ;
+    // a split needs at most two more chunks, grow the pool now if needed
+    // so that it can't fail half way through
+    if (!mPool.reserve(mPool.used() + 2)) {
+        return -ENOMEM;
+    }
 
-        // best fit
-        if (cur->free && (cur->size >= (size+extra))) {
-            if ((!free_chunk) || (cur->size < free_chunk->size)) {
-                free_chunk = cur;
-            }
-            if (cur->size == size) {
-                break;
-            }
+    // best fit, among clean chunks only if the caller needs zeroed memory
+    uint32_t free_chunk = bestFit(mCleanTree, size);
+    if (!(flags & ALLOCATE_ZEROED)) {
+        const uint32_t dirty_chunk = bestFit(mDirtyTree, size);
+        if (dirty_chunk &&
+                (!free_chunk || c(dirty_chunk).size < c(free_chunk).size)) {
+            free_chunk = dirty_chunk;
         }
-        cur = cur->next;
     }
 
+    size_t pagesize = getpagesize();
     if (free_chunk) {
-        const size_t free_size = free_chunk->size;
-        free_chunk->free = 0;
-        free_chunk->size = size;
+        const size_t free_size = c(free_chunk).size;
+        const int clean = c(free_chunk).clean;
+        removeFree(free_chunk);
+        c(free_chunk).free = 0;
+        c(free_chunk).size = size;
         if (free_size > size) {
-            int extra = ( -free_chunk->start & ((pagesize/kMemoryAlign)-1) ) ;
+            int extra = ( -c(free_chunk).start & ((pagesize/kMemoryAlign)-1) ) ;
             if (extra) {
-                chunk_t* split = new chunk_t(free_chunk->start, extra);
-                free_chunk->start += extra;
-                mList.insertBefore(free_chunk, split);
+                const uint32_t split = newChunk(c(free_chunk).start, extra, clean);
+                c(free_chunk).start += extra;
+                insertBefore(free_chunk, split);
+                insertFree(split);
             }
 
-            LOGE_IF(((free_chunk->start*kMemoryAlign)&(pagesize-1)),
+            LOGE_IF(((c(free_chunk).start*kMemoryAlign)&(pagesize-1)),
                     "page is not aligned!!!");
 
             const ssize_t tail_free = free_size - (size+extra);
             if (tail_free > 0) {
-                chunk_t* split = new chunk_t(
-                        free_chunk->start + free_chunk->size, tail_free);
-                mList.insertAfter(free_chunk, split);
+                const uint32_t split = newChunk(
+                        c(free_chunk).start + size, tail_free, clean);
+                insertAfter(free_chunk, split);
+                insertFree(split);
             }
         }
-        return (free_chunk->start)*kMemoryAlign;
+        mUsedTree.insert(free_chunk);
+        mUsedChunks++;
+        return (c(free_chunk).start)*kMemoryAlign;
     }
     return -ENOMEM;
 }
 
-SimpleBestFitAllocator::chunk_t* SimpleBestFitAllocator::dealloc(size_t start)
+uint32_t SimpleBestFitAllocator::spanAt(uint32_t chunk, size_t start,
+        size_t end, int maxDirty, size_t* pDirtySize)
+{
+    while (chunk && c(chunk).start > start) chunk = c(chunk).prev;
+    if (!chunk)
+        return 0;
+    const uint32_t first = chunk;
+    size_t dirtySize = 0;
+    int pieces = 0;
+    for (; chunk && c(chunk).free ; chunk = c(chunk).next) {
+        const size_t chunkEnd = c(chunk).start + c(chunk).size;
+        const size_t l = c(chunk).start > start ? c(chunk).start : start;
+        const size_t r = chunkEnd < end ? chunkEnd : end;
+        if (l < r && !c(chunk).clean) {
+            dirtySize += r - l;
+            pieces++;
+        }
+        if (chunkEnd >= end) {
+            if (pieces > maxDirty)
+                return 0;
+            *pDirtySize = dirtySize;
+            return first;
+        }
+    }
+    return 0;
+}
+
+ssize_t SimpleBestFitAllocator::allocSpanning(size_t size, range_t* dirty,
+        int maxDirty, int* pDirty)
+{
+    size = (size + kMemoryAlign-1) / kMemoryAlign;
+    const size_t pageMask = getpagesize() / kMemoryAlign - 1;
+
+    uint32_t head = mDirtyTree.last();
+    if (!head || !mCleanTree.last()) {
+        return -ENOMEM;
+    }
+    if (!mPool.reserve(mPool.used() + 2)) {
+        return -ENOMEM;
+    }
+    while (c(head).prev) head = c(head).prev;
+
+    // Only on the slow path, so all chunks are walked in address order.
+    // Of the page-aligned ranges over free chunks starting or ending with
+    // one, the one with the fewest dirty bytes.
+    uint32_t best = 0;
+    size_t bestStart = 0, bestDirty = 0;
+    for (uint32_t cur = head ; cur ; cur = c(cur).next) {
+        if (!c(cur).free)
+            continue;
+        const size_t chunkEnd = c(cur).start + c(cur).size;
+        size_t starts[2];
+        int n = 0;
+        starts[n] = (c(cur).start + pageMask) & ~pageMask;
+        if (starts[n] < chunkEnd) n++;
+        if (chunkEnd >= size) {
+            starts[n++] = (chunkEnd - size) & ~pageMask;
+        }
+        for (int i=0 ; i<n ; i++) {
+            size_t dirtySize;
+            uint32_t first = spanAt(cur, starts[i], starts[i] + size,
+                    maxDirty, &dirtySize);
+            if (first && (!best || dirtySize < bestDirty)) {
+                best = first;
+                bestStart = starts[i];
+                bestDirty = dirtySize;
+            }
+        }
+    }
+    if (!best) {
+        return -ENOMEM;
+    }
+
+    const size_t start = bestStart;
+    const size_t end = start + size;
+    uint32_t last = best;
+    int count = 0;
+    for (uint32_t cur = best ; ; cur = c(cur).next) {
+        const size_t chunkEnd = c(cur).start + c(cur).size;
+        const size_t l = c(cur).start > start ? c(cur).start : start;
+        const size_t r = chunkEnd < end ? chunkEnd : end;
+        if (l < r && !c(cur).clean) {
+            dirty[count].offset = l * kMemoryAlign;
+            dirty[count].size = (r - l) * kMemoryAlign;
+            count++;
+        }
+        removeFree(cur);
+        last = cur;
+        if (chunkEnd >= end)
+            break;
+    }
+    *pDirty = count;
+
+    // what's left over at either end stays free, as it was
+    const size_t lastEnd = c(last).start + c(last).size;
+    if (lastEnd > end) {
+        const uint32_t split = newChunk(end, lastEnd - end, c(last).clean);
+        insertAfter(last, split);
+        insertFree(split);
+    }
+    if (c(best).start < start) {
+        const uint32_t split = newChunk(c(best).start,
+                start - c(best).start, c(best).clean);
+        insertBefore(best, split);
+        insertFree(split);
+    }
+    while (c(best).next && c(c(best).next).start < end) {
+        deleteChunk(c(best).next);
+    }
+    c(best).start = start;
+    c(best).size = size;
+    c(best).free = 0;
+    mUsedTree.insert(best);
+    mUsedChunks++;
+    return start * kMemoryAlign;
+}
+
+uint32_t SimpleBestFitAllocator::dealloc(size_t start, bool clean)
 {
     start = start / kMemoryAlign;
-    chunk_t* cur = mList.head();
-    while (cur) {
-        if (cur->start == start) {
-            LOG_FATAL_IF(cur->free,
-                "block at offset 0x%08lX of size 0x%08lX already freed",
-                cur->start*kMemoryAlign, cur->size*kMemoryAlign);
-
-            // merge freed blocks together
-            chunk_t* freed = cur;
-            cur->free = 1;
-            do {
-                chunk_t* const p = cur->prev;
-                chunk_t* const n = cur->next;
-                if (p && (p->free || !cur->size)) {
-                    freed = p;
-                    p->size += cur->size;
-                    mList.remove(cur);
-                    delete cur;
-                }
-                cur = n;
-            } while (cur && cur->free);
-
-            LOG_FATAL_IF(!freed->free,
-                "freed block at offset 0x%08lX of size 0x%08lX is not free!",
-                freed->start * kMemoryAlign, freed->size * kMemoryAlign);
-
-            return freed;
+    chunk_t key;
+    memset(&key, 0, sizeof(key));
+    key.start = start;
+    uint32_t cur = mUsedTree.find(key);
+    if (cur == 0) {
+        // unknown offset, or a block that was already freed
+        return 0;
+    }
+
+    LOG_FATAL_IF(c(cur).free,
+        "block at offset 0x%08lX of size 0x%08lX already freed",
+        c(cur).start*kMemoryAlign, c(cur).size*kMemoryAlign);
+
+    // merge freed blocks together, free chunks of the same kind are never
+    // adjacent so there is at most one on each side.
+    mUsedTree.remove(cur);
+    mUsedChunks--;
+    c(cur).free = 1;
+    c(cur).clean = clean;
+    const uint32_t p = c(cur).prev;
+    if (p && c(p).free && c(p).clean == c(cur).clean) {
+        removeFree(p);
+        c(p).size += c(cur).size;
+        deleteChunk(cur);
+        cur = p;
+    }
+    const uint32_t n = c(cur).next;
+    if (n && c(n).free && c(n).clean == c(cur).clean) {
+        removeFree(n);
+        c(cur).size += c(n).size;
+        deleteChunk(n);
+    }
+    insertFree(cur);
+
+    LOG_FATAL_IF(!c(cur).free,
+        "freed block at offset 0x%08lX of size 0x%08lX is not free!",
+        c(cur).start * kMemoryAlign, c(cur).size * kMemoryAlign);
+
+    return cur;
+}
+
+// ----------------------------------------------------------------------------
+
+BuddyAllocator::BuddyAllocator()
+    : mPageSize(getpagesize()), mPages(0), mHeapSize(0), mMaxOrder(0),
+      mNext(0), mPrev(0), mFreeOrder(0), mUsedPages(0), mUsedBytes(0),
+      mFreePages(0), mRequestedBytes(0), mAllocatedPages(0), mPow2Pages(0)
+{
+    for (int i=0 ; i<=kMaxOrder ; i++) {
+        mFreeHead[i] = NIL;
+        mFreeBlocks[i] = 0;
+        mLive[i] = 0;
+    }
+}
+
+BuddyAllocator::BuddyAllocator(size_t size)
+    : mPageSize(getpagesize()), mPages(0), mHeapSize(0), mMaxOrder(0),
+      mNext(0), mPrev(0), mFreeOrder(0), mUsedPages(0), mUsedBytes(0),
+      mFreePages(0), mRequestedBytes(0), mAllocatedPages(0), mPow2Pages(0)
+{
+    for (int i=0 ; i<=kMaxOrder ; i++) {
+        mFreeHead[i] = NIL;
+        mFreeBlocks[i] = 0;
+        mLive[i] = 0;
+    }
+    setSize(size);
+}
+
+BuddyAllocator::~BuddyAllocator()
+{
+    delete [] mNext;
+    delete [] mPrev;
+    delete [] mFreeOrder;
+    delete [] mUsedPages;
+    delete [] mUsedBytes;
+}
+
+ssize_t BuddyAllocator::setSize(size_t size)
+{
+    Locker::Autolock _l(mLock);
+    if (mHeapSize != 0) return -EINVAL;
+    mPages = size / mPageSize;
+    if (mPages == 0) return -EINVAL;
+    mHeapSize = mPages * mPageSize;
+    mMaxOrder = orderOf(mPages);
+    if ((size_t(1) << mMaxOrder) > mPages) mMaxOrder--;
+    if (mMaxOrder > kMaxOrder) mMaxOrder = kMaxOrder;
+
+    mNext = new int32_t[mPages];
+    mPrev = new int32_t[mPages];
+    mFreeOrder = new int8_t[mPages];
+    mUsedPages = new uint32_t[mPages];
+    mUsedBytes = new uint32_t[mPages];
+    for (size_t i=0 ; i<mPages ; i++) {
+        mNext[i] = mPrev[i] = NIL;
+        mFreeOrder[i] = NIL;
+        mUsedPages[i] = 0;
+        mUsedBytes[i] = 0;
+    }
+    freeRange(0, mPages);
+    return size;
+}
+
+size_t BuddyAllocator::size() const
+{
+    return mHeapSize;
+}
+
+int BuddyAllocator::orderOf(size_t pages)
+{
+    // smallest order such that (1 << order) >= pages
+    int order = 0;
+    while ((size_t(1) << order) < pages) {
+        order++;
+    }
+    return order;
+}
+
+void BuddyAllocator::pushFree(size_t page, int order)
+{
+    mFreeOrder[page] = order;
+    mPrev[page] = NIL;
+    mNext[page] = mFreeHead[order];
+    if (mFreeHead[order] != NIL) {
+        mPrev[mFreeHead[order]] = page;
+    }
+    mFreeHead[order] = page;
+    mFreeBlocks[order]++;
+    mFreePages += size_t(1) << order;
+}
+
+void BuddyAllocator::popFree(size_t page)
+{
+    const int order = mFreeOrder[page];
+    if (mPrev[page] == NIL) mFreeHead[order] = mNext[page];
+    else                    mNext[mPrev[page]] = mNext[page];
+    if (mNext[page] != NIL) mPrev[mNext[page]] = mPrev[page];
+    mNext[page] = mPrev[page] = NIL;
+    mFreeOrder[page] = NIL;
+    mFreeBlocks[order]--;
+    mFreePages -= size_t(1) << order;
+}
+
+void BuddyAllocator::freeBlock(size_t page, int order)
+{
+    // coalesce with our buddy for as long as it's entirely free
+    while (order < mMaxOrder) {
+        const size_t buddy = page ^ (size_t(1) << order);
+        if (buddy + (size_t(1) << order) > mPages ||
+                mFreeOrder[buddy] != order) {
+            break;
+        }
+        popFree(buddy);
+        if (buddy < page) page = buddy;
+        order++;
+    }
+    pushFree(page, order);
+}
+
+void BuddyAllocator::freeRange(size_t page, size_t end)
+{
+    // split [page, end) into the largest naturally aligned blocks
+    while (page < end) {
+        int order = 0;
+        while (order < mMaxOrder &&
+                (page & ((size_t(2) << order) - 1)) == 0 &&
+                page + (size_t(2) << order) <= end) {
+            order++;
         }
-        cur = cur->next;
+        freeBlock(page, order);
+        page += size_t(1) << order;
     }
+}
+
+ssize_t BuddyAllocator::allocate(size_t size, uint32_t flags)
+{
+    Locker::Autolock _l(mLock);
+    // offset 0 would be a real block, which deallocate() can't tell apart
+    if (mHeapSize == 0 || size == 0) return -EINVAL;
+
+    const size_t pages = (size + mPageSize-1) / mPageSize;
+    const int order = orderOf(pages);
+    if (order > mMaxOrder) {
+        return -ENOMEM;
+    }
+
+    int found = order;
+    while (found <= mMaxOrder && mFreeHead[found] == NIL) {
+        found++;
+    }
+    if (found > mMaxOrder) {
+        return -ENOMEM;
+    }
+
+    // split down to the order we need, the upper halves go back
+    const size_t page = mFreeHead[found];
+    popFree(page);
+    while (found > order) {
+        found--;
+        pushFree(page + (size_t(1) << found), found);
+    }
+
+    // and give back the tail we don't need
+    freeRange(page + pages, page + (size_t(1) << order));
+
+    mUsedPages[page] = pages;
+    mUsedBytes[page] = size;
+    mLive[order]++;
+    mRequestedBytes += size;
+    mAllocatedPages += pages;
+    mPow2Pages += size_t(1) << order;
+    return page * mPageSize;
+}
+
+ssize_t BuddyAllocator::deallocate(size_t offset)
+{
+    Locker::Autolock _l(mLock);
+    if (mHeapSize == 0) return -EINVAL;
+    if (offset % mPageSize) return -ENOENT;
+    const size_t page = offset / mPageSize;
+    if (page >= mPages || mUsedPages[page] == 0) {
+        return -ENOENT;
+    }
+
+    const size_t pages = mUsedPages[page];
+    const int order = orderOf(pages);
+    mLive[order]--;
+    mRequestedBytes -= mUsedBytes[page];
+    mAllocatedPages -= pages;
+    mPow2Pages -= size_t(1) << order;
+    mUsedPages[page] = 0;
+    mUsedBytes[page] = 0;
+
+    freeRange(page, page + pages);
     return 0;
 }
+
+void BuddyAllocator::getStats(stats_t* stats) const
+{
+    Locker::Autolock _l(mLock);
+    stats->pageSize = mPageSize;
+    stats->heapSize = mHeapSize;
+    stats->freeBytes = mFreePages * mPageSize;
+    stats->requestedBytes = mRequestedBytes;
+    stats->allocatedBytes = mAllocatedPages * mPageSize;
+    stats->pow2Bytes = mPow2Pages * mPageSize;
+    stats->maxOrder = mMaxOrder;
+    for (int i=0 ; i<=kMaxOrder ; i++) {
+        stats->freeBlocks[i] = mFreeBlocks[i];
+        stats->liveAllocations[i] = mLive[i];
+    }
+}
+
+void BuddyAllocator::dump(char* buff, int buff_len) const
+{
+    stats_t stats;
+    getStats(&stats);
+
+    int len = snprintf(buff, buff_len,
+            "    heap=%u KiB, free=%u KiB, requested=%u KiB, "
+            "allocated=%u KiB (%u KiB if rounded to powers of 2)\n",
+            stats.heapSize >> 10, stats.freeBytes >> 10,
+            stats.requestedBytes >> 10, stats.allocatedBytes >> 10,
+            stats.pow2Bytes >> 10);
+    for (int i=0 ; i<=stats.maxOrder && len>0 && len<buff_len ; i++) {
+        if (stats.freeBlocks[i] == 0 && stats.liveAllocations[i] == 0)
+            continue;
+        len += snprintf(buff + len, buff_len - len,
+                "    order %2d (%6u KiB): %u free, %u allocated\n",
+                i, (stats.pageSize << i) >> 10,
+                stats.freeBlocks[i], stats.liveAllocations[i]);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+ArenaAllocator::ArenaAllocator(int arenas, size_t arenaSize, size_t smallLimit)
+    : mMaxArenas(arenas < kMaxArenas ? arenas : kMaxArenas),
+      mArenaSize(arenaSize & ~(getpagesize()-1)),
+      mSmallLimit(smallLimit), mArenas(0), mHeapSize(0)
+{
+}
+
+ArenaAllocator::~ArenaAllocator()
+{
+}
+
+ssize_t ArenaAllocator::setSize(size_t size)
+{
+    if (mHeapSize != 0) return -EINVAL;
+    size_t pagesize = getpagesize();
+    size = (size + pagesize-1) & ~(pagesize-1);
+    int arenas = mMaxArenas;
+    if (mArenaSize == 0 || arenas * mArenaSize > size / 2) {
+        arenas = 0;
+    }
+    ssize_t err;
+    for (int i=0 ; i<arenas ; i++) {
+        err = mArena[i].setSize(mArenaSize);
+        if (err < 0) return err;
+    }
+    err = mMain.setSize(size - arenas * mArenaSize);
+    if (err < 0) return err;
+    mArenas = arenas;
+    mHeapSize = size;
+    return size;
+}
+
+size_t ArenaAllocator::size() const
+{
+    return mHeapSize;
+}
+
+SimpleBestFitAllocator& ArenaAllocator::owner(size_t offset, size_t* base)
+{
+    const size_t arenasEnd = mArenas * mArenaSize;
+    if (offset < arenasEnd) {
+        const int i = offset / mArenaSize;
+        *base = i * mArenaSize;
+        return mArena[i];
+    }
+    *base = arenasEnd;
+    return mMain;
+}
+
+ssize_t ArenaAllocator::allocate(size_t size, uint32_t flags)
+{
+    if (mHeapSize == 0) return -EINVAL;
+
+    if (size <= mSmallLimit && mArenas) {
+        // stick to one arena per thread as long as it isn't busy, this
+        // keeps concurrent clients apart
+        const int first = (uintptr_t(pthread_self()) >> 4) % mArenas;
+        for (int n=0 ; n<mArenas ; n++) {
+            const int i = (first + n) % mArenas;
+            ssize_t offset = mArena[i].tryAllocate(size, flags);
+            if (offset >= 0) {
+                return i * mArenaSize + offset;
+            }
+        }
+        // all busy or full, wait for ours rather than for the main heap
+        ssize_t offset = mArena[first].allocate(size, flags);
+        if (offset >= 0) {
+            return first * mArenaSize + offset;
+        }
+    }
+
+    ssize_t offset = mMain.allocate(size, flags);
+    if (offset < 0) {
+        return offset;
+    }
+    return mArenas * mArenaSize + offset;
+}
+
+ssize_t ArenaAllocator::deallocate(size_t offset)
+{
+    if (mHeapSize == 0) return -EINVAL;
+    size_t base;
+    SimpleBestFitAllocator& allocator = owner(offset, &base);
+    return allocator.deallocate(offset - base);
+}
+
+bool ArenaAllocator::supportsScrubbing() const
+{
+    return true;
+}
+
+ssize_t ArenaAllocator::claimDirty(size_t maxSize, size_t* pSize)
+{
+    if (mHeapSize == 0) return -EINVAL;
+    ssize_t offset = mMain.claimDirty(maxSize, pSize);
+    if (offset >= 0) {
+        return mArenas * mArenaSize + offset;
+    }
+    for (int i=0 ; i<mArenas && offset == -ENOENT ; i++) {
+        offset = mArena[i].claimDirty(maxSize, pSize);
+        if (offset >= 0) {
+            return i * mArenaSize + offset;
+        }
+    }
+    return offset;
+}
+
+ssize_t ArenaAllocator::allocateSpanning(size_t size, range_t* dirty,
+        int maxDirty, int* pDirty)
+{
+    if (mHeapSize == 0) return -EINVAL;
+    size_t base = mArenas * mArenaSize;
+    ssize_t offset = mMain.allocateSpanning(size, dirty, maxDirty, pDirty);
+    for (int i=0 ; i<mArenas && offset < 0 && size <= mSmallLimit ; i++) {
+        base = i * mArenaSize;
+        offset = mArena[i].allocateSpanning(size, dirty, maxDirty, pDirty);
+    }
+    if (offset < 0) {
+        return offset;
+    }
+    for (int i=0 ; i<*pDirty ; i++) {
+        dirty[i].offset += base;
+    }
+    return base + offset;
+}
+
+ssize_t ArenaAllocator::releaseClean(size_t offset)
+{
+    if (mHeapSize == 0) return -EINVAL;
+    size_t base;
+    SimpleBestFitAllocator& allocator = owner(offset, &base);
+    return allocator.releaseClean(offset - base);
+}
+
+void ArenaAllocator::getStats(SimpleBestFitAllocator::stats_t* stats) const
+{
+    mMain.getStats(stats);
+}
+
+void ArenaAllocator::getArenaStats(int i,
+        SimpleBestFitAllocator::stats_t* stats) const
+{
+    mArena[i].getStats(stats);
+}
+
+void ArenaAllocator::dump(char* buff, int buff_len) const
+{
+    mMain.dump(buff, buff_len);
+    int len = strlen(buff);
+    for (int i=0 ; i<mArenas && len<buff_len ; i++) {
+        SimpleBestFitAllocator::stats_t stats;
+        mArena[i].getStats(&stats);
+        len += snprintf(buff + len, buff_len - len,
+                "    arena %d: %u KiB free of %u KiB, largest %u KiB, "
+                "lock contended %u times, busy %u times\n",
+                i, stats.freeBytes >> 10, stats.heapSize >> 10,
+                stats.largestFree >> 10, stats.lockContention,
+                stats.busySkips);
+    }
+}
@@ -19,6 +19,8 @@
 #define GRALLOC_ALLOCATOR_H_
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 
 #include "gr.h"
@@ -92,6 +94,267 @@ public:
     }
 };
 
+/*
+ * A pool of NODEs kept in one contiguous array and named by their index,
+ * so that it can grow without invalidating the links between them. Index
+ * 0 is never handed out and stands for "no node"; it stays zeroed. NODE
+ * must be plain data with a uint32_t next member, used to chain the free
+ * nodes. Released nodes are reused before the pool grows, so once it is
+ * large enough for the workload alloc() never touches the heap.
+ */
+
+template <typename NODE>
+class NodePool
+{
+    NODE*       mNodes;
+    uint32_t    mCapacity;
+    uint32_t    mFree;
+    uint32_t    mUsed;
+
+    NodePool(NodePool const&);
+    NodePool& operator = (NodePool const&);
+
+public:
+                NodePool() : mNodes(0), mCapacity(0), mFree(0), mUsed(0) { }
+                ~NodePool() { free(mNodes); }
+
+    NODE&       operator [] (uint32_t i) { return mNodes[i]; }
+    NODE const& operator [] (uint32_t i) const { return mNodes[i]; }
+    uint32_t    capacity() const { return mCapacity ? mCapacity - 1 : 0; }
+    uint32_t    used() const { return mUsed; }
+
+    // makes room for count nodes in total, returns false if out of memory
+    bool reserve(uint32_t count) {
+        if (count + 1 <= mCapacity) return true;
+        uint32_t capacity = 2*mCapacity;
+        if (capacity < count + 1) capacity = count + 1;
+        NODE* nodes = (NODE*)realloc(mNodes, capacity * sizeof(NODE));
+        if (nodes == 0) return false;
+        memset(nodes + mCapacity, 0, (capacity - mCapacity) * sizeof(NODE));
+        // chain the new nodes in front of the free list, lowest index first
+        for (uint32_t i = capacity-1 ; i >= (mCapacity ? mCapacity : 1) ; i--) {
+            nodes[i].next = mFree;
+            mFree = i;
+        }
+        mNodes = nodes;
+        mCapacity = capacity;
+        return true;
+    }
+
+    // returns the index of a zeroed node, or 0 if out of memory
+    uint32_t alloc() {
+        if (mFree == 0 && !reserve(mUsed + 1))
+            return 0;
+        const uint32_t i = mFree;
+        mFree = mNodes[i].next;
+        memset(&mNodes[i], 0, sizeof(NODE));
+        mUsed++;
+        return i;
+    }
+
+    void release(uint32_t i) {
+        mNodes[i].next = mFree;
+        mFree = i;
+        mUsed--;
+    }
+};
+
+/*
+ * A simple templatized intrusive AVL tree over the nodes of a NodePool.
+ * NODE must provide uint32_t left, right and parent links and an int height;
+ * COMPARE::compare(a, b) orders two nodes and must never return 0 for two
+ * distinct nodes in the same tree. Nodes are named by their pool index and
+ * 0 means none.
+ */
+
+template <typename NODE, typename COMPARE>
+class AvlTree
+{
+    NodePool<NODE>& mPool;
+    uint32_t        mRoot;
+
+    NODE& n(uint32_t i) { return mPool[i]; }
+
+    // relies on node 0 being zeroed
+    int height(uint32_t i) { return n(i).height; }
+
+    void update(uint32_t i) {
+        const int hl = height(n(i).left);
+        const int hr = height(n(i).right);
+        n(i).height = 1 + (hl > hr ? hl : hr);
+    }
+
+    void replaceChild(uint32_t parent, uint32_t node, uint32_t newNode) {
+        if (parent == 0)                    mRoot = newNode;
+        else if (n(parent).left == node)    n(parent).left = newNode;
+        else                                n(parent).right = newNode;
+        if (newNode) n(newNode).parent = parent;
+    }
+
+    uint32_t rotateLeft(uint32_t node) {
+        const uint32_t pivot = n(node).right;
+        n(node).right = n(pivot).left;
+        if (n(pivot).left) n(n(pivot).left).parent = node;
+        replaceChild(n(node).parent, node, pivot);
+        n(pivot).left = node;
+        n(node).parent = pivot;
+        update(node);
+        update(pivot);
+        return pivot;
+    }
+
+    uint32_t rotateRight(uint32_t node) {
+        const uint32_t pivot = n(node).left;
+        n(node).left = n(pivot).right;
+        if (n(pivot).right) n(n(pivot).right).parent = node;
+        replaceChild(n(node).parent, node, pivot);
+        n(pivot).right = node;
+        n(node).parent = pivot;
+        update(node);
+        update(pivot);
+        return pivot;
+    }
+
+    void rebalance(uint32_t node) {
+        while (node) {
+            update(node);
+            const int balance = height(n(node).left) - height(n(node).right);
+            if (balance > 1) {
+                const uint32_t l = n(node).left;
+                if (height(n(l).left) < height(n(l).right))
+                    rotateLeft(l);
+                node = rotateRight(node);
+            } else if (balance < -1) {
+                const uint32_t r = n(node).right;
+                if (height(n(r).right) < height(n(r).left))
+                    rotateRight(r);
+                node = rotateLeft(node);
+            }
+            node = n(node).parent;
+        }
+    }
+
+public:
+                AvlTree(NodePool<NODE>& pool) : mPool(pool), mRoot(0) { }
+    bool        isEmpty() const { return mRoot == 0; }
+    uint32_t    root() const { return mRoot; }
+
+    uint32_t first() {
+        uint32_t node = mRoot;
+        while (node && n(node).left) node = n(node).left;
+        return node;
+    }
+
+    uint32_t last() {
+        uint32_t node = mRoot;
+        while (node && n(node).right) node = n(node).right;
+        return node;
+    }
+
+    uint32_t next(uint32_t node) {
+        if (n(node).right) {
+            node = n(node).right;
+            while (n(node).left) node = n(node).left;
+            return node;
+        }
+        uint32_t parent = n(node).parent;
+        while (parent && node == n(parent).right) {
+            node = parent;
+            parent = n(parent).parent;
+        }
+        return parent;
+    }
+
+    // returns the first node that does not compare less than key
+    uint32_t lowerBound(NODE const& key) {
+        uint32_t result = 0;
+        uint32_t cur = mRoot;
+        while (cur) {
+            if (COMPARE::compare(n(cur), key) >= 0) {
+                result = cur;
+                cur = n(cur).left;
+            } else {
+                cur = n(cur).right;
+            }
+        }
+        return result;
+    }
+
+    uint32_t find(NODE const& key) {
+        uint32_t cur = mRoot;
+        while (cur) {
+            const int c = COMPARE::compare(key, n(cur));
+            if (c == 0) return cur;
+            cur = (c < 0) ? n(cur).left : n(cur).right;
+        }
+        return 0;
+    }
+
+    void insert(uint32_t newNode) {
+        uint32_t parent = 0;
+        uint32_t cur = mRoot;
+        bool left = false;
+        while (cur) {
+            parent = cur;
+            left = COMPARE::compare(n(newNode), n(cur)) < 0;
+            cur = left ? n(cur).left : n(cur).right;
+        }
+        n(newNode).left = n(newNode).right = 0;
+        n(newNode).parent = parent;
+        n(newNode).height = 1;
+        if (parent == 0)    mRoot = newNode;
+        else if (left)      n(parent).left = newNode;
+        else                n(parent).right = newNode;
+        rebalance(parent);
+    }
+
+    uint32_t remove(uint32_t node) {
+        uint32_t from;
+        NODE& nd = n(node);
+        if (nd.left == 0 || nd.right == 0) {
+            from = nd.parent;
+            replaceChild(nd.parent, node, nd.left ? nd.left : nd.right);
+        } else {
+            // splice in the in-order successor
+            uint32_t succ = nd.right;
+            while (n(succ).left) succ = n(succ).left;
+            if (n(succ).parent != node) {
+                from = n(succ).parent;
+                replaceChild(n(succ).parent, succ, n(succ).right);
+                n(succ).right = nd.right;
+                n(n(succ).right).parent = succ;
+            } else {
+                from = succ;
+            }
+            replaceChild(nd.parent, node, succ);
+            n(succ).left = nd.left;
+            n(n(succ).left).parent = succ;
+            n(succ).height = nd.height;
+        }
+        rebalance(from);
+        nd.left = nd.right = nd.parent = 0;
+        return node;
+    }
+};
+
+/*
+ * Best-fit allocator. Chunks are linked in address order so that
+ * neighbours can be merged on free; free chunks are additionally indexed by
+ * (size, start) in mCleanTree or mDirtyTree and used chunks by start in
+ * mUsedTree, which makes both allocate() and deallocate() O(log n) in the
+ * number of chunks. The chunks themselves live in a NodePool, so splitting
+ * and merging them reuses pool entries instead of going to the heap.
+ *
+ * Free memory is dirty unless it was handed back with releaseClean(), i.e.
+ * it's known to be zero. Clean and dirty chunks are not merged with each
+ * other so that scrubbing work is never lost, allocateSpanning() takes
+ * neighbours of both kinds when neither alone has room.
+ *
+ * Fragmentation is tracked as chunks come and go: the number of free chunks
+ * per power-of-two size class and the free total are kept up to date, and
+ * the largest free chunk is sampled after every operation.
+ */
+
 class SimpleBestFitAllocator : public PmemUserspaceAllocator::Deps::Allocator
 {
 public:
@@ -106,25 +369,236 @@ public:
     virtual ssize_t deallocate(size_t offset);
     virtual size_t  size() const;
 
+    // like allocate(), but returns -EBUSY instead of waiting for the lock
+    ssize_t tryAllocate(size_t size, uint32_t flags = 0);
+
+    virtual bool    supportsScrubbing() const;
+    virtual ssize_t claimDirty(size_t maxSize, size_t* pSize);
+    virtual ssize_t releaseClean(size_t offset);
+    virtual ssize_t allocateSpanning(size_t size, range_t* dirty,
+            int maxDirty, int* pDirty);
+
+    // free chunks are counted in buckets of [page << i, page << (i+1)),
+    // the first one also holds sub-page chunks and the last one is open
+    enum { kHistBuckets = 16 };
+
+    struct stats_t {
+        size_t      heapSize;
+        size_t      freeBytes;
+        size_t      largestFree;
+        // 1000 * (1 - largestFree / freeBytes), 0 when nothing is free
+        uint32_t    fragmentation;
+        uint32_t    peakFragmentation;
+        uint32_t    freeChunks;
+        uint32_t    usedChunks;
+        // allocations that failed although enough memory was free
+        uint32_t    fragmentedFailures;
+        uint32_t    freeHist[kHistBuckets];
+        // chunk metadata entries allocated so far
+        uint32_t    chunkCapacity;
+        // times a caller had to wait for the allocator lock
+        uint32_t    lockContention;
+        // times tryAllocate() found the lock taken and gave up
+        uint32_t    busySkips;
+    };
+
+    void getStats(stats_t* stats) const;
+    virtual void dump(char* buff, int buff_len) const;
+
 private:
+    // plain data, lives in mPool and is linked by pool index (0 is none)
     struct chunk_t {
-        chunk_t(size_t start, size_t size) 
-            : start(start), size(size), free(1), prev(0), next(0) {
+        size_t      start;
+        size_t      size : 28;
+        int         free : 2;
+        int         clean : 2;
+        // address order
+        uint32_t    prev;
+        uint32_t    next;
+        // links in mCleanTree, mDirtyTree or mUsedTree
+        uint32_t    left;
+        uint32_t    right;
+        uint32_t    parent;
+        int         height;
+    };
+
+    struct by_size {
+        static int compare(chunk_t const& lhs, chunk_t const& rhs) {
+            if (lhs.size != rhs.size) return lhs.size < rhs.size ? -1 : 1;
+            if (lhs.start != rhs.start) return lhs.start < rhs.start ? -1 : 1;
+            return 0;
         }
-        size_t              start;
-        size_t              size : 28;
-        int                 free : 4;
-        mutable chunk_t*    prev;
-        mutable chunk_t*    next;
     };
 
+    struct by_start {
+        static int compare(chunk_t const& lhs, chunk_t const& rhs) {
+            if (lhs.start != rhs.start) return lhs.start < rhs.start ? -1 : 1;
+            return 0;
+        }
+    };
+
+    typedef AvlTree<chunk_t, by_size> free_tree_t;
+
+    chunk_t& c(uint32_t chunk) { return mPool[chunk]; }
+
+    free_tree_t& freeTree(uint32_t chunk) {
+        return mPool[chunk].clean ? mCleanTree : mDirtyTree;
+    }
+
+    // newChunk() can't fail once mPool has room, see alloc()
+    uint32_t newChunk(size_t start, size_t size, int clean);
+    void     deleteChunk(uint32_t chunk);
+    void     insertAfter(uint32_t chunk, uint32_t newChunk);
+    void     insertBefore(uint32_t chunk, uint32_t newChunk);
+
+    static int histBucket(size_t size);
+    void     insertFree(uint32_t chunk);
+    void     removeFree(uint32_t chunk);
+    void     sample();
+    uint32_t bestFit(free_tree_t& tree, size_t size);
     ssize_t  alloc(size_t size, uint32_t flags);
-    chunk_t* dealloc(size_t start);
+    ssize_t  allocLocked(size_t size, uint32_t flags);
+    uint32_t spanAt(uint32_t chunk, size_t start, size_t end, int maxDirty,
+                    size_t* pDirtySize);
+    ssize_t  allocSpanning(size_t size, range_t* dirty, int maxDirty,
+                    int* pDirty);
+    uint32_t dealloc(size_t start, bool clean);
 
     static const int    kMemoryAlign;
     mutable Locker      mLock;
-    LinkedList<chunk_t> mList;
+    NodePool<chunk_t>   mPool;
+    free_tree_t         mCleanTree;
+    free_tree_t         mDirtyTree;
+    AvlTree<chunk_t, by_start>  mUsedTree;
     size_t              mHeapSize;
+    // fragmentation statistics, sizes in kMemoryAlign units
+    size_t              mFreeSize;
+    size_t              mLargestFree;
+    uint32_t            mPeakFragmentation;
+    uint32_t            mFreeChunks;
+    uint32_t            mUsedChunks;
+    uint32_t            mFragmentedFailures;
+    uint32_t            mFreeHist[kHistBuckets];
+};
+
+/*
+ * Buddy allocator working in pages. Blocks are split and coalesced in
+ * powers of two, but a request is only charged for the pages it needs: the
+ * unused tail of its block is immediately given back as smaller buddies,
+ * so a 600 KiB buffer takes 600 KiB instead of 1 MiB.
+ */
+
+class BuddyAllocator : public PmemUserspaceAllocator::Deps::Allocator
+{
+public:
+
+    enum { kMaxOrder = 24 };
+
+    struct stats_t {
+        size_t  pageSize;
+        size_t  heapSize;
+        size_t  freeBytes;
+        size_t  requestedBytes;     // sum of live request sizes
+        size_t  allocatedBytes;     // sum of live allocations in pages
+        size_t  pow2Bytes;          // what power-of-two rounding would take
+        int     maxOrder;
+        // per order (block of pageSize << order)
+        uint32_t freeBlocks[kMaxOrder+1];
+        uint32_t liveAllocations[kMaxOrder+1];
+    };
+
+    BuddyAllocator();
+    BuddyAllocator(size_t size);
+    virtual ~BuddyAllocator();
+
+    virtual ssize_t setSize(size_t size);
+
+    virtual ssize_t allocate(size_t size, uint32_t flags = 0);
+    virtual ssize_t deallocate(size_t offset);
+    virtual size_t  size() const;
+
+    void getStats(stats_t* stats) const;
+    virtual void dump(char* buff, int buff_len) const;
+
+private:
+    static int orderOf(size_t pages);
+
+    void    pushFree(size_t page, int order);
+    void    popFree(size_t page);
+    void    freeBlock(size_t page, int order);
+    void    freeRange(size_t page, size_t end);
+
+    enum { NIL = -1 };
+
+    mutable Locker  mLock;
+    size_t          mPageSize;
+    size_t          mPages;
+    size_t          mHeapSize;
+    int             mMaxOrder;
+    // free lists, one per order, linked through mNext/mPrev by page index
+    int32_t         mFreeHead[kMaxOrder+1];
+    int32_t*        mNext;
+    int32_t*        mPrev;
+    int8_t*         mFreeOrder;     // order of the free block at page, or NIL
+    uint32_t*       mUsedPages;     // pages of the allocation at page, or 0
+    uint32_t*       mUsedBytes;     // requested size of the allocation
+    uint32_t        mFreeBlocks[kMaxOrder+1];
+    uint32_t        mLive[kMaxOrder+1];
+    size_t          mFreePages;
+    size_t          mRequestedBytes;
+    size_t          mAllocatedPages;
+    size_t          mPow2Pages;
+};
+
+/*
+ * Splits the heap into a few small arenas followed by the main heap, each
+ * one a SimpleBestFitAllocator with its own lock. Requests up to smallLimit
+ * bytes are served from the arenas, starting with the one the calling
+ * thread maps to and moving on to the next whenever an arena is busy or
+ * full, so concurrent small allocations don't serialize on the main heap.
+ * Everything else, and small requests no arena can take, go to the main
+ * heap.
+ */
+
+class ArenaAllocator : public PmemUserspaceAllocator::Deps::Allocator
+{
+public:
+
+    enum { kMaxArenas = 8 };
+
+    // The arenas are only set up if they take at most half of the heap.
+    ArenaAllocator(int arenas, size_t arenaSize, size_t smallLimit);
+    virtual ~ArenaAllocator();
+
+    virtual ssize_t setSize(size_t size);
+
+    virtual ssize_t allocate(size_t size, uint32_t flags = 0);
+    virtual ssize_t deallocate(size_t offset);
+    virtual size_t  size() const;
+
+    virtual bool    supportsScrubbing() const;
+    virtual ssize_t claimDirty(size_t maxSize, size_t* pSize);
+    virtual ssize_t releaseClean(size_t offset);
+    virtual ssize_t allocateSpanning(size_t size, range_t* dirty,
+            int maxDirty, int* pDirty);
+
+    virtual void dump(char* buff, int buff_len) const;
+
+    // main heap statistics, and those of arena i, 0 <= i < arenas()
+    void getStats(SimpleBestFitAllocator::stats_t* stats) const;
+    void getArenaStats(int i, SimpleBestFitAllocator::stats_t* stats) const;
+    int  arenas() const { return mArenas; }
+
+private:
+    SimpleBestFitAllocator& owner(size_t offset, size_t* base);
+
+    const int               mMaxArenas;
+    const size_t            mArenaSize;
+    const size_t            mSmallLimit;
+    int                     mArenas;
+    size_t                  mHeapSize;
+    SimpleBestFitAllocator  mArena[kMaxArenas];
+    SimpleBestFitAllocator  mMain;
 };
 
 #endif /* GRALLOC_ALLOCATOR_H_ */
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/log.h>
+
+#include "compaction.h"
+#include "gralloc_priv.h"
+#include "trace.h"
+
+
+CompactionPlanner::CompactionPlanner(size_t heapSize)
+    : mAllocator(heapSize), mHeapSize(mAllocator.size()),
+      mBuffers(0), mCount(0), mCapacity(0), mLiveBytes(0),
+      mFailedLine(0), mFailedSize(0)
+{
+}
+
+CompactionPlanner::~CompactionPlanner()
+{
+    delete [] mBuffers;
+}
+
+int CompactionPlanner::find(uint32_t id) const
+{
+    for (size_t i=0 ; i<mCount ; i++) {
+        if (mBuffers[i].id == id)
+            return i;
+    }
+    return -1;
+}
+
+int CompactionPlanner::allocate(uint32_t id, size_t size)
+{
+    if (find(id) >= 0) {
+        return -EEXIST;
+    }
+    ssize_t offset = mAllocator.allocate(size);
+    if (offset < 0) {
+        return offset;
+    }
+    if (mCount == mCapacity) {
+        size_t capacity = mCapacity ? mCapacity * 2 : 64;
+        buffer_t* buffers = new buffer_t[capacity];
+        if (mCount) {
+            memcpy(buffers, mBuffers, mCount * sizeof(buffer_t));
+        }
+        delete [] mBuffers;
+        mBuffers = buffers;
+        mCapacity = capacity;
+    }
+    buffer_t& b = mBuffers[mCount++];
+    b.id = id;
+    b.offset = offset;
+    b.size = size;
+    mLiveBytes += size;
+    return 0;
+}
+
+int CompactionPlanner::free(uint32_t id)
+{
+    int i = find(id);
+    if (i < 0) {
+        return -ENOENT;
+    }
+    mAllocator.deallocate(mBuffers[i].offset);
+    mLiveBytes -= mBuffers[i].size;
+    mBuffers[i] = mBuffers[--mCount];
+    return 0;
+}
+
+int CompactionPlanner::replay(FILE* trace)
+{
+    char line[128];
+    int lineno = 0;
+    mFailedLine = 0;
+    mFailedSize = 0;
+    while (fgets(line, sizeof(line), trace)) {
+        lineno++;
+        trace_record_t rec;
+        int err = parseTraceLine(line, &rec);
+        if (err < 0) {
+            mFailedLine = lineno;
+            return err;
+        }
+        if (err == 0)
+            continue;
+
+        if (rec.op == 'a') {
+            // only model the /dev/pmem heap, traces without flags are
+            // assumed to be all about it. Framebuffer slots have
+            // PRIV_FLAGS_USES_PMEM too, but aren't in it.
+            if (rec.flags &&
+                    (!(rec.flags & private_handle_t::PRIV_FLAGS_USES_PMEM) ||
+                     (rec.flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER))) {
+                continue;
+            }
+            err = allocate(rec.id, rec.size);
+            if (err == -ENOMEM) {
+                mFailedLine = lineno;
+                mFailedSize = rec.size;
+                break;
+            }
+            LOGE_IF(err, "line %d: can't allocate buffer %#x (%s)",
+                    lineno, rec.id, strerror(-err));
+        } else {
+            // buffers from other heaps are freed too, just ignore them
+            free(rec.id);
+        }
+    }
+    return lineno;
+}
+
+int CompactionPlanner::compareOffsets(const void* lhs, const void* rhs)
+{
+    size_t l = ((buffer_t const*)lhs)->offset;
+    size_t r = ((buffer_t const*)rhs)->offset;
+    return l < r ? -1 : (l > r ? 1 : 0);
+}
+
+int CompactionPlanner::plan(move_t* moves, int maxMoves, size_t* pMovedBytes,
+        size_t* pLargestFree)
+{
+    // slide everything down in address order, keeping buffers page aligned
+    // like the allocator does, so each destination is already vacated
+    qsort(mBuffers, mCount, sizeof(buffer_t), compareOffsets);
+
+    const size_t pagesize = getpagesize();
+    size_t cursor = 0;
+    size_t moved = 0;
+    int count = 0;
+    for (size_t i=0 ; i<mCount ; i++) {
+        buffer_t const& b = mBuffers[i];
+        if (b.offset != cursor) {
+            if (count < maxMoves) {
+                moves[count].id = b.id;
+                moves[count].from = b.offset;
+                moves[count].to = cursor;
+                moves[count].size = b.size;
+            }
+            count++;
+            moved += b.size;
+        }
+        cursor = (cursor + b.size + pagesize-1) & ~(pagesize-1);
+    }
+
+    if (pMovedBytes) *pMovedBytes = moved;
+    if (pLargestFree) *pLargestFree = mHeapSize - cursor;
+    return count;
+}
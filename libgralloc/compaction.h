@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GRALLOC_QSD8K_COMPACTION_H
+#define GRALLOC_QSD8K_COMPACTION_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "allocator.h"
+
+
+/**
+ * Offline model of the pmem heap. An allocation trace is replayed through a
+ * SimpleBestFitAllocator of the given size, and plan() then lists the moves
+ * that would slide every live buffer down to the bottom of the heap, leaving
+ * all the free memory in one chunk.
+ *
+ * Traces are in the format written by TraceRecorder (see trace.h); only
+ * the allocations made from /dev/pmem are modelled.
+ */
+class CompactionPlanner {
+
+ public:
+
+    struct move_t {
+        uint32_t    id;
+        size_t      from;
+        size_t      to;
+        size_t      size;
+    };
+
+    CompactionPlanner(size_t heapSize);
+    ~CompactionPlanner();
+
+    // Returns 0, -EEXIST if id is live already, or the allocator's error.
+    int allocate(uint32_t id, size_t size);
+
+    // Returns 0 or -ENOENT if id isn't live.
+    int free(uint32_t id);
+
+    // Replays trace until its end or the first failed allocation, which is
+    // usually the moment worth compacting at. Returns the number of lines
+    // read, or -EINVAL on a malformed line (see failedLine()).
+    int replay(FILE* trace);
+
+    // Where replay() stopped, and the size it failed to allocate, if any.
+    int failedLine() const { return mFailedLine; }
+    size_t failedSize() const { return mFailedSize; }
+
+    // Fills in up to maxMoves moves, lowest address first; they can be
+    // carried out in that order with memmove semantics. Returns how many
+    // moves the whole plan needs. *pMovedBytes gets their total size and
+    // *pLargestFree the single free chunk left once they are all done.
+    int plan(move_t* moves, int maxMoves, size_t* pMovedBytes,
+            size_t* pLargestFree);
+
+    size_t liveCount() const { return mCount; }
+    size_t liveBytes() const { return mLiveBytes; }
+    SimpleBestFitAllocator& allocator() { return mAllocator; }
+
+ private:
+
+    struct buffer_t {
+        uint32_t    id;
+        size_t      offset;
+        size_t      size;
+    };
+
+    int  find(uint32_t id) const;
+    static int compareOffsets(const void* lhs, const void* rhs);
+
+    SimpleBestFitAllocator  mAllocator;
+    const size_t            mHeapSize;
+    buffer_t*               mBuffers;
+    size_t                  mCount;
+    size_t                  mCapacity;
+    size_t                  mLiveBytes;
+    int                     mFailedLine;
+    size_t                  mFailedSize;
+};
+
+#endif  // GRALLOC_QSD8K_COMPACTION_H
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <limits.h>
+#include <string.h>
+
+#include <hardware/gralloc.h>
+
+#include "dirty.h"
+
+
+int getBytesPerPixel(int format)
+{
+    switch (format) {
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+            return 4;
+        case HAL_PIXEL_FORMAT_RGB_888:
+            return 3;
+        case HAL_PIXEL_FORMAT_RGB_565:
+        case HAL_PIXEL_FORMAT_RGBA_5551:
+        case HAL_PIXEL_FORMAT_RGBA_4444:
+            return 2;
+    }
+    return 0;
+}
+
+void getDirtyRange(int format, int stride, size_t size,
+        int l, int t, int w, int h, size_t* start, size_t* end)
+{
+    *start = 0;
+    *end = size;
+
+    size_t bpp = getBytesPerPixel(format);
+    if (!bpp || stride <= 0 || l < 0 || t < 0 || w <= 0 || h <= 0)
+        return;
+    if (w > stride - l)
+        return;
+
+    size_t bpr = size_t(stride) * bpp;
+    size_t rows = size / bpr;
+    if (size_t(t) >= rows || size_t(h) > rows - t)
+        return;
+
+    // the rows in between are touched only partially when w < stride, but
+    // one clean over the whole span is cheaper than one ioctl per row
+    size_t first = t * bpr + l * bpp;
+    size_t last = (t + h - 1) * bpr + (l + w) * bpp;
+    first &= ~size_t(GRALLOC_CACHE_LINE - 1);
+    last = (last + GRALLOC_CACHE_LINE - 1) & ~size_t(GRALLOC_CACHE_LINE - 1);
+    if (last > size)
+        last = size;
+
+    *start = first;
+    *end = last;
+}
+
+void mergeDirtyRange(int* start, int* end, size_t s, size_t e)
+{
+    if (s >= e)
+        return;
+    if (*start == *end) {
+        *start = s;
+        *end = e;
+        return;
+    }
+    if (int(s) < *start) *start = s;
+    if (int(e) > *end)   *end = e;
+}
+
+BufferStateTable::BufferStateTable()
+{
+    memset(mBuckets, 0, sizeof(mBuckets));
+}
+
+BufferStateTable::~BufferStateTable()
+{
+    for (int i=0 ; i<kBuckets ; i++) {
+        while (mBuckets[i]) {
+            entry_t* e = mBuckets[i];
+            mBuckets[i] = e->next;
+            delete e;
+        }
+    }
+}
+
+BufferStateTable::entry_t** BufferStateTable::bucket(
+        private_handle_t const* hnd)
+{
+    // handles come from new, the low bits are always clear
+    return &mBuckets[(uintptr_t(hnd) >> 3) % kBuckets];
+}
+
+BufferStateTable::entry_t* BufferStateTable::find(private_handle_t const* hnd)
+{
+    entry_t* e = *bucket(hnd);
+    while (e && e->hnd != hnd)
+        e = e->next;
+    return e;
+}
+
+void BufferStateTable::setLayout(private_handle_t const* hnd,
+        int format, int stride)
+{
+    Locker::Autolock _l(mLock);
+    entry_t* e = find(hnd);
+    if (!e) {
+        e = new entry_t;
+        e->hnd = hnd;
+        e->next = *bucket(hnd);
+        *bucket(hnd) = e;
+    }
+    e->format = format;
+    e->stride = stride;
+    e->dirtyStart = 0;
+    e->dirtyEnd = 0;
+}
+
+void BufferStateTable::forget(private_handle_t const* hnd)
+{
+    Locker::Autolock _l(mLock);
+    for (entry_t** p = bucket(hnd) ; *p ; p = &(*p)->next) {
+        if ((*p)->hnd == hnd) {
+            entry_t* e = *p;
+            *p = e->next;
+            delete e;
+            return;
+        }
+    }
+}
+
+void BufferStateTable::addDirty(private_handle_t const* hnd,
+        int l, int t, int w, int h)
+{
+    Locker::Autolock _l(mLock);
+    entry_t* e = find(hnd);
+    if (e) {
+        size_t start, end;
+        getDirtyRange(e->format, e->stride, hnd->size, l, t, w, h,
+                &start, &end);
+        mergeDirtyRange(&e->dirtyStart, &e->dirtyEnd, start, end);
+    }
+}
+
+void BufferStateTable::takeDirty(private_handle_t const* hnd,
+        size_t* start, size_t* end)
+{
+    *start = 0;
+    *end = hnd->size;
+
+    Locker::Autolock _l(mLock);
+    entry_t* e = find(hnd);
+    if (e && e->dirtyStart < e->dirtyEnd) {
+        *start = e->dirtyStart;
+        *end = e->dirtyEnd;
+    }
+    if (e) {
+        e->dirtyStart = 0;
+        e->dirtyEnd = 0;
+    }
+}
+
+static inline int area(int l, int t, int r, int b)
+{
+    return (r - l) * (b - t);
+}
+
+static void unite(damage_t* damage, int i, int l, int t, int r, int b)
+{
+    if (l < damage->rects[i].l) damage->rects[i].l = l;
+    if (t < damage->rects[i].t) damage->rects[i].t = t;
+    if (r > damage->rects[i].r) damage->rects[i].r = r;
+    if (b > damage->rects[i].b) damage->rects[i].b = b;
+}
+
+void addDamage(damage_t* damage, int l, int t, int r, int b)
+{
+    if (l >= r || t >= b)
+        return;
+
+    // merge with the first rectangle it overlaps, the result may now
+    // overlap others, so take it out and add it again
+    for (int i=0 ; i<damage->count ; i++) {
+        if (l < damage->rects[i].r && damage->rects[i].l < r &&
+                t < damage->rects[i].b && damage->rects[i].t < b) {
+            unite(damage, i, l, t, r, b);
+            l = damage->rects[i].l;
+            t = damage->rects[i].t;
+            r = damage->rects[i].r;
+            b = damage->rects[i].b;
+            damage->rects[i] = damage->rects[--damage->count];
+            addDamage(damage, l, t, r, b);
+            return;
+        }
+    }
+
+    if (damage->count < MAX_DAMAGE_RECTS) {
+        int i = damage->count++;
+        damage->rects[i].l = l;
+        damage->rects[i].t = t;
+        damage->rects[i].r = r;
+        damage->rects[i].b = b;
+        return;
+    }
+
+    int best = 0;
+    int bestGrowth = INT_MAX;
+    for (int i=0 ; i<damage->count ; i++) {
+        int ul = l < damage->rects[i].l ? l : damage->rects[i].l;
+        int ut = t < damage->rects[i].t ? t : damage->rects[i].t;
+        int ur = r > damage->rects[i].r ? r : damage->rects[i].r;
+        int ub = b > damage->rects[i].b ? b : damage->rects[i].b;
+        int growth = area(ul, ut, ur, ub) - area(damage->rects[i].l,
+                damage->rects[i].t, damage->rects[i].r, damage->rects[i].b);
+        if (growth < bestGrowth) {
+            best = i;
+            bestGrowth = growth;
+        }
+    }
+    unite(damage, best, l, t, r, b);
+    l = damage->rects[best].l;
+    t = damage->rects[best].t;
+    r = damage->rects[best].r;
+    b = damage->rects[best].b;
+    damage->rects[best] = damage->rects[--damage->count];
+    addDamage(damage, l, t, r, b);
+}
+
+void getDamageBounds(damage_t const* damage, int* l, int* t, int* r, int* b)
+{
+    *l = damage->rects[0].l;
+    *t = damage->rects[0].t;
+    *r = damage->rects[0].r;
+    *b = damage->rects[0].b;
+    for (int i=1 ; i<damage->count ; i++) {
+        if (damage->rects[i].l < *l) *l = damage->rects[i].l;
+        if (damage->rects[i].t < *t) *t = damage->rects[i].t;
+        if (damage->rects[i].r > *r) *r = damage->rects[i].r;
+        if (damage->rects[i].b > *b) *b = damage->rects[i].b;
+    }
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GRALLOC_QSD8K_DIRTY_H
+#define GRALLOC_QSD8K_DIRTY_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <cutils/log.h>
+
+#include "gralloc_priv.h"
+#include "gr.h"
+
+
+// D-cache line size of the ARM11 core, cache maintenance is done in lines
+#define GRALLOC_CACHE_LINE  32
+
+/*
+ * Bytes per pixel of the single plane formats, 0 for the YUV formats whose
+ * planes can't be described by a single stride.
+ */
+int getBytesPerPixel(int format);
+
+/*
+ * Computes the byte range [*start, *end) of a buffer of the given format,
+ * stride (in pixels) and size touched by a lock of the rectangle l, t, w, h,
+ * widened to whole cache lines. The whole buffer is returned when the
+ * format's layout isn't known, or when the rectangle is empty or doesn't
+ * fit in the buffer, as gralloc_lock() is commonly called with 0,0,0,0.
+ */
+void getDirtyRange(int format, int stride, size_t size,
+        int l, int t, int w, int h, size_t* start, size_t* end);
+
+/*
+ * Grows the dirty range [*start, *end) so that it also covers [s, e). An
+ * empty range has *start == *end.
+ */
+void mergeDirtyRange(int* start, int* end, size_t s, size_t e);
+
+/*
+ * The per-process state of the buffers that doesn't travel with their
+ * handles, so the handle layout other processes parse stays the same: the
+ * format and stride, known only where the buffer was allocated, and the
+ * bytes written through locks since the last flush. Handles without an
+ * entry are flushed whole.
+ */
+class BufferStateTable {
+public:
+    BufferStateTable();
+    ~BufferStateTable();
+
+    // starts tracking hnd, or resets its entry when it's reused
+    void setLayout(private_handle_t const* hnd, int format, int stride);
+    void forget(private_handle_t const* hnd);
+
+    // adds the rows a write lock of l, t, w, h touches
+    void addDirty(private_handle_t const* hnd, int l, int t, int w, int h);
+
+    // returns the range to flush in [*start, *end) and resets it
+    void takeDirty(private_handle_t const* hnd, size_t* start, size_t* end);
+
+private:
+    struct entry_t {
+        private_handle_t const* hnd;
+        int format;
+        int stride;     // in pixels
+        int dirtyStart;
+        int dirtyEnd;
+        entry_t* next;
+    };
+
+    enum { kBuckets = 64 };
+
+    entry_t** bucket(private_handle_t const* hnd);
+    entry_t* find(private_handle_t const* hnd);
+
+    Locker mLock;
+    entry_t* mBuckets[kBuckets];
+};
+
+/*
+ * Adds the rectangle [l, r) x [t, b) to the damage. Rectangles that overlap
+ * are merged, and once MAX_DAMAGE_RECTS are in use the new one is merged
+ * with the one that grows the least.
+ */
+void addDamage(damage_t* damage, int l, int t, int r, int b);
+
+// The bounding box of the damage, which must not be empty.
+void getDamageBounds(damage_t const* damage, int* l, int* t, int* r, int* b);
+
+#endif  // GRALLOC_QSD8K_DIRTY_H
@@ -32,6 +32,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <time.h>
 
 #include <cutils/log.h>
 #include <cutils/atomic.h>
@@ -39,10 +40,21 @@
 #include <linux/fb.h>
 #include <linux/msm_mdp.h>
 
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include <GLES/gl.h>
 
+#ifndef EGL_SYNC_FENCE_KHR
+// EGL_KHR_fence_sync, older headers only know EGL_KHR_reusable_sync
+#define EGL_SYNC_FENCE_KHR 0x30F9
+#endif
+
 #include "gralloc_priv.h"
 #include "gr.h"
+#include "framestats.h"
+#include "pacer.h"
+#include "dirty.h"
+#include "blitter.h"
 #ifdef NO_SURFACEFLINGER_SWAPINTERVAL
 #include <cutils/properties.h>
 #endif
@@ -67,12 +79,37 @@ struct fb_context_t {
 };
 
 static int neworientation;
+
+// frames posted by this process, see dumpFrameStats()
+static FrameStats sFrameStats;
+
+// paces disp_loop() when debug.gr.pacing is set
+static VsyncPacer* sPacer;
+
+// copies frames to the framebuffer when it can't be flipped
+static Blitter* sBlitter;
+
+/*
+ * GPU completion fences, when the EGL driver has EGL_KHR_fence_sync.
+ * fb_compositionComplete() puts one behind the composition of the next
+ * buffer to be posted, and only scanning out that buffer waits for it.
+ */
+static struct {
+    bool probed;
+    EGLDisplay dpy;
+    PFNEGLCREATESYNCKHRPROC create;
+    PFNEGLCLIENTWAITSYNCKHRPROC clientWait;
+    PFNEGLDESTROYSYNCKHRPROC destroy;
+    // created by fb_compositionComplete(), taken by the next fb_post(),
+    // both are only ever called from the compositor's thread
+    EGLSyncKHR pending;
+} sFence;
 /*****************************************************************************/
 
 static void
 msm_copy_buffer(buffer_handle_t handle, int fd,
                 int width, int height, int format,
-                int x, int y, int w, int h);
+                damage_t const* damage);
 
 static int fb_setSwapInterval(struct framebuffer_device_t* dev,
             int interval)
@@ -96,32 +133,157 @@ static int fb_setUpdateRect(struct framebuffer_device_t* dev,
     fb_context_t* ctx = (fb_context_t*)dev;
     private_module_t* m = reinterpret_cast<private_module_t*>(
             dev->common.module);
+
+    // the area of frames that weren't displayed is still to be updated
+    int r = l+w < int(m->info.xres) ? l+w : m->info.xres;
+    int b = t+h < int(m->info.yres) ? t+h : m->info.yres;
+    addDamage(&m->damage, l, t, r, b);
+    if (!m->damage.count)
+        return -EINVAL;
+    getDamageBounds(&m->damage, &l, &t, &r, &b);
     m->info.reserved[0] = 0x54445055; // "UPDT";
     m->info.reserved[1] = (uint16_t)l | ((uint32_t)t << 16);
-    m->info.reserved[2] = (uint16_t)(l+w) | ((uint32_t)(t+h) << 16);
+    m->info.reserved[2] = (uint16_t)r | ((uint32_t)b << 16);
     return 0;
 }
 
+/*
+ * The post queue. fb_post() only sleeps when it has to wait for a buffer to
+ * come back from the display, never to queue one, and disp_loop() is only
+ * woken up when it went to sleep on an empty queue.
+ */
+
+static void post_queue_push(private_module_t* m, const struct qbuf_t& qb)
+{
+    post_queue_t* q = &m->disp;
+    int32_t tail = q->tail;
+    int32_t head;
+    // full only if a buffer is posted again before it was displayed
+    while (tail - (head = android_atomic_acquire_load(&q->head)) >= NUM_BUFFERS) {
+        futex_wait(&q->head, head);
+    }
+    q->ring[tail % NUM_BUFFERS] = qb;
+    // a full barrier, the entry must be visible before tail and tail before
+    // we look at sleeping
+    android_atomic_inc(&q->tail);
+    if (android_atomic_acquire_load(&q->sleeping)) {
+        futex_wake(&q->tail);
+    }
+}
+
+static void post_queue_pop(private_module_t* m, struct qbuf_t* qb)
+{
+    post_queue_t* q = &m->disp;
+    int32_t head = q->head;
+    int32_t tail;
+    while ((tail = android_atomic_acquire_load(&q->tail)) == head) {
+        android_atomic_inc(&q->sleeping);
+        if (android_atomic_acquire_load(&q->tail) == head) {
+            futex_wait(&q->tail, tail);
+        }
+        android_atomic_dec(&q->sleeping);
+    }
+    *qb = q->ring[head % NUM_BUFFERS];
+    android_atomic_inc(&q->head);
+    futex_wake(&q->head);
+}
+
+static bool post_queue_pending(private_module_t* m)
+{
+    return android_atomic_acquire_load(&m->disp.tail) != m->disp.head;
+}
+
+static void release_buffer(private_module_t* m, int idx)
+{
+    android_atomic_release_store(1, &m->avail[idx]);
+    futex_wake(&m->avail[idx]);
+}
+
+static void wait_for_buffer(private_module_t* m, int idx)
+{
+    while (!android_atomic_acquire_load(&m->avail[idx])) {
+        futex_wait(&m->avail[idx], 0);
+    }
+}
+
+/*
+ * The buffer to be rendered into after idx: of the ones handed out by
+ * gralloc, the one queued the longest ago. -1 if there's no other.
+ */
+static int next_render_buffer(private_module_t* m, int idx)
+{
+    int next = -1;
+    for (uint32_t i = 0; i < m->numBuffers; i++) {
+        if (int(i) == idx || !(m->bufferMask & (1LU << i)))
+            continue;
+        if (next < 0 || int32_t(m->queued[i] - m->queued[next]) < 0)
+            next = i;
+    }
+    return next;
+}
+
+static void *take_fence()
+{
+    EGLSyncKHR fence = sFence.pending;
+    sFence.pending = EGL_NO_SYNC_KHR;
+    return fence;
+}
+
+static void wait_fence(void *fence)
+{
+    if (fence == EGL_NO_SYNC_KHR)
+        return;
+    if (sFence.clientWait(sFence.dpy, (EGLSyncKHR)fence, 0,
+            EGL_FOREVER_KHR) == EGL_FALSE) {
+        LOGE("eglClientWaitSyncKHR failed (%#x)", eglGetError());
+    }
+    sFence.destroy(sFence.dpy, (EGLSyncKHR)fence);
+}
+
+/*
+ * Returns false if the frame is to be skipped, after waiting until it may
+ * be shown otherwise.
+ */
+static bool pace_frame(private_module_t* m, struct qbuf_t const* buf)
+{
+    int64_t until;
+    int decision;
+    sPacer->posted(buf->posted);
+    while ((decision = sPacer->decide(buf->posted, FrameStats::now(),
+            post_queue_pending(m), &until)) == VsyncPacer::HOLD) {
+        int64_t delay = until - FrameStats::now();
+        if (delay > 0) {
+            struct timespec ts;
+            ts.tv_sec = delay / 1000000000LL;
+            ts.tv_nsec = delay % 1000000000LL;
+            nanosleep(&ts, NULL);
+        }
+    }
+    return decision == VsyncPacer::SHOW;
+}
+
 static void *disp_loop(void *ptr)
 {
     struct qbuf_t nxtBuf;
-    static int cur_buf=-1;
+    int cur_buf = -1;
     private_module_t *m = reinterpret_cast<private_module_t*>(ptr);
 
     while (1) {
-        pthread_mutex_lock(&(m->qlock));
-
-        // wait (sleep) while display queue is empty;
-        if (m->disp.isEmpty()) {
-            pthread_cond_wait(&(m->qpost),&(m->qlock));
+        // wait (sleep) while display queue is empty, and dequeue next
+        // buff to display
+        post_queue_pop(m, &nxtBuf);
+
+        if (sPacer && !pace_frame(m, &nxtBuf)) {
+            // late, and a newer frame is queued already
+            if (nxtBuf.fence != EGL_NO_SYNC_KHR)
+                sFence.destroy(sFence.dpy, (EGLSyncKHR)nxtBuf.fence);
+            release_buffer(m, nxtBuf.idx);
+            continue;
         }
 
-        // dequeue next buff to display and lock it
-        nxtBuf = m->disp.getHeadValue();
-        m->disp.pop();
-        pthread_mutex_unlock(&(m->qlock));
-
-        // post buf out to display synchronously
+        // post buf out to display synchronously, once the GPU is done
+        // with it
+        wait_fence(nxtBuf.fence);
         private_handle_t const* hnd = reinterpret_cast<private_handle_t const*>
                                                 (nxtBuf.buf);
         const size_t offset = hnd->base - m->framebuffer->base;
@@ -130,19 +292,16 @@ static void *disp_loop(void *ptr)
 
         if (ioctl(m->framebuffer->fd, FBIOPUT_VSCREENINFO, &m->info) == -1) {
             LOGE("ERROR FBIOPUT_VSCREENINFO failed; frame not displayed");
-        }
-
-        if (cur_buf == -1) {
-            pthread_mutex_lock(&(m->avail[nxtBuf.idx].lock));
-            m->avail[nxtBuf.idx].is_avail = true;
-            pthread_cond_signal(&(m->avail[nxtBuf.idx].cond));
-            pthread_mutex_unlock(&(m->avail[nxtBuf.idx].lock));
         } else {
-            pthread_mutex_lock(&(m->avail[cur_buf].lock));
-            m->avail[cur_buf].is_avail = true;
-            pthread_cond_signal(&(m->avail[cur_buf].cond));
-            pthread_mutex_unlock(&(m->avail[cur_buf].lock));
+            int64_t now = FrameStats::now();
+            sFrameStats.scannedOut(nxtBuf.frame, now);
+            if (sPacer)
+                sPacer->flipped(now);
+        }
 
+        // the buffer that was on screen until now can be rendered into
+        if (cur_buf != -1) {
+            release_buffer(m, cur_buf);
         }
         cur_buf = nxtBuf.idx;
     }
@@ -165,19 +324,21 @@ static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
 
     if (hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER) {
 
+        int64_t posted = FrameStats::now();
+        uint32_t frame = sFrameStats.posted(posted);
+
+        // the slot of this buffer in the framebuffer, buffers are rendered
+        // into in order
         reuse = false;
-        nxtIdx = (m->currentIdx + 1) % NUM_BUFFERS;
+        nxtIdx = (hnd->base - m->framebuffer->base) /
+                (m->finfo.line_length * m->info.yres);
 
         if (m->swapInterval == 0) {
-            // if SwapInterval = 0 and no buffers available then reuse
-            // current buf for next rendering so don't post new buffer
-            if (pthread_mutex_trylock(&(m->avail[nxtIdx].lock))) {
+            // if SwapInterval = 0 and this buffer is still queued or on
+            // screen then reuse current buf for next rendering so don't
+            // post new buffer
+            if (!android_atomic_acquire_load(&m->avail[nxtIdx]))
                 reuse = true;
-            } else {
-                if (! m->avail[nxtIdx].is_avail)
-                    reuse = true;
-                pthread_mutex_unlock(&(m->avail[nxtIdx].lock));
-            }
         }
 
         if(!reuse){
@@ -187,34 +348,39 @@ static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
                     0,0, m->info.xres, m->info.yres, NULL);
 
             // post/queue the new buffer
-            pthread_mutex_lock(&(m->avail[nxtIdx].lock));
-            m->avail[nxtIdx].is_avail = false;
-            pthread_mutex_unlock(&(m->avail[nxtIdx].lock));
-
+            android_atomic_release_store(0, &m->avail[nxtIdx]);
+            m->queued[nxtIdx] = frame + 1;
             qb.idx = nxtIdx;
             qb.buf = buffer;
-            pthread_mutex_lock(&(m->qlock));
-            m->disp.push(qb);
-            pthread_cond_signal(&(m->qpost));
-            pthread_mutex_unlock(&(m->qlock));
-
-            // LCDC: after new buffer grabbed by MDP can unlock previous
-            // (current) buffer
+            qb.frame = frame;
+            qb.posted = posted;
+            qb.fence = take_fence();
+            post_queue_push(m, qb);
+            m->damage.count = 0;
+            int64_t queued = FrameStats::now();
+
+            // LCDC: the next buffer to be rendered into must have left
+            // the screen; with double buffering that's the previous
+            // (current) buffer, which the MDP lets go of once it grabbed
+            // the new one. With more buffers it usually is already free.
+            // Only the buffers gralloc handed out count, the window may
+            // have fewer than the framebuffer holds.
+            int renderIdx = next_render_buffer(m, nxtIdx);
+            if (m->swapInterval != 0 && renderIdx >= 0) {
+                wait_for_buffer(m, renderIdx);
+            }
+            sFrameStats.queued(frame, nxtIdx, queued,
+                    FrameStats::now() - queued);
             if (m->currentBuffer) {
-                if (m->swapInterval != 0) {
-                    pthread_mutex_lock(&(m->avail[m->currentIdx].lock));
-                    if (! m->avail[m->currentIdx].is_avail) {
-                        pthread_cond_wait(&(m->avail[m->currentIdx].cond),
-                                         &(m->avail[m->currentIdx].lock));
-                        m->avail[m->currentIdx].is_avail = true;
-                    }
-                    pthread_mutex_unlock(&(m->avail[m->currentIdx].lock));
-                }
                 m->base.unlock(&m->base, m->currentBuffer);
             }
             m->currentBuffer = buffer;
             m->currentIdx = nxtIdx;
         } else {
+            sFrameStats.reused(frame);
+            void *fence = take_fence();
+            if (fence != EGL_NO_SYNC_KHR)
+                sFence.destroy(sFence.dpy, (EGLSyncKHR)fence);
             if (m->currentBuffer)
                 m->base.unlock(&m->base, m->currentBuffer);
             m->base.lock(&m->base, buffer,
@@ -239,11 +405,14 @@ static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
 
         //memcpy(fb_vaddr, buffer_vaddr, m->finfo.line_length * m->info.yres);
 
+        // the framebuffer keeps what was copied before, only the area
+        // updated since then needs to be copied again
+        wait_fence(take_fence());
         msm_copy_buffer(
-                m->framebuffer, m->framebuffer->fd,
+                buffer, m->framebuffer->fd,
                 m->info.xres, m->info.yres, m->fbFormat,
-                m->info.xoffset, m->info.yoffset,
-                m->info.width, m->info.height);
+                &m->damage);
+        m->damage.count = 0;
 
         m->base.unlock(&m->base, buffer); 
         m->base.unlock(&m->base, m->framebuffer); 
@@ -252,11 +421,49 @@ static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
     return 0;
 }
 
+static void probe_fences()
+{
+    sFence.probed = true;
+    sFence.pending = EGL_NO_SYNC_KHR;
+    sFence.dpy = eglGetCurrentDisplay();
+    if (sFence.dpy == EGL_NO_DISPLAY)
+        return;
+    const char* extensions = eglQueryString(sFence.dpy, EGL_EXTENSIONS);
+    if (!extensions || !strstr(extensions, "EGL_KHR_fence_sync"))
+        return;
+    sFence.create = (PFNEGLCREATESYNCKHRPROC)
+            eglGetProcAddress("eglCreateSyncKHR");
+    sFence.clientWait = (PFNEGLCLIENTWAITSYNCKHRPROC)
+            eglGetProcAddress("eglClientWaitSyncKHR");
+    sFence.destroy = (PFNEGLDESTROYSYNCKHRPROC)
+            eglGetProcAddress("eglDestroySyncKHR");
+    if (!sFence.create || !sFence.clientWait || !sFence.destroy) {
+        sFence.create = 0;
+        return;
+    }
+    LOGD("using EGL fences for composition complete");
+}
+
 static int fb_compositionComplete(struct framebuffer_device_t* dev)
 {
-    // TODO: Properly implement composition complete callback
-    glFinish();
+    if (!sFence.probed)
+        probe_fences();
+
+    if (sFence.create) {
+        // a fence after the composition, the GPU keeps rendering while
+        // the next frame is composed
+        EGLSyncKHR fence = sFence.create(sFence.dpy, EGL_SYNC_FENCE_KHR, NULL);
+        if (fence != EGL_NO_SYNC_KHR) {
+            glFlush();
+            if (sFence.pending != EGL_NO_SYNC_KHR)
+                sFence.destroy(sFence.dpy, sFence.pending);
+            sFence.pending = fence;
+            return 0;
+        }
+        LOGE("eglCreateSyncKHR failed (%#x)", eglGetError());
+    }
 
+    glFinish();
     return 0;
 }
 
@@ -348,16 +555,31 @@ int mapFrameBufferLocked(struct private_module_t* module)
 	module->fbFormat = HAL_PIXEL_FORMAT_RGB_565;
     }
     /*
-     * Request NUM_BUFFERS screens (at lest 2 for page flipping)
+     * Request debug.gr.numbuffers screens (at lest 2 for page flipping),
+     * as many as the framebuffer memory can hold. FramebufferNativeWindow
+     * only allocates 2 of them, a third screen is only worth its memory
+     * with a framework that renders into it.
      */
-    info.yres_virtual = info.yres * NUM_BUFFERS;
+    char pval[PROPERTY_VALUE_MAX];
+    property_get("debug.gr.numbuffers", pval, "2");
+    int numBuffers = atoi(pval);
+    if (numBuffers < 2 || numBuffers > NUM_BUFFERS) {
+        LOGW("Out of range (2 to %d) value for debug.gr.numbuffers, using 2",
+             NUM_BUFFERS);
+        numBuffers = 2;
+    }
+    info.yres_virtual = info.yres * numBuffers;
 
 
     uint32_t flags = PAGE_FLIP;
-    if (ioctl(fd, FBIOPUT_VSCREENINFO, &info) == -1) {
-        info.yres_virtual = info.yres;
-        flags &= ~PAGE_FLIP;
-        LOGW("FBIOPUT_VSCREENINFO failed, page flipping not supported");
+    while (ioctl(fd, FBIOPUT_VSCREENINFO, &info) == -1) {
+        if (--numBuffers < 2) {
+            info.yres_virtual = info.yres;
+            flags &= ~PAGE_FLIP;
+            LOGW("FBIOPUT_VSCREENINFO failed, page flipping not supported");
+            break;
+        }
+        info.yres_virtual = info.yres * numBuffers;
     }
 
     if (info.yres_virtual < info.yres * 2) {
@@ -438,9 +660,13 @@ int mapFrameBufferLocked(struct private_module_t* module)
     module->xdpi = xdpi;
     module->ydpi = ydpi;
     module->fps = fps;
+    sFrameStats.setRefreshPeriod(int64_t(1000000000000LL / refreshRate));
+    property_get("debug.gr.pacing", pval, "0");
+    if (atoi(pval) && !sPacer) {
+        sPacer = new VsyncPacer(int64_t(1000000000000LL / refreshRate));
+    }
 
 #ifdef NO_SURFACEFLINGER_SWAPINTERVAL
-    char pval[PROPERTY_VALUE_MAX];
     property_get("debug.gr.swapinterval", pval, "1");
     module->swapInterval = atoi(pval);
     if (module->swapInterval < private_module_t::PRIV_MIN_SWAP_INTERVAL ||
@@ -457,13 +683,14 @@ int mapFrameBufferLocked(struct private_module_t* module)
 #endif
 
     module->currentIdx = -1;
-    pthread_cond_init(&(module->qpost), NULL);
-    pthread_mutex_init(&(module->qlock), NULL);
+    module->damage.count = 0;
+    module->disp.head = 0;
+    module->disp.tail = 0;
+    module->disp.sleeping = 0;
     for (i = 0; i < NUM_BUFFERS; i++) {
-        pthread_mutex_init(&(module->avail[i].lock), NULL);
-        pthread_cond_init(&(module->avail[i].cond), NULL);
-        module->avail[i].is_avail = true;
-    }    
+        module->avail[i] = 1;
+        module->queued[i] = 0;
+    }
 
     /* create display update thread */
     pthread_t thread1;
@@ -481,7 +708,12 @@ int mapFrameBufferLocked(struct private_module_t* module)
             private_handle_t::PRIV_FLAGS_USES_PMEM);
 
     module->numBuffers = info.yres_virtual / info.yres;
+    if (module->numBuffers > NUM_BUFFERS) {
+        // more than we asked for, we don't keep track of the others
+        module->numBuffers = NUM_BUFFERS;
+    }
     module->bufferMask = 0;
+    LOGI("using %d framebuffers", module->numBuffers);
 
     void* vaddr = mmap(0, fbSize, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
     if (vaddr == MAP_FAILED) {
@@ -491,9 +723,32 @@ int mapFrameBufferLocked(struct private_module_t* module)
     module->framebuffer->base = intptr_t(vaddr);
     memset(vaddr, 0, fbSize);
 
+    if (!sBlitter) {
+        sBlitter = Blitter::create(module->framebuffer->fd);
+    }
+
     return 0;
 }
 
+void dumpFrameStats(char* buff, int buff_len)
+{
+    sFrameStats.dump(buff, buff_len);
+    if (sPacer) {
+        int len = strlen(buff);
+        sPacer->dump(buff + len, buff_len - len);
+    }
+    if (sBlitter) {
+        int len = strlen(buff);
+        sBlitter->dump(buff + len, buff_len - len);
+    }
+    // the frames in the ring are also saved here, if set
+    char path[PROPERTY_VALUE_MAX];
+    property_get("debug.gr.frametrace", path, "");
+    if (path[0]) {
+        sFrameStats.writeTrace(path);
+    }
+}
+
 static int mapFrameBuffer(struct private_module_t* module)
 {
     pthread_mutex_lock(&module->lock);
@@ -556,6 +811,10 @@ int fb_device_open(hw_module_t const* module, const char* name,
                     m->finfo.reserved[1] == 0x5055) {
                 dev->device.setUpdateRect = fb_setUpdateRect;
                 LOGD("UPDATE_ON_DEMAND supported");
+            } else if (m->numBuffers == 1) {
+                // posts are copied, and only the updated area is
+                dev->device.setUpdateRect = fb_setUpdateRect;
+                LOGD("partial updates supported");
             }
 
             *device = &dev->device.common;
@@ -567,42 +826,57 @@ int fb_device_open(hw_module_t const* module, const char* name,
     return status;
 }
 
-/* Copy a pmem buffer to the framebuffer */
+/* Copy the damaged area of a pmem buffer to the framebuffer */
 
 static void
 msm_copy_buffer(buffer_handle_t handle, int fd,
                 int width, int height, int format,
-                int x, int y, int w, int h)
+                damage_t const* damage)
 {
     struct {
         unsigned int count;
-        mdp_blit_req req;
+        mdp_blit_req req[MAX_DAMAGE_RECTS];
     } blit;
     private_handle_t *priv = (private_handle_t*) handle;
 
     memset(&blit, 0, sizeof(blit));
-    blit.count = 1;
-
-    blit.req.flags = 0;
-    blit.req.alpha = 0xff;
-    blit.req.transp_mask = 0xffffffff;
-
-    blit.req.src.width = width;
-    blit.req.src.height = height;
-    blit.req.src.offset = 0;
-    blit.req.src.memory_id = priv->fd;
-
-    blit.req.dst.width = width;
-    blit.req.dst.height = height;
-    blit.req.dst.offset = 0;
-    blit.req.dst.memory_id = fd; 
-    blit.req.dst.format = format;
-
-    blit.req.src_rect.x = blit.req.dst_rect.x = x;
-    blit.req.src_rect.y = blit.req.dst_rect.y = y;
-    blit.req.src_rect.w = blit.req.dst_rect.w = w;
-    blit.req.src_rect.h = blit.req.dst_rect.h = h;
-
-    if (ioctl(fd, MSMFB_BLIT, &blit))
-        LOGE("MSMFB_BLIT failed = %d", -errno);
+    blit.count = damage->count ? damage->count : 1;
+
+    for (unsigned int i = 0; i < blit.count; i++) {
+        mdp_blit_req* req = &blit.req[i];
+
+        req->flags = 0;
+        req->alpha = 0xff;
+        req->transp_mask = 0xffffffff;
+
+        req->src.width = width;
+        req->src.height = height;
+        req->src.offset = priv->offset;
+        req->src.memory_id = priv->fd;
+        req->src.format = format;
+
+        req->dst.width = width;
+        req->dst.height = height;
+        req->dst.offset = 0;
+        req->dst.memory_id = fd;
+        req->dst.format = format;
+
+        if (damage->count) {
+            req->src_rect.x = req->dst_rect.x = damage->rects[i].l;
+            req->src_rect.y = req->dst_rect.y = damage->rects[i].t;
+            req->src_rect.w = req->dst_rect.w =
+                    damage->rects[i].r - damage->rects[i].l;
+            req->src_rect.h = req->dst_rect.h =
+                    damage->rects[i].b - damage->rects[i].t;
+        } else {
+            req->src_rect.x = req->dst_rect.x = 0;
+            req->src_rect.y = req->dst_rect.y = 0;
+            req->src_rect.w = req->dst_rect.w = width;
+            req->src_rect.h = req->dst_rect.h = height;
+        }
+    }
+
+    int err = sBlitter->blit((mdp_blit_req_list const*)&blit);
+    if (err)
+        LOGE("MSMFB_BLIT failed = %d", err);
 }
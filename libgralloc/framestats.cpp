@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <cutils/log.h>
+
+#include "framestats.h"
+
+
+FrameStats::FrameStats()
+    : mPosted(0), mReused(0), mDisplayed(0), mLate(0),
+      mRefreshPeriod(0), mLastScanout(0)
+{
+    memset(mRing, 0, sizeof(mRing));
+    memset(mLatencyHist, 0, sizeof(mLatencyHist));
+    memset(mWaitHist, 0, sizeof(mWaitHist));
+}
+
+int64_t FrameStats::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+int FrameStats::histBucket(int64_t ns)
+{
+    int64_t us = ns / 1000;
+    int bucket = 0;
+    while (us > 1 && bucket < kHistBuckets - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void FrameStats::setRefreshPeriod(int64_t ns)
+{
+    Locker::Autolock _l(mLock);
+    mRefreshPeriod = ns;
+}
+
+uint32_t FrameStats::posted(int64_t when)
+{
+    Locker::Autolock _l(mLock);
+    uint32_t frame = mPosted++;
+    frame_t& f = mRing[frame % kFrames];
+    memset(&f, 0, sizeof(f));
+    f.frame = frame;
+    f.idx = -1;
+    f.posted = when;
+    return frame;
+}
+
+void FrameStats::queued(uint32_t frame, int idx, int64_t when, int64_t waited)
+{
+    Locker::Autolock _l(mLock);
+    frame_t& f = mRing[frame % kFrames];
+    if (f.frame != frame)
+        return;
+    f.idx = idx;
+    f.queued = when;
+    f.waited = waited;
+    mWaitHist[histBucket(waited)]++;
+}
+
+void FrameStats::reused(uint32_t frame)
+{
+    Locker::Autolock _l(mLock);
+    mReused++;
+}
+
+void FrameStats::scannedOut(uint32_t frame, int64_t when)
+{
+    Locker::Autolock _l(mLock);
+    frame_t& f = mRing[frame % kFrames];
+    if (f.frame != frame)
+        return;
+    f.scanout = when;
+    mDisplayed++;
+    mLatencyHist[histBucket(when - f.posted)]++;
+    if (mLastScanout && mRefreshPeriod &&
+            (when - mLastScanout) * 2 > mRefreshPeriod * 3) {
+        mLate++;
+    }
+    mLastScanout = when;
+}
+
+int FrameStats::dumpHist(char* buff, int buff_len, const char* what,
+        uint32_t const* hist)
+{
+    int len = snprintf(buff, buff_len, "    %s (us):", what);
+    for (int i=0 ; i<kHistBuckets && len<buff_len ; i++) {
+        if (hist[i]) {
+            bool open = i == kHistBuckets - 1;
+            len += snprintf(buff + len, buff_len - len, " %s%u:%u",
+                    open ? ">=" : "<", open ? 1U << i : 2U << i, hist[i]);
+        }
+    }
+    if (len < buff_len)
+        len += snprintf(buff + len, buff_len - len, "\n");
+    return len;
+}
+
+void FrameStats::dump(char* buff, int buff_len) const
+{
+    Locker::Autolock _l(mLock);
+
+    // achieved rate over the frames still in the ring
+    int64_t first = 0, last = 0;
+    int shown = 0;
+    for (int i=0 ; i<kFrames ; i++) {
+        int64_t t = mRing[i].scanout;
+        if (!t) continue;
+        if (!first || t < first) first = t;
+        if (t > last) last = t;
+        shown++;
+    }
+    float fps = (shown > 1 && last > first) ?
+            (shown - 1) * 1e9f / float(last - first) : 0.0f;
+
+    int len = snprintf(buff, buff_len,
+            "  framebuffer: %u posted, %u displayed, %u reused, %u late, "
+            "%.2f fps\n",
+            mPosted, mDisplayed, mReused, mLate, fps);
+    if (len < buff_len) {
+        len += dumpHist(buff + len, buff_len - len, "post to scanout",
+                mLatencyHist);
+    }
+    if (len < buff_len) {
+        dumpHist(buff + len, buff_len - len, "wait for buffer", mWaitHist);
+    }
+}
+
+int FrameStats::writeTrace(const char* path) const
+{
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        int err = errno;
+        LOGE("can't open frame trace %s (%s)", path, strerror(err));
+        return -err;
+    }
+
+    Locker::Autolock _l(mLock);
+    uint32_t count = mPosted < uint32_t(kFrames) ? mPosted : uint32_t(kFrames);
+    frame_trace_header_t header;
+    header.magic = kTraceMagic;
+    header.version = kTraceVersion;
+    header.count = count;
+    header.refreshPeriod = mRefreshPeriod;
+
+    int err = 0;
+    if (fwrite(&header, sizeof(header), 1, file) != 1)
+        err = -EIO;
+    // oldest first
+    for (uint32_t i=0 ; i<count && !err ; i++) {
+        frame_t const& f = mRing[(mPosted - count + i) % kFrames];
+        if (fwrite(&f, sizeof(f), 1, file) != 1)
+            err = -EIO;
+    }
+    if (fclose(file) != 0 && !err)
+        err = -EIO;
+    LOGE_IF(err, "can't write frame trace %s", path);
+    return err;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GRALLOC_QSD8K_FRAMESTATS_H
+#define GRALLOC_QSD8K_FRAMESTATS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "gr.h"
+
+
+/*
+ * Timestamps of the last kFrames frames through fb_post() and disp_loop(),
+ * and histograms of how long frames took from fb_post() to the display and
+ * how long fb_post() was blocked waiting for a free buffer.
+ *
+ * writeTrace() saves the frames still in the ring as a frame_trace_header_t
+ * followed by 'count' frame_t, in the host's byte order.
+ */
+class FrameStats {
+
+ public:
+
+    enum {
+        kFrames = 128,
+        kHistBuckets = 16,      // log2 of microseconds, the last is open
+        kTraceMagic = 0x53465247,   // "GRFS"
+        kTraceVersion = 1,
+    };
+
+    // CLOCK_MONOTONIC ns, 0 for a stage the frame didn't reach
+    struct frame_t {
+        uint32_t    frame;
+        int32_t     idx;        // framebuffer slot, -1 when reused
+        int64_t     posted;     // fb_post() called
+        int64_t     queued;     // handed to disp_loop()
+        int64_t     waited;     // ns fb_post() then waited for a buffer
+        int64_t     scanout;    // FBIOPUT_VSCREENINFO returned
+    };
+
+    struct frame_trace_header_t {
+        uint32_t    magic;
+        uint32_t    version;
+        uint32_t    count;
+        uint32_t    refreshPeriod;  // ns
+    };
+
+    FrameStats();
+
+    static int64_t now();
+
+    // the nominal time between two vsyncs, frames shown later than 1.5
+    // periods after the previous one count as late
+    void setRefreshPeriod(int64_t ns);
+
+    // fb_post() was called, returns the frame number to report the other
+    // stages with
+    uint32_t posted(int64_t when);
+    void queued(uint32_t frame, int idx, int64_t when, int64_t waited);
+    // swapInterval is 0 and no buffer was free, the frame isn't shown
+    void reused(uint32_t frame);
+    void scannedOut(uint32_t frame, int64_t when);
+
+    void dump(char* buff, int buff_len) const;
+    // Returns 0 or a negative errno.
+    int writeTrace(const char* path) const;
+
+ private:
+
+    static int histBucket(int64_t ns);
+    static int dumpHist(char* buff, int buff_len, const char* what,
+            uint32_t const* hist);
+
+    mutable Locker  mLock;
+    frame_t         mRing[kFrames];
+    uint32_t        mPosted;
+    uint32_t        mReused;
+    uint32_t        mDisplayed;
+    uint32_t        mLate;
+    int64_t         mRefreshPeriod;
+    int64_t         mLastScanout;
+    uint32_t        mLatencyHist[kHistBuckets];
+    uint32_t        mWaitHist[kHistBuckets];
+};
+
+#endif  // GRALLOC_QSD8K_FRAMESTATS_H
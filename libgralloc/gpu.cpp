@@ -24,10 +24,13 @@
 #include "gpu.h"
 
 gpu_context_t::gpu_context_t(Deps& deps, PmemAllocator& pmemAllocator,
-        PmemAllocator& pmemAdspAllocator, const private_module_t* module) :
+        PmemAllocator& pmemAdspAllocator, const private_module_t* module,
+        size_t recycleBudget, const char* tracePath) :
     deps(deps),
     pmemAllocator(pmemAllocator),
-    pmemAdspAllocator(pmemAdspAllocator)
+    pmemAdspAllocator(pmemAdspAllocator),
+    recycler(recycleBudget),
+    tracer(tracePath)
 {
     // Zero out the alloc_device_t
     memset(static_cast<alloc_device_t*>(this), 0, sizeof(alloc_device_t));
@@ -39,6 +42,15 @@ gpu_context_t::gpu_context_t(Deps& deps, PmemAllocator& pmemAllocator,
     common.close   = gralloc_close;
     alloc          = gralloc_alloc;
     free           = gralloc_free;
+    dump           = gralloc_dump;
+}
+
+gpu_context_t::~gpu_context_t()
+{
+    private_handle_t* hnd;
+    while ((hnd = recycler.popOldest(0)) != 0) {
+        release_buffer(hnd);
+    }
 }
 
 int gpu_context_t::gralloc_alloc_framebuffer_locked(size_t size, int usage,
@@ -211,13 +223,34 @@ int gpu_context_t::gralloc_alloc_buffer(size_t size, int usage, buffer_handle_t*
         // PMEM buffers are always mmapped
         lockState |= private_handle_t::LOCK_STATE_MAPPED;
 
+        // remember whether the pmem fd is opened cached (see get_open_flags)
+        if ((usage & GRALLOC_USAGE_SW_READ_MASK) == GRALLOC_USAGE_SW_READ_OFTEN ||
+            (usage & GRALLOC_USAGE_SW_WRITE_MASK) == GRALLOC_USAGE_SW_WRITE_OFTEN) {
+            flags |= private_handle_t::PRIV_FLAGS_CACHED;
+        }
+
+        // Hand back a recently freed buffer of the same kind if we have one
+        private_handle_t* hnd = reuse_pmem_buffer(pma, size, usage, flags);
+        if (hnd) {
+            *pHandle = hnd;
+            return 0;
+        }
+
         // Allocate the buffer from pmem
         err = pma->alloc_pmem_buffer(size, usage, &base, &offset, &fd);
+        if (err == -ENOMEM && recycler.parked()) {
+            // parked buffers are holding on to pmem, give it all back
+            while ((hnd = recycler.popOldest(0)) != 0) {
+                release_buffer(hnd);
+            }
+            err = pma->alloc_pmem_buffer(size, usage, &base, &offset, &fd);
+        }
         if (err < 0) {
             if (((usage & GRALLOC_USAGE_HW_MASK) == 0) &&
                 ((usage & GRALLOC_USAGE_PRIVATE_PMEM_ADSP) == 0)) {
                 // the caller didn't request PMEM, so we can try something else
-                flags &= ~private_handle_t::PRIV_FLAGS_USES_PMEM;
+                flags &= ~(private_handle_t::PRIV_FLAGS_USES_PMEM |
+                           private_handle_t::PRIV_FLAGS_CACHED);
                 err = 0;
                 goto try_ashmem;
             } else {
@@ -318,10 +351,63 @@ int gpu_context_t::alloc_impl(int w, int h, int format, int usage,
         return err;
     }
 
+    private_handle_t* hnd = (private_handle_t*)*pHandle;
+    if (!(hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER)) {
+        deps.setBufferLayout(hnd, format, alignedw);
+    }
+    tracer.recordAlloc(uint32_t(intptr_t(hnd)), hnd->size, usage, hnd->flags);
+
     *pStride = alignedw;
     return 0;
 }
 
+private_handle_t* gpu_context_t::reuse_pmem_buffer(PmemAllocator* pma,
+        size_t size, int usage, int flags)
+{
+    private_handle_t* hnd = recycler.take(size, flags);
+    if (hnd) {
+        // the fd the previous owner had is revoked, connect a new one
+        int fd;
+        if (pma->remap_pmem_buffer(hnd->size, usage, hnd->offset, &fd) < 0) {
+            release_buffer(hnd);
+            return 0;
+        }
+        hnd->fd = fd;
+        // the previous owner may have left it locked or dirty, and its
+        // content must never leak to the next client
+        hnd->lockState = private_handle_t::LOCK_STATE_MAPPED;
+        hnd->writeOwner = 0;
+        hnd->flags &= ~private_handle_t::PRIV_FLAGS_NEEDS_FLUSH;
+        memset((void*)hnd->base, 0, hnd->size);
+    }
+    return hnd;
+}
+
+PmemAllocator* gpu_context_t::pmem_allocator_for(private_handle_t const* hnd)
+{
+    if (hnd->flags & private_handle_t::PRIV_FLAGS_USES_PMEM) {
+        return &pmemAllocator;
+    } else if (hnd->flags & private_handle_t::PRIV_FLAGS_USES_PMEM_ADSP) {
+        return &pmemAdspAllocator;
+    }
+    return 0;
+}
+
+void gpu_context_t::release_buffer(private_handle_t const* hnd) {
+    private_module_t* m = reinterpret_cast<private_module_t*>(common.module);
+    PmemAllocator* pmem_allocator = pmem_allocator_for(hnd);
+    if (pmem_allocator) {
+        // a parked buffer has no fd, it was unmapped when it was parked
+        pmem_allocator->free_pmem_buffer(hnd->size, (void*)hnd->base,
+                hnd->offset, hnd->fd);
+    }
+    deps.terminateBuffer(&m->base, const_cast<private_handle_t*>(hnd));
+    if (hnd->fd >= 0) {
+        deps.close(hnd->fd);
+    }
+    delete hnd; // XXX JMG: move this to the deps
+}
+
 int gpu_context_t::free_impl(private_handle_t const* hnd) {
     private_module_t* m = reinterpret_cast<private_module_t*>(common.module);
     if (hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER) {
@@ -329,22 +415,32 @@ int gpu_context_t::free_impl(private_handle_t const* hnd) {
         const size_t bufferSize = m->finfo.line_length * m->info.yres;
         int index = (hnd->base - m->framebuffer->base) / bufferSize;
         m->bufferMask &= ~(1<<index); 
-    } else { 
-        PmemAllocator* pmem_allocator = 0;
-        if (hnd->flags & private_handle_t::PRIV_FLAGS_USES_PMEM) {
-            pmem_allocator = &pmemAllocator;
-        } else if (hnd->flags & private_handle_t::PRIV_FLAGS_USES_PMEM_ADSP) {
-            pmem_allocator = &pmemAdspAllocator;
-        }
-        if (pmem_allocator) {
-            pmem_allocator->free_pmem_buffer(hnd->size, (void*)hnd->base,
-                    hnd->offset, hnd->fd);
+        deps.close(hnd->fd);
+        delete hnd; // XXX JMG: move this to the deps
+        return 0;
+    }
+
+    // Keep it around for the next allocation of this kind. Other processes
+    // may still have its fd, so they lose access to it first and it is
+    // parked without one.
+    PmemAllocator* pmem_allocator = pmem_allocator_for(hnd);
+    private_handle_t* parked = const_cast<private_handle_t*>(hnd);
+    if (pmem_allocator && recycler.budget() && hnd->pid == getpid() &&
+            pmem_allocator->unmap_pmem_buffer(hnd->size, (void*)hnd->base,
+                    hnd->offset, hnd->fd) == 0) {
+        deps.close(hnd->fd);
+        parked->fd = -1;
+        if (recycler.park(parked)) {
+            // trim the oldest parked buffers back under budget
+            private_handle_t* victim;
+            while ((victim = recycler.popOldest(recycler.budget())) != 0) {
+                release_buffer(victim);
+            }
+            return 0;
         }
-        deps.terminateBuffer(&m->base, const_cast<private_handle_t*>(hnd));
     }
 
-    deps.close(hnd->fd);
-    delete hnd; // XXX JMG: move this to the deps
+    release_buffer(hnd);
     return 0;
 }
 
@@ -370,9 +466,27 @@ int gpu_context_t::gralloc_free(alloc_device_t* dev,
 
     private_handle_t const* hnd = reinterpret_cast<private_handle_t const*>(handle);
     gpu_context_t* gpu = reinterpret_cast<gpu_context_t*>(dev);
+    gpu->tracer.recordFree(uint32_t(intptr_t(hnd)));
     return gpu->free_impl(hnd);
 }
 
+void gpu_context_t::gralloc_dump(alloc_device_t* dev, char* buff, int buff_len)
+{
+    if (!dev || !buff || buff_len <= 0) {
+        return;
+    }
+    gpu_context_t* gpu = reinterpret_cast<gpu_context_t*>(dev);
+    // a good time to get the trace on disk, too
+    gpu->tracer.flush();
+    gpu->recycler.dump(buff, buff_len);
+    size_t len = strlen(buff);
+    gpu->pmemAllocator.dump(buff + len, buff_len - len);
+    len = strlen(buff);
+    gpu->pmemAdspAllocator.dump(buff + len, buff_len - len);
+    len = strlen(buff);
+    gpu->deps.dumpFrameStats(buff + len, buff_len - len);
+}
+
 /*****************************************************************************/
 
 int gpu_context_t::gralloc_close(struct hw_device_t *dev)
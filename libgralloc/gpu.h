@@ -27,6 +27,8 @@
 
 #include "gralloc_priv.h"
 #include "pmemalloc.h"
+#include "recycler.h"
+#include "trace.h"
 
 
 class gpu_context_t : public alloc_device_t {
@@ -47,10 +49,15 @@ class gpu_context_t : public alloc_device_t {
         virtual int mapFrameBufferLocked(struct private_module_t* module) = 0;
         virtual int terminateBuffer(gralloc_module_t const* module,
             private_handle_t* hnd) = 0;
+        virtual void setBufferLayout(private_handle_t const* hnd,
+            int format, int stride) = 0;
+        virtual void dumpFrameStats(char* buff, int buff_len) = 0;
     };
 
     gpu_context_t(Deps& deps, PmemAllocator& pmemAllocator,
-            PmemAllocator& pmemAdspAllocator, const private_module_t* module);
+            PmemAllocator& pmemAdspAllocator, const private_module_t* module,
+            size_t recycleBudget = 0, const char* tracePath = 0);
+    ~gpu_context_t();
 
     int gralloc_alloc_framebuffer_locked(size_t size, int usage,
             buffer_handle_t* pHandle);
@@ -65,14 +72,21 @@ class gpu_context_t : public alloc_device_t {
             int usage, buffer_handle_t* pHandle, int* pStride);
     static int gralloc_free(alloc_device_t* dev, buffer_handle_t handle);
     static int gralloc_close(struct hw_device_t *dev);
+    static void gralloc_dump(alloc_device_t* dev, char* buff, int buff_len);
 
  private:
 
     Deps& deps;
     PmemAllocator& pmemAllocator;
     PmemAllocator& pmemAdspAllocator;
+    BufferRecycler recycler;
+    TraceRecorder tracer;
     int alloc_ashmem_buffer(size_t size, unsigned int postfix, void** pBase,
             int* pOffset, int* pFd);
+    private_handle_t* reuse_pmem_buffer(PmemAllocator* pma, size_t size,
+            int usage, int flags);
+    PmemAllocator* pmem_allocator_for(private_handle_t const* hnd);
+    void release_buffer(private_handle_t const* hnd);
 };
 
 #endif  // GRALLOC_QSD8K_GPU_H
@@ -28,7 +28,11 @@
 #include <hardware/gralloc.h>
 #include <pthread.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
+#include <cutils/atomic.h>
 #include <cutils/native_handle.h>
 
 /*****************************************************************************/
@@ -44,15 +48,30 @@ inline size_t roundUpToPageSize(size_t x) {
 #define TRUE  1
 
 int mapFrameBufferLocked(struct private_module_t* module);
+void dumpFrameStats(char* buff, int buff_len);
 int terminateBuffer(gralloc_module_t const* module, private_handle_t* hnd);
+void setBufferLayout(private_handle_t const* hnd, int format, int stride);
 size_t calculateBufferSize(int width, int height, int format);
 int decideBufferHandlingMechanism(int format, const char *compositionUsed,
                                    int hasBlitEngine, int *needConversion,
                                    int *useBufferDirectly);
 /*****************************************************************************/
 
+// sleeps as long as *addr == value, spurious wake-ups are possible
+inline void futex_wait(volatile int32_t* addr, int32_t value) {
+    syscall(__NR_futex, addr, FUTEX_WAIT, value, NULL, NULL, 0);
+}
+
+inline void futex_wake(volatile int32_t* addr) {
+    syscall(__NR_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/*****************************************************************************/
+
 class Locker {
     pthread_mutex_t mutex;
+    uint32_t contended;     // times lock() had to wait, guarded by mutex
+    volatile int32_t busy;  // times tryLock() failed, atomic
 public:
     class Autolock {
         Locker& locker;
@@ -60,10 +79,25 @@ public:
         inline Autolock(Locker& locker) : locker(locker) {  locker.lock(); }
         inline ~Autolock() { locker.unlock(); }
     };
-    inline Locker()        { pthread_mutex_init(&mutex, 0); }
+    inline Locker() : contended(0), busy(0) { pthread_mutex_init(&mutex, 0); }
     inline ~Locker()       { pthread_mutex_destroy(&mutex); }
-    inline void lock()     { pthread_mutex_lock(&mutex); }
+    inline void lock() {
+        if (pthread_mutex_trylock(&mutex) != 0) {
+            pthread_mutex_lock(&mutex);
+            contended++;
+        }
+    }
+    inline bool tryLock() {
+        if (pthread_mutex_trylock(&mutex) == 0) {
+            return true;
+        }
+        android_atomic_inc(&busy);
+        return false;
+    }
     inline void unlock()   { pthread_mutex_unlock(&mutex); }
+    // only meaningful with the lock held
+    inline uint32_t contention() const { return contended; }
+    inline uint32_t busySkips() const { return android_atomic_acquire_load(&busy); }
 };
 
 #endif /* GR_H_ */
@@ -24,6 +24,8 @@
 
 #include <linux/android_pmem.h>
 
+#include <cutils/properties.h>
+
 #include "allocator.h"
 #include "gr.h"
 #include "gpu.h"
@@ -135,6 +137,15 @@ class GpuContextDepsDeviceImpl : public gpu_context_t::Deps {
         return ::terminateBuffer(module, hnd);
     }
 
+    virtual void setBufferLayout(private_handle_t const* hnd,
+            int format, int stride) {
+        ::setBufferLayout(hnd, format, stride);
+    }
+
+    virtual void dumpFrameStats(char* buff, int buff_len) {
+        ::dumpFrameStats(buff, buff_len);
+    }
+
     virtual int close(int fd) {
         return ::close(fd);
     }
@@ -145,12 +156,23 @@ static GpuContextDepsDeviceImpl gpuContextDeviceDepsImpl;
 
 /*****************************************************************************/
 
-static SimpleBestFitAllocator pmemAllocMgr;
+// small buffers (icons, glyph caches, status bar...) come from 4 arenas of
+// 1 MiB so that they don't queue behind one another or the big ones
+static ArenaAllocator pmemAllocMgr(4, 1<<20, 128<<10);
 static PmemUserspaceAllocator pmemAllocator(pmemAllocatorDeviceDepsImpl, pmemAllocMgr,
         "/dev/pmem");
 
+// pmem_adsp is shared with the camera and video drivers, so only grab a pool
+// of it up front when asked to (a power of 2 number of KiB).
+static size_t getAdspPoolSize() {
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.gr.adsp_pool_kb", value, "0");
+    return size_t(atoi(value)) << 10;
+}
+
+static BuddyAllocator pmemAdspAllocMgr;
 static PmemKernelAllocator pmemAdspAllocator(pmemAllocatorDeviceDepsImpl,
-        "/dev/pmem_adsp");
+        pmemAdspAllocMgr, getAdspPoolSize(), "/dev/pmem_adsp");
 
 /*****************************************************************************/
 
@@ -193,9 +215,19 @@ int gralloc_device_open(const hw_module_t* module, const char* name,
     if (!strcmp(name, GRALLOC_HARDWARE_GPU0)) {
         const private_module_t* m = reinterpret_cast<const private_module_t*>(
                 module);
+        // freed pmem buffers are kept around for reuse, up to this many KiB.
+        // Off by default: a reused buffer is reconnected and zeroed like a
+        // new one, on the allocating thread, and the scrubber never gets
+        // to zero it in the background.
+        char value[PROPERTY_VALUE_MAX];
+        property_get("debug.gr.recycle_kb", value, "0");
+        size_t recycleBudget = size_t(atoi(value)) << 10;
+        // allocations and frees are appended to this file, if set
+        char tracePath[PROPERTY_VALUE_MAX];
+        property_get("debug.gr.trace", tracePath, "");
         gpu_context_t *dev;
         dev = new gpu_context_t(gpuContextDeviceDepsImpl, pmemAllocator,
-                pmemAdspAllocator, m);
+                pmemAdspAllocator, m, recycleBudget, tracePath);
         *device = &dev->common;
         status = 0;
     } else {
@@ -36,87 +36,10 @@ enum {
     GRALLOC_USAGE_PRIVATE_PMEM = GRALLOC_USAGE_PRIVATE_1,
 };
 
-#define NUM_BUFFERS 2
+#define NUM_BUFFERS 3     // at most, see debug.gr.numbuffers
 #undef NO_SURFACEFLINGER_SWAPINTERVAL
 #define INTERLACE_MASK 0x80
 /*****************************************************************************/
-#ifdef __cplusplus
-template <class T>
-struct Node
-{
-    T data;
-    Node<T> *next;
-};
-
-template <class T>
-class Queue
-{
-public:
-    Queue(): front(NULL), back(NULL), len(0) {dummy = new T;}
-    ~Queue()
-    {
-        clear();
-        delete dummy;
-    }
-    void push(const T& item)   //add an item to the back of the queue
-    {
-        if(len != 0) {         //if the queue is not empty
-            back->next = new Node<T>; //create a new node
-            back = back->next; //set the new node as the back node
-            back->data = item;
-            back->next = NULL;
-        } else {
-            back = new Node<T>;
-            back->data = item;
-            back->next = NULL;
-            front = back;
-       }
-       len++;
-    }
-    void pop()                 //remove the first item from the queue
-    {
-        if (isEmpty())
-            return;            //if the queue is empty, no node to dequeue
-        T item = front->data;
-        Node<T> *tmp = front;
-        front = front->next;
-        delete tmp;
-        if(front == NULL)      //if the queue is empty, update the back pointer
-            back = NULL;
-        len--;
-        return;
-    }
-    T& getHeadValue() const    //return the value of the first item in the queue
-    {                          //without modification to the structure
-        if (isEmpty()) {
-            LOGE("Error can't get head of empty queue");
-            return *dummy;
-        }
-        return front->data;
-    }
-
-    bool isEmpty() const       //returns true if no elements are in the queue
-    {
-        return (front == NULL);
-    }
-
-    size_t size() const        //returns the amount of elements in the queue
-    {
-        return len;
-    }
-
-private:
-    Node<T> *front;
-    Node<T> *back;
-    size_t len;
-    void clear()
-    {
-        while (!isEmpty())
-            pop();
-    }
-    T *dummy;
-};
-#endif
 
 enum {
     /* OEM specific HAL formats */
@@ -158,14 +81,33 @@ struct PmemAllocator;
 struct qbuf_t {
     buffer_handle_t buf;
     int  idx;
+    uint32_t frame;     // for the FrameStats
+    int64_t posted;     // when fb_post() was called, for the VsyncPacer
+    void* fence;        // EGLSyncKHR signaled when the GPU is done with buf
 };
 
-struct avail_t {
-    pthread_mutex_t lock;
-    pthread_cond_t cond;
-#ifdef __cplusplus
-    bool is_avail;
-#endif
+/*
+ * Buffers posted and waiting to be displayed. fb_post() is the only producer
+ * and disp_loop() the only consumer, head and tail only ever grow.
+ */
+struct post_queue_t {
+    struct qbuf_t ring[NUM_BUFFERS];
+    volatile int32_t head;      // next buffer to display, moved by disp_loop
+    volatile int32_t tail;      // next free entry, moved by fb_post
+    volatile int32_t sleeping;  // disp_loop is waiting on tail
+};
+
+#define MAX_DAMAGE_RECTS 4
+
+/*
+ * Screen area updated since the last buffer was displayed, as given to
+ * fb_setUpdateRect(). A count of 0 stands for the whole screen.
+ */
+struct damage_t {
+    int count;
+    struct {
+        int l, t, r, b;
+    } rects[MAX_DAMAGE_RECTS];
 };
 
 struct private_module_t {
@@ -185,13 +127,13 @@ struct private_module_t {
     float ydpi;
     float fps;
     int swapInterval;
-#ifdef __cplusplus
-    Queue<struct qbuf_t> disp; // non-empty when buffer is ready for display    
-#endif
+    struct post_queue_t disp;
     int currentIdx;
-    struct avail_t avail[NUM_BUFFERS];
-    pthread_mutex_t qlock;
-    pthread_cond_t qpost;
+    // nonzero when a buffer is neither queued nor on screen
+    volatile int32_t avail[NUM_BUFFERS];
+    // the frame each buffer was last queued for, plus one, 0 if never
+    uint32_t queued[NUM_BUFFERS];
+    struct damage_t damage;
 
     enum {
         // flag to indicate we'll post this buffer
@@ -216,12 +158,14 @@ struct private_handle_t {
         PRIV_FLAGS_USES_PMEM_ADSP = 0x00000004,
         PRIV_FLAGS_NEEDS_FLUSH    = 0x00000008,
         PRIV_FLAGS_USES_ASHMEM    = 0x00000010,
+        PRIV_FLAGS_CACHED         = 0x00000020,
     };
 
     enum {
         LOCK_STATE_WRITE     =   1<<31,
         LOCK_STATE_MAPPED    =   1<<30,
-        LOCK_STATE_READ_MASK =   0x3FFFFFFF
+        LOCK_STATE_MAPPING   =   1<<29,     // a thread is mapping the buffer
+        LOCK_STATE_READ_MASK =   0x1FFFFFFF
     };
 
     // file-descriptors
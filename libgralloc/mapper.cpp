@@ -38,6 +38,7 @@
 
 #include "gralloc_priv.h"
 #include "gr.h"
+#include "dirty.h"
 
 // we need this for now because pmem cannot mmap at an offset
 #define PMEM_HACK   1
@@ -57,6 +58,11 @@ pid_t gettid() { return syscall(__NR_gettid);}
 
 /*****************************************************************************/
 
+// what this process knows of its buffers beyond their handles
+static BufferStateTable sBufferStates;
+
+/*****************************************************************************/
+
 static int gralloc_map(gralloc_module_t const* module,
         buffer_handle_t handle,
         void** vaddr)
@@ -111,7 +117,51 @@ static int gralloc_unmap(gralloc_module_t const* module,
 
 /*****************************************************************************/
 
-static pthread_mutex_t sMapLock = PTHREAD_MUTEX_INITIALIZER; 
+/*
+ * Maps the buffer once per process. The first thread to get here claims the
+ * mapping with LOCK_STATE_MAPPING and does the mmap, the others sleep on the
+ * handle's lockState until it's done. Threads locking different buffers
+ * never wait on each other.
+ */
+static int gralloc_map_once(gralloc_module_t const* module,
+        buffer_handle_t handle)
+{
+    private_handle_t* hnd = (private_handle_t*)handle;
+    volatile int32_t* state = (volatile int32_t*)&hnd->lockState;
+    int32_t current_value;
+
+    for (;;) {
+        current_value = android_atomic_acquire_load(state);
+        if (current_value & private_handle_t::LOCK_STATE_MAPPED) {
+            return 0;
+        }
+        if (current_value & private_handle_t::LOCK_STATE_MAPPING) {
+            // only the futex_wake() below wakes us up. If the lock count
+            // changed lockState since we read it, futex_wait() returns at
+            // once and we just look again
+            futex_wait(state, current_value);
+            continue;
+        }
+        if (!android_atomic_cmpxchg(current_value,
+                current_value | private_handle_t::LOCK_STATE_MAPPING, state)) {
+            break;
+        }
+    }
+
+    void* vaddr;
+    int err = gralloc_map(module, handle, &vaddr);
+
+    // hnd->base is published by the release in cmpxchg; on failure the
+    // waiters get to try for themselves
+    int32_t mapped = err ? 0 : private_handle_t::LOCK_STATE_MAPPED;
+    do {
+        current_value = *state;
+    } while (android_atomic_cmpxchg(current_value,
+            (current_value & ~private_handle_t::LOCK_STATE_MAPPING) | mapped,
+            state));
+    futex_wake(state);
+    return err;
+}
 
 /*****************************************************************************/
 
@@ -170,6 +220,11 @@ int gralloc_unregister_buffer(gralloc_module_t const* module,
     return 0;
 }
 
+void setBufferLayout(private_handle_t const* hnd, int format, int stride)
+{
+    sBufferStates.setLayout(hnd, format, stride);
+}
+
 int terminateBuffer(gralloc_module_t const* module,
         private_handle_t* hnd)
 {
@@ -185,11 +240,14 @@ int terminateBuffer(gralloc_module_t const* module,
     if (hnd->lockState & private_handle_t::LOCK_STATE_MAPPED) {
         // this buffer was mapped, unmap it now
         if (hnd->flags & private_handle_t::PRIV_FLAGS_USES_PMEM ||
+            hnd->flags & private_handle_t::PRIV_FLAGS_USES_PMEM_ADSP ||
             hnd->flags & private_handle_t::PRIV_FLAGS_USES_ASHMEM) {
             if (hnd->pid != getpid()) {
                 // ... unless it's a "master" pmem buffer, that is a buffer
                 // mapped in the process it's been allocated.
                 // (see gralloc_alloc_buffer())
+                // pmem_adsp buffers are unmapped by their PmemKernelAllocator,
+                // and may live in its pool mapping.
                 gralloc_unmap(module, hnd);
             }
         } else {
@@ -197,6 +255,7 @@ int terminateBuffer(gralloc_module_t const* module,
         }
     }
 
+    sBufferStates.forget(hnd);
     return 0;
 }
 
@@ -250,26 +309,18 @@ int gralloc_lock(gralloc_module_t const* module,
     }
 
     // if requesting sw write for non-framebuffer handles, flag for
-    // flushing at unlock
+    // flushing at unlock, only the locked rectangle needs to be cleaned
 
     if ((usage & GRALLOC_USAGE_SW_WRITE_MASK) &&
             !(hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER)) {
+        sBufferStates.addDirty(hnd, l, t, w, h);
         hnd->flags |= private_handle_t::PRIV_FLAGS_NEEDS_FLUSH;
     }
 
     if (usage & (GRALLOC_USAGE_SW_READ_MASK | GRALLOC_USAGE_SW_WRITE_MASK)) {
         if (!(current_value & private_handle_t::LOCK_STATE_MAPPED)) {
             // we need to map for real
-            pthread_mutex_t* const lock = &sMapLock;
-            pthread_mutex_lock(lock);
-            if (!(hnd->lockState & private_handle_t::LOCK_STATE_MAPPED)) {
-                err = gralloc_map(module, handle, vaddr);
-                if (err == 0) {
-                    android_atomic_or(private_handle_t::LOCK_STATE_MAPPED,
-                            (volatile int32_t*)&(hnd->lockState));
-                }
-            }
-            pthread_mutex_unlock(lock);
+            err = gralloc_map_once(module, handle);
         }
         *vaddr = (void*)hnd->base;
     }
@@ -287,20 +338,23 @@ int gralloc_unlock(gralloc_module_t const* module,
     int32_t current_value, new_value;
 
     if (hnd->flags & private_handle_t::PRIV_FLAGS_NEEDS_FLUSH) {
-        int err;
+        int err = 0;
+        size_t start, end;
+        sBufferStates.takeDirty(hnd, &start, &end);
+        size_t length = end - start;
         if (hnd->flags & private_handle_t::PRIV_FLAGS_USES_PMEM) {
             struct pmem_addr pmem_addr;
-            pmem_addr.vaddr = hnd->base;
-            pmem_addr.offset = hnd->offset;
-            pmem_addr.length = hnd->size;
+            pmem_addr.vaddr = hnd->base + start;
+            pmem_addr.offset = hnd->offset + start;
+            pmem_addr.length = length;
             err = ioctl( hnd->fd, PMEM_CLEAN_CACHES,  &pmem_addr);
         } else if ((hnd->flags & private_handle_t::PRIV_FLAGS_USES_ASHMEM)) {
-            unsigned long addr = hnd->base + hnd->offset;
+            // the ashmem driver cleans the whole region, it takes no range
             err = ioctl(hnd->fd, ASHMEM_CACHE_CLEAN_RANGE, NULL);
         }         
 
         LOGE_IF(err < 0, "cannot flush handle %p (offs=%x len=%x)\n",
-                hnd, hnd->offset, hnd->size);
+                hnd, hnd->offset + int(start), int(length));
         hnd->flags &= ~private_handle_t::PRIV_FLAGS_NEEDS_FLUSH;
     }
 
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include "pacer.h"
+
+
+VsyncPacer::VsyncPacer(int64_t period)
+    : mPeriod(period), mLastFlip(0), mLastPost(0), mPostInterval(period),
+      mShown(0), mHeld(0), mDropped(0), mJanks(0)
+{
+}
+
+void VsyncPacer::posted(int64_t when)
+{
+    if (mLastPost) {
+        int64_t interval = when - mLastPost;
+        // a long pause isn't a rate, start over
+        if (interval > kMaxCadence * 2 * mPeriod) {
+            interval = kMaxCadence * mPeriod;
+        }
+        mPostInterval += (interval - mPostInterval) / 8;
+    }
+    mLastPost = when;
+}
+
+void VsyncPacer::flipped(int64_t when)
+{
+    if (mLastFlip) {
+        int64_t interval = when - mLastFlip;
+        int64_t vsyncs = (interval + mPeriod / 2) / mPeriod;
+        if (vsyncs >= 1 && vsyncs <= kMaxCadence) {
+            // flips land on vblanks, their spacing refines the period
+            mPeriod += (interval / vsyncs - mPeriod) / 16;
+            if (vsyncs != cadence()) {
+                mJanks++;
+            }
+        }
+    }
+    mLastFlip = when;
+    mShown++;
+}
+
+int VsyncPacer::cadence() const
+{
+    int cadence = int((mPostInterval + mPeriod / 2) / mPeriod);
+    if (cadence < 1) cadence = 1;
+    if (cadence > kMaxCadence) cadence = kMaxCadence;
+    return cadence;
+}
+
+int64_t VsyncPacer::nextVsync(int64_t now) const
+{
+    if (!mLastFlip || now < mLastFlip) {
+        return now;
+    }
+    int64_t vsyncs = (now - mLastFlip) / mPeriod + 1;
+    return mLastFlip + vsyncs * mPeriod;
+}
+
+int VsyncPacer::decide(int64_t posted, int64_t now, bool newer,
+        int64_t* holdUntil)
+{
+    if (!mLastFlip) {
+        return SHOW;
+    }
+
+    int64_t slot = int64_t(cadence()) * mPeriod;
+
+    // waited more than a frame's worth and the next one is there already,
+    // showing this one would only add latency
+    if (newer && now - posted > slot) {
+        mDropped++;
+        return DROP;
+    }
+
+    // flipping now would come out before the cadence, hold it to half a
+    // period before the right vblank so the flip lands on it
+    int64_t target = mLastFlip + slot;
+    if (nextVsync(now) < target - mPeriod / 2) {
+        *holdUntil = target - mPeriod / 2;
+        mHeld++;
+        return HOLD;
+    }
+    return SHOW;
+}
+
+void VsyncPacer::dump(char* buff, int buff_len) const
+{
+    snprintf(buff, buff_len,
+            "    pacing: period=%lld ns, cadence=%d, %u shown, %u held, "
+            "%u dropped, %u janks\n",
+            (long long)mPeriod, cadence(), mShown, mHeld, mDropped, mJanks);
+}
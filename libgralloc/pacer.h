@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GRALLOC_QSD8K_PACER_H
+#define GRALLOC_QSD8K_PACER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+
+/*
+ * Decides when disp_loop() shows the frame at the head of the post queue so
+ * that frames come out at a steady cadence, a whole number of vsyncs apart.
+ *
+ * The panel timing is learnt from the flips: a flip with FB_ACTIVATE_VBL
+ * completes on a vblank, so the time between two flips is a multiple of
+ * the refresh period. The cadence follows the rate frames are posted at.
+ * A frame that would come out ahead of the cadence is held, and a frame
+ * that is already late is dropped when a newer one is queued behind it.
+ *
+ * All times are CLOCK_MONOTONIC ns. The pacer isn't thread-safe, only
+ * disp_loop() uses it, and learns about posts as it dequeues them.
+ */
+class VsyncPacer {
+
+ public:
+
+    enum {
+        SHOW,       // flip to it now
+        HOLD,       // wait until *holdUntil and decide again
+        DROP,       // skip it, there is a newer frame
+    };
+
+    enum { kMaxCadence = 4 };
+
+    // period is the nominal refresh period, until measured
+    VsyncPacer(int64_t period);
+
+    // a frame was posted
+    void posted(int64_t when);
+    // a flip completed at 'when', the frame is on screen
+    void flipped(int64_t when);
+
+    int decide(int64_t posted, int64_t now, bool newer, int64_t* holdUntil);
+
+    int64_t period() const { return mPeriod; }
+    // vsyncs per frame
+    int cadence() const;
+    // the first vblank after now, as far as we can tell
+    int64_t nextVsync(int64_t now) const;
+
+    uint32_t shown() const   { return mShown; }
+    uint32_t held() const    { return mHeld; }
+    uint32_t dropped() const { return mDropped; }
+    // frames that came out at another interval than the cadence
+    uint32_t janks() const   { return mJanks; }
+
+    void dump(char* buff, int buff_len) const;
+
+ private:
+
+    int64_t     mPeriod;
+    int64_t     mLastFlip;
+    int64_t     mLastPost;
+    int64_t     mPostInterval;
+    uint32_t    mShown;
+    uint32_t    mHeld;
+    uint32_t    mDropped;
+    uint32_t    mJanks;
+};
+
+#endif  // GRALLOC_QSD8K_PACER_H
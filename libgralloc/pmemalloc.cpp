@@ -21,10 +21,13 @@
 #include <fcntl.h>
 #include <pthread.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 
 #include <sys/mman.h>
+#include <sys/resource.h>
 
+#include <cutils/atomic.h>
 #include <cutils/log.h>
 #include <cutils/ashmem.h>
 
@@ -54,14 +57,42 @@ PmemAllocator::~PmemAllocator()
 }
 
 
+int PmemAllocator::unmap_pmem_buffer(size_t size, void* base, int offset,
+        int fd)
+{
+    return -ENOSYS;
+}
+
+
+int PmemAllocator::remap_pmem_buffer(size_t size, int usage, int offset,
+        int* pFd)
+{
+    return -ENOSYS;
+}
+
+
+void PmemAllocator::dump(char* buff, int buff_len)
+{
+}
+
+
 PmemUserspaceAllocator::PmemUserspaceAllocator(Deps& deps, Deps::Allocator& allocator, const char* pmemdev):
     deps(deps),
     allocator(allocator),
     pmemdev(pmemdev),
-    master_fd(MASTER_FD_INIT)
+    master_fd(MASTER_FD_INIT),
+    scrubbing(false),
+    scrub_pending(false),
+    scrub_claimed(false),
+    scrub_quit(false),
+    bytes_zeroed_async(0),
+    bytes_zeroed_sync(0)
 {
     BEGIN_FUNC;
     pthread_mutex_init(&lock, NULL);
+    pthread_mutex_init(&scrub_lock, NULL);
+    pthread_cond_init(&scrub_cond, NULL);
+    pthread_cond_init(&scrub_idle_cond, NULL);
     END_FUNC;
 }
 
@@ -69,10 +100,108 @@ PmemUserspaceAllocator::PmemUserspaceAllocator(Deps& deps, Deps::Allocator& allo
 PmemUserspaceAllocator::~PmemUserspaceAllocator()
 {
     BEGIN_FUNC;
+    if (scrubbing) {
+        pthread_mutex_lock(&scrub_lock);
+        scrub_quit = true;
+        pthread_cond_signal(&scrub_cond);
+        pthread_mutex_unlock(&scrub_lock);
+        pthread_join(scrub_tid, NULL);
+    }
+    pthread_cond_destroy(&scrub_idle_cond);
+    pthread_cond_destroy(&scrub_cond);
+    pthread_mutex_destroy(&scrub_lock);
     END_FUNC;
 }
 
 
+void* PmemUserspaceAllocator::scrub_thread(void* data)
+{
+    // we only ever use idle time, the allocation path zeroes what it needs
+    // synchronously anyway (0 is the calling thread on linux)
+    setpriority(PRIO_PROCESS, 0, 19);
+    static_cast<PmemUserspaceAllocator*>(data)->scrub_loop();
+    return NULL;
+}
+
+
+void PmemUserspaceAllocator::scrub_loop()
+{
+    pthread_mutex_lock(&scrub_lock);
+    while (!scrub_quit) {
+        if (!scrub_pending) {
+            pthread_cond_wait(&scrub_cond, &scrub_lock);
+            continue;
+        }
+        scrub_pending = false;
+        size_t size;
+        ssize_t offset;
+        while (!scrub_quit &&
+                (offset = allocator.claimDirty(kScrubChunkSize, &size)) >= 0) {
+            // frees only take scrub_lock to signal us, they mustn't wait
+            // for a chunk to be zeroed
+            scrub_claimed = true;
+            pthread_mutex_unlock(&scrub_lock);
+            memset((char*)master_base + offset, 0, size);
+            allocator.releaseClean(offset);
+
+            pthread_mutex_lock(&lock);
+            bytes_zeroed_async += size;
+            pthread_mutex_unlock(&lock);
+
+            pthread_mutex_lock(&scrub_lock);
+            scrub_claimed = false;
+            pthread_cond_broadcast(&scrub_idle_cond);
+        }
+    }
+    pthread_mutex_unlock(&scrub_lock);
+}
+
+
+// When clean and dirty free memory only have room together: takes the
+// range over both that needs the least zeroing and zeroes its dirty parts.
+int PmemUserspaceAllocator::alloc_spanning(size_t size)
+{
+    Deps::Allocator::range_t dirty[kMaxDirtyRanges];
+    int count = 0;
+    ssize_t offset = allocator.allocateSpanning(size, dirty,
+            kMaxDirtyRanges, &count);
+    if (offset < 0) {
+        // what the scrubber holds is neither, wait for it to give it back
+        pthread_mutex_lock(&scrub_lock);
+        while (scrub_claimed) {
+            pthread_cond_wait(&scrub_idle_cond, &scrub_lock);
+        }
+        pthread_mutex_unlock(&scrub_lock);
+        offset = allocator.allocate(size, Deps::Allocator::ALLOCATE_ZEROED);
+        if (offset >= 0) {
+            return offset;
+        }
+        offset = allocator.allocate(size);
+        if (offset >= 0) {
+            memset((char*)master_base + offset, 0, size);
+            pthread_mutex_lock(&lock);
+            bytes_zeroed_sync += size;
+            pthread_mutex_unlock(&lock);
+            return offset;
+        }
+        offset = allocator.allocateSpanning(size, dirty, kMaxDirtyRanges,
+                &count);
+        if (offset < 0) {
+            return offset;
+        }
+    }
+    size_t zeroed = 0;
+    for (int i=0 ; i<count ; i++) {
+        memset((char*)master_base + dirty[i].offset, 0, dirty[i].size);
+        zeroed += dirty[i].size;
+    }
+    pthread_mutex_lock(&lock);
+    bytes_zeroed_sync += zeroed;
+    pthread_mutex_unlock(&lock);
+    return offset;
+}
+
+
 void* PmemUserspaceAllocator::get_base_address() {
     BEGIN_FUNC;
     END_FUNC;
@@ -105,8 +234,21 @@ int PmemUserspaceAllocator::init_pmem_area_locked()
             deps.close(fd);
             fd = -1;
         } else {
-            master_fd = fd;
             master_base = base;
+
+            // the heap starts out dirty, start zeroing it in the background
+            if (allocator.supportsScrubbing()) {
+                scrub_pending = true;
+                if (pthread_create(&scrub_tid, NULL, scrub_thread, this) == 0) {
+                    scrubbing = true;
+                } else {
+                    LOGW("%s: couldn't start scrubber thread", pmemdev);
+                }
+            }
+
+            // publish master_base and scrubbing before master_fd, callers
+            // that skip the lock in init_pmem_area() must see both
+            android_atomic_release_store(fd, (volatile int32_t*)&master_fd);
         }
     } else {
         LOGE("%s: failed to open pmem device: %s", pmemdev,
@@ -121,14 +263,22 @@ int PmemUserspaceAllocator::init_pmem_area_locked()
 int PmemUserspaceAllocator::init_pmem_area()
 {
     BEGIN_FUNC;
+    // master_fd is only ever set once, so every allocation after the first
+    // can skip the lock
+    int err = android_atomic_acquire_load((volatile int32_t*)&master_fd);
+    if (err != MASTER_FD_INIT) {
+        END_FUNC;
+        return err < 0 ? err : 0;
+    }
+
     pthread_mutex_lock(&lock);
-    int err = master_fd;
+    err = master_fd;
     if (err == MASTER_FD_INIT) {
         // first time, try to initialize pmem
         err = init_pmem_area_locked();
         if (err) {
             LOGE("%s: failed to initialize pmem area", pmemdev);
-            master_fd = err;
+            android_atomic_release_store(err, (volatile int32_t*)&master_fd);
         }
     } else if (err < 0) {
         // pmem couldn't be initialized, never use it
@@ -149,38 +299,42 @@ int PmemUserspaceAllocator::alloc_pmem_buffer(size_t size, int usage,
     int err = init_pmem_area();
     if (err == 0) {
         void* base = master_base;
-        int offset = allocator.allocate(size);
+        bool zeroed = false;
+        int offset = -ENOMEM;
+        if (scrubbing) {
+            // prefer memory the scrubber already zeroed
+            offset = allocator.allocate(size,
+                    Deps::Allocator::ALLOCATE_ZEROED);
+            zeroed = offset >= 0;
+        }
+        if (offset < 0) {
+            offset = allocator.allocate(size);
+        }
+        if (offset < 0 && scrubbing) {
+            // clean and dirty free chunks are kept apart, the room may
+            // only be there over both
+            offset = alloc_spanning(size);
+            zeroed = offset >= 0;
+        }
         if (offset < 0) {
             // no more pmem memory
             LOGE("%s: no more pmem available", pmemdev);
             err = -ENOMEM;
         } else {
-            int openFlags = get_open_flags(usage);
-
             //LOGD("%s: allocating pmem at offset 0x%p", pmemdev, offset);
 
-            // now create the "sub-heap"
-            int fd = deps.open(pmemdev, openFlags, 0);
-            err = fd < 0 ? fd : 0;
-
-            // and connect to it
-            if (err == 0)
-                err = deps.connectPmem(fd, master_fd);
-
-            // and make it available to the client process
-            if (err == 0)
-                err = deps.mapPmem(fd, offset, size);
-
+            int fd = -1;
+            err = connect_sub_heap(size, usage, offset, &fd);
             if (err < 0) {
-                LOGE("%s: failed to initialize pmem sub-heap: %d", pmemdev,
-                        err);
-                err = -deps.getErrno();
-                deps.close(fd);
                 allocator.deallocate(offset);
-                fd = -1;
             } else {
                 LOGV("%s: mapped fd %d at offset %d, size %d", pmemdev, fd, offset, size);
-                memset((char*)base + offset, 0, size);
+                if (!zeroed) {
+                    memset((char*)base + offset, 0, size);
+                    pthread_mutex_lock(&lock);
+                    bytes_zeroed_sync += size;
+                    pthread_mutex_unlock(&lock);
+                }
                 //cacheflush(intptr_t(base) + offset, intptr_t(base) + offset + size, 0);
                 *pBase = base;
                 *pOffset = offset;
@@ -194,25 +348,91 @@ int PmemUserspaceAllocator::alloc_pmem_buffer(size_t size, int usage,
 }
 
 
+// Opens a new "sub-heap" fd, connects it to the master and makes the
+// buffer at offset available through it to the client process.
+int PmemUserspaceAllocator::connect_sub_heap(size_t size, int usage,
+        int offset, int* pFd)
+{
+    int fd = deps.open(pmemdev, get_open_flags(usage), 0);
+    int err = fd < 0 ? fd : 0;
+    if (err == 0)
+        err = deps.connectPmem(fd, master_fd);
+    if (err == 0)
+        err = deps.mapPmem(fd, offset, size);
+
+    if (err < 0) {
+        LOGE("%s: failed to initialize pmem sub-heap: %d", pmemdev, err);
+        err = -deps.getErrno();
+        deps.close(fd);
+        return err;
+    }
+    *pFd = fd;
+    return 0;
+}
+
+
 int PmemUserspaceAllocator::free_pmem_buffer(size_t size, void* base, int offset, int fd)
 {
     BEGIN_FUNC;
     int err = 0;
     if (fd >= 0) {
-        int err = deps.unmapPmem(fd, offset, size);
-        LOGE_IF(err<0, "PMEM_UNMAP failed (%s), fd=%d, sub.offset=%u, "
-                "sub.size=%u", strerror(deps.getErrno()), fd, offset, size);
-        if (err == 0) {
-            // we can't deallocate the memory in case of UNMAP failure
-            // because it would give that process access to someone else's
-            // surfaces, which would be a security breach.
-            allocator.deallocate(offset);
+        err = unmap_pmem_buffer(size, base, offset, fd);
+    }
+    if (err == 0) {
+        // we can't deallocate the memory in case of UNMAP failure
+        // because it would give that process access to someone else's
+        // surfaces, which would be a security breach.
+        allocator.deallocate(offset);
+
+        if (scrubbing) {
+            pthread_mutex_lock(&scrub_lock);
+            scrub_pending = true;
+            pthread_cond_signal(&scrub_cond);
+            pthread_mutex_unlock(&scrub_lock);
         }
     }
     END_FUNC;
     return err;
 }
 
+
+int PmemUserspaceAllocator::unmap_pmem_buffer(size_t size, void* base,
+        int offset, int fd)
+{
+    BEGIN_FUNC;
+    int err = deps.unmapPmem(fd, offset, size);
+    if (err < 0) {
+        err = -deps.getErrno();
+        LOGE("PMEM_UNMAP failed (%s), fd=%d, sub.offset=%u, sub.size=%u",
+                strerror(-err), fd, offset, size);
+    }
+    END_FUNC;
+    return err;
+}
+
+
+int PmemUserspaceAllocator::remap_pmem_buffer(size_t size, int usage,
+        int offset, int* pFd)
+{
+    BEGIN_FUNC;
+    int err = connect_sub_heap(size, usage, offset, pFd);
+    END_FUNC;
+    return err;
+}
+
+
+void PmemUserspaceAllocator::dump(char* buff, int buff_len)
+{
+    pthread_mutex_lock(&lock);
+    int len = snprintf(buff, buff_len,
+            "  %s: zeroed %llu KiB in the background, %llu KiB on allocation\n",
+            pmemdev, bytes_zeroed_async >> 10, bytes_zeroed_sync >> 10);
+    pthread_mutex_unlock(&lock);
+    if (len > 0 && len < buff_len) {
+        allocator.dump(buff + len, buff_len - len);
+    }
+}
+
 PmemUserspaceAllocator::Deps::Allocator::~Allocator()
 {
     BEGIN_FUNC;
@@ -227,9 +447,33 @@ PmemUserspaceAllocator::Deps::~Deps()
 
 PmemKernelAllocator::PmemKernelAllocator(Deps& deps, const char* pmemdev):
     deps(deps),
-    pmemdev(pmemdev)
+    pool(0),
+    pool_size(0),
+    pmemdev(pmemdev),
+    pool_fd(POOL_FD_INIT),
+    pool_base(0),
+    kernel_requested(0),
+    kernel_allocated(0)
 {
     BEGIN_FUNC;
+    pthread_mutex_init(&lock, NULL);
+    END_FUNC;
+}
+
+
+PmemKernelAllocator::PmemKernelAllocator(Deps& deps, Allocator& pool,
+        size_t poolSize, const char* pmemdev):
+    deps(deps),
+    pool(poolSize ? &pool : 0),
+    pool_size(poolSize),
+    pmemdev(pmemdev),
+    pool_fd(POOL_FD_INIT),
+    pool_base(0),
+    kernel_requested(0),
+    kernel_allocated(0)
+{
+    BEGIN_FUNC;
+    pthread_mutex_init(&lock, NULL);
     END_FUNC;
 }
 
@@ -259,6 +503,97 @@ static unsigned clp2(unsigned x) {
 }
 
 
+int PmemKernelAllocator::init_pool()
+{
+    BEGIN_FUNC;
+    pthread_mutex_lock(&lock);
+    int err = pool_fd;
+    if (err == POOL_FD_INIT) {
+        // first time, grab the whole pool from the kernel
+        int fd = deps.open(pmemdev, O_RDWR, 0);
+        if (fd < 0) {
+            err = -deps.getErrno();
+            LOGE("%s: failed to open pmem pool: %s", pmemdev, strerror(-err));
+        } else {
+            void* base = deps.mmap(0, pool_size, PROT_READ|PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+            if (base == MAP_FAILED) {
+                err = -deps.getErrno();
+                LOGE("%s: failed to map %u bytes pmem pool: %s", pmemdev,
+                        pool_size, strerror(-err));
+                deps.close(fd);
+            } else {
+                pool->setSize(pool_size);
+                pool_base = base;
+                err = fd;
+            }
+        }
+        // never try again if that failed
+        pool_fd = err;
+    }
+    pthread_mutex_unlock(&lock);
+    END_FUNC;
+    return err < 0 ? err : 0;
+}
+
+
+// Connects a new fd to the pool and gives it just the buffer at offset.
+int PmemKernelAllocator::connect_pool_buffer(size_t size, int usage,
+        int offset, int* pFd)
+{
+    int err = 0;
+    int fd = deps.open(pmemdev, get_open_flags(usage), 0);
+    if (fd < 0)
+        err = -deps.getErrno();
+    if (err == 0 && deps.connectPmem(fd, pool_fd) < 0)
+        err = -deps.getErrno();
+    if (err == 0 && deps.mapPmem(fd, offset, size) < 0)
+        err = -deps.getErrno();
+
+    if (err < 0) {
+        LOGE("%s: failed to initialize pmem pool buffer: %d", pmemdev, err);
+        if (fd >= 0)
+            deps.close(fd);
+        return err ? err : -EINVAL;
+    }
+    *pFd = fd;
+    return 0;
+}
+
+
+bool PmemKernelAllocator::in_pool(void* base, int offset) const
+{
+    return pool && pool_base && (char*)base - offset == (char*)pool_base;
+}
+
+
+int PmemKernelAllocator::alloc_pool_buffer(size_t size, int usage,
+        void** pBase, int* pOffset, int* pFd)
+{
+    BEGIN_FUNC;
+    int offset = pool->allocate(size);
+    if (offset < 0) {
+        END_FUNC;
+        return -ENOMEM;
+    }
+
+    int fd = -1;
+    int err = connect_pool_buffer(size, usage, offset, &fd);
+    if (err < 0) {
+        pool->deallocate(offset);
+        END_FUNC;
+        return err;
+    }
+
+    memset((char*)pool_base + offset, 0, size);
+    *pBase = pool_base;
+    *pOffset = offset;
+    *pFd = fd;
+    END_FUNC;
+    return 0;
+}
+
+
 int PmemKernelAllocator::alloc_pmem_buffer(size_t size, int usage,
         void** pBase,int* pOffset, int* pFd)
 {
@@ -269,6 +604,15 @@ int PmemKernelAllocator::alloc_pmem_buffer(size_t size, int usage,
     *pFd = -1;
 
     int err;
+    if (pool && init_pool() == 0) {
+        err = alloc_pool_buffer(size, usage, pBase, pOffset, pFd);
+        if (err == 0) {
+            END_FUNC;
+            return 0;
+        }
+        // the pool is full (or broken), fall back to the kernel allocator
+    }
+
     int openFlags = get_open_flags(usage);
     int fd = deps.open(pmemdev, openFlags, 0);
     if (fd < 0) {
@@ -278,6 +622,7 @@ int PmemKernelAllocator::alloc_pmem_buffer(size_t size, int usage,
     }
 
     // The size should already be page aligned, now round it up to a power of 2.
+    const size_t requested = size;
     size = clp2(size);
 
     void* base = deps.mmap(0, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
@@ -292,6 +637,11 @@ int PmemKernelAllocator::alloc_pmem_buffer(size_t size, int usage,
 
     memset(base, 0, size);
 
+    pthread_mutex_lock(&lock);
+    kernel_requested += requested;
+    kernel_allocated += size;
+    pthread_mutex_unlock(&lock);
+
     *pBase = base;
     *pOffset = 0;
     *pFd = fd;
@@ -304,8 +654,24 @@ int PmemKernelAllocator::alloc_pmem_buffer(size_t size, int usage,
 int PmemKernelAllocator::free_pmem_buffer(size_t size, void* base, int offset, int fd)
 {
     BEGIN_FUNC;
+    if (in_pool(base, offset)) {
+        if (fd >= 0) {
+            // same as the userspace allocator, never hand out memory
+            // another process may still have access to
+            int err = unmap_pmem_buffer(size, base, offset, fd);
+            if (err < 0) {
+                END_FUNC;
+                return err;
+            }
+        }
+        pool->deallocate(offset);
+        END_FUNC;
+        return 0;
+    }
+
     // The size should already be page aligned, now round it up to a power of 2
     // like we did when allocating.
+    const size_t requested = size;
     size = clp2(size);
 
     int err = deps.munmap(base, size);
@@ -314,10 +680,60 @@ int PmemKernelAllocator::free_pmem_buffer(size_t size, void* base, int offset, i
         LOGW("%s: error unmapping pmem fd: %s", pmemdev, strerror(err));
         return -err;
     }
+
+    pthread_mutex_lock(&lock);
+    kernel_requested -= requested;
+    kernel_allocated -= size;
+    pthread_mutex_unlock(&lock);
+
     END_FUNC;
     return 0;
 }
 
+
+// Only pool buffers can be revoked, a buffer of its own lives as long as any
+// process has its fd.
+int PmemKernelAllocator::unmap_pmem_buffer(size_t size, void* base,
+        int offset, int fd)
+{
+    BEGIN_FUNC;
+    if (!in_pool(base, offset)) {
+        END_FUNC;
+        return -ENOSYS;
+    }
+    int err = 0;
+    if (deps.unmapPmem(fd, offset, size) < 0) {
+        err = -deps.getErrno();
+        LOGE("%s: PMEM_UNMAP failed (%s), fd=%d, offset=%d, size=%u",
+                pmemdev, strerror(-err), fd, offset, size);
+    }
+    END_FUNC;
+    return err;
+}
+
+
+int PmemKernelAllocator::remap_pmem_buffer(size_t size, int usage,
+        int offset, int* pFd)
+{
+    BEGIN_FUNC;
+    int err = connect_pool_buffer(size, usage, offset, pFd);
+    END_FUNC;
+    return err;
+}
+
+
+void PmemKernelAllocator::dump(char* buff, int buff_len)
+{
+    pthread_mutex_lock(&lock);
+    int len = snprintf(buff, buff_len,
+            "  %s: %u KiB requested outside the pool take %u KiB\n",
+            pmemdev, kernel_requested >> 10, kernel_allocated >> 10);
+    pthread_mutex_unlock(&lock);
+    if (pool && len > 0 && len < buff_len) {
+        pool->dump(buff + len, buff_len - len);
+    }
+}
+
 PmemKernelAllocator::Deps::~Deps()
 {
     BEGIN_FUNC;
@@ -17,7 +17,9 @@
 #ifndef GRALLOC_QSD8K_PMEMALLOC_H
 #define GRALLOC_QSD8K_PMEMALLOC_H
 
+#include <errno.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <unistd.h>
@@ -38,6 +40,16 @@ class PmemAllocator {
     virtual int alloc_pmem_buffer(size_t size, int usage, void** pBase,
             int* pOffset, int* pFd) = 0;
     virtual int free_pmem_buffer(size_t size, void* base, int offset, int fd) = 0;
+
+    // For a freed buffer kept for reuse: revokes every process's access to
+    // it through fd, which the caller closes then. -ENOSYS if it can't be
+    // revoked, and must be freed instead. Until remap_pmem_buffer() gives
+    // it a new fd, free_pmem_buffer() takes it with an fd of -1.
+    virtual int unmap_pmem_buffer(size_t size, void* base, int offset, int fd);
+    virtual int remap_pmem_buffer(size_t size, int usage, int offset, int* pFd);
+
+    // Appends human readable statistics to buff (for gralloc's dump).
+    virtual void dump(char* buff, int buff_len);
 };
 
 
@@ -55,11 +67,46 @@ class PmemUserspaceAllocator: public PmemAllocator {
 
         class Allocator {
          public:
+            enum {
+                // only hand out memory that is known to be zero
+                ALLOCATE_ZEROED = 0x00000001,
+            };
+
             virtual ~Allocator();
             virtual ssize_t setSize(size_t size) = 0;
             virtual size_t  size() const = 0;
             virtual ssize_t allocate(size_t size, uint32_t flags = 0) = 0;
             virtual ssize_t deallocate(size_t offset) = 0;
+
+            // Background scrubbing. An allocator that supports it tracks
+            // which free memory is known to be zero: claimDirty() reserves
+            // up to maxSize bytes of free memory that isn't, and
+            // releaseClean() frees it again once the caller zeroed it.
+            virtual bool supportsScrubbing() const { return false; }
+            virtual ssize_t claimDirty(size_t maxSize, size_t* pSize) {
+                return -ENOSYS;
+            }
+            virtual ssize_t releaseClean(size_t offset) {
+                return deallocate(offset);
+            }
+
+            struct range_t {
+                size_t offset;
+                size_t size;
+            };
+
+            // For when neither the clean nor the dirty free memory alone
+            // has room: allocates size bytes over adjacent free chunks of
+            // both kinds. The parts of it that aren't known to be zero, at
+            // most maxDirty of them, are stored in dirty and their number
+            // in *pDirty, for the caller to zero.
+            virtual ssize_t allocateSpanning(size_t size, range_t* dirty,
+                    int maxDirty, int* pDirty) {
+                return -ENOSYS;
+            }
+
+            // Appends human readable statistics to buff, if any.
+            virtual void dump(char* buff, int buff_len) const { }
         };
 
         virtual ~Deps();
@@ -91,6 +138,9 @@ class PmemUserspaceAllocator: public PmemAllocator {
     virtual int alloc_pmem_buffer(size_t size, int usage, void** pBase,
             int* pOffset, int* pFd);
     virtual int free_pmem_buffer(size_t size, void* base, int offset, int fd);
+    virtual int unmap_pmem_buffer(size_t size, void* base, int offset, int fd);
+    virtual int remap_pmem_buffer(size_t size, int usage, int offset, int* pFd);
+    virtual void dump(char* buff, int buff_len);
 
 #ifndef ANDROID_OS
     // DO NOT USE: For testing purposes only.
@@ -106,6 +156,17 @@ class PmemUserspaceAllocator: public PmemAllocator {
         MASTER_FD_INIT = -1,
     };
 
+    // largest range the scrubber zeroes in one go
+    static const size_t kScrubChunkSize = 256 << 10;
+    // most dirty parts an allocation spanning clean and dirty memory has
+    static const int kMaxDirtyRanges = 8;
+
+    int connect_sub_heap(size_t size, int usage, int offset, int* pFd);
+
+    static void* scrub_thread(void* data);
+    void scrub_loop();
+    int alloc_spanning(size_t size);
+
     Deps& deps;
     Deps::Allocator& allocator;
 
@@ -113,6 +174,20 @@ class PmemUserspaceAllocator: public PmemAllocator {
     const char* pmemdev;
     int master_fd;
     void* master_base;
+
+    // background zeroing of freed memory, guarded by scrub_lock but for
+    // the zeroing itself; the byte counters are guarded by lock
+    pthread_mutex_t scrub_lock;
+    pthread_cond_t scrub_cond;
+    // signaled when the scrubber gives back what it claimed
+    pthread_cond_t scrub_idle_cond;
+    pthread_t scrub_tid;
+    bool scrubbing;
+    bool scrub_pending;
+    bool scrub_claimed;
+    bool scrub_quit;
+    uint64_t bytes_zeroed_async;
+    uint64_t bytes_zeroed_sync;
 };
 
 
@@ -130,6 +205,11 @@ class PmemKernelAllocator: public PmemAllocator {
 
         virtual ~Deps();
 
+        // pmem
+        virtual int connectPmem(int fd, int master_fd) = 0;
+        virtual int mapPmem(int fd, int offset, size_t size) = 0;
+        virtual int unmapPmem(int fd, int offset, size_t size) = 0;
+
         // C99
         virtual int getErrno() = 0;
 
@@ -141,7 +221,15 @@ class PmemKernelAllocator: public PmemAllocator {
         virtual int close(int fd) = 0;
     };
 
+    typedef PmemUserspaceAllocator::Deps::Allocator Allocator;
+
     PmemKernelAllocator(Deps& deps, const char* pmemdev);
+
+    // Buffers are first sub-allocated with 'pool' from a single kernel
+    // allocation of poolSize bytes (which should be a power of 2), made on
+    // first use. Only when that fails do they get their own allocation.
+    PmemKernelAllocator(Deps& deps, Allocator& pool, size_t poolSize,
+            const char* pmemdev);
     virtual ~PmemKernelAllocator();
 
     // Only valid after init_pmem_area() has completed successfully.
@@ -150,12 +238,34 @@ class PmemKernelAllocator: public PmemAllocator {
     virtual int alloc_pmem_buffer(size_t size, int usage, void** pBase,
             int* pOffset, int* pFd);
     virtual int free_pmem_buffer(size_t size, void* base, int offset, int fd);
+    virtual int unmap_pmem_buffer(size_t size, void* base, int offset, int fd);
+    virtual int remap_pmem_buffer(size_t size, int usage, int offset, int* pFd);
+    virtual void dump(char* buff, int buff_len);
 
  private:
 
+    enum {
+        POOL_FD_INIT = -1,
+    };
+
+    int init_pool();
+    int alloc_pool_buffer(size_t size, int usage, void** pBase,
+            int* pOffset, int* pFd);
+    int connect_pool_buffer(size_t size, int usage, int offset, int* pFd);
+    bool in_pool(void* base, int offset) const;
+
     Deps& deps;
+    Allocator* pool;
+    size_t pool_size;
 
+    pthread_mutex_t lock;
     const char* pmemdev;
+    int pool_fd;
+    void* pool_base;
+
+    // kernel allocations made outside of the pool, guarded by lock
+    size_t kernel_requested;
+    size_t kernel_allocated;
 };
 
 #endif  // GRALLOC_QSD8K_PMEMALLOC_H
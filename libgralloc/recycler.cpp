@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <cutils/log.h>
+
+#include "recycler.h"
+
+
+BufferRecycler::BufferRecycler(size_t budget)
+    : mBudget(budget), mParkedBytes(0), mParkedCount(0),
+      mHits(0), mMisses(0), mEvictions(0)
+{
+}
+
+BufferRecycler::~BufferRecycler()
+{
+    // the owner is expected to have drained us with popOldest(0)
+    LOGE_IF(!mList.isEmpty(), "recycler destroyed with %d parked buffers",
+            mParkedCount);
+    while (!mList.isEmpty()) {
+        delete mList.remove(mList.head());
+    }
+}
+
+private_handle_t* BufferRecycler::take(size_t size, int flags)
+{
+    Locker::Autolock _l(mLock);
+    if (mBudget == 0) {
+        return 0;
+    }
+    // most recently parked first, it's the most likely to still be in cache
+    for (entry_t* cur = mList.tail() ; cur ; cur = cur->prev) {
+        private_handle_t* hnd = cur->hnd;
+        if (size_t(hnd->size) == size &&
+                (hnd->flags & CLASS_MASK) == (flags & CLASS_MASK)) {
+            delete mList.remove(cur);
+            mParkedBytes -= size;
+            mParkedCount--;
+            mHits++;
+            return hnd;
+        }
+    }
+    mMisses++;
+    return 0;
+}
+
+bool BufferRecycler::park(private_handle_t* hnd)
+{
+    Locker::Autolock _l(mLock);
+    if (size_t(hnd->size) > mBudget) {
+        return false;
+    }
+    mList.insertTail(new entry_t(hnd));
+    mParkedBytes += hnd->size;
+    mParkedCount++;
+    return true;
+}
+
+private_handle_t* BufferRecycler::popOldest(size_t keep)
+{
+    Locker::Autolock _l(mLock);
+    if (mParkedBytes <= keep || mList.isEmpty()) {
+        return 0;
+    }
+    entry_t* oldest = mList.remove(mList.head());
+    private_handle_t* hnd = oldest->hnd;
+    delete oldest;
+    mParkedBytes -= hnd->size;
+    mParkedCount--;
+    mEvictions++;
+    return hnd;
+}
+
+size_t BufferRecycler::parked() const
+{
+    Locker::Autolock _l(mLock);
+    return mParkedBytes;
+}
+
+void BufferRecycler::dump(char* buff, int buff_len) const
+{
+    Locker::Autolock _l(mLock);
+    snprintf(buff, buff_len,
+            "  buffer recycler: budget=%u KiB, parked=%u KiB in %u buffers\n"
+            "    hits=%u, misses=%u, evictions=%u\n",
+            mBudget >> 10, mParkedBytes >> 10, mParkedCount,
+            mHits, mMisses, mEvictions);
+}
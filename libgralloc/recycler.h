@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GRALLOC_QSD8K_RECYCLER_H
+#define GRALLOC_QSD8K_RECYCLER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <cutils/log.h>
+
+#include "allocator.h"
+#include "gralloc_priv.h"
+
+
+/**
+ * A bounded cache of freed pmem buffers. Instead of going back to the pmem
+ * allocator, a freed handle is parked here without an fd, as the one its
+ * clients had is revoked and closed, and handed back on the next request
+ * for the same size and usage class, which connects it a new one. The
+ * least recently parked buffers are evicted when the parked bytes exceed
+ * the budget; a budget of 0 disables the cache.
+ */
+class BufferRecycler {
+
+ public:
+
+    // handle flags that must match for a parked buffer to be reused
+    enum {
+        CLASS_MASK = private_handle_t::PRIV_FLAGS_USES_PMEM |
+                     private_handle_t::PRIV_FLAGS_USES_PMEM_ADSP |
+                     private_handle_t::PRIV_FLAGS_CACHED,
+    };
+
+    BufferRecycler(size_t budget);
+    ~BufferRecycler();
+
+    // Returns a parked handle of exactly this size and class, or NULL.
+    private_handle_t* take(size_t size, int flags);
+
+    // Parks hnd, returns false if it doesn't fit in the budget at all.
+    bool park(private_handle_t* hnd);
+
+    // Removes and returns the oldest parked handle as long as more than
+    // 'keep' bytes are parked, NULL otherwise. The caller frees it.
+    private_handle_t* popOldest(size_t keep);
+
+    size_t budget() const { return mBudget; }
+    size_t parked() const;
+
+    void dump(char* buff, int buff_len) const;
+
+ private:
+
+    struct entry_t {
+        entry_t(private_handle_t* hnd) : hnd(hnd), prev(0), next(0) { }
+        private_handle_t*   hnd;
+        mutable entry_t*    prev;
+        mutable entry_t*    next;
+    };
+
+    mutable Locker      mLock;
+    LinkedList<entry_t> mList;      // oldest first
+    const size_t        mBudget;
+    size_t              mParkedBytes;
+    size_t              mParkedCount;
+    uint32_t            mHits;
+    uint32_t            mMisses;
+    uint32_t            mEvictions;
+};
+
+#endif  // GRALLOC_QSD8K_RECYCLER_H
@@ -50,6 +50,13 @@ define host-test
 endef
 
 TEST_SRC_FILES := \
-	pmemalloc_test.cpp
+	allocator_test.cpp \
+	compaction_test.cpp \
+	dirty_test.cpp \
+	framestats_test.cpp \
+	pacer_test.cpp \
+	pmemalloc_test.cpp \
+	recycler_test.cpp \
+	trace_test.cpp
 
 $(call host-test, $(TEST_SRC_FILES))
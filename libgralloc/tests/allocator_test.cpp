@@ -0,0 +1,551 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "allocator.h"
+
+static const size_t kPage = getpagesize();
+
+/******************************************************************************/
+
+TEST(test_simple_best_fit_allocator, testAllocateIsPageAligned) {
+    SimpleBestFitAllocator allocator(16 * kPage);
+
+    ssize_t a = allocator.allocate(100);
+    ssize_t b = allocator.allocate(100);
+    ASSERT_EQ(0, a);
+    ASSERT_EQ(ssize_t(kPage), b);
+    ASSERT_EQ(0, allocator.deallocate(a));
+    ASSERT_EQ(0, allocator.deallocate(b));
+}
+
+/******************************************************************************/
+
+TEST(test_simple_best_fit_allocator, testAllocateWithEnomem) {
+    SimpleBestFitAllocator allocator(4 * kPage);
+
+    ASSERT_EQ(0, allocator.allocate(4 * kPage));
+    ASSERT_EQ(-ENOMEM, allocator.allocate(kPage));
+}
+
+/******************************************************************************/
+
+TEST(test_simple_best_fit_allocator, testDeallocateUnknownOffset) {
+    SimpleBestFitAllocator allocator(4 * kPage);
+
+    ssize_t a = allocator.allocate(kPage);
+    ASSERT_EQ(-ENOENT, allocator.deallocate(a + kPage));
+    ASSERT_EQ(0, allocator.deallocate(a));
+    ASSERT_EQ(-ENOENT, allocator.deallocate(a));
+}
+
+/******************************************************************************/
+
+TEST(test_simple_best_fit_allocator, testAllocatePicksBestFit) {
+    SimpleBestFitAllocator allocator(16 * kPage);
+
+    // carve the heap into holes of 3, 1 and 2 pages separated by used pages
+    ssize_t h3 = allocator.allocate(3 * kPage);
+    ssize_t s0 = allocator.allocate(kPage);
+    ssize_t h1 = allocator.allocate(kPage);
+    ssize_t s1 = allocator.allocate(kPage);
+    ssize_t h2 = allocator.allocate(2 * kPage);
+    ssize_t s2 = allocator.allocate(kPage);
+    ASSERT_LE(0, s0);
+    ASSERT_LE(0, s1);
+    ASSERT_LE(0, s2);
+    ASSERT_EQ(0, allocator.deallocate(h3));
+    ASSERT_EQ(0, allocator.deallocate(h1));
+    ASSERT_EQ(0, allocator.deallocate(h2));
+
+    ASSERT_EQ(h2, allocator.allocate(2 * kPage));
+    ASSERT_EQ(h1, allocator.allocate(kPage));
+    ASSERT_EQ(h3, allocator.allocate(kPage));
+}
+
+/******************************************************************************/
+
+TEST(test_simple_best_fit_allocator, testDeallocateMergesNeighbours) {
+    SimpleBestFitAllocator allocator(8 * kPage);
+
+    ssize_t a = allocator.allocate(2 * kPage);
+    ssize_t b = allocator.allocate(2 * kPage);
+    ssize_t c = allocator.allocate(2 * kPage);
+    ssize_t d = allocator.allocate(2 * kPage);
+    ASSERT_EQ(-ENOMEM, allocator.allocate(kPage));
+
+    ASSERT_EQ(0, allocator.deallocate(a));
+    ASSERT_EQ(0, allocator.deallocate(c));
+    ASSERT_EQ(-ENOMEM, allocator.allocate(4 * kPage));
+    ASSERT_EQ(0, allocator.deallocate(b));
+    ASSERT_EQ(a, allocator.allocate(6 * kPage));
+    ASSERT_EQ(0, allocator.deallocate(a));
+    ASSERT_EQ(0, allocator.deallocate(d));
+    ASSERT_EQ(0, allocator.allocate(8 * kPage));
+}
+
+/******************************************************************************/
+
+TEST(test_simple_best_fit_allocator, testRandomAllocateDeallocate) {
+    const size_t heapSize = 256 * kPage;
+    const int kSlots = 64;
+    SimpleBestFitAllocator allocator(heapSize);
+
+    ssize_t offsets[kSlots];
+    size_t sizes[kSlots];
+    for (int i = 0; i < kSlots; ++i) {
+        offsets[i] = -1;
+    }
+
+    srand(1234);
+    for (int iter = 0; iter < 20000; ++iter) {
+        int slot = rand() % kSlots;
+        if (offsets[slot] >= 0) {
+            ASSERT_EQ(0, allocator.deallocate(offsets[slot]));
+            offsets[slot] = -1;
+            continue;
+        }
+        size_t size = 1 + rand() % (8 * kPage);
+        ssize_t offset = allocator.allocate(size);
+        if (offset == -ENOMEM) {
+            continue;
+        }
+        ASSERT_LE(0, offset);
+        ASSERT_EQ(0u, offset & (kPage - 1));
+        ASSERT_LE(size_t(offset) + size, heapSize);
+        for (int j = 0; j < kSlots; ++j) {
+            if (offsets[j] < 0) continue;
+            ASSERT_TRUE(size_t(offset) + size <= size_t(offsets[j]) ||
+                        size_t(offsets[j]) + sizes[j] <= size_t(offset));
+        }
+        offsets[slot] = offset;
+        sizes[slot] = size;
+    }
+
+    for (int i = 0; i < kSlots; ++i) {
+        if (offsets[i] >= 0) {
+            ASSERT_EQ(0, allocator.deallocate(offsets[i]));
+        }
+    }
+    ASSERT_EQ(0, allocator.allocate(heapSize));
+}
+
+/******************************************************************************/
+
+TEST(test_simple_best_fit_allocator, testAllocateZeroedNeedsCleanMemory) {
+    SimpleBestFitAllocator allocator(4 * kPage);
+
+    ASSERT_TRUE(allocator.supportsScrubbing());
+    ASSERT_EQ(-ENOMEM, allocator.allocate(kPage,
+            SimpleBestFitAllocator::ALLOCATE_ZEROED));
+
+    size_t size = 0;
+    ssize_t offset = allocator.claimDirty(2 * kPage, &size);
+    ASSERT_EQ(0, offset);
+    ASSERT_EQ(2 * kPage, size);
+    ASSERT_EQ(0, allocator.releaseClean(offset));
+
+    ASSERT_EQ(-ENOMEM, allocator.allocate(3 * kPage,
+            SimpleBestFitAllocator::ALLOCATE_ZEROED));
+    ASSERT_EQ(0, allocator.allocate(2 * kPage,
+            SimpleBestFitAllocator::ALLOCATE_ZEROED));
+    ASSERT_EQ(-ENOMEM, allocator.allocate(kPage,
+            SimpleBestFitAllocator::ALLOCATE_ZEROED));
+}
+
+/******************************************************************************/
+
+TEST(test_simple_best_fit_allocator, testClaimDirtyScrubsWholeHeap) {
+    SimpleBestFitAllocator allocator(8 * kPage);
+
+    ssize_t a = allocator.allocate(2 * kPage);
+    ASSERT_EQ(0, a);
+
+    size_t size = 0, scrubbed = 0;
+    ssize_t offset;
+    while ((offset = allocator.claimDirty(kPage, &size)) >= 0) {
+        ASSERT_EQ(kPage, size);
+        ASSERT_LE(2 * kPage, size_t(offset));
+        ASSERT_EQ(0, allocator.releaseClean(offset));
+        scrubbed += size;
+    }
+    ASSERT_EQ(6 * kPage, scrubbed);
+
+    // freed memory is dirty again and isn't merged with the clean rest
+    ASSERT_EQ(0, allocator.deallocate(a));
+    ASSERT_EQ(-ENOMEM, allocator.allocate(8 * kPage,
+            SimpleBestFitAllocator::ALLOCATE_ZEROED));
+    ASSERT_EQ(ssize_t(2 * kPage), allocator.allocate(6 * kPage,
+            SimpleBestFitAllocator::ALLOCATE_ZEROED));
+    ASSERT_EQ(0, allocator.claimDirty(8 * kPage, &size));
+    ASSERT_EQ(2 * kPage, size);
+    ASSERT_EQ(-ENOENT, allocator.claimDirty(8 * kPage, &size));
+}
+
+/******************************************************************************/
+
+TEST(test_simple_best_fit_allocator, testAllocateSpanningCleanAndDirty) {
+    SimpleBestFitAllocator allocator(8 * kPage);
+
+    ssize_t a = allocator.allocate(2 * kPage);
+    ssize_t b = allocator.allocate(kPage);
+    ASSERT_EQ(0, a);
+    ASSERT_EQ(ssize_t(2 * kPage), b);
+    size_t size = 0;
+    ssize_t offset;
+    while ((offset = allocator.claimDirty(8 * kPage, &size)) >= 0) {
+        ASSERT_EQ(0, allocator.releaseClean(offset));
+    }
+    // dirty [0, 3), clean [3, 8)
+    ASSERT_EQ(0, allocator.deallocate(a));
+    ASSERT_EQ(0, allocator.deallocate(b));
+    ASSERT_EQ(-ENOMEM, allocator.allocate(6 * kPage));
+
+    SimpleBestFitAllocator::range_t dirty[2];
+    int count = 0;
+    ASSERT_EQ(-ENOMEM, allocator.allocateSpanning(9 * kPage, dirty, 2,
+            &count));
+    // the most clean memory it can take, i.e. the end of the heap
+    ASSERT_EQ(ssize_t(2 * kPage), allocator.allocateSpanning(6 * kPage,
+            dirty, 2, &count));
+    ASSERT_EQ(1, count);
+    ASSERT_EQ(2 * kPage, dirty[0].offset);
+    ASSERT_EQ(kPage, dirty[0].size);
+
+    // and what's left before it is still free and dirty
+    ASSERT_EQ(-ENOMEM, allocator.allocate(kPage,
+            SimpleBestFitAllocator::ALLOCATE_ZEROED));
+    ASSERT_EQ(0, allocator.allocate(2 * kPage));
+    ASSERT_EQ(0, allocator.deallocate(0));
+    ASSERT_EQ(0, allocator.deallocate(2 * kPage));
+
+    SimpleBestFitAllocator::stats_t stats;
+    allocator.getStats(&stats);
+    ASSERT_EQ(8 * kPage, stats.freeBytes);
+    ASSERT_EQ(1u, stats.freeChunks);
+}
+
+/******************************************************************************/
+
+TEST(test_buddy_allocator, testAllocateDoesNotRoundToPowerOfTwo) {
+    BuddyAllocator allocator(16 * kPage);
+
+    // 5 pages used to take 8, the 3 page tail goes back to the free lists
+    ASSERT_EQ(0, allocator.allocate(5 * kPage));
+    ASSERT_EQ(ssize_t(6 * kPage), allocator.allocate(2 * kPage));
+    ASSERT_EQ(ssize_t(5 * kPage), allocator.allocate(kPage));
+    ASSERT_EQ(ssize_t(8 * kPage), allocator.allocate(8 * kPage));
+    ASSERT_EQ(-ENOMEM, allocator.allocate(kPage));
+
+    BuddyAllocator::stats_t stats;
+    allocator.getStats(&stats);
+    ASSERT_EQ(0u, stats.freeBytes);
+    ASSERT_EQ(16 * kPage, stats.allocatedBytes);
+    ASSERT_EQ(19 * kPage, stats.pow2Bytes);
+}
+
+/******************************************************************************/
+
+TEST(test_buddy_allocator, testAllocateZeroBytes) {
+    BuddyAllocator allocator(4 * kPage);
+
+    ASSERT_EQ(-EINVAL, allocator.allocate(0));
+    ASSERT_EQ(0, allocator.allocate(4 * kPage));
+}
+
+/******************************************************************************/
+
+TEST(test_buddy_allocator, testDeallocateCoalescesBuddies) {
+    BuddyAllocator allocator(8 * kPage);
+
+    ssize_t a = allocator.allocate(kPage);
+    ssize_t b = allocator.allocate(2 * kPage);
+    ssize_t c = allocator.allocate(4 * kPage);
+    ASSERT_LE(0, a);
+    ASSERT_LE(0, b);
+    ASSERT_LE(0, c);
+    ASSERT_EQ(-ENOENT, allocator.deallocate(a + kPage / 2));
+    ASSERT_EQ(0, allocator.deallocate(b));
+    ASSERT_EQ(0, allocator.deallocate(c));
+    ASSERT_EQ(-ENOENT, allocator.deallocate(c));
+    ASSERT_EQ(-ENOMEM, allocator.allocate(8 * kPage));
+    ASSERT_EQ(0, allocator.deallocate(a));
+
+    BuddyAllocator::stats_t stats;
+    allocator.getStats(&stats);
+    ASSERT_EQ(8 * kPage, stats.freeBytes);
+    ASSERT_EQ(1u, stats.freeBlocks[3]);
+    ASSERT_EQ(0, allocator.allocate(8 * kPage));
+}
+
+/******************************************************************************/
+
+TEST(test_buddy_allocator, testRandomAllocateDeallocate) {
+    const size_t heapSize = 256 * kPage;
+    const int kSlots = 64;
+    BuddyAllocator allocator(heapSize);
+
+    ssize_t offsets[kSlots];
+    size_t sizes[kSlots];
+    for (int i = 0; i < kSlots; ++i) {
+        offsets[i] = -1;
+    }
+
+    srand(4321);
+    for (int iter = 0; iter < 20000; ++iter) {
+        int slot = rand() % kSlots;
+        if (offsets[slot] >= 0) {
+            ASSERT_EQ(0, allocator.deallocate(offsets[slot]));
+            offsets[slot] = -1;
+            continue;
+        }
+        size_t size = 1 + rand() % (16 * kPage);
+        ssize_t offset = allocator.allocate(size);
+        if (offset == -ENOMEM) {
+            continue;
+        }
+        ASSERT_LE(0, offset);
+        ASSERT_EQ(0u, offset & (kPage - 1));
+        ASSERT_LE(size_t(offset) + size, heapSize);
+        for (int j = 0; j < kSlots; ++j) {
+            if (offsets[j] < 0) continue;
+            ASSERT_TRUE(size_t(offset) + size <= size_t(offsets[j]) ||
+                        size_t(offsets[j]) + sizes[j] <= size_t(offset));
+        }
+        offsets[slot] = offset;
+        sizes[slot] = size;
+    }
+
+    for (int i = 0; i < kSlots; ++i) {
+        if (offsets[i] >= 0) {
+            ASSERT_EQ(0, allocator.deallocate(offsets[i]));
+        }
+    }
+    ASSERT_EQ(0, allocator.allocate(heapSize));
+}
+
+/******************************************************************************/
+
+TEST(test_simple_best_fit_allocator, testFragmentationStats) {
+    SimpleBestFitAllocator allocator(8 * kPage);
+    SimpleBestFitAllocator::stats_t stats;
+
+    allocator.getStats(&stats);
+    ASSERT_EQ(8 * kPage, stats.freeBytes);
+    ASSERT_EQ(8 * kPage, stats.largestFree);
+    ASSERT_EQ(0u, stats.fragmentation);
+    ASSERT_EQ(1u, stats.freeChunks);
+    ASSERT_EQ(1u, stats.freeHist[3]);
+
+    // leave four single-page holes
+    ssize_t offsets[8];
+    for (int i = 0; i < 8; ++i) {
+        offsets[i] = allocator.allocate(kPage);
+        ASSERT_EQ(ssize_t(i * kPage), offsets[i]);
+    }
+    for (int i = 0; i < 8; i += 2) {
+        ASSERT_EQ(0, allocator.deallocate(offsets[i]));
+    }
+    ASSERT_EQ(-ENOMEM, allocator.allocate(2 * kPage));
+
+    allocator.getStats(&stats);
+    ASSERT_EQ(4 * kPage, stats.freeBytes);
+    ASSERT_EQ(kPage, stats.largestFree);
+    ASSERT_EQ(750u, stats.fragmentation);
+    ASSERT_EQ(750u, stats.peakFragmentation);
+    ASSERT_EQ(4u, stats.freeChunks);
+    ASSERT_EQ(4u, stats.usedChunks);
+    ASSERT_EQ(4u, stats.freeHist[0]);
+    ASSERT_EQ(1u, stats.fragmentedFailures);
+
+    for (int i = 1; i < 8; i += 2) {
+        ASSERT_EQ(0, allocator.deallocate(offsets[i]));
+    }
+    allocator.getStats(&stats);
+    ASSERT_EQ(0u, stats.fragmentation);
+    ASSERT_EQ(750u, stats.peakFragmentation);
+    ASSERT_EQ(1u, stats.freeChunks);
+
+    char buff[1024];
+    allocator.dump(buff, sizeof(buff));
+    ASSERT_TRUE(strstr(buff, "peak 75.0%") != 0);
+}
+
+/******************************************************************************/
+
+struct pool_node_t {
+    uint32_t next;
+    int value;
+};
+
+TEST(test_node_pool, testAllocReusesReleasedNodes) {
+    NodePool<pool_node_t> pool;
+
+    ASSERT_TRUE(pool.reserve(2));
+    ASSERT_EQ(2u, pool.capacity());
+    uint32_t a = pool.alloc();
+    uint32_t b = pool.alloc();
+    ASSERT_NE(0u, a);
+    ASSERT_NE(0u, b);
+    ASSERT_NE(a, b);
+    pool[a].value = 1;
+    pool[b].value = 2;
+
+    // growing keeps the indices and what they point to
+    uint32_t c = pool.alloc();
+    ASSERT_NE(0u, c);
+    ASSERT_LE(3u, pool.capacity());
+    ASSERT_EQ(1, pool[a].value);
+    ASSERT_EQ(2, pool[b].value);
+    ASSERT_EQ(3u, pool.used());
+
+    pool.release(b);
+    ASSERT_EQ(b, pool.alloc());
+    ASSERT_EQ(0, pool[b].value);
+}
+
+/******************************************************************************/
+
+TEST(test_simple_best_fit_allocator, testSteadyStateDoesNotGrowChunkPool) {
+    const size_t heapSize = 256 * kPage;
+    const int kSlots = 64;
+    SimpleBestFitAllocator allocator(heapSize);
+    SimpleBestFitAllocator::stats_t stats;
+
+    ssize_t offsets[kSlots];
+    for (int i = 0; i < kSlots; ++i) {
+        offsets[i] = allocator.allocate(2 * kPage);
+        ASSERT_LE(0, offsets[i]);
+    }
+    for (int i = 0; i < kSlots; i += 2) {
+        ASSERT_EQ(0, allocator.deallocate(offsets[i]));
+    }
+    allocator.getStats(&stats);
+    const uint32_t capacity = stats.chunkCapacity;
+
+    // freeing and allocating the same sizes again just reuses chunks
+    for (int iter = 0; iter < 1000; ++iter) {
+        for (int i = 0; i < kSlots; i += 2) {
+            offsets[i] = allocator.allocate(2 * kPage);
+            ASSERT_LE(0, offsets[i]);
+        }
+        for (int i = 0; i < kSlots; i += 2) {
+            ASSERT_EQ(0, allocator.deallocate(offsets[i]));
+        }
+    }
+    allocator.getStats(&stats);
+    ASSERT_EQ(capacity, stats.chunkCapacity);
+}
+
+/******************************************************************************/
+
+TEST(test_arena_allocator, testSmallBuffersComeFromArenas) {
+    ArenaAllocator allocator(2, 4 * kPage, 2 * kPage);
+    ASSERT_EQ(ssize_t(32 * kPage), allocator.setSize(32 * kPage));
+    ASSERT_EQ(2, allocator.arenas());
+    ASSERT_EQ(32 * kPage, allocator.size());
+
+    // small buffers land below the main heap, big ones in it
+    ssize_t small = allocator.allocate(kPage);
+    ASSERT_LE(0, small);
+    ASSERT_GT(ssize_t(8 * kPage), small);
+    ssize_t big = allocator.allocate(4 * kPage);
+    ASSERT_EQ(ssize_t(8 * kPage), big);
+
+    // once the arenas are full small buffers spill into the main heap
+    ssize_t offsets[7];
+    for (int i = 0; i < 7; ++i) {
+        offsets[i] = allocator.allocate(kPage);
+        ASSERT_GT(ssize_t(8 * kPage), offsets[i]);
+    }
+    ssize_t spilled = allocator.allocate(kPage);
+    ASSERT_EQ(ssize_t(12 * kPage), spilled);
+
+    SimpleBestFitAllocator::stats_t stats;
+    allocator.getArenaStats(0, &stats);
+    ASSERT_EQ(0u, stats.freeBytes);
+    allocator.getStats(&stats);
+    ASSERT_EQ(19 * kPage, stats.freeBytes);
+
+    ASSERT_EQ(0, allocator.deallocate(small));
+    ASSERT_EQ(-ENOENT, allocator.deallocate(small));
+    ASSERT_EQ(0, allocator.deallocate(big));
+    ASSERT_EQ(0, allocator.deallocate(spilled));
+    for (int i = 0; i < 7; ++i) {
+        ASSERT_EQ(0, allocator.deallocate(offsets[i]));
+    }
+    allocator.getStats(&stats);
+    ASSERT_EQ(24 * kPage, stats.freeBytes);
+}
+
+/******************************************************************************/
+
+TEST(test_arena_allocator, testNoArenasOnSmallHeap) {
+    ArenaAllocator allocator(4, 4 * kPage, 2 * kPage);
+    ASSERT_LE(0, allocator.setSize(16 * kPage));
+    ASSERT_EQ(0, allocator.arenas());
+    ASSERT_EQ(0, allocator.allocate(kPage));
+}
+
+/******************************************************************************/
+
+TEST(test_arena_allocator, testClaimDirtyCoversArenas) {
+    ArenaAllocator allocator(2, 4 * kPage, 2 * kPage);
+    ASSERT_LE(0, allocator.setSize(16 * kPage));
+
+    size_t size = 0, scrubbed = 0;
+    ssize_t offset;
+    while ((offset = allocator.claimDirty(16 * kPage, &size)) >= 0) {
+        ASSERT_EQ(0, allocator.releaseClean(offset));
+        scrubbed += size;
+    }
+    ASSERT_EQ(16 * kPage, scrubbed);
+    ASSERT_LE(0, allocator.allocate(kPage,
+            SimpleBestFitAllocator::ALLOCATE_ZEROED));
+    ASSERT_EQ(ssize_t(8 * kPage), allocator.allocate(8 * kPage,
+            SimpleBestFitAllocator::ALLOCATE_ZEROED));
+}
+
+/******************************************************************************/
+
+static void* holdLocker(void* data) {
+    Locker* locker = static_cast<Locker*>(data);
+    locker->lock();
+    locker->unlock();
+    return 0;
+}
+
+TEST(test_locker, testCountsContention) {
+    Locker locker;
+
+    locker.lock();
+    ASSERT_FALSE(locker.tryLock());
+    pthread_t tid;
+    ASSERT_EQ(0, pthread_create(&tid, 0, holdLocker, &locker));
+    usleep(50000);
+    locker.unlock();
+    ASSERT_EQ(0, pthread_join(tid, 0));
+    ASSERT_TRUE(locker.tryLock());
+    ASSERT_EQ(1u, locker.contention());
+    ASSERT_EQ(1u, locker.busySkips());
+    locker.unlock();
+}
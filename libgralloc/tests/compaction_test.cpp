@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "compaction.h"
+
+static const size_t kPage = getpagesize();
+
+static FILE* makeTrace(const char* text) {
+    FILE* trace = tmpfile();
+    fputs(text, trace);
+    rewind(trace);
+    return trace;
+}
+
+/******************************************************************************/
+
+TEST(test_compaction_planner, testAllocateAndFree) {
+    CompactionPlanner planner(4 * kPage);
+
+    ASSERT_EQ(0, planner.allocate(1, kPage));
+    ASSERT_EQ(-EEXIST, planner.allocate(1, kPage));
+    ASSERT_EQ(0, planner.free(1));
+    ASSERT_EQ(-ENOENT, planner.free(1));
+    ASSERT_EQ(0u, planner.liveCount());
+    ASSERT_EQ(0u, planner.liveBytes());
+}
+
+/******************************************************************************/
+
+TEST(test_compaction_planner, testReplayStopsAtFragmentedFailure) {
+    CompactionPlanner planner(4 * kPage);
+
+    char text[256];
+    snprintf(text, sizeof(text),
+            "# four pages, every other one freed\n"
+            "a 1 %u\na 2 %u\na 3 %u\na 0x10 %u\n"
+            "f 1\nf 3\n"
+            "a 5 %u\n"
+            "f 2\n",
+            kPage, kPage, kPage, kPage, 2 * kPage);
+    FILE* trace = makeTrace(text);
+    ASSERT_EQ(8, planner.replay(trace));
+    fclose(trace);
+    ASSERT_EQ(8, planner.failedLine());
+    ASSERT_EQ(2 * kPage, planner.failedSize());
+    ASSERT_EQ(2u, planner.liveCount());
+
+    CompactionPlanner::move_t moves[4];
+    size_t moved = 0, largest = 0;
+    ASSERT_EQ(2, planner.plan(moves, 4, &moved, &largest));
+    ASSERT_EQ(2 * kPage, moved);
+    ASSERT_EQ(2 * kPage, largest);
+    ASSERT_EQ(2u, moves[0].id);
+    ASSERT_EQ(kPage, moves[0].from);
+    ASSERT_EQ(0u, moves[0].to);
+    ASSERT_EQ(0x10u, moves[1].id);
+    ASSERT_EQ(3 * kPage, moves[1].from);
+    ASSERT_EQ(kPage, moves[1].to);
+}
+
+/******************************************************************************/
+
+TEST(test_compaction_planner, testCompactHeapNeedsNoMoves) {
+    CompactionPlanner planner(4 * kPage);
+
+    ASSERT_EQ(0, planner.allocate(1, kPage));
+    ASSERT_EQ(0, planner.allocate(2, 100));
+    size_t moved = 1, largest = 0;
+    ASSERT_EQ(0, planner.plan(0, 0, &moved, &largest));
+    ASSERT_EQ(0u, moved);
+    ASSERT_EQ(2 * kPage, largest);
+}
+
+/******************************************************************************/
+
+TEST(test_compaction_planner, testReplaySkipsFramebufferSlots) {
+    CompactionPlanner planner(4 * kPage);
+
+    char text[256];
+    snprintf(text, sizeof(text),
+            "# a framebuffer slot, then a pmem buffer\n"
+            "a 1 %u 0 0x3 0\n"
+            "a 2 %u 0 0x2 0\n"
+            "f 1\n",
+            4 * kPage, kPage);
+    FILE* trace = makeTrace(text);
+    ASSERT_EQ(4, planner.replay(trace));
+    fclose(trace);
+    ASSERT_EQ(1u, planner.liveCount());
+    ASSERT_EQ(kPage, planner.liveBytes());
+}
+
+/******************************************************************************/
+
+TEST(test_compaction_planner, testReplayRejectsMalformedTrace) {
+    CompactionPlanner planner(4 * kPage);
+
+    FILE* trace = makeTrace("a 1 4096\nx 2\n");
+    ASSERT_EQ(-EINVAL, planner.replay(trace));
+    fclose(trace);
+    ASSERT_EQ(2, planner.failedLine());
+}
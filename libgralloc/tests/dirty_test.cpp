@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <hardware/gralloc.h>
+
+#include "dirty.h"
+
+/******************************************************************************/
+
+// a 320x480 RGB_565 buffer, 640 bytes per row
+static const size_t kSize = 640 * 480;
+
+TEST(test_dirty, testRectangle) {
+    size_t start, end;
+
+    // rows 10 to 19, whole width
+    getDirtyRange(HAL_PIXEL_FORMAT_RGB_565, 320, kSize, 0, 10, 320, 10,
+            &start, &end);
+    ASSERT_EQ(10u * 640, start);
+    ASSERT_EQ(20u * 640, end);
+
+    // partial rows are widened to cache lines
+    getDirtyRange(HAL_PIXEL_FORMAT_RGB_565, 320, kSize, 17, 2, 3, 1,
+            &start, &end);
+    ASSERT_EQ(2u * 640 + 32, start);
+    ASSERT_EQ(2u * 640 + 64, end);
+
+    // the last row
+    getDirtyRange(HAL_PIXEL_FORMAT_RGB_565, 320, kSize, 0, 479, 320, 1,
+            &start, &end);
+    ASSERT_EQ(479u * 640, start);
+    ASSERT_EQ(kSize, end);
+}
+
+TEST(test_dirty, testWholeBuffer) {
+    size_t start, end;
+
+    // lock(0, 0, 0, 0)
+    getDirtyRange(HAL_PIXEL_FORMAT_RGB_565, 320, kSize, 0, 0, 0, 0,
+            &start, &end);
+    ASSERT_EQ(0u, start);
+    ASSERT_EQ(kSize, end);
+
+    // stride unknown
+    getDirtyRange(HAL_PIXEL_FORMAT_RGB_565, 0, kSize, 0, 10, 320, 10,
+            &start, &end);
+    ASSERT_EQ(0u, start);
+    ASSERT_EQ(kSize, end);
+
+    // planar formats
+    getDirtyRange(HAL_PIXEL_FORMAT_YV12, 320, kSize, 0, 10, 320, 10,
+            &start, &end);
+    ASSERT_EQ(0u, start);
+    ASSERT_EQ(kSize, end);
+
+    // rectangles that don't fit
+    getDirtyRange(HAL_PIXEL_FORMAT_RGB_565, 320, kSize, 300, 10, 40, 10,
+            &start, &end);
+    ASSERT_EQ(0u, start);
+    ASSERT_EQ(kSize, end);
+    getDirtyRange(HAL_PIXEL_FORMAT_RGB_565, 320, kSize, 0, 470, 320, 20,
+            &start, &end);
+    ASSERT_EQ(0u, start);
+    ASSERT_EQ(kSize, end);
+    getDirtyRange(HAL_PIXEL_FORMAT_RGB_565, 320, kSize, -1, 10, 320, 10,
+            &start, &end);
+    ASSERT_EQ(0u, start);
+    ASSERT_EQ(kSize, end);
+}
+
+TEST(test_dirty, testMerge) {
+    int start = 0, end = 0;
+
+    mergeDirtyRange(&start, &end, 0, 0);
+    ASSERT_EQ(start, end);
+
+    mergeDirtyRange(&start, &end, 4096, 8192);
+    ASSERT_EQ(4096, start);
+    ASSERT_EQ(8192, end);
+
+    // contained
+    mergeDirtyRange(&start, &end, 5000, 6000);
+    ASSERT_EQ(4096, start);
+    ASSERT_EQ(8192, end);
+
+    // disjoint ranges are covered by their span
+    mergeDirtyRange(&start, &end, 16384, 20480);
+    ASSERT_EQ(4096, start);
+    ASSERT_EQ(20480, end);
+    mergeDirtyRange(&start, &end, 0, 32);
+    ASSERT_EQ(0, start);
+    ASSERT_EQ(20480, end);
+}
+
+TEST(test_dirty, testBufferStateTable) {
+    BufferStateTable table;
+    private_handle_t hnd(-1, kSize, private_handle_t::PRIV_FLAGS_USES_PMEM);
+    size_t start, end;
+
+    // unknown handles are flushed whole
+    table.addDirty(&hnd, 0, 10, 320, 10);
+    table.takeDirty(&hnd, &start, &end);
+    ASSERT_EQ(0u, start);
+    ASSERT_EQ(kSize, end);
+
+    table.setLayout(&hnd, HAL_PIXEL_FORMAT_RGB_565, 320);
+    table.addDirty(&hnd, 0, 10, 320, 10);
+    table.addDirty(&hnd, 0, 30, 320, 10);
+    table.takeDirty(&hnd, &start, &end);
+    ASSERT_EQ(10u * 640, start);
+    ASSERT_EQ(40u * 640, end);
+
+    // taking the range resets it, and nothing locked means everything
+    table.takeDirty(&hnd, &start, &end);
+    ASSERT_EQ(0u, start);
+    ASSERT_EQ(kSize, end);
+
+    // a reused handle starts clean
+    table.addDirty(&hnd, 0, 10, 320, 10);
+    table.setLayout(&hnd, HAL_PIXEL_FORMAT_RGB_565, 320);
+    table.addDirty(&hnd, 0, 470, 320, 10);
+    table.takeDirty(&hnd, &start, &end);
+    ASSERT_EQ(470u * 640, start);
+    ASSERT_EQ(kSize, end);
+
+    table.forget(&hnd);
+    table.addDirty(&hnd, 0, 10, 320, 10);
+    table.takeDirty(&hnd, &start, &end);
+    ASSERT_EQ(0u, start);
+    ASSERT_EQ(kSize, end);
+}
+
+static int damageArea(damage_t const& damage) {
+    int area = 0;
+    for (int i=0 ; i<damage.count ; i++) {
+        area += (damage.rects[i].r - damage.rects[i].l) *
+                (damage.rects[i].b - damage.rects[i].t);
+    }
+    return area;
+}
+
+TEST(test_dirty, testDamage) {
+    damage_t damage;
+    damage.count = 0;
+    int l, t, r, b;
+
+    addDamage(&damage, 10, 10, 10, 20);     // empty
+    ASSERT_EQ(0, damage.count);
+
+    // a blinking cursor and a clock, far apart
+    addDamage(&damage, 10, 10, 12, 26);
+    addDamage(&damage, 280, 0, 320, 16);
+    ASSERT_EQ(2, damage.count);
+    ASSERT_EQ(2 * 16 + 40 * 16, damageArea(damage));
+
+    // the same cursor again in the next frame
+    addDamage(&damage, 10, 10, 12, 26);
+    ASSERT_EQ(2, damage.count);
+
+    // overlapping rectangles merge, and what they grow into too
+    addDamage(&damage, 0, 20, 100, 40);
+    ASSERT_EQ(2, damage.count);
+    addDamage(&damage, 90, 0, 300, 22);
+    ASSERT_EQ(1, damage.count);
+
+    getDamageBounds(&damage, &l, &t, &r, &b);
+    ASSERT_EQ(0, l);
+    ASSERT_EQ(0, t);
+    ASSERT_EQ(320, r);
+    ASSERT_EQ(40, b);
+}
+
+TEST(test_dirty, testDamageFull) {
+    damage_t damage;
+    damage.count = 0;
+
+    for (int i=0 ; i<MAX_DAMAGE_RECTS ; i++) {
+        addDamage(&damage, 0, i * 100, 10, i * 100 + 10);
+    }
+    ASSERT_EQ(MAX_DAMAGE_RECTS, damage.count);
+
+    // goes with its nearest neighbour
+    addDamage(&damage, 0, 115, 10, 125);
+    ASSERT_EQ(MAX_DAMAGE_RECTS, damage.count);
+    ASSERT_EQ((MAX_DAMAGE_RECTS - 1) * 100 + 10 * 25, damageArea(damage));
+
+    int l, t, r, b;
+    getDamageBounds(&damage, &l, &t, &r, &b);
+    ASSERT_EQ(0, t);
+    ASSERT_EQ((MAX_DAMAGE_RECTS - 1) * 100 + 10, b);
+}
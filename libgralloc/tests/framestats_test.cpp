@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "framestats.h"
+
+/******************************************************************************/
+
+static const int64_t kPeriod = 16666667;   // 60 Hz
+
+TEST(test_framestats, testCounts) {
+    FrameStats stats;
+    stats.setRefreshPeriod(kPeriod);
+
+    // 10 frames on every vsync, each shown 20ms after it was posted
+    int64_t t = 1000000000LL;
+    for (int i=0 ; i<10 ; i++) {
+        uint32_t frame = stats.posted(t);
+        ASSERT_EQ(uint32_t(i), frame);
+        stats.queued(frame, i % 3, t + 1000, 0);
+        stats.scannedOut(frame, t + 20000000);
+        t += kPeriod;
+    }
+    // one dropped, then one shown two vsyncs after the previous
+    stats.reused(stats.posted(t));
+    t += kPeriod;
+    uint32_t frame = stats.posted(t);
+    stats.queued(frame, 1, t + 1000, 5000000);
+    stats.scannedOut(frame, t + 20000000);
+
+    char buff[1024];
+    stats.dump(buff, sizeof(buff));
+    ASSERT_TRUE(strstr(buff, "12 posted, 11 displayed, 1 reused, 1 late"))
+            << buff;
+    // 20ms is in the 16384-32768us bucket
+    ASSERT_TRUE(strstr(buff, "post to scanout (us): <32768:11\n")) << buff;
+    ASSERT_TRUE(strstr(buff, "wait for buffer (us): <2:10 <8192:1\n")) << buff;
+}
+
+TEST(test_framestats, testTrace) {
+    FrameStats stats;
+    stats.setRefreshPeriod(kPeriod);
+
+    // wrap the ring
+    int count = FrameStats::kFrames + 10;
+    for (int i=0 ; i<count ; i++) {
+        uint32_t frame = stats.posted(i * kPeriod);
+        stats.queued(frame, 0, i * kPeriod + 1, 0);
+        stats.scannedOut(frame, i * kPeriod + 2);
+    }
+
+    char path[] = "/tmp/framestats_testXXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    ASSERT_EQ(0, stats.writeTrace(path));
+
+    FILE* file = fopen(path, "r");
+    ASSERT_TRUE(file != NULL);
+    FrameStats::frame_trace_header_t header;
+    ASSERT_EQ(1u, fread(&header, sizeof(header), 1, file));
+    ASSERT_EQ(uint32_t(FrameStats::kTraceMagic), header.magic);
+    ASSERT_EQ(uint32_t(FrameStats::kFrames), header.count);
+    ASSERT_EQ(uint32_t(kPeriod), header.refreshPeriod);
+    // oldest first
+    for (uint32_t i=0 ; i<header.count ; i++) {
+        FrameStats::frame_t f;
+        ASSERT_EQ(1u, fread(&f, sizeof(f), 1, file));
+        ASSERT_EQ(i + 10, f.frame);
+        ASSERT_EQ((i + 10) * kPeriod + 2, f.scanout);
+    }
+    fclose(file);
+    unlink(path);
+}
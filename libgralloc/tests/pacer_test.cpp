@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "pacer.h"
+
+/******************************************************************************/
+
+static const int64_t kMs = 1000000;
+static const int64_t kPeriod = 16666667;   // 60 Hz
+
+TEST(test_pacer, testLearnsPeriod) {
+    // the panel actually runs at 55 Hz
+    const int64_t period = 18181818;
+    VsyncPacer pacer(kPeriod);
+    int64_t t = 1000 * kMs;
+    for (int i=0 ; i<200 ; i++) {
+        pacer.posted(t - 5 * kMs);
+        pacer.flipped(t);
+        // now and then a frame misses a vsync
+        t += (i % 10 == 9) ? 2 * period : period;
+    }
+    ASSERT_NEAR(double(period), double(pacer.period()), 0.001 * period);
+    ASSERT_EQ(1, pacer.cadence());
+    // the last flip was a period before t
+    ASSERT_NEAR(double(t), double(pacer.nextVsync(t - period + kMs)), 1000.0);
+}
+
+TEST(test_pacer, testHoldsToCadence) {
+    VsyncPacer pacer(kPeriod);
+    int64_t t = 1000 * kMs;
+    // 30 fps content
+    for (int i=0 ; i<32 ; i++) {
+        pacer.posted(t + i * 2 * kPeriod);
+    }
+    ASSERT_EQ(2, pacer.cadence());
+
+    int64_t holdUntil = 0;
+    pacer.flipped(t);
+    // ready just after the flip, would come out a vsync early
+    ASSERT_EQ(VsyncPacer::HOLD,
+            pacer.decide(t + kMs, t + kMs, false, &holdUntil));
+    ASSERT_EQ(t + 2 * kPeriod - kPeriod / 2, holdUntil);
+    ASSERT_EQ(VsyncPacer::SHOW,
+            pacer.decide(t + kMs, holdUntil, false, &holdUntil));
+    pacer.flipped(t + 2 * kPeriod);
+    ASSERT_EQ(0u, pacer.janks());
+
+    // shown a vsync late
+    pacer.flipped(t + 5 * kPeriod);
+    ASSERT_EQ(1u, pacer.janks());
+    ASSERT_EQ(1u, pacer.held());
+}
+
+TEST(test_pacer, testDropsLateFrames) {
+    VsyncPacer pacer(kPeriod);
+    int64_t t = 1000 * kMs;
+    int64_t holdUntil;
+
+    // the first frame is always shown
+    ASSERT_EQ(VsyncPacer::SHOW, pacer.decide(t, t, true, &holdUntil));
+    pacer.flipped(t);
+
+    // late, but nothing to show instead
+    int64_t posted = t - 2 * kPeriod;
+    ASSERT_EQ(VsyncPacer::SHOW,
+            pacer.decide(posted, t + kMs, false, &holdUntil));
+    // late with a newer frame queued
+    ASSERT_EQ(VsyncPacer::DROP,
+            pacer.decide(posted, t + kMs, true, &holdUntil));
+    // recent enough
+    ASSERT_EQ(VsyncPacer::SHOW,
+            pacer.decide(t, t + kMs, true, &holdUntil));
+    ASSERT_EQ(1u, pacer.dropped());
+}
@@ -17,6 +17,7 @@
 #include <gtest/gtest.h>
 
 #include <errno.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/mman.h>
@@ -599,3 +600,288 @@ TEST(test_pmem_kernel_allocator, testAllocPmemBufferWithEnomemOnMmap) {
 }
 
 /******************************************************************************/
+
+struct Deps_KernelAllocPmemBufferFromPool : public DepsStub {
+
+    void* poolBase;
+    int opened;
+    int unmapped;
+
+    Deps_KernelAllocPmemBufferFromPool(void* poolBase) :
+        poolBase(poolBase), opened(0), unmapped(0) {}
+
+    virtual int open(const char* pathname, int flags, int mode) {
+        EXPECT_EQ(fakePmemDev, pathname);
+        EXPECT_EQ(O_RDWR, flags & O_RDWR);
+        EXPECT_EQ(0, mode);
+        return opened++ ? 5678 : 1234;
+    }
+
+    virtual void* mmap(void* start, size_t length, int prot, int flags, int fd,
+            off_t offset) {
+        EXPECT_EQ(1234, fd);
+        EXPECT_EQ(0x1000u, length);
+        return poolBase;
+    }
+
+    virtual int connectPmem(int fd, int master_fd) {
+        EXPECT_EQ(5678, fd);
+        EXPECT_EQ(1234, master_fd);
+        return 0;
+    }
+
+    virtual int mapPmem(int fd, int offset, size_t size) {
+        EXPECT_EQ(5678, fd);
+        EXPECT_EQ(0x100, offset);
+        EXPECT_EQ(0x100u, size);
+        return 0;
+    }
+
+    virtual int unmapPmem(int fd, int offset, size_t size) {
+        EXPECT_EQ(5678, fd);
+        EXPECT_EQ(0x100, offset);
+        EXPECT_EQ(0x100u, size);
+        unmapped++;
+        return 0;
+    }
+
+    virtual int munmap(void* start, size_t length) {
+        ADD_FAILURE() << "pool buffers must not be unmapped";
+        return 0;
+    }
+};
+
+struct Allocator_KernelAllocPmemBufferFromPool : public AllocatorStub {
+
+    ssize_t result;
+    size_t heapSize;
+    int deallocated;
+
+    Allocator_KernelAllocPmemBufferFromPool(ssize_t result) :
+        result(result), heapSize(0), deallocated(0) {}
+
+    virtual ssize_t setSize(size_t size) {
+        heapSize = size;
+        return 0;
+    }
+
+    virtual ssize_t allocate(size_t size, uint32_t flags = 0) {
+        EXPECT_EQ(0x1000u, heapSize);
+        return result;
+    }
+
+    virtual ssize_t deallocate(size_t offset) {
+        EXPECT_EQ(0x100u, offset);
+        deallocated++;
+        return 0;
+    }
+};
+
+TEST(test_pmem_kernel_allocator, testAllocPmemBufferFromPool) {
+    uint8_t buf[0x1000];
+    memset(buf, 0xff, sizeof(buf));
+    Deps_KernelAllocPmemBufferFromPool depsMock(buf);
+    Allocator_KernelAllocPmemBufferFromPool allocMock(0x100);
+    PmemKernelAllocator pma(depsMock, allocMock, 0x1000, fakePmemDev);
+
+    void* base = 0;
+    int offset = -9182, fd = -9182;
+    int size = 0x100;
+    int flags = 0;
+    int result = pma.alloc_pmem_buffer(size, flags, &base, &offset, &fd);
+    ASSERT_EQ(0, result);
+    ASSERT_EQ(buf, base);
+    ASSERT_EQ(0x100, offset);
+    ASSERT_EQ(5678, fd);
+    for (int i = 0; i < 0x100; ++i) {
+        ASSERT_EQ(0, buf[0x100 + i]);
+    }
+    ASSERT_EQ(0xff, buf[0x200]);
+
+    // gralloc hands back base + offset, like the userspace allocator
+    ASSERT_EQ(0, pma.free_pmem_buffer(size, (char*)base + offset, offset, fd));
+    ASSERT_EQ(1, depsMock.unmapped);
+    ASSERT_EQ(1, allocMock.deallocated);
+}
+
+/******************************************************************************/
+
+struct Deps_KernelAllocPmemBufferWithFullPool : public DepsStub {
+
+    void* poolBase;
+    void* buffer;
+
+    Deps_KernelAllocPmemBufferWithFullPool(void* poolBase, void* buffer) :
+        poolBase(poolBase), buffer(buffer) {}
+
+    virtual int open(const char* pathname, int flags, int mode) {
+        return 5678;
+    }
+
+    virtual void* mmap(void* start, size_t length, int prot, int flags, int fd,
+            off_t offset) {
+        // the pool first, then the buffer of its own
+        return length == 0x1000 ? poolBase : buffer;
+    }
+};
+
+TEST(test_pmem_kernel_allocator, testAllocPmemBufferWithFullPool) {
+    uint8_t pool[0x1000];
+    uint8_t buf[0x100];
+    Deps_KernelAllocPmemBufferWithFullPool depsMock(pool, buf);
+    Allocator_KernelAllocPmemBufferFromPool allocMock(-ENOMEM);
+    PmemKernelAllocator pma(depsMock, allocMock, 0x1000, fakePmemDev);
+
+    void* base = 0;
+    int offset = -9182, fd = -9182;
+    int size = 0x100;
+    int flags = 0;
+    int result = pma.alloc_pmem_buffer(size, flags, &base, &offset, &fd);
+    ASSERT_EQ(0, result);
+    ASSERT_EQ(buf, base);
+    ASSERT_EQ(0, offset);
+    ASSERT_EQ(5678, fd);
+    ASSERT_EQ(0, pma.free_pmem_buffer(size, base, offset, fd));
+    ASSERT_EQ(0, allocMock.deallocated);
+}
+
+/******************************************************************************/
+
+struct Deps_UnmapAndRemapPmemBuffer : public DepsStub {
+
+    int unmapped;
+    int connected;
+
+    Deps_UnmapAndRemapPmemBuffer() : unmapped(0), connected(0) {}
+
+    virtual int open(const char* pathname, int flags, int mode) {
+        return 5679;
+    }
+
+    virtual int connectPmem(int fd, int master_fd) {
+        EXPECT_EQ(5679, fd);
+        EXPECT_EQ(1234, master_fd);
+        connected++;
+        return 0;
+    }
+
+    virtual int mapPmem(int fd, int offset, size_t size) {
+        EXPECT_EQ(0x300, offset);
+        EXPECT_EQ(size_t(0x100), size);
+        return 0;
+    }
+
+    virtual int unmapPmem(int fd, int offset, size_t size) {
+        EXPECT_EQ(5678, fd);
+        EXPECT_EQ(0x300, offset);
+        unmapped++;
+        return 0;
+    }
+};
+
+struct Allocator_UnmapAndRemapPmemBuffer : public AllocatorStub {
+
+    int deallocated;
+
+    Allocator_UnmapAndRemapPmemBuffer() : deallocated(0) {}
+
+    virtual ssize_t deallocate(size_t offset) {
+        EXPECT_EQ(0x300u, offset);
+        deallocated++;
+        return 0;
+    }
+};
+
+TEST(test_pmem_userspace_allocator, testUnmapAndRemapPmemBuffer) {
+    Deps_UnmapAndRemapPmemBuffer depsMock;
+    Allocator_UnmapAndRemapPmemBuffer allocMock;
+    PmemUserspaceAllocator pma(depsMock, allocMock, fakePmemDev);
+
+    uint8_t buf[0x300 + 0x100];
+    pma.set_master_values(1234, buf);
+
+    // revoking the old fd keeps the offset allocated
+    ASSERT_EQ(0, pma.unmap_pmem_buffer(0x100, buf + 0x300, 0x300, 5678));
+    ASSERT_EQ(1, depsMock.unmapped);
+    ASSERT_EQ(0, allocMock.deallocated);
+
+    int fd = -9182;
+    ASSERT_EQ(0, pma.remap_pmem_buffer(0x100, 0, 0x300, &fd));
+    ASSERT_EQ(5679, fd);
+    ASSERT_EQ(1, depsMock.connected);
+
+    // and one that has no fd is freed without unmapping it again
+    ASSERT_EQ(0, pma.free_pmem_buffer(0x100, buf + 0x300, 0x300, -1));
+    ASSERT_EQ(1, depsMock.unmapped);
+    ASSERT_EQ(1, allocMock.deallocated);
+}
+
+/******************************************************************************/
+
+struct Deps_AllocPmemBufferSpanningCleanAndDirty : public DepsStub {
+
+    void* heap;
+
+    Deps_AllocPmemBufferSpanningCleanAndDirty(void* heap) : heap(heap) {}
+
+    virtual int open(const char* pathname, int flags, int mode) {
+        return 1234;
+    }
+
+    virtual size_t getPmemTotalSize(int fd, size_t* size) {
+        *size = 0x4000;
+        return 0;
+    }
+
+    virtual void* mmap(void* start, size_t length, int prot, int flags, int fd,
+            off_t offset) {
+        return heap;
+    }
+};
+
+struct Allocator_AllocPmemBufferSpanningCleanAndDirty : public AllocatorStub {
+
+    virtual bool supportsScrubbing() const {
+        return true;
+    }
+
+    virtual ssize_t claimDirty(size_t maxSize, size_t* pSize) {
+        return -ENOENT;
+    }
+
+    virtual ssize_t allocate(size_t size, uint32_t flags = 0) {
+        return -ENOMEM;
+    }
+
+    virtual ssize_t allocateSpanning(size_t size, range_t* dirty,
+            int maxDirty, int* pDirty) {
+        EXPECT_EQ(size_t(0x2000), size);
+        EXPECT_LE(1, maxDirty);
+        dirty[0].offset = 0x1000;
+        dirty[0].size = 0x800;
+        *pDirty = 1;
+        return 0x1000;
+    }
+};
+
+TEST(test_pmem_userspace_allocator, testAllocPmemBufferSpanningCleanAndDirty) {
+    uint8_t heap[0x4000];
+    memset(heap, 0xff, sizeof(heap));
+    Deps_AllocPmemBufferSpanningCleanAndDirty depsMock(heap);
+    Allocator_AllocPmemBufferSpanningCleanAndDirty allocMock;
+    PmemUserspaceAllocator pma(depsMock, allocMock, fakePmemDev);
+
+    void* base = 0;
+    int offset = -9182, fd = -9182;
+    int result = pma.alloc_pmem_buffer(0x2000, 0, &base, &offset, &fd);
+    ASSERT_EQ(0, result);
+    ASSERT_EQ(0x1000, offset);
+
+    // only the dirty part is zeroed, the rest is known to be zero already
+    for (int i = 0x1000; i < 0x1800; ++i) {
+        ASSERT_EQ(0, heap[i]);
+    }
+    for (int i = 0x1800; i < 0x3000; ++i) {
+        ASSERT_EQ(0xff, heap[i]);
+    }
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "recycler.h"
+
+static const int kPmem = private_handle_t::PRIV_FLAGS_USES_PMEM;
+static const int kAdsp = private_handle_t::PRIV_FLAGS_USES_PMEM_ADSP;
+
+/******************************************************************************/
+
+TEST(test_buffer_recycler, testTakeMatchesSizeAndClass) {
+    BufferRecycler recycler(1 << 20);
+    private_handle_t a(1, 0x1000, kPmem);
+    private_handle_t b(2, 0x1000, kAdsp);
+
+    ASSERT_TRUE(recycler.park(&a));
+    ASSERT_TRUE(recycler.park(&b));
+    ASSERT_EQ(0x2000u, recycler.parked());
+
+    ASSERT_EQ((private_handle_t*)0, recycler.take(0x2000, kPmem));
+    ASSERT_EQ((private_handle_t*)0,
+            recycler.take(0x1000, kPmem | private_handle_t::PRIV_FLAGS_CACHED));
+    ASSERT_EQ(&b, recycler.take(0x1000, kAdsp));
+    ASSERT_EQ(&a, recycler.take(0x1000, kPmem));
+    ASSERT_EQ(0u, recycler.parked());
+}
+
+/******************************************************************************/
+
+TEST(test_buffer_recycler, testPopOldestTrimsToBudget) {
+    BufferRecycler recycler(0x2000);
+    private_handle_t a(1, 0x1000, kPmem);
+    private_handle_t b(2, 0x1000, kPmem);
+    private_handle_t c(3, 0x1000, kPmem);
+    private_handle_t big(4, 0x3000, kPmem);
+
+    ASSERT_FALSE(recycler.park(&big));
+    ASSERT_TRUE(recycler.park(&a));
+    ASSERT_TRUE(recycler.park(&b));
+    ASSERT_TRUE(recycler.park(&c));
+
+    ASSERT_EQ(&a, recycler.popOldest(recycler.budget()));
+    ASSERT_EQ((private_handle_t*)0, recycler.popOldest(recycler.budget()));
+    ASSERT_EQ(&b, recycler.popOldest(0));
+    ASSERT_EQ(&c, recycler.popOldest(0));
+    ASSERT_EQ((private_handle_t*)0, recycler.popOldest(0));
+}
+
+/******************************************************************************/
+
+TEST(test_buffer_recycler, testDisabledWithZeroBudget) {
+    BufferRecycler recycler(0);
+    private_handle_t a(1, 0x1000, kPmem);
+
+    ASSERT_FALSE(recycler.park(&a));
+    ASSERT_EQ((private_handle_t*)0, recycler.take(0x1000, kPmem));
+}
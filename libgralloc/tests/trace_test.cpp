@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+/******************************************************************************/
+
+TEST(test_trace, testParseTraceLine) {
+    trace_record_t rec;
+
+    ASSERT_EQ(0, parseTraceLine("# comment\n", &rec));
+    ASSERT_EQ(0, parseTraceLine("   \n", &rec));
+
+    ASSERT_EQ(1, parseTraceLine("a 0x10 4096\n", &rec));
+    ASSERT_EQ('a', rec.op);
+    ASSERT_EQ(0x10u, rec.id);
+    ASSERT_EQ(4096u, rec.size);
+    ASSERT_EQ(0u, rec.flags);
+
+    ASSERT_EQ(1, parseTraceLine("a 0x10 4096 0x33 0x2 123456789\n", &rec));
+    ASSERT_EQ(0x33u, rec.usage);
+    ASSERT_EQ(0x2u, rec.flags);
+    ASSERT_EQ(123456789, rec.time);
+
+    ASSERT_EQ(1, parseTraceLine("f 16 42\n", &rec));
+    ASSERT_EQ('f', rec.op);
+    ASSERT_EQ(16u, rec.id);
+    ASSERT_EQ(42, rec.time);
+
+    ASSERT_EQ(-EINVAL, parseTraceLine("a 1\n", &rec));
+    ASSERT_EQ(-EINVAL, parseTraceLine("a 1 4096 0x33\n", &rec));
+    ASSERT_EQ(-EINVAL, parseTraceLine("x 1\n", &rec));
+}
+
+/******************************************************************************/
+
+TEST(test_trace, testRecorderWritesParseableTrace) {
+    char path[] = "/tmp/gralloc_trace_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_LE(0, fd);
+    close(fd);
+
+    TraceRecorder disabled(0);
+    ASSERT_FALSE(disabled.enabled());
+    disabled.recordAlloc(1, 4096, 0, 0);
+
+    {
+        TraceRecorder recorder(path);
+        ASSERT_TRUE(recorder.enabled());
+        // more than one batch
+        for (uint32_t i = 0; i < 200; ++i) {
+            recorder.recordAlloc(i, 4096 * (i + 1), 0x33, 0x2);
+            recorder.recordFree(i);
+        }
+    }
+
+    FILE* trace = fopen(path, "r");
+    ASSERT_TRUE(trace != 0);
+    char line[128];
+    int count = 0;
+    int64_t last = 0;
+    trace_record_t rec;
+    while (fgets(line, sizeof(line), trace)) {
+        ASSERT_EQ(1, parseTraceLine(line, &rec));
+        ASSERT_EQ(count & 1 ? 'f' : 'a', rec.op);
+        ASSERT_EQ(uint32_t(count / 2), rec.id);
+        if (rec.op == 'a') {
+            ASSERT_EQ(4096u * (rec.id + 1), rec.size);
+            ASSERT_EQ(0x33u, rec.usage);
+            ASSERT_EQ(0x2u, rec.flags);
+        }
+        ASSERT_LE(last, rec.time);
+        last = rec.time;
+        count++;
+    }
+    fclose(trace);
+    unlink(path);
+    ASSERT_EQ(400, count);
+}
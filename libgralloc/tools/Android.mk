@@ -0,0 +1,45 @@
+# Copyright (C) 2010 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+# host tools working on recorded gralloc allocation traces
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := pmem_defrag.cpp
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+LOCAL_STATIC_LIBRARIES := libgralloc_qsd8k_host liblog
+LOCAL_MODULE := pmem_defrag
+LOCAL_MODULE_TAGS := eng
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := gralloc_replay.cpp
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+LOCAL_STATIC_LIBRARIES := libgralloc_qsd8k_host liblog
+LOCAL_LDLIBS := -lpthread -lrt
+LOCAL_MODULE := gralloc_replay
+LOCAL_MODULE_TAGS := eng
+include $(BUILD_HOST_EXECUTABLE)
+
+# the framebuffer pacing simulation
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := vsync_sim.cpp
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+LOCAL_STATIC_LIBRARIES := libgralloc_qsd8k_host liblog
+LOCAL_LDLIBS := -lm
+LOCAL_MODULE := vsync_sim
+LOCAL_MODULE_TAGS := eng
+include $(BUILD_HOST_EXECUTABLE)
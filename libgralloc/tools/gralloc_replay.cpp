@@ -0,0 +1,382 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays a gralloc allocation trace (see trace.h) through each of the pmem
+ * allocators, with their device dependencies stubbed out by anonymous
+ * memory, and reports the time per operation, peak footprint and
+ * fragmentation of each:
+ *
+ *     gralloc_replay [-p <pmem KiB>] [-a <adsp pool KiB>] [-n <passes>] trace
+ *
+ * Only buffers that went to pmem or pmem_adsp are replayed, all of them
+ * through every allocator so that the numbers can be compared.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <cutils/log.h>
+
+#include "allocator.h"
+#include "gralloc_priv.h"
+#include "pmemalloc.h"
+#include "trace.h"
+
+/*****************************************************************************/
+
+static int64_t now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static int compareTimes(const void* lhs, const void* rhs)
+{
+    int64_t l = *(int64_t const*)lhs;
+    int64_t r = *(int64_t const*)rhs;
+    return l < r ? -1 : (l > r ? 1 : 0);
+}
+
+/*****************************************************************************/
+
+// pmem devices backed by anonymous memory, the pmem ioctls always succeed
+class HostDeps : public PmemUserspaceAllocator::Deps,
+        public PmemKernelAllocator::Deps {
+
+    size_t mPmemSize;
+    int mNextFd;
+
+ public:
+
+    size_t mapped;
+    size_t peakMapped;
+
+    HostDeps(size_t pmemSize)
+        : mPmemSize(pmemSize), mNextFd(100), mapped(0), peakMapped(0) { }
+
+    virtual size_t getPmemTotalSize(int fd, size_t* size) {
+        *size = mPmemSize;
+        return 0;
+    }
+
+    virtual int connectPmem(int fd, int master_fd) { return 0; }
+    virtual int mapPmem(int fd, int offset, size_t size) { return 0; }
+    virtual int unmapPmem(int fd, int offset, size_t size) { return 0; }
+
+    virtual int getErrno() { return errno; }
+
+    virtual void* mmap(void* start, size_t length, int prot, int flags, int fd,
+            off_t offset) {
+        void* base = ::mmap(0, length, PROT_READ|PROT_WRITE,
+                MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (base != MAP_FAILED) {
+            mapped += length;
+            if (mapped > peakMapped) peakMapped = mapped;
+        }
+        return base;
+    }
+
+    virtual int munmap(void* start, size_t length) {
+        mapped -= length;
+        return ::munmap(start, length);
+    }
+
+    virtual int open(const char* pathname, int flags, int mode) {
+        return mNextFd++;
+    }
+
+    virtual int close(int fd) { return 0; }
+};
+
+/*****************************************************************************/
+
+// what a replay needs to know about a live buffer
+struct live_t {
+    uint32_t    id;
+    size_t      size;
+    void*       base;
+    int         offset;
+    int         fd;
+};
+
+class Target {
+ public:
+    const char* name;
+    Target(const char* name) : name(name) { }
+    virtual ~Target() { }
+    virtual int alloc(live_t* buffer) = 0;
+    virtual int free(live_t const* buffer) = 0;
+    // bytes of the device currently committed, sampled after each op
+    virtual size_t footprint() = 0;
+    virtual void report() = 0;
+};
+
+class BestFitTarget : public Target {
+    SimpleBestFitAllocator mAllocator;
+ public:
+    BestFitTarget(size_t size)
+        : Target("SimpleBestFitAllocator"), mAllocator(size) { }
+    virtual int alloc(live_t* b) {
+        ssize_t offset = mAllocator.allocate(b->size);
+        b->offset = offset;
+        return offset < 0 ? offset : 0;
+    }
+    virtual int free(live_t const* b) {
+        return mAllocator.deallocate(b->offset);
+    }
+    virtual size_t footprint() {
+        SimpleBestFitAllocator::stats_t stats;
+        mAllocator.getStats(&stats);
+        return stats.heapSize - stats.freeBytes;
+    }
+    virtual void report() {
+        char buff[2048];
+        buff[0] = '\0';
+        mAllocator.dump(buff, sizeof(buff));
+        printf("%s", buff);
+    }
+};
+
+// without the scrubber, which would zero the heap while the ops are timed;
+// allocations zero what they get instead
+class UnscrubbedArenaAllocator : public ArenaAllocator {
+ public:
+    UnscrubbedArenaAllocator(int arenas, size_t arenaSize, size_t smallLimit)
+        : ArenaAllocator(arenas, arenaSize, smallLimit) { }
+    virtual bool supportsScrubbing() const { return false; }
+};
+
+// set up like gralloc.cpp does, but for the scrubber
+class UserspaceTarget : public Target {
+    HostDeps mDeps;
+    UnscrubbedArenaAllocator mAllocator;
+    PmemUserspaceAllocator mPmem;
+ public:
+    UserspaceTarget(size_t size)
+        : Target("PmemUserspaceAllocator"), mDeps(size),
+          mAllocator(4, 1<<20, 128<<10),
+          mPmem(mDeps, mAllocator, "/dev/pmem") { }
+    virtual int alloc(live_t* b) {
+        return mPmem.alloc_pmem_buffer(b->size, 0, &b->base, &b->offset, &b->fd);
+    }
+    virtual int free(live_t const* b) {
+        return mPmem.free_pmem_buffer(b->size, (char*)b->base + b->offset,
+                b->offset, b->fd);
+    }
+    virtual size_t footprint() {
+        SimpleBestFitAllocator::stats_t stats;
+        size_t used = 0;
+        mAllocator.getStats(&stats);
+        used += stats.heapSize - stats.freeBytes;
+        for (int i=0 ; i<mAllocator.arenas() ; i++) {
+            mAllocator.getArenaStats(i, &stats);
+            used += stats.heapSize - stats.freeBytes;
+        }
+        return used;
+    }
+    virtual void report() {
+        char buff[2048];
+        buff[0] = '\0';
+        mPmem.dump(buff, sizeof(buff));
+        printf("%s", buff);
+    }
+};
+
+class KernelTarget : public Target {
+    HostDeps mDeps;
+    BuddyAllocator mPool;
+    PmemKernelAllocator mPmem;
+ public:
+    KernelTarget(size_t poolSize)
+        : Target(poolSize ? "PmemKernelAllocator (buddy pool)" :
+                            "PmemKernelAllocator"),
+          mDeps(0), mPmem(mDeps, mPool, poolSize, "/dev/pmem_adsp") { }
+    virtual int alloc(live_t* b) {
+        return mPmem.alloc_pmem_buffer(b->size, 0, &b->base, &b->offset, &b->fd);
+    }
+    virtual int free(live_t const* b) {
+        return mPmem.free_pmem_buffer(b->size, (char*)b->base + b->offset,
+                b->offset, b->fd);
+    }
+    virtual size_t footprint() {
+        return mDeps.mapped;
+    }
+    virtual void report() {
+        char buff[2048];
+        buff[0] = '\0';
+        mPmem.dump(buff, sizeof(buff));
+        printf("%s", buff);
+    }
+};
+
+/*****************************************************************************/
+
+static void printPercentiles(const char* what, int64_t* times, int count)
+{
+    if (count == 0) {
+        printf("  %-5s: no operations\n", what);
+        return;
+    }
+    qsort(times, count, sizeof(int64_t), compareTimes);
+    printf("  %-5s: %d ops, ns/op p50=%lld p90=%lld p99=%lld max=%lld\n",
+            what, count,
+            (long long)times[count / 2],
+            (long long)times[(count * 9) / 10],
+            (long long)times[(count * 99) / 100],
+            (long long)times[count - 1]);
+}
+
+static void replay(Target& target, trace_record_t const* records, int count,
+        int passes)
+{
+    live_t* live = new live_t[count];
+    int64_t* allocTimes = new int64_t[count * passes];
+    int64_t* freeTimes = new int64_t[count * passes];
+    int nlive = 0, nalloc = 0, nfree = 0, failures = 0;
+    size_t peak = 0;
+
+    for (int pass=0 ; pass<passes ; pass++) {
+        for (int i=0 ; i<count ; i++) {
+            trace_record_t const& rec = records[i];
+            if (rec.op == 'a') {
+                live_t& b = live[nlive];
+                b.id = rec.id;
+                b.size = rec.size;
+                b.base = 0;
+                b.offset = 0;
+                b.fd = -1;
+                int64_t t = now();
+                int err = target.alloc(&b);
+                allocTimes[nalloc++] = now() - t;
+                if (err < 0) {
+                    failures++;
+                    continue;
+                }
+                nlive++;
+            } else {
+                int j = nlive;
+                while (j-- > 0 && live[j].id != rec.id)
+                    ;
+                if (j < 0)
+                    continue;
+                int64_t t = now();
+                target.free(&live[j]);
+                freeTimes[nfree++] = now() - t;
+                live[j] = live[--nlive];
+            }
+            size_t footprint = target.footprint();
+            if (footprint > peak) peak = footprint;
+        }
+        // start every pass from an empty heap
+        while (nlive) {
+            target.free(&live[--nlive]);
+        }
+    }
+
+    printf("%s:\n", target.name);
+    printPercentiles("alloc", allocTimes, nalloc);
+    printPercentiles("free", freeTimes, nfree);
+    printf("  peak footprint %u KiB, %d failed allocations\n",
+            peak >> 10, failures);
+    target.report();
+
+    delete [] freeTimes;
+    delete [] allocTimes;
+    delete [] live;
+}
+
+/*****************************************************************************/
+
+int main(int argc, char** argv)
+{
+    size_t pmemSize = 32 << 20;
+    size_t poolSize = 8 << 20;
+    int passes = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:a:n:")) != -1) {
+        switch (opt) {
+            case 'p': pmemSize = size_t(strtoul(optarg, 0, 0)) << 10; break;
+            case 'a': poolSize = size_t(strtoul(optarg, 0, 0)) << 10; break;
+            case 'n': passes = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-p <pmem KiB>] [-a <adsp pool KiB>] "
+                        "[-n <passes>] trace\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1 || passes < 1) {
+        fprintf(stderr, "usage: %s [-p <pmem KiB>] [-a <adsp pool KiB>] "
+                "[-n <passes>] trace\n", argv[0]);
+        return 1;
+    }
+
+    FILE* trace = fopen(argv[optind], "r");
+    if (!trace) {
+        fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+
+    int count = 0, capacity = 1024;
+    trace_record_t* records = (trace_record_t*)malloc(capacity * sizeof(*records));
+    char line[128];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), trace)) {
+        lineno++;
+        trace_record_t rec;
+        int err = parseTraceLine(line, &rec);
+        if (err < 0) {
+            fprintf(stderr, "line %d: malformed trace\n", lineno);
+            return 1;
+        }
+        if (err == 0)
+            continue;
+        // framebuffer and ashmem buffers don't come from pmem, framebuffer
+        // slots have PRIV_FLAGS_USES_PMEM too
+        if (rec.op == 'a' && rec.flags && (!(rec.flags &
+                (private_handle_t::PRIV_FLAGS_USES_PMEM |
+                 private_handle_t::PRIV_FLAGS_USES_PMEM_ADSP)) ||
+                (rec.flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER))) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity *= 2;
+            records = (trace_record_t*)realloc(records,
+                    capacity * sizeof(*records));
+        }
+        records[count++] = rec;
+    }
+    fclose(trace);
+    printf("%d operations, %d passes\n", count, passes);
+
+    BestFitTarget bestFit(pmemSize);
+    UserspaceTarget userspace(pmemSize);
+    KernelTarget kernel(0);
+    KernelTarget pooled(poolSize);
+    Target* targets[] = { &bestFit, &userspace, &kernel, &pooled };
+    for (size_t i=0 ; i<sizeof(targets)/sizeof(*targets) ; i++) {
+        replay(*targets[i], records, count, passes);
+    }
+
+    free(records);
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays a gralloc allocation trace (see compaction.h) against a pmem heap
+ * of the given size and prints its fragmentation together with the moves
+ * that would compact it:
+ *
+ *     pmem_defrag <heap KiB> [trace]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compaction.h"
+
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s <heap KiB> [trace]\n", argv[0]);
+        return 1;
+    }
+
+    size_t heapSize = size_t(strtoul(argv[1], 0, 0)) << 10;
+    FILE* trace = stdin;
+    if (argc == 3) {
+        trace = fopen(argv[2], "r");
+        if (!trace) {
+            fprintf(stderr, "%s: %s\n", argv[2], strerror(errno));
+            return 1;
+        }
+    }
+
+    CompactionPlanner planner(heapSize);
+    int lines = planner.replay(trace);
+    if (trace != stdin) {
+        fclose(trace);
+    }
+    if (lines < 0) {
+        fprintf(stderr, "line %d: malformed trace\n", planner.failedLine());
+        return 1;
+    }
+
+    if (planner.failedSize()) {
+        printf("line %d: allocation of %u KiB failed\n",
+                planner.failedLine(), planner.failedSize() >> 10);
+    } else {
+        printf("replayed %d lines\n", lines);
+    }
+
+    char buff[2048];
+    buff[0] = '\0';
+    planner.allocator().dump(buff, sizeof(buff));
+    printf("%u live buffers, %u KiB\n%s",
+            planner.liveCount(), planner.liveBytes() >> 10, buff);
+
+    size_t movedBytes, largestFree;
+    int count = planner.plan(0, 0, &movedBytes, &largestFree);
+    CompactionPlanner::move_t* moves = new CompactionPlanner::move_t[count+1];
+    planner.plan(moves, count, &movedBytes, &largestFree);
+    for (int i=0 ; i<count ; i++) {
+        printf("  move %#010x: %#010x -> %#010x (%u KiB)\n",
+                moves[i].id, moves[i].from, moves[i].to, moves[i].size >> 10);
+    }
+    printf("%d moves, %u KiB copied, largest free afterwards: %u KiB\n",
+            count, movedBytes >> 10, largestFree >> 10);
+    if (planner.failedSize()) {
+        printf("the failed allocation %s after compaction\n",
+                planner.failedSize() <= largestFree ? "fits" : "still doesn't fit");
+    }
+    delete [] moves;
+    return 0;
+}
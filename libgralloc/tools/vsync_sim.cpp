@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulates a renderer posting frames through the framebuffer post queue to
+ * a panel, once with disp_loop() flipping to every frame as soon as it can
+ * and once paced by VsyncPacer, and compares latency against smoothness:
+ *
+ *     vsync_sim [-r <render time>] [-i <content interval ms>] [-b <buffers>]
+ *               [-f <frames>] [-p <refresh Hz>] [-s <seed>]
+ *
+ * Render times in ms are drawn from one of
+ *
+ *     const:<ms>
+ *     uniform:<min>:<max>
+ *     normal:<mean>:<sd>
+ *     spiky:<mean>:<sd>:<percent>:<extra>    normal, some frames take longer
+ *
+ * A content interval of 0 renders as fast as buffers come back, otherwise
+ * frames are made at that rate, like a video would.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/log.h>
+
+#include "gralloc_priv.h"
+#include "pacer.h"
+
+/*****************************************************************************/
+
+static const int64_t kMs = 1000000;
+
+struct distribution_t {
+    enum { CONST, UNIFORM, NORMAL, SPIKY } kind;
+    double a, b, c, d;
+};
+
+static bool parseDistribution(const char* spec, distribution_t* dist)
+{
+    memset(dist, 0, sizeof(*dist));
+    if (sscanf(spec, "const:%lf", &dist->a) == 1) {
+        dist->kind = distribution_t::CONST;
+    } else if (sscanf(spec, "uniform:%lf:%lf", &dist->a, &dist->b) == 2) {
+        dist->kind = distribution_t::UNIFORM;
+    } else if (sscanf(spec, "normal:%lf:%lf", &dist->a, &dist->b) == 2) {
+        dist->kind = distribution_t::NORMAL;
+    } else if (sscanf(spec, "spiky:%lf:%lf:%lf:%lf",
+            &dist->a, &dist->b, &dist->c, &dist->d) == 4) {
+        dist->kind = distribution_t::SPIKY;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static double uniform(unsigned int* seed)
+{
+    return (rand_r(seed) + 0.5) / (RAND_MAX + 1.0);
+}
+
+static double normal(unsigned int* seed, double mean, double sd)
+{
+    double u = uniform(seed), v = uniform(seed);
+    return mean + sd * sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static int64_t renderTime(distribution_t const& dist, unsigned int* seed)
+{
+    double ms = 0;
+    switch (dist.kind) {
+        case distribution_t::CONST:
+            ms = dist.a;
+            break;
+        case distribution_t::UNIFORM:
+            ms = dist.a + (dist.b - dist.a) * uniform(seed);
+            break;
+        case distribution_t::NORMAL:
+            ms = normal(seed, dist.a, dist.b);
+            break;
+        case distribution_t::SPIKY:
+            ms = normal(seed, dist.a, dist.b);
+            if (uniform(seed) * 100.0 < dist.c)
+                ms += dist.d;
+            break;
+    }
+    if (ms < 0.1) ms = 0.1;
+    return int64_t(ms * kMs);
+}
+
+static int compareTimes(const void* lhs, const void* rhs)
+{
+    int64_t l = *(int64_t const*)lhs;
+    int64_t r = *(int64_t const*)rhs;
+    return l < r ? -1 : (l > r ? 1 : 0);
+}
+
+/*****************************************************************************/
+
+struct params_t {
+    distribution_t  dist;
+    int64_t         interval;
+    int             buffers;
+    int             frames;
+    int64_t         period;
+    unsigned int    seed;
+};
+
+/*
+ * One producer and disp_loop() as two state machines, advanced event by
+ * event. A buffer goes back to the producer when the frame after it is on
+ * screen, or when it's dropped.
+ */
+static void simulate(params_t const& p, bool pacing)
+{
+    enum { IDLE, RENDERING };
+    enum { WAITING, HOLDING, FLIPPING };
+
+    unsigned int seed = p.seed;
+    VsyncPacer pacer(p.period);
+    int64_t* post = new int64_t[p.frames];
+    int64_t* latency = new int64_t[p.frames];
+    int* queue = new int[p.frames];
+    int busy[NUM_BUFFERS * 4];
+    for (int i=0 ; i<p.buffers ; i++) busy[i] = -1;
+
+    int head = 0, tail = 0;         // of the queue
+    int next = 0;                   // next frame to render
+    int producer = IDLE;
+    int64_t renderedAt = 0;
+    int display = WAITING;
+    int64_t displayAt = 0;
+    int onScreen = -1;
+    int done = 0, shown = 0;
+    int64_t now = 0;
+
+    while (done < p.frames) {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            if (producer == IDLE && next < p.frames &&
+                    busy[next % p.buffers] < 0 && now >= next * p.interval) {
+                busy[next % p.buffers] = next;
+                renderedAt = now + renderTime(p.dist, &seed);
+                producer = RENDERING;
+                changed = true;
+            }
+            if (producer == RENDERING && now >= renderedAt) {
+                post[next] = now;
+                pacer.posted(now);
+                queue[tail++] = next++;
+                producer = IDLE;
+                changed = true;
+            }
+            if (display == HOLDING && now >= displayAt) {
+                display = WAITING;
+                changed = true;
+            }
+            if (display == WAITING && head < tail) {
+                int frame = queue[head];
+                int64_t holdUntil = 0;
+                int decision = VsyncPacer::SHOW;
+                if (pacing) {
+                    decision = pacer.decide(post[frame], now,
+                            tail - head > 1, &holdUntil);
+                }
+                if (decision == VsyncPacer::DROP) {
+                    busy[frame % p.buffers] = -1;
+                    head++;
+                    done++;
+                } else if (decision == VsyncPacer::HOLD) {
+                    display = HOLDING;
+                    displayAt = holdUntil;
+                } else {
+                    // FB_ACTIVATE_VBL completes on the next vblank
+                    display = FLIPPING;
+                    displayAt = (now / p.period + 1) * p.period;
+                }
+                changed = true;
+            }
+            if (display == FLIPPING && now >= displayAt) {
+                int frame = queue[head++];
+                if (onScreen >= 0)
+                    busy[onScreen % p.buffers] = -1;
+                onScreen = frame;
+                pacer.flipped(now);
+                latency[shown++] = now - post[frame];
+                done++;
+                display = WAITING;
+                changed = true;
+            }
+        }
+
+        // on to the next event
+        int64_t t = INT64_MAX;
+        if (producer == RENDERING && renderedAt < t)
+            t = renderedAt;
+        if (producer == IDLE && next < p.frames && busy[next % p.buffers] < 0
+                && next * p.interval < t)
+            t = next * p.interval;
+        if (display != WAITING && displayAt < t)
+            t = displayAt;
+        if (t == INT64_MAX)
+            break;
+        now = t > now ? t : now;
+    }
+
+    qsort(latency, shown, sizeof(int64_t), compareTimes);
+    printf("pacing %-3s: %d shown, %u dropped, %u held, %u janks, "
+            "%.1f fps, latency ms p50=%.1f p90=%.1f p99=%.1f\n",
+            pacing ? "on" : "off", shown, pacer.dropped(), pacer.held(),
+            pacer.janks(), now ? shown * 1e9 / double(now) : 0.0,
+            shown ? latency[shown / 2] / 1e6 : 0.0,
+            shown ? latency[(shown * 9) / 10] / 1e6 : 0.0,
+            shown ? latency[(shown * 99) / 100] / 1e6 : 0.0);
+
+    delete [] queue;
+    delete [] latency;
+    delete [] post;
+}
+
+/*****************************************************************************/
+
+static void usage(const char* name)
+{
+    fprintf(stderr, "usage: %s [-r <render time>] [-i <content interval ms>] "
+            "[-b <buffers>] [-f <frames>] [-p <refresh Hz>] [-s <seed>]\n",
+            name);
+}
+
+int main(int argc, char** argv)
+{
+    params_t p;
+    parseDistribution("normal:12:3", &p.dist);
+    p.interval = 0;
+    p.buffers = 2;
+    p.frames = 600;
+    p.period = 1000000000LL / 60;
+    p.seed = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:i:b:f:p:s:")) != -1) {
+        switch (opt) {
+            case 'r':
+                if (!parseDistribution(optarg, &p.dist)) {
+                    fprintf(stderr, "bad render time %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'i': p.interval = int64_t(atof(optarg) * kMs); break;
+            case 'b': p.buffers = atoi(optarg); break;
+            case 'f': p.frames = atoi(optarg); break;
+            case 'p': p.period = int64_t(1e9 / atof(optarg)); break;
+            case 's': p.seed = strtoul(optarg, 0, 0); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc || p.buffers < 2 || p.buffers > NUM_BUFFERS * 4 ||
+            p.frames < 1 || p.period <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    simulate(p, false);
+    simulate(p, true);
+    return 0;
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <cutils/log.h>
+
+#include "trace.h"
+
+
+static bool parseNumber(const char** p, uint64_t* value) {
+    char* end;
+    *value = strtoull(*p, &end, 0);
+    if (end == *p) {
+        return false;
+    }
+    *p = end;
+    return true;
+}
+
+int parseTraceLine(const char* line, trace_record_t* rec)
+{
+    const char* p = line;
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p == '#' || *p == '\n' || *p == '\0')
+        return 0;
+
+    memset(rec, 0, sizeof(*rec));
+    rec->op = *p++;
+    if (rec->op != 'a' && rec->op != 'f')
+        return -EINVAL;
+
+    uint64_t value;
+    if (!parseNumber(&p, &value))
+        return -EINVAL;
+    rec->id = value;
+
+    if (rec->op == 'a') {
+        if (!parseNumber(&p, &value))
+            return -EINVAL;
+        rec->size = value;
+        // the rest is optional, but comes all together
+        if (parseNumber(&p, &value)) {
+            rec->usage = value;
+            if (!parseNumber(&p, &value))
+                return -EINVAL;
+            rec->flags = value;
+            if (!parseNumber(&p, &value))
+                return -EINVAL;
+            rec->time = value;
+        }
+    } else if (parseNumber(&p, &value)) {
+        rec->time = value;
+    }
+    return 1;
+}
+
+// ----------------------------------------------------------------------------
+
+TraceRecorder::TraceRecorder(const char* path)
+    : mFile(0), mCount(0)
+{
+    if (path && path[0]) {
+        mFile = fopen(path, "a");
+        LOGE_IF(!mFile, "can't open allocation trace %s (%s)",
+                path, strerror(errno));
+    }
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    if (mFile) {
+        flushLocked();
+        fclose(mFile);
+    }
+}
+
+int64_t TraceRecorder::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+void TraceRecorder::recordAlloc(uint32_t id, size_t size, int usage, int flags)
+{
+    if (!mFile) return;
+    Locker::Autolock _l(mLock);
+    trace_record_t& rec = mBatch[mCount++];
+    rec.op = 'a';
+    rec.id = id;
+    rec.size = size;
+    rec.usage = usage;
+    rec.flags = flags;
+    rec.time = now();
+    if (mCount == kBatchSize) {
+        flushLocked();
+    }
+}
+
+void TraceRecorder::recordFree(uint32_t id)
+{
+    if (!mFile) return;
+    Locker::Autolock _l(mLock);
+    trace_record_t& rec = mBatch[mCount++];
+    rec.op = 'f';
+    rec.id = id;
+    rec.time = now();
+    if (mCount == kBatchSize) {
+        flushLocked();
+    }
+}
+
+void TraceRecorder::flush()
+{
+    if (!mFile) return;
+    Locker::Autolock _l(mLock);
+    flushLocked();
+}
+
+void TraceRecorder::flushLocked()
+{
+    for (int i=0 ; i<mCount ; i++) {
+        trace_record_t const& rec = mBatch[i];
+        if (rec.op == 'a') {
+            fprintf(mFile, "a %#x %u %#x %#x %lld\n", rec.id, rec.size,
+                    rec.usage, rec.flags, (long long)rec.time);
+        } else {
+            fprintf(mFile, "f %#x %lld\n", rec.id, (long long)rec.time);
+        }
+    }
+    mCount = 0;
+    fflush(mFile);
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GRALLOC_QSD8K_TRACE_H
+#define GRALLOC_QSD8K_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "gr.h"
+
+
+/*
+ * Allocation traces are text, one operation per line, '#' starts a comment:
+ *
+ *     a <id> <size> [<usage> <flags> <time>]    allocation
+ *     f <id> [<time>]                           free
+ *
+ * id names the buffer (gralloc records the handle address), size is in
+ * bytes, usage the gralloc usage bits, flags the private_handle_t flags the
+ * buffer ended up with and time a CLOCK_MONOTONIC timestamp in ns. Numbers
+ * may be decimal or 0x-prefixed hex.
+ */
+
+struct trace_record_t {
+    char        op;         // 'a' or 'f'
+    uint32_t    id;
+    uint32_t    size;
+    uint32_t    usage;
+    uint32_t    flags;
+    int64_t     time;
+};
+
+// Returns 1 if line holds a record, 0 for blank and comment lines, and
+// -EINVAL if it's malformed.
+int parseTraceLine(const char* line, trace_record_t* rec);
+
+/*
+ * Appends the allocations and frees made through a gpu_context_t to a trace
+ * file. Records are batched in memory and written out when the batch is
+ * full, on flush() and when the recorder goes away.
+ */
+class TraceRecorder {
+
+ public:
+
+    // A NULL or empty path disables recording.
+    TraceRecorder(const char* path);
+    ~TraceRecorder();
+
+    bool enabled() const { return mFile != 0; }
+
+    void recordAlloc(uint32_t id, size_t size, int usage, int flags);
+    void recordFree(uint32_t id);
+    void flush();
+
+ private:
+
+    enum { kBatchSize = 128 };
+
+    static int64_t now();
+    void flushLocked();
+
+    Locker          mLock;
+    FILE*           mFile;
+    trace_record_t  mBatch[kBatchSize];
+    int             mCount;
+};
+
+#endif  // GRALLOC_QSD8K_TRACE_H